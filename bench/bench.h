@@ -0,0 +1,21 @@
+#ifndef BENCH_H
+#define BENCH_H
+#include <time.h>
+
+// Benchmarks run without a window, so they keep time themselves rather than
+// through glfwGetTime()
+
+static inline double bench_now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// Keeps a result alive so the work that made it isn't optimized away
+static inline void bench_use(const void* result)
+{
+    __asm__ volatile("" : : "g"(result) : "memory");
+}
+
+#endif
@@ -0,0 +1,245 @@
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "bvh.h"
+#include "cglm/cglm.h"
+
+// Times building, refitting and querying the BVH over random boxes, and
+// checks every query finds what testing each box in turn does:
+//
+//     bench_bvh [items...]
+//
+// Boxes are scattered through a cube that grows with the count, so scenes
+// of every size are about as crowded.
+
+#define BENCH_REFITS 10
+#define BENCH_FRUSTUMS 10
+#define BENCH_SPHERES 1000
+#define BENCH_RAYS 100
+#define BENCH_SPACING 10.0f // Cube side per cube root of the item count
+
+static float bench_random(float min, float max)
+{
+    return min + (max - min) * (rand() / (float)RAND_MAX);
+}
+
+// The same tests the tree does at its leaves, one box at a time
+static bool bench_boxInFrustum(vec4 planes[6], vec3 min, vec3 max)
+{
+    for (int p = 0; p < 6; p++)
+    {
+        vec3 ahead;
+        for (int k = 0; k < 3; k++)
+        {
+            ahead[k] = planes[p][k] >= 0.0f ? max[k] : min[k];
+        }
+        if (glm_vec3_dot(planes[p], ahead) + planes[p][3] < 0.0f)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool bench_boxTouchesSphere(vec3 min, vec3 max, vec3 center, float radius)
+{
+    vec3 closest;
+    glm_vec3_maxv(min, center, closest);
+    glm_vec3_minv(max, closest, closest);
+    return glm_vec3_distance2(closest, center) <= radius * radius;
+}
+
+static float bench_rayBox(vec3 origin, vec3 direction, vec3 min, vec3 max, float maxDistance)
+{
+    float enter = 0.0f;
+    float exit = maxDistance;
+    for (int k = 0; k < 3; k++)
+    {
+        float t0 = (min[k] - origin[k]) / direction[k];
+        float t1 = (max[k] - origin[k]) / direction[k];
+        enter = fmaxf(enter, fminf(t0, t1));
+        exit = fminf(exit, fmaxf(t0, t1));
+    }
+    return enter <= exit ? enter : FLT_MAX;
+}
+
+static void bench_randomBoxes(vec3* mins, vec3* maxs, size_t count, float side)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            mins[i][k] = bench_random(0.0f, side);
+            maxs[i][k] = mins[i][k] + bench_random(0.5f, 2.0f);
+        }
+    }
+}
+
+static bool bench_run(size_t count)
+{
+    float side = BENCH_SPACING * cbrtf((float)count);
+    vec3* mins = malloc(sizeof(vec3) * count);
+    vec3* maxs = malloc(sizeof(vec3) * count);
+    unsigned int* found = malloc(sizeof(unsigned int) * count);
+    bench_randomBoxes(mins, maxs, count, side);
+    bool same = true;
+
+    Bvh* bvh = newBvh();
+    double start = bench_now();
+    bvh_build(bvh, mins, maxs, count);
+    double buildSeconds = bench_now() - start;
+
+    // Everything drifts a little each time, the way moving objects would
+    double refitSeconds = 0.0;
+    for (int n = 0; n < BENCH_REFITS; n++)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            vec3 offset = { bench_random(-0.5f, 0.5f), bench_random(-0.5f, 0.5f), bench_random(-0.5f, 0.5f) };
+            glm_vec3_add(mins[i], offset, mins[i]);
+            glm_vec3_add(maxs[i], offset, maxs[i]);
+        }
+        start = bench_now();
+        bvh_refit(bvh, mins, maxs);
+        refitSeconds += bench_now() - start;
+    }
+
+    // Looking into the cube from the middle of one face
+    mat4 view, projection, viewProjection;
+    vec4 planes[6];
+    glm_lookat((vec3){ side / 2.0f, side / 2.0f, side }, (vec3){ side / 2.0f, side / 2.0f, 0.0f }, GLM_YUP, view);
+    glm_perspective(glm_rad(60.0f), 16.0f / 9.0f, 0.1f, side, projection);
+    glm_mat4_mul(projection, view, viewProjection);
+    glm_frustum_planes(viewProjection, planes);
+
+    size_t treeFound = 0, bruteFound = 0;
+    start = bench_now();
+    for (int n = 0; n < BENCH_FRUSTUMS; n++)
+    {
+        treeFound = bvh_queryFrustum(bvh, planes, found);
+    }
+    double frustumSeconds = bench_now() - start;
+    start = bench_now();
+    for (int n = 0; n < BENCH_FRUSTUMS; n++)
+    {
+        bruteFound = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            bruteFound += bench_boxInFrustum(planes, mins[i], maxs[i]);
+        }
+        bench_use(&bruteFound);
+    }
+    double frustumBruteSeconds = bench_now() - start;
+    same = same && treeFound == bruteFound;
+    size_t frustumFound = treeFound;
+
+    vec4* spheres = malloc(sizeof(vec4) * BENCH_SPHERES);
+    for (int n = 0; n < BENCH_SPHERES; n++)
+    {
+        glm_vec4_copy((vec4){ bench_random(0.0f, side), bench_random(0.0f, side), bench_random(0.0f, side), side * 0.05f }, spheres[n]);
+    }
+    treeFound = bruteFound = 0;
+    start = bench_now();
+    for (int n = 0; n < BENCH_SPHERES; n++)
+    {
+        treeFound += bvh_querySphere(bvh, spheres[n], spheres[n][3], found);
+    }
+    double sphereSeconds = bench_now() - start;
+    start = bench_now();
+    for (int n = 0; n < BENCH_SPHERES; n++)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            bruteFound += bench_boxTouchesSphere(mins[i], maxs[i], spheres[n], spheres[n][3]);
+        }
+    }
+    double sphereBruteSeconds = bench_now() - start;
+    same = same && treeFound == bruteFound;
+    free(spheres);
+
+    // Ties can hit different items, so only the distances are compared
+    int rayMismatches = 0;
+    double raySeconds = 0.0, rayBruteSeconds = 0.0;
+    for (int n = 0; n < BENCH_RAYS; n++)
+    {
+        vec3 origin = { bench_random(0.0f, side), bench_random(0.0f, side), bench_random(0.0f, side) };
+        vec3 direction = { bench_random(-1.0f, 1.0f), bench_random(-1.0f, 1.0f), bench_random(-1.0f, 1.0f) };
+        glm_vec3_normalize(direction);
+
+        float treeDistance = FLT_MAX;
+        start = bench_now();
+        int hit = bvh_raycast(bvh, origin, direction, side, NULL, NULL, &treeDistance);
+        raySeconds += bench_now() - start;
+
+        float bruteDistance = side;
+        int bruteHit = -1;
+        start = bench_now();
+        for (size_t i = 0; i < count; i++)
+        {
+            float t = bench_rayBox(origin, direction, mins[i], maxs[i], bruteDistance);
+            if (t < bruteDistance)
+            {
+                bruteDistance = t;
+                bruteHit = i;
+            }
+        }
+        rayBruteSeconds += bench_now() - start;
+
+        if ((hit < 0) != (bruteHit < 0) || (hit >= 0 && fabsf(treeDistance - bruteDistance) > 1e-3f))
+        {
+            rayMismatches++;
+        }
+    }
+    same = same && rayMismatches == 0;
+
+    printf("%zu items in a cube %.0f across, %zu nodes\n", count, side, bvh->numNodes);
+    printf("  build    %10.3f ms\n", buildSeconds * 1000.0);
+    printf("  refit    %10.3f ms\n", refitSeconds * 1000.0 / BENCH_REFITS);
+    printf("  frustum  %10.3f ms, brute force %10.3f ms, %zu found\n", frustumSeconds * 1000.0 / BENCH_FRUSTUMS,
+        frustumBruteSeconds * 1000.0 / BENCH_FRUSTUMS, frustumFound);
+    printf("  sphere   %10.4f ms, brute force %10.4f ms, %.1f found on average\n", sphereSeconds * 1000.0 / BENCH_SPHERES,
+        sphereBruteSeconds * 1000.0 / BENCH_SPHERES, (double)treeFound / BENCH_SPHERES);
+    printf("  ray      %10.4f ms, brute force %10.4f ms\n", raySeconds * 1000.0 / BENCH_RAYS,
+        rayBruteSeconds * 1000.0 / BENCH_RAYS);
+    if (!same)
+    {
+        printf("  MISMATCH: queries found different items than brute force (%d rays)\n", rayMismatches);
+    }
+
+    bvh_free(bvh);
+    free(mins);
+    free(maxs);
+    free(found);
+    return same;
+}
+
+int main(int argc, char** argv)
+{
+    static const size_t defaultCounts[] = { 10000, 100000, 1000000 };
+    srand(182);
+    bool same = true;
+    if (argc > 1)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            size_t count = strtoul(argv[i], NULL, 10);
+            if (count == 0)
+            {
+                printf("Usage: %s [items...]\n", argv[0]);
+                return 1;
+            }
+            same = bench_run(count) && same;
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < sizeof(defaultCounts) / sizeof(defaultCounts[0]); i++)
+        {
+            same = bench_run(defaultCounts[i]) && same;
+        }
+    }
+    return same ? 0 : 1;
+}
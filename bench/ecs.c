@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "cglm/cglm.h"
+#include "ecs.h"
+#include "resources.h"
+
+// Spawns a field of renderable entities, a tenth of them moving, and times
+// each system a frame runs over them:
+//
+//     bench_ecs [entities] [frames]
+//
+// Every entity shares one made up model, a single mesh a unit across, so
+// nothing here touches the disk or GL.
+
+#define BENCH_ENTITIES 100000
+#define BENCH_FRAMES 100
+#define BENCH_SPACING 4.0f
+#define BENCH_DYNAMIC_EVERY 10
+
+typedef enum {
+    SYSTEM_TRANSFORMS,
+    SYSTEM_BOUNDS,
+    SYSTEM_CULL,
+    SYSTEM_DRAWS,
+    NUM_SYSTEMS,
+} BenchSystem;
+
+static const char* systemNames[NUM_SYSTEMS] = {
+    "ecs_updateTransforms",
+    "ecs_updateBounds",
+    "ecs_cull",
+    "ecs_collectDraws",
+};
+
+int main(int argc, char** argv)
+{
+    size_t numEntities = argc > 1 ? strtoul(argv[1], NULL, 10) : BENCH_ENTITIES;
+    int numFrames = argc > 2 ? atoi(argv[2]) : BENCH_FRAMES;
+    if (numEntities == 0 || numFrames <= 0)
+    {
+        printf("Usage: %s [entities] [frames]\n", argv[0]);
+        return 1;
+    }
+
+    resources_init();
+
+    ModelNode node = { .name = "mesh", .parent = -1 };
+    glm_mat4_identity(node.transform);
+    Mesh mesh = { .boundsRadius = 0.5f, .node = 0 };
+    Model model = { .meshes = &mesh, .numMeshes = 1, .nodes = &node, .numNodes = 1 };
+    ModelHandle handle = resources_addModel(&model);
+
+    Scene* scene = newScene();
+    EcsWorld* world = newEcsWorld(scene);
+
+    // Laid out on a square in front of the camera, which sees about half
+    size_t side = (size_t)ceil(sqrt((double)numEntities));
+    int* nodes = malloc(sizeof(int) * numEntities);
+    double start = bench_now();
+    for (size_t i = 0; i < numEntities; i++)
+    {
+        Entity entity = ecs_createEntity(world);
+        nodes[i] = scene_addNode(scene, SCENE_NO_PARENT, "entity");
+        vec3 position = { (i % side - side / 2.0f) * BENCH_SPACING, 0.0f, -(float)(i / side) * BENCH_SPACING };
+        scene_setPosition(scene, nodes[i], position);
+        ecs_addTransform(world, entity, nodes[i]);
+        ecs_addRenderable(world, entity, scene_addModel(scene, nodes[i], handle), false);
+        ecs_addBounds(world, entity, i % BENCH_DYNAMIC_EVERY == 0);
+    }
+    printf("Spawned %zu entities in %.1f ms\n", numEntities, (bench_now() - start) * 1000.0);
+
+    mat4 view, projection, viewProjection;
+    glm_lookat((vec3){ 0.0f, 20.0f, 10.0f }, (vec3){ 0.0f, 0.0f, -100.0f }, GLM_YUP, view);
+    glm_perspective(glm_rad(60.0f), 16.0f / 9.0f, 0.1f, 1000.0f, projection);
+    glm_mat4_mul(projection, view, viewProjection);
+
+    FramePacket packet = { 0 };
+    double seconds[NUM_SYSTEMS] = { 0 };
+    size_t numDraws = 0;
+    for (int frame = 0; frame <= numFrames; frame++)
+    {
+        for (size_t i = 0; i < numEntities; i += BENCH_DYNAMIC_EVERY)
+        {
+            vec3 position;
+            glm_vec3_copy(scene->positions[nodes[i]], position);
+            position[1] = sinf(frame * 0.1f + i);
+            scene_setPosition(scene, nodes[i], position);
+        }
+        frame_reset(&packet);
+
+        double times[NUM_SYSTEMS + 1];
+        times[0] = bench_now();
+        ecs_updateTransforms(world);
+        times[1] = bench_now();
+        ecs_updateBounds(world);
+        times[2] = bench_now();
+        ecs_cull(world, viewProjection);
+        times[3] = bench_now();
+        ecs_collectDraws(world, &packet.opaque, false);
+        times[4] = bench_now();
+
+        // The first frame builds everything from scratch, so it's left out
+        if (frame == 0)
+        {
+            printf("First frame took %.3f ms\n", (times[NUM_SYSTEMS] - times[0]) * 1000.0);
+            continue;
+        }
+        for (int s = 0; s < NUM_SYSTEMS; s++)
+        {
+            seconds[s] += times[s + 1] - times[s];
+        }
+        numDraws += packet.opaque.count;
+    }
+
+    double total = 0.0;
+    for (int s = 0; s < NUM_SYSTEMS; s++)
+    {
+        printf("%-22s %8.3f ms a frame\n", systemNames[s], seconds[s] * 1000.0 / numFrames);
+        total += seconds[s];
+    }
+    printf("%-22s %8.3f ms a frame, %zu of %zu drawn\n", "total", total * 1000.0 / numFrames,
+        numDraws / numFrames, numEntities);
+
+    free(nodes);
+    return 0;
+}
@@ -0,0 +1,252 @@
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "cglm/cglm.h"
+#include "grid.h"
+
+// Moves every box each frame and times keeping the grid up to date and
+// querying it, against testing every box in turn, which has nothing to
+// keep up to date. Checks both find the same things:
+//
+//     bench_grid [items...]
+//
+// Boxes bounce around a cube that grows with the count, so scenes of every
+// size are about as crowded.
+
+#define BENCH_FRAMES 20
+#define BENCH_SPHERES 100
+#define BENCH_RAYS 100
+#define BENCH_SPACING 10.0f // Cube side per cube root of the item count
+#define BENCH_SPEED 1.0f // Furthest a box moves in a frame, along each axis
+#define BENCH_CELL_SIZE 16.0f // Same as ECS_GRID_CELL_SIZE
+
+typedef struct {
+    double update;
+    double frustum;
+    double sphere;
+    double ray;
+} BenchTimes;
+
+static float bench_random(float min, float max)
+{
+    return min + (max - min) * (rand() / (float)RAND_MAX);
+}
+
+// The same tests the grid does for each item
+static bool bench_boxInFrustum(vec4 planes[6], vec3 min, vec3 max)
+{
+    for (int p = 0; p < 6; p++)
+    {
+        vec3 ahead;
+        for (int k = 0; k < 3; k++)
+        {
+            ahead[k] = planes[p][k] >= 0.0f ? max[k] : min[k];
+        }
+        if (glm_vec3_dot(planes[p], ahead) + planes[p][3] < 0.0f)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool bench_boxTouchesSphere(vec3 min, vec3 max, vec3 center, float radius)
+{
+    vec3 closest;
+    glm_vec3_maxv(min, center, closest);
+    glm_vec3_minv(max, closest, closest);
+    return glm_vec3_distance2(closest, center) <= radius * radius;
+}
+
+static float bench_rayBox(vec3 origin, vec3 direction, vec3 min, vec3 max, float maxDistance)
+{
+    float enter = 0.0f;
+    float exit = maxDistance;
+    for (int k = 0; k < 3; k++)
+    {
+        float t0 = (min[k] - origin[k]) / direction[k];
+        float t1 = (max[k] - origin[k]) / direction[k];
+        enter = fmaxf(enter, fminf(t0, t1));
+        exit = fminf(exit, fmaxf(t0, t1));
+    }
+    return enter <= exit ? enter : FLT_MAX;
+}
+
+static void bench_print(const char* name, BenchTimes* times)
+{
+    printf("  %-11s update %8.3f ms, frustum %8.3f ms, sphere %8.4f ms, ray %8.4f ms\n", name,
+        times->update * 1000.0 / BENCH_FRAMES, times->frustum * 1000.0 / BENCH_FRAMES,
+        times->sphere * 1000.0 / (BENCH_FRAMES * BENCH_SPHERES), times->ray * 1000.0 / (BENCH_FRAMES * BENCH_RAYS));
+}
+
+static bool bench_run(size_t count)
+{
+    float side = BENCH_SPACING * cbrtf((float)count);
+    vec3* mins = malloc(sizeof(vec3) * count);
+    vec3* maxs = malloc(sizeof(vec3) * count);
+    vec3* velocities = malloc(sizeof(vec3) * count);
+    unsigned int* found = malloc(sizeof(unsigned int) * count);
+    for (size_t i = 0; i < count; i++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            mins[i][k] = bench_random(0.0f, side);
+            maxs[i][k] = mins[i][k] + bench_random(0.5f, 2.0f);
+            velocities[i][k] = bench_random(-BENCH_SPEED, BENCH_SPEED);
+        }
+    }
+
+    Grid* grid = newGrid(BENCH_CELL_SIZE);
+    double start = bench_now();
+    for (size_t i = 0; i < count; i++)
+    {
+        grid_update(grid, i, mins[i], maxs[i]);
+    }
+    double insertSeconds = bench_now() - start;
+
+    mat4 view, projection, viewProjection;
+    vec4 planes[6];
+    glm_lookat((vec3){ side / 2.0f, side / 2.0f, side }, (vec3){ side / 2.0f, side / 2.0f, 0.0f }, GLM_YUP, view);
+    glm_perspective(glm_rad(60.0f), 16.0f / 9.0f, 0.1f, side, projection);
+    glm_mat4_mul(projection, view, viewProjection);
+    glm_frustum_planes(viewProjection, planes);
+
+    BenchTimes gridTimes = { 0 }, bruteTimes = { 0 };
+    size_t frustumFound = 0, sphereFound = 0;
+    int mismatches = 0;
+    for (int frame = 0; frame < BENCH_FRAMES; frame++)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                if (mins[i][k] + velocities[i][k] < 0.0f || maxs[i][k] + velocities[i][k] > side)
+                {
+                    velocities[i][k] = -velocities[i][k];
+                }
+                mins[i][k] += velocities[i][k];
+                maxs[i][k] += velocities[i][k];
+            }
+        }
+
+        start = bench_now();
+        for (size_t i = 0; i < count; i++)
+        {
+            grid_update(grid, i, mins[i], maxs[i]);
+        }
+        gridTimes.update += bench_now() - start;
+
+        start = bench_now();
+        size_t gridFound = grid_queryFrustum(grid, planes, found);
+        gridTimes.frustum += bench_now() - start;
+
+        start = bench_now();
+        size_t bruteFound = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            bruteFound += bench_boxInFrustum(planes, mins[i], maxs[i]);
+        }
+        bruteTimes.frustum += bench_now() - start;
+        mismatches += gridFound != bruteFound;
+        frustumFound += gridFound;
+
+        for (int n = 0; n < BENCH_SPHERES; n++)
+        {
+            vec3 center = { bench_random(0.0f, side), bench_random(0.0f, side), bench_random(0.0f, side) };
+            float radius = side * 0.05f;
+
+            start = bench_now();
+            gridFound = grid_querySphere(grid, center, radius, found);
+            gridTimes.sphere += bench_now() - start;
+
+            start = bench_now();
+            bruteFound = 0;
+            for (size_t i = 0; i < count; i++)
+            {
+                bruteFound += bench_boxTouchesSphere(mins[i], maxs[i], center, radius);
+            }
+            bruteTimes.sphere += bench_now() - start;
+            mismatches += gridFound != bruteFound;
+            sphereFound += gridFound;
+        }
+
+        // Ties can hit different items, so only the distances are compared
+        for (int n = 0; n < BENCH_RAYS; n++)
+        {
+            vec3 origin = { bench_random(0.0f, side), bench_random(0.0f, side), bench_random(0.0f, side) };
+            vec3 direction = { bench_random(-1.0f, 1.0f), bench_random(-1.0f, 1.0f), bench_random(-1.0f, 1.0f) };
+            glm_vec3_normalize(direction);
+
+            float gridDistance = FLT_MAX;
+            start = bench_now();
+            int hit = grid_raycast(grid, origin, direction, side, NULL, NULL, &gridDistance);
+            gridTimes.ray += bench_now() - start;
+
+            float bruteDistance = side;
+            int bruteHit = -1;
+            start = bench_now();
+            for (size_t i = 0; i < count; i++)
+            {
+                float t = bench_rayBox(origin, direction, mins[i], maxs[i], bruteDistance);
+                if (t < bruteDistance)
+                {
+                    bruteDistance = t;
+                    bruteHit = i;
+                }
+            }
+            bruteTimes.ray += bench_now() - start;
+            if ((hit < 0) != (bruteHit < 0) || (hit >= 0 && fabsf(gridDistance - bruteDistance) > 1e-3f))
+            {
+                mismatches++;
+            }
+        }
+    }
+
+    printf("%zu items in a cube %.0f across, %zu cells, inserted in %.3f ms\n", count, side, grid->numCells,
+        insertSeconds * 1000.0);
+    bench_print("grid", &gridTimes);
+    bench_print("brute force", &bruteTimes);
+    printf("  %zu in the frustum and %.1f in each sphere on average\n", frustumFound / BENCH_FRAMES,
+        (double)sphereFound / (BENCH_FRAMES * BENCH_SPHERES));
+    if (mismatches > 0)
+    {
+        printf("  MISMATCH: %d queries found different items than brute force\n", mismatches);
+    }
+
+    grid_free(grid);
+    free(mins);
+    free(maxs);
+    free(velocities);
+    free(found);
+    return mismatches == 0;
+}
+
+int main(int argc, char** argv)
+{
+    static const size_t defaultCounts[] = { 1000, 10000, 100000 };
+    srand(182);
+    bool same = true;
+    if (argc > 1)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            size_t count = strtoul(argv[i], NULL, 10);
+            if (count == 0)
+            {
+                printf("Usage: %s [items...]\n", argv[0]);
+                return 1;
+            }
+            same = bench_run(count) && same;
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < sizeof(defaultCounts) / sizeof(defaultCounts[0]); i++)
+        {
+            same = bench_run(defaultCounts[i]) && same;
+        }
+    }
+    return same ? 0 : 1;
+}
@@ -0,0 +1,294 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bcn.h"
+#include "bench.h"
+#include "bvh.h"
+#include "cglm/cglm.h"
+#include "jobs.h"
+#include "pack.h"
+#include "stb_image.h"
+
+// Times the work the engine hands the job system at 1, 2, 4, ... threads up
+// to the core count, or up to the count given:
+//
+//     bench_jobs [threads]
+//
+// Run it from where the engine runs so it finds the textures. The loads
+// are:
+// - decode: every texture decoded with stb_image, a job per file, the way
+//   the streamer decodes them
+// - encode: one large texture compressed to BC1 with jobs_parallelFor over
+//   block rows, as texture loading does
+// - meshes: a tree over each mesh's triangles built, a job per mesh. That's
+//   the part of loading a model that happens after assimp, which needs the
+//   real importer to time.
+// - culling: bounding spheres tested against a frustum with
+//   jobs_parallelFor
+
+#define BENCH_ROUNDS 3
+#define BENCH_DECODE_COPIES 4 // Each file is decoded this many times a round
+#define BENCH_ENCODE_SIZE 2048
+#define BENCH_MESHES 64
+#define BENCH_MESH_TRIANGLES 20000
+#define BENCH_SPHERES 1000000
+#define BENCH_MAX_THREADS 64
+
+static const char* benchTextures[] = {
+    "textures/awesomeface.png",
+    "textures/container.jpg",
+    "textures/container2.png",
+    "textures/container2_specular.png",
+    "textures/matrix.jpg",
+    "textures/wall.jpg",
+    "models/plane/diffuse.jpg",
+    "models/backpack/ao.jpg",
+};
+#define BENCH_NUM_TEXTURES (sizeof(benchTextures) / sizeof(benchTextures[0]))
+
+typedef struct {
+    const unsigned char* data;
+    size_t size;
+    size_t pixels; // Decoded, to check every thread count gets the same
+} DecodeJob;
+
+typedef struct {
+    const unsigned char* rgba;
+    int size;
+    unsigned char* dest;
+} EncodeJob;
+
+typedef struct {
+    const vec3* mins;
+    const vec3* maxs;
+    Bvh* bvh;
+} MeshJob;
+
+typedef struct {
+    const vec4* spheres;
+    vec4* planes;
+    unsigned char* visible;
+} CullJob;
+
+static float bench_random(float min, float max)
+{
+    return min + (max - min) * (rand() / (float)RAND_MAX);
+}
+
+static void bench_decode(void* data)
+{
+    DecodeJob* job = data;
+    int width, height, channels;
+    unsigned char* pixels = stbi_load_from_memory(job->data, job->size, &width, &height, &channels, 4);
+    job->pixels = pixels ? (size_t)width * height : 0;
+    stbi_image_free(pixels);
+}
+
+static void bench_encodeRows(size_t begin, size_t end, void* ctx)
+{
+    EncodeJob* job = ctx;
+    size_t blocksX = job->size / 4;
+    bcnEncode(BCN_BC1, &job->rgba[begin * 4 * job->size * 4], job->size, (int)((end - begin) * 4),
+        &job->dest[begin * blocksX * bcnBlockSize(BCN_BC1)]);
+}
+
+static void bench_buildMesh(void* data)
+{
+    MeshJob* job = data;
+    bvh_build(job->bvh, job->mins, job->maxs, BENCH_MESH_TRIANGLES);
+}
+
+static void bench_cullRange(size_t begin, size_t end, void* ctx)
+{
+    CullJob* job = ctx;
+    for (size_t i = begin; i < end; i++)
+    {
+        bool visible = true;
+        for (int p = 0; p < 6 && visible; p++)
+        {
+            visible = glm_vec3_dot(job->planes[p], (float*)job->spheres[i]) + job->planes[p][3] >= -job->spheres[i][3];
+        }
+        job->visible[i] = visible;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int maxThreads = argc > 1 ? atoi(argv[1]) : parallelNumThreads();
+    if (maxThreads < 1 || maxThreads > BENCH_MAX_THREADS)
+    {
+        printf("Usage: %s [threads, 1 to %d]\n", argv[0], BENCH_MAX_THREADS);
+        return 1;
+    }
+
+    // Decode: whatever textures can be found, read up front
+    PackFile files[BENCH_NUM_TEXTURES];
+    size_t numFiles = 0;
+    for (size_t i = 0; i < BENCH_NUM_TEXTURES; i++)
+    {
+        if (packOpenFile(benchTextures[i], &files[numFiles]))
+        {
+            numFiles++;
+        }
+    }
+    if (numFiles == 0)
+    {
+        printf("No textures found, run this from the directory with textures/ in it\n");
+        return 1;
+    }
+    DecodeJob decodes[BENCH_NUM_TEXTURES * BENCH_DECODE_COPIES];
+    Job decodeJobs[BENCH_NUM_TEXTURES * BENCH_DECODE_COPIES];
+    size_t numDecodes = numFiles * BENCH_DECODE_COPIES;
+    for (size_t i = 0; i < numDecodes; i++)
+    {
+        decodes[i].data = files[i % numFiles].data;
+        decodes[i].size = files[i % numFiles].size;
+        decodeJobs[i].fn = bench_decode;
+        decodeJobs[i].data = &decodes[i];
+    }
+
+    // Encode: a noisy gradient, so blocks aren't all the same
+    EncodeJob encode = { .size = BENCH_ENCODE_SIZE };
+    unsigned char* rgba = malloc((size_t)BENCH_ENCODE_SIZE * BENCH_ENCODE_SIZE * 4);
+    for (size_t i = 0; i < (size_t)BENCH_ENCODE_SIZE * BENCH_ENCODE_SIZE; i++)
+    {
+        size_t x = i % BENCH_ENCODE_SIZE, y = i / BENCH_ENCODE_SIZE;
+        rgba[i * 4] = x * 255 / BENCH_ENCODE_SIZE;
+        rgba[i * 4 + 1] = y * 255 / BENCH_ENCODE_SIZE;
+        rgba[i * 4 + 2] = rand() & 0xff;
+        rgba[i * 4 + 3] = 255;
+    }
+    encode.rgba = rgba;
+    encode.dest = malloc(bcnImageSize(BCN_BC1, BENCH_ENCODE_SIZE, BENCH_ENCODE_SIZE));
+
+    // Meshes: triangles scattered through a unit cube, boxed
+    MeshJob meshes[BENCH_MESHES];
+    Job meshJobs[BENCH_MESHES];
+    for (int m = 0; m < BENCH_MESHES; m++)
+    {
+        vec3* mins = malloc(sizeof(vec3) * BENCH_MESH_TRIANGLES);
+        vec3* maxs = malloc(sizeof(vec3) * BENCH_MESH_TRIANGLES);
+        for (int t = 0; t < BENCH_MESH_TRIANGLES; t++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                mins[t][k] = bench_random(0.0f, 1.0f);
+                maxs[t][k] = mins[t][k] + bench_random(0.0f, 0.02f);
+            }
+        }
+        meshes[m].mins = mins;
+        meshes[m].maxs = maxs;
+        meshes[m].bvh = newBvh();
+        meshJobs[m].fn = bench_buildMesh;
+        meshJobs[m].data = &meshes[m];
+    }
+
+    // Culling: spheres all around a camera at the origin
+    vec4* spheres = malloc(sizeof(vec4) * BENCH_SPHERES);
+    for (size_t i = 0; i < BENCH_SPHERES; i++)
+    {
+        glm_vec4_copy((vec4){ bench_random(-500.0f, 500.0f), bench_random(-500.0f, 500.0f), bench_random(-500.0f, 500.0f), 1.0f }, spheres[i]);
+    }
+    mat4 projection;
+    vec4 planes[6];
+    glm_perspective(glm_rad(60.0f), 16.0f / 9.0f, 0.1f, 1000.0f, projection);
+    glm_frustum_planes(projection, planes);
+    CullJob cull = { spheres, planes, malloc(BENCH_SPHERES) };
+
+    printf("%zu decodes of %zu files, %dx%d BC1 encode, %d meshes of %d triangles, %d spheres, best of %d\n",
+        numDecodes, numFiles, BENCH_ENCODE_SIZE, BENCH_ENCODE_SIZE, BENCH_MESHES, BENCH_MESH_TRIANGLES,
+        BENCH_SPHERES, BENCH_ROUNDS);
+    printf("%7s%15s%15s%15s%15s\n", "threads", "decode ms", "encode ms", "meshes ms", "culling ms");
+
+    double baseline[4] = { 0 };
+    size_t firstPixels = 0;
+    size_t firstVisible = 0;
+    bool same = true;
+    for (int threads = 1; threads <= maxThreads; threads = threads * 2 > maxThreads && threads < maxThreads ? maxThreads : threads * 2)
+    {
+        // The calling thread works too, while it waits
+        jobs_init(threads - 1);
+
+        double best[4] = { INFINITY, INFINITY, INFINITY, INFINITY };
+        for (int round = 0; round < BENCH_ROUNDS; round++)
+        {
+            double start = bench_now();
+            JobCounter counter = { 0 };
+            for (size_t i = 0; i < numDecodes; i++)
+            {
+                decodeJobs[i].counter = &counter;
+            }
+            jobs_run(decodeJobs, numDecodes, &counter);
+            jobs_wait(&counter);
+            best[0] = fmin(best[0], bench_now() - start);
+
+            start = bench_now();
+            jobs_parallelFor(BENCH_ENCODE_SIZE / 4, 4, bench_encodeRows, &encode);
+            best[1] = fmin(best[1], bench_now() - start);
+
+            start = bench_now();
+            for (int m = 0; m < BENCH_MESHES; m++)
+            {
+                meshJobs[m].counter = &counter;
+            }
+            jobs_run(meshJobs, BENCH_MESHES, &counter);
+            jobs_wait(&counter);
+            best[2] = fmin(best[2], bench_now() - start);
+
+            start = bench_now();
+            jobs_parallelFor(BENCH_SPHERES, 4096, bench_cullRange, &cull);
+            best[3] = fmin(best[3], bench_now() - start);
+        }
+        jobs_shutdown();
+
+        size_t pixels = 0, visible = 0;
+        for (size_t i = 0; i < numDecodes; i++)
+        {
+            pixels += decodes[i].pixels;
+        }
+        for (size_t i = 0; i < BENCH_SPHERES; i++)
+        {
+            visible += cull.visible[i];
+        }
+        if (threads == 1)
+        {
+            memcpy(baseline, best, sizeof(best));
+            firstPixels = pixels;
+            firstVisible = visible;
+        }
+        same = same && pixels == firstPixels && visible == firstVisible;
+
+        printf("%7d", threads);
+        for (int w = 0; w < 4; w++)
+        {
+            printf(" %8.2f %4.1fx", best[w] * 1000.0, baseline[w] / best[w]);
+        }
+        printf("\n");
+        if (threads == maxThreads)
+        {
+            break;
+        }
+    }
+
+    if (!same)
+    {
+        printf("MISMATCH: thread counts decoded or culled different amounts\n");
+    }
+
+    for (size_t i = 0; i < numFiles; i++)
+    {
+        packCloseFile(&files[i]);
+    }
+    for (int m = 0; m < BENCH_MESHES; m++)
+    {
+        free((void*)meshes[m].mins);
+        free((void*)meshes[m].maxs);
+        bvh_free(meshes[m].bvh);
+    }
+    free(rgba);
+    free(encode.dest);
+    free(spheres);
+    free(cull.visible);
+    return same ? 0 : 1;
+}
@@ -0,0 +1,156 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "cglm/cglm.h"
+#include "transform.h"
+
+// Times the batch transform kernels against doing the same one object at a
+// time with cglm, and checks they agree:
+//
+//     bench_transform [objects] [iterations]
+//
+// The batch kernels use AVX2 when the CPU has it, which this prints.
+
+#define BENCH_OBJECTS 100000
+#define BENCH_ITERATIONS 50
+// Products of unit scale matrices stay around 1, so this is loose enough
+// for FMA rounding differently and tight enough to catch a wrong element
+#define BENCH_TOLERANCE 1e-4f
+
+static float bench_random(float min, float max)
+{
+    return min + (max - min) * (rand() / (float)RAND_MAX);
+}
+
+static float bench_maxDifference(const mat4* a, const mat4* b, size_t count)
+{
+    float maxDifference = 0.0f;
+    for (size_t i = 0; i < count; i++)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            for (int r = 0; r < 4; r++)
+            {
+                maxDifference = fmaxf(maxDifference, fabsf(a[i][c][r] - b[i][c][r]));
+            }
+        }
+    }
+    return maxDifference;
+}
+
+static bool bench_report(const char* name, double batchSeconds, double scalarSeconds, float difference, int iterations)
+{
+    bool same = difference <= BENCH_TOLERANCE;
+    printf("%-8s batch %7.3f ms, cglm %7.3f ms, %.2fx, max difference %g%s\n", name,
+        batchSeconds * 1000.0 / iterations, scalarSeconds * 1000.0 / iterations,
+        scalarSeconds / batchSeconds, difference, same ? "" : " MISMATCH");
+    return same;
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : BENCH_OBJECTS;
+    int iterations = argc > 2 ? atoi(argv[2]) : BENCH_ITERATIONS;
+    if (count == 0 || iterations <= 0)
+    {
+        printf("Usage: %s [objects] [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    vec3* positions = malloc(sizeof(vec3) * count);
+    versor* rotations = malloc(sizeof(versor) * count);
+    vec3* scales = malloc(sizeof(vec3) * count);
+    int* parents = malloc(sizeof(int) * count);
+    mat4* locals = malloc(sizeof(mat4) * count);
+    mat4* parentMatrices = malloc(sizeof(mat4) * count);
+    mat4* batch = malloc(sizeof(mat4) * count);
+    mat4* scalar = malloc(sizeof(mat4) * count);
+
+    srand(182);
+    for (size_t i = 0; i < count; i++)
+    {
+        glm_vec3_copy((vec3){ bench_random(-100.0f, 100.0f), bench_random(-100.0f, 100.0f), bench_random(-100.0f, 100.0f) }, positions[i]);
+        vec3 axis = { bench_random(-1.0f, 1.0f), bench_random(-1.0f, 1.0f), bench_random(-1.0f, 1.0f) };
+        glm_vec3_normalize(axis);
+        glm_quatv(rotations[i], bench_random(0.0f, GLM_PIf * 2.0f), axis);
+        glm_vec3_copy((vec3){ bench_random(0.5f, 2.0f), bench_random(0.5f, 2.0f), bench_random(0.5f, 2.0f) }, scales[i]);
+
+        // Parents always come first, as in the scene graph, and a few
+        // objects are roots
+        parents[i] = i % 16 == 0 ? -1 : (int)(rand() % (i + 1));
+        glm_quat_mat4(rotations[i], locals[i]);
+        glm_vec3_copy(positions[i], locals[i][3]);
+        glm_quat_mat4(rotations[(i * 7) % count], parentMatrices[i]);
+    }
+
+    printf("%zu objects, %d iterations, AVX2 %s\n", count, iterations,
+        __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") ? "on" : "off");
+    bool same = true;
+
+    // So the first pass over each doesn't pay for faulting its pages in
+    memset(batch, 0, sizeof(mat4) * count);
+    memset(scalar, 0, sizeof(mat4) * count);
+
+    // translate * rotate * scale
+    double start = bench_now();
+    for (int n = 0; n < iterations; n++)
+    {
+        transformBatchCompose(positions, rotations, scales, NULL, count, batch);
+        bench_use(batch);
+    }
+    double batchSeconds = bench_now() - start;
+
+    start = bench_now();
+    for (int n = 0; n < iterations; n++)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            glm_translate_make(scalar[i], positions[i]);
+            glm_quat_rotate(scalar[i], rotations[i], scalar[i]);
+            glm_scale(scalar[i], scales[i]);
+        }
+        bench_use(scalar);
+    }
+    double scalarSeconds = bench_now() - start;
+    same = bench_report("compose", batchSeconds, scalarSeconds, bench_maxDifference(batch, scalar, count), iterations) && same;
+
+    // parent * local
+    start = bench_now();
+    for (int n = 0; n < iterations; n++)
+    {
+        transformBatchMultiply(parentMatrices, parents, locals, NULL, count, batch);
+        bench_use(batch);
+    }
+    batchSeconds = bench_now() - start;
+
+    start = bench_now();
+    for (int n = 0; n < iterations; n++)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            if (parents[i] < 0)
+            {
+                glm_mat4_copy(locals[i], scalar[i]);
+            }
+            else
+            {
+                glm_mat4_mul(parentMatrices[parents[i]], locals[i], scalar[i]);
+            }
+        }
+        bench_use(scalar);
+    }
+    scalarSeconds = bench_now() - start;
+    same = bench_report("multiply", batchSeconds, scalarSeconds, bench_maxDifference(batch, scalar, count), iterations) && same;
+
+    free(positions);
+    free(rotations);
+    free(scales);
+    free(parents);
+    free(locals);
+    free(parentMatrices);
+    free(batch);
+    free(scalar);
+    return same ? 0 : 1;
+}
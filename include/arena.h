@@ -0,0 +1,53 @@
+#ifndef ARENA_H
+#define ARENA_H
+#include <stdarg.h>
+#include <stddef.h>
+
+// Smallest block an arena asks the heap for
+#define ARENA_DEFAULT_BLOCK_SIZE (64 * 1024)
+
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t size;
+    size_t used;
+    _Alignas(16) unsigned char data[];
+} ArenaBlock;
+
+// Linear allocator for data that all goes away at once. Allocating bumps an
+// offset, and there's no freeing single allocations, only rewinding to an
+// earlier mark or resetting the whole thing. Blocks are kept when it's
+// rewound, so once an arena has seen its biggest frame it stops touching
+// the heap.
+typedef struct {
+    ArenaBlock* first;
+    ArenaBlock* current;
+    size_t blockSize;
+} Arena;
+
+typedef struct {
+    ArenaBlock* block;
+    size_t used;
+} ArenaMark;
+
+Arena* newArena(size_t blockSize);
+void arenaFree(Arena* arena);
+void* arenaAlloc(Arena* arena, size_t size, size_t alignment);
+char* arenaPrintf(Arena* arena, const char* format, ...);
+void arenaReset(Arena* arena);
+ArenaMark arenaMark(Arena* arena);
+void arenaRewind(Arena* arena, ArenaMark mark);
+
+// The calling thread's own arena, for scratch space that doesn't outlive
+// the function or job using it. Jobs get theirs rewound after they run.
+Arena* arenaScratch();
+void arenaScratchRelease();
+
+// Everything the engine allocates goes through these, so the number of
+// heap allocations can be checked, e.g. that a steady frame makes none
+void* heapAlloc(size_t size);
+void* heapCalloc(size_t count, size_t size);
+void* heapRealloc(void* ptr, size_t size);
+void* heapAlignedAlloc(size_t alignment, size_t size);
+size_t heapAllocations();
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef BCN_H
+#define BCN_H
+#include <stddef.h>
+
+// Block compression formats we can encode. BC7 files made by other tools can
+// be loaded (see dds.h), but there's no encoder for it here.
+enum BCnFormat {
+    BCN_BC1, // RGB, 8 bytes per 4x4 block
+    BCN_BC3, // RGBA, 16 bytes per block (BC4 alpha + BC1 color)
+    BCN_BC4, // R, 8 bytes per block
+    BCN_BC5, // RG, 16 bytes per block (two BC4 blocks)
+    BCN_BC7, // RGBA, 16 bytes per block, load only
+};
+
+size_t bcnBlockSize(enum BCnFormat format);
+size_t bcnImageSize(enum BCnFormat format, int width, int height);
+
+// Encodes an RGBA8 image. dest must hold bcnImageSize() bytes.
+void bcnEncode(enum BCnFormat format, const unsigned char* rgba, int width, int height, unsigned char* dest);
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef BVH_H
+#define BVH_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "cglm/types.h"
+
+// Deepest a tree gets, which bounds the traversal stacks
+#define BVH_MAX_DEPTH 48
+
+// Inner nodes have count 0 and their two children at first and first + 1.
+// Leaves hold items[first] to items[first + count - 1].
+typedef struct {
+    vec3 min;
+    unsigned int first;
+    vec3 max;
+    unsigned int count;
+} BvhNode;
+
+// Bounding volume hierarchy over axis aligned boxes, one per item. Items
+// are whatever the caller numbers them as (bounds, triangles, ...); the
+// tree only ever hands back those numbers.
+//
+// Children are always stored after their parent, so bvh_refit() can
+// update every node in one pass from the back.
+typedef struct {
+    BvhNode* nodes;
+    size_t numNodes;
+
+    unsigned int* items;
+    vec3* itemMins;
+    vec3* itemMaxs;
+    size_t numItems;
+    size_t capacity;
+} Bvh;
+
+// Distance along the ray to where it hits the item, or a negative number
+// if it doesn't. Distances are in multiples of direction, which doesn't have
+// to be normalized.
+typedef float (*BvhRayTest)(unsigned int item, vec3 origin, vec3 direction, void* user);
+
+Bvh* newBvh();
+void bvh_free(Bvh* bvh);
+
+// Builds the tree over count items with the surface area heuristic
+void bvh_build(Bvh* bvh, const vec3* mins, const vec3* maxs, size_t count);
+// Takes new bounds for the same items and fixes up the node bounds without
+// changing the tree. Cheap, but the tree gets worse the further things move
+// from where they were at build time.
+void bvh_refit(Bvh* bvh, const vec3* mins, const vec3* maxs);
+
+// Each query writes the items it finds to dest, which has room for every
+// item, and returns how many it found
+size_t bvh_queryFrustum(Bvh* bvh, vec4 planes[6], unsigned int* dest);
+size_t bvh_querySphere(Bvh* bvh, vec3 center, float radius, unsigned int* dest);
+
+// Closest item the ray hits within maxDistance, or -1. Without a test,
+// items are hit where the ray enters their box.
+int bvh_raycast(Bvh* bvh, vec3 origin, vec3 direction, float maxDistance, BvhRayTest test, void* user,
+    float* distance);
+
+#endif
@@ -35,6 +35,7 @@ typedef struct {
 Camera* newCameraWithDefaults();
 Camera* newCamera(vec3 pos, vec3 front, vec3 up, float yaw, float pitch);
 void cameraGetViewMatrix(Camera* camera, mat4 dest);
+void cameraScreenRay(mat4 viewProjection, vec4 viewport, float x, float y, vec3 origin, vec3 direction);
 void cameraProcessKeyboard(Camera* camera, enum CameraMovement direction, float deltaTime);
 void cameraProcessMouse(Camera* camera, float xOffset, float yOffset, bool constrainPitch);
 void cameraProcessScroll(Camera* camera, float yOffset);
@@ -0,0 +1,42 @@
+#ifndef COMMANDS_H
+#define COMMANDS_H
+#include <stddef.h>
+#include "cglm/types.h"
+#include "ringbuffer.h"
+#include "shader.h"
+#include "texture.h"
+#include "uniforms.h"
+
+struct Model;
+
+// Draw calls written down to be made later. Recording never touches GL, so
+// any thread can fill a buffer, and only the one with the context plays it
+// back.
+//
+// GL objects are looked up at playback: shaders by their Shader, model
+// buffers through pointers to where the model keeps them, textures through
+// the registry. That way a hot reload between recording and playback can't
+// leave a buffer pointing at deleted objects.
+typedef struct {
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+} CommandBuffer;
+
+CommandBuffer* newCommandBuffer();
+void commandBufferFree(CommandBuffer* commands);
+void commandBufferReset(CommandBuffer* commands);
+
+void commandBufferUseShader(CommandBuffer* commands, Shader* shader);
+void commandBufferBindUniformBuffer(CommandBuffer* commands, unsigned int binding, const unsigned int* buffer);
+void commandBufferBindTexture(CommandBuffer* commands, unsigned int unit, unsigned int target, const unsigned int* texture);
+void commandBufferBindTextureHandle(CommandBuffer* commands, unsigned int unit, TextureHandle texture);
+void commandBufferSetInt(CommandBuffer* commands, Shader* shader, const char* name, int value);
+// Works out the DrawData block now, uploads it to the ring at playback
+void commandBufferSetDrawUniforms(CommandBuffer* commands, mat4 model, mat4 view);
+void commandBufferDrawMesh(CommandBuffer* commands, struct Model* model, unsigned int mesh);
+
+// Makes the calls. ring can be NULL if nothing set draw uniforms.
+void commandBufferExecute(CommandBuffer* commands, RingBuffer* ring);
+
+#endif
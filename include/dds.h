@@ -0,0 +1,33 @@
+#ifndef DDS_H
+#define DDS_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "bcn.h"
+
+typedef struct {
+    const unsigned char* data;
+    size_t size;
+    int width;
+    int height;
+} DDSLevel;
+
+// A block compressed 2D texture with its mip chain, as stored in a .dds file.
+// Rows are expected in OpenGL's bottom-up order, which is what we write. DDS
+// files made by other tools need to be flipped when they're exported.
+typedef struct {
+    enum BCnFormat format;
+    int width;
+    int height;
+
+    DDSLevel* levels;
+    size_t numLevels;
+
+    unsigned char* fileData; // Owns the memory the levels point into, NULL from ddsParse()
+} DDSImage;
+
+bool ddsParse(const char* path, const unsigned char* data, size_t size, DDSImage* image);
+bool ddsRead(const char* path, DDSImage* image);
+void ddsFree(DDSImage* image);
+bool ddsWrite(const char* path, enum BCnFormat format, int width, int height, unsigned char** levels, size_t numLevels);
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef ECS_H
+#define ECS_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "bvh.h"
+#include "cglm/types.h"
+#include "frame.h"
+#include "grid.h"
+#include "light.h"
+#include "scene.h"
+#include "uniforms.h"
+
+// 0 is never a valid entity
+typedef unsigned int Entity;
+#define ENTITY_NONE 0
+
+// What a ray cast with ecs_pick() hit
+typedef struct {
+    Entity entity;
+    int mesh; // In the entity's model
+    int triangle; // In the mesh
+    float distance;
+    vec3 point;
+} EcsPickHit;
+
+// Side of a cell in the grid dynamic bounds are kept in
+#define ECS_GRID_CELL_SIZE 16.0f
+
+// Which entities have a component, as a sparse set. The component's data
+// lives in arrays parallel to entities[], packed with no holes, so systems
+// walk them front to back without ever looking at entities that don't
+// have the component.
+typedef struct {
+    Entity* entities; // Dense index to entity
+    size_t count;
+    size_t capacity;
+
+    unsigned int* indices; // Entity to dense index + 1, 0 if it doesn't have one
+    size_t numIndices;
+} EcsPool;
+
+typedef struct {
+    Scene* scene;
+
+    Entity nextEntity;
+    Entity* freeEntities;
+    size_t numFreeEntities;
+
+    // Transform: the entity's node in the scene graph, which keeps the
+    // transforms themselves in flat arrays too
+    EcsPool transforms;
+    int* transformNodes;
+
+    // Renderable: a model placed in the scene
+    EcsPool renderables;
+    int* renderableModels; // SceneModel index
+    bool* renderableOutlined; // Drawn in the outline pass
+
+    // Bounds: world space sphere around a renderable, the box around that
+    // sphere, whether it moves, and whether the last cull found it on screen
+    EcsPool bounds;
+    vec4* boundsSpheres;
+    vec3* boundsMins;
+    vec3* boundsMaxs;
+    bool* boundsDynamic;
+    bool* boundsVisible;
+
+    // Static bounds go in a tree, numbered by their place in boundsStatic[].
+    // It's rebuilt when bounds are added or removed and refit otherwise, so
+    // it stays good as long as they stay put.
+    Bvh* boundsBvh;
+    bool boundsBvhStale;
+    unsigned int* boundsStatic;
+    vec3* boundsStaticMins;
+    vec3* boundsStaticMaxs;
+    size_t numBoundsStatic;
+
+    // Dynamic bounds go in a grid, by entity, where moving is constant time
+    Grid* boundsGrid;
+
+    unsigned int* boundsFound;
+
+    // Light: directional light, in world space
+    EcsPool lights;
+    DirLight* lightDirs;
+} EcsWorld;
+
+EcsWorld* newEcsWorld(Scene* scene);
+Entity ecs_createEntity(EcsWorld* world);
+void ecs_destroyEntity(EcsWorld* world, Entity entity);
+
+void ecs_addTransform(EcsWorld* world, Entity entity, int node);
+void ecs_addRenderable(EcsWorld* world, Entity entity, int sceneModel, bool outlined);
+void ecs_addBounds(EcsWorld* world, Entity entity, bool dynamic);
+void ecs_addLight(EcsWorld* world, Entity entity, DirLight* light);
+int ecs_getTransform(EcsWorld* world, Entity entity);
+void ecs_setOutlined(EcsWorld* world, Entity entity, bool outlined);
+Entity ecs_pick(EcsWorld* world, vec3 origin, vec3 direction, float maxDistance, EcsPickHit* hit);
+
+// Systems, in the order a frame runs them
+void ecs_updateTransforms(EcsWorld* world);
+void ecs_updateBounds(EcsWorld* world);
+void ecs_cull(EcsWorld* world, mat4 viewProjection);
+void ecs_gatherLights(EcsWorld* world, mat4 view, LightUniforms* dest);
+void ecs_collectDraws(EcsWorld* world, FrameDrawList* dest, bool outlined);
+void ecs_collectOutline(EcsWorld* world, Entity entity, float scale, FrameDrawList* dest);
+void ecs_collectModels(EcsWorld* world, FramePacket* packet);
+
+#endif
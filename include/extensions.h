@@ -0,0 +1,68 @@
+#ifndef EXTENSIONS_H
+#define EXTENSIONS_H
+#include <stdbool.h>
+#include <glad/glad.h>
+
+// glad was generated for core 3.3 without extensions, so anything newer that
+// we can take advantage of is loaded by hand here after the context exists.
+
+// GL_KHR_parallel_shader_compile / GL_ARB_parallel_shader_compile
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+extern PFNGLMAXSHADERCOMPILERTHREADSKHRPROC ext_glMaxShaderCompilerThreadsKHR;
+#define glMaxShaderCompilerThreadsKHR ext_glMaxShaderCompilerThreadsKHR
+
+// GL_EXT_texture_compression_s3tc (BC1 and BC3)
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+
+// GL_ARB_texture_compression_bptc (BC7)
+#define GL_COMPRESSED_RGBA_BPTC_UNORM_ARB 0x8E8C
+
+// GL_ARB_texture_storage (core in 4.2)
+#define GL_TEXTURE_IMMUTABLE_FORMAT 0x912F
+#define GL_TEXTURE_IMMUTABLE_LEVELS 0x82DF
+typedef void (APIENTRYP PFNGLTEXSTORAGE2DPROC)(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height);
+typedef void (APIENTRYP PFNGLTEXSTORAGE3DPROC)(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height, GLsizei depth);
+extern PFNGLTEXSTORAGE2DPROC ext_glTexStorage2D;
+extern PFNGLTEXSTORAGE3DPROC ext_glTexStorage3D;
+#define glTexStorage2D ext_glTexStorage2D
+#define glTexStorage3D ext_glTexStorage3D
+
+// GL_ARB_buffer_storage (core in 4.4)
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+typedef void (APIENTRYP PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+extern PFNGLBUFFERSTORAGEPROC ext_glBufferStorage;
+#define glBufferStorage ext_glBufferStorage
+
+// GL_ARB_bindless_texture
+typedef GLuint64 (APIENTRYP PFNGLGETTEXTUREHANDLEARBPROC)(GLuint texture);
+typedef GLuint64 (APIENTRYP PFNGLGETTEXTURESAMPLERHANDLEARBPROC)(GLuint texture, GLuint sampler);
+typedef void (APIENTRYP PFNGLMAKETEXTUREHANDLERESIDENTARBPROC)(GLuint64 handle);
+typedef void (APIENTRYP PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC)(GLuint64 handle);
+extern PFNGLGETTEXTUREHANDLEARBPROC ext_glGetTextureHandleARB;
+extern PFNGLGETTEXTURESAMPLERHANDLEARBPROC ext_glGetTextureSamplerHandleARB;
+extern PFNGLMAKETEXTUREHANDLERESIDENTARBPROC ext_glMakeTextureHandleResidentARB;
+extern PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC ext_glMakeTextureHandleNonResidentARB;
+#define glGetTextureHandleARB ext_glGetTextureHandleARB
+#define glGetTextureSamplerHandleARB ext_glGetTextureSamplerHandleARB
+#define glMakeTextureHandleResidentARB ext_glMakeTextureHandleResidentARB
+#define glMakeTextureHandleNonResidentARB ext_glMakeTextureHandleNonResidentARB
+
+typedef struct {
+    bool parallelShaderCompile;
+    bool textureCompressionS3TC;
+    bool textureCompressionBPTC;
+    bool textureStorage;
+    bool bufferStorage;
+    bool bindlessTexture;
+} GLExtensions;
+
+extern GLExtensions glExtensions;
+
+// Must be called with a current context, after gladLoadGLLoader()
+void loadGLExtensions();
+
+#endif
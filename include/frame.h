@@ -0,0 +1,122 @@
+#ifndef FRAME_H
+#define FRAME_H
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "cglm/types.h"
+#include "arena.h"
+#include "commands.h"
+#include "model.h"
+#include "ringbuffer.h"
+#include "shader.h"
+#include "uniforms.h"
+
+// One mesh to draw and where. newTransform is false when it sits on the
+// same node as the draw before it, which can then keep its DrawData.
+typedef struct {
+    Model* model;
+    unsigned int mesh;
+    bool newTransform;
+    mat4 world;
+} FrameDraw;
+
+// Grows inside its packet's arena, so it's gone when the packet is reset
+typedef struct {
+    FrameDraw* draws;
+    size_t count;
+    size_t capacity;
+    Arena* arena;
+} FrameDrawList;
+
+// Big enough for a frame's draw lists without going back to the heap
+#define FRAME_ARENA_BLOCK_SIZE (1024 * 1024)
+
+// Most buffers a draw list is recorded into at once, and the fewest draws
+// worth giving a buffer of its own
+#define FRAME_MAX_RECORDERS 16
+#define FRAME_MIN_DRAWS_PER_RECORDER 64
+
+// A draw list recorded as slices, played back in order
+typedef struct {
+    CommandBuffer* buffers[FRAME_MAX_RECORDERS];
+    size_t count;
+} FrameCommands;
+
+// A model on screen this frame, for texture streaming
+typedef struct {
+    Model* model;
+    mat4 transform;
+} FrameModel;
+
+// Everything the render thread needs to draw a frame, so it never has to
+// look at the scene the update thread is busy changing
+typedef struct {
+    mat4 view;
+    mat4 projection;
+    vec3 cameraPos;
+    float fovY;
+    LightUniforms lights;
+
+    FrameDrawList opaque;
+    FrameDrawList outlined; // Drawn writing the stencil buffer
+    FrameDrawList outlines; // The outlined draws scaled up, drawn around them
+
+    // The lists above, recorded with the shader each pass uses
+    FrameCommands opaqueCommands;
+    FrameCommands outlinedCommands;
+    FrameCommands outlineCommands;
+
+    FrameModel* models;
+    size_t numModels;
+    size_t modelCapacity;
+
+    // Anything that only lives as long as the packet, reset with it
+    Arena* arena;
+} FramePacket;
+
+// Input sampled on the main thread, which is the only one GLFW lets read it
+typedef struct {
+    float deltaTime;
+    bool moves[6]; // By enum CameraMovement
+    bool sprinting;
+    float lookX; // Mouse movement since the last frame
+    float lookY;
+    float scroll;
+    bool pick;
+} FrameInput;
+
+typedef void (*FrameUpdateFn)(const FrameInput* input, FramePacket* packet, void* ctx);
+
+// Two packets: the update thread fills one from the latest input while the
+// render thread draws the other, and they trade at framePipeline_wait().
+typedef struct {
+    FramePacket packets[2];
+    int front; // The one being drawn
+
+    FrameUpdateFn update;
+    void* ctx;
+    FrameInput input;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    bool requested;
+    bool done;
+    bool quit;
+} FramePipeline;
+
+void frame_reset(FramePacket* packet);
+void frame_addDraw(FrameDrawList* list, Model* model, unsigned int mesh, bool newTransform, mat4 world);
+void frame_addModel(FramePacket* packet, Model* model, mat4 transform);
+void frame_recordDraws(FrameDrawList* list, Shader* shader, mat4 view, FrameCommands* dest);
+void frame_executeCommands(FrameCommands* commands, RingBuffer* ring);
+
+FramePipeline* newFramePipeline(FrameUpdateFn update, void* ctx);
+void framePipeline_free(FramePipeline* pipeline);
+// Starts building the next packet from input
+void framePipeline_submit(FramePipeline* pipeline, const FrameInput* input);
+// Waits for the packet being built and hands it over for drawing. The
+// update thread does nothing until the next submit.
+FramePacket* framePipeline_wait(FramePipeline* pipeline);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef GPUTIMER_H
+#define GPUTIMER_H
+#include <stdbool.h>
+#include <stddef.h>
+
+// Queries in flight. Results are read this many frames late, by which time
+// the GPU is done with them, so reading never stalls.
+#define GPU_TIMER_QUERIES 4
+
+// Times a stretch of GL commands on the GPU with GL_TIME_ELAPSED queries,
+// one begin/end pair a frame, and keeps a running total to report from
+typedef struct {
+    unsigned int queries[GPU_TIMER_QUERIES];
+    bool pending[GPU_TIMER_QUERIES];
+    unsigned int next;
+
+    double totalMs;
+    size_t samples;
+} GpuTimer;
+
+GpuTimer* newGpuTimer();
+void gpuTimerFree(GpuTimer* timer);
+void gpuTimerBegin(GpuTimer* timer);
+void gpuTimerEnd(GpuTimer* timer);
+double gpuTimerAverageMs(GpuTimer* timer);
+
+#endif
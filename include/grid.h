@@ -0,0 +1,61 @@
+#ifndef GRID_H
+#define GRID_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "bvh.h"
+#include "cglm/types.h"
+
+typedef struct {
+    int64_t key;
+    unsigned int* items;
+    size_t count;
+    size_t capacity;
+} GridCell;
+
+typedef struct {
+    int cell; // -1 if the item isn't in the grid
+    unsigned int slot; // Where it is in the cell's items
+    vec3 min;
+    vec3 max;
+} GridItem;
+
+// Loose uniform grid hashed by cell coordinates, for things that move every
+// frame. An item goes in the one cell holding the center of its box, so
+// adding, moving and removing it is constant time whatever its size.
+// Queries make up for that by growing every cell by the largest half size
+// any item has had.
+//
+// Items are whatever the caller numbers them as, and the numbers are used
+// as indices, so they should stay small.
+typedef struct {
+    float cellSize;
+    float looseness;
+
+    GridCell* cells;
+    size_t numCells;
+    size_t cellCapacity;
+
+    // Open addressed table from cell key to cells[] index + 1
+    unsigned int* table;
+    size_t tableSize;
+
+    GridItem* items;
+    size_t numItems; // Highest item number + 1
+    size_t itemCapacity;
+} Grid;
+
+Grid* newGrid(float cellSize);
+void grid_free(Grid* grid);
+
+// Puts the item in the grid, or moves it if it's already there
+void grid_update(Grid* grid, unsigned int item, vec3 min, vec3 max);
+void grid_remove(Grid* grid, unsigned int item);
+
+// Same as the bvh.h queries: dest has room for every item in the grid
+size_t grid_queryFrustum(Grid* grid, vec4 planes[6], unsigned int* dest);
+size_t grid_querySphere(Grid* grid, vec3 center, float radius, unsigned int* dest);
+int grid_raycast(Grid* grid, vec3 origin, vec3 direction, float maxDistance, BvhRayTest test, void* user,
+    float* distance);
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef HANDLE_H
+#define HANDLE_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A handle is a slot index in the low bits and the slot's generation in the
+// high ones. Removing an item bumps its slot's generation, so handles to it
+// stop resolving even once the slot holds something else. 0 is never a
+// valid handle.
+#define HANDLE_INDEX_BITS 20
+#define HANDLE_INDEX_MASK ((1u << HANDLE_INDEX_BITS) - 1)
+#define HANDLE_MAX_GENERATION ((1u << (32 - HANDLE_INDEX_BITS)) - 1)
+#define HANDLE_NONE 0
+
+typedef uint32_t Handle;
+
+// Fixed size items packed in one array, with removed slots reused first.
+// Pointers from handlePoolGet() are good until the next handlePoolAdd().
+typedef struct {
+    unsigned char* items;
+    size_t itemSize;
+
+    uint32_t* generations; // Current generation of each slot
+    bool* alive;
+    size_t count; // Slots ever used
+    size_t capacity;
+
+    uint32_t* freeSlots;
+    size_t numFree;
+} HandlePool;
+
+HandlePool* newHandlePool(size_t itemSize);
+void handlePoolFree(HandlePool* pool);
+Handle handlePoolAdd(HandlePool* pool, const void* item);
+void* handlePoolGet(HandlePool* pool, Handle handle);
+bool handlePoolRemove(HandlePool* pool, Handle handle, void* item);
+Handle handlePoolAt(HandlePool* pool, size_t slot);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef HOTRELOAD_H
+#define HOTRELOAD_H
+#include <stddef.h>
+#include "model.h"
+#include "resources.h"
+#include "shader.h"
+
+typedef enum {
+    HOTRELOAD_SHADER,
+    HOTRELOAD_PERMUTATION,
+    HOTRELOAD_MODEL,
+    HOTRELOAD_TEXTURE,
+} HotReloadKind;
+
+typedef struct {
+    HotReloadKind kind;
+    void* asset;
+    ShaderHandle shader; // Shaders and models are kept by handle, and skipped once destroyed
+    ModelHandle model;
+    char* path; // Only for models and standalone textures
+} HotReloadAsset;
+
+// Watches asset directories with inotify and reloads whatever depends on a
+// file when it changes. Nothing happens until hotReloadUpdate() is called,
+// which is meant to run on the GL thread between frames.
+typedef struct {
+    int fd;
+
+    int* watchDescriptors;
+    char** watchDirs;
+    size_t numWatches;
+
+    HotReloadAsset* assets;
+    size_t numAssets;
+} HotReload;
+
+HotReload* newHotReload();
+void hotReloadWatchDirectory(HotReload* hotReload, const char* dir);
+void hotReloadAddShader(HotReload* hotReload, ShaderHandle shader);
+void hotReloadAddPermutation(HotReload* hotReload, ShaderPermutation* permutation);
+void hotReloadAddModel(HotReload* hotReload, ModelHandle model, const char* path);
+void hotReloadAddTexture(HotReload* hotReload, unsigned int* texture, const char* path);
+void hotReloadUpdate(HotReload* hotReload);
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef JOBS_H
+#define JOBS_H
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "parallel.h"
+
+// Jobs a worker can have queued before new ones just run on the spot
+#define JOBS_DEQUE_SIZE 4096
+
+typedef void (*JobFn)(void* data);
+
+// Counts jobs still to finish. Starts at zero and can be reused once it's
+// back there.
+typedef struct {
+    atomic_size_t remaining;
+} JobCounter;
+
+// Must stay where it is until its counter says it's done
+typedef struct {
+    JobFn fn;
+    void* data;
+    JobCounter* counter;
+} Job;
+
+// Starts numWorkers threads, each with a deque of jobs of its own. A worker
+// takes the newest job off its own deque, and when that's empty steals the
+// oldest off someone else's, so work spreads without a shared lock. Threads
+// that aren't workers hand jobs over through a shared queue.
+//
+// Until this is called, or after jobs_shutdown(), jobs run right away on
+// the calling thread.
+void jobs_init(int numWorkers);
+void jobs_shutdown();
+int jobs_numWorkers();
+
+// Queues count jobs and adds them to counter, which can be NULL
+void jobs_run(Job* jobs, size_t count, JobCounter* counter);
+
+// Runs counter's own jobs, and any the calling worker queued meanwhile,
+// until counter gets to zero. Unrelated jobs are left to the workers, so
+// waiting costs no more than the work waited on. Jobs depend on each other
+// by waiting on the counters of the ones they need, which is fine from
+// inside a job since the wait keeps the worker busy.
+void jobs_wait(JobCounter* counter);
+
+// parallelFor() on the job system: [0, count) split into at most a slice
+// per thread, and no slices smaller than minPerJob
+void jobs_parallelFor(size_t count, size_t minPerJob, ParallelForFn fn, void* ctx);
+
+#endif
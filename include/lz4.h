@@ -0,0 +1,20 @@
+#ifndef LZ4_H
+#define LZ4_H
+#include <stdbool.h>
+#include <stddef.h>
+
+// The LZ4 block format, without the frame around it. Sizes are kept by
+// whoever stores the block (see pack.h), so decompressing needs to be told
+// exactly how big the result is.
+// https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md
+
+// Most a block of size bytes can grow to when it doesn't compress
+size_t lz4CompressBound(size_t size);
+
+// Returns the compressed size, or 0 if it doesn't fit in destCapacity
+size_t lz4Compress(const unsigned char* src, size_t srcSize, unsigned char* dest, size_t destCapacity);
+
+// Fails on a corrupt block, or one that doesn't come out at destSize
+bool lz4Decompress(const unsigned char* src, size_t srcSize, unsigned char* dest, size_t destSize);
+
+#endif
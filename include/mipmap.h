@@ -0,0 +1,21 @@
+#ifndef MIPMAP_H
+#define MIPMAP_H
+#include <stddef.h>
+
+#define MIPMAP_MAX_LEVELS 16
+
+size_t mipmapNumLevels(int width, int height);
+void mipmapLevelSize(int width, int height, size_t level, int* levelWidth, int* levelHeight);
+
+// Halves an RGBA8 image with a 2x2 box filter into dest, which must hold
+// (width / 2) * (height / 2) pixels (at least 1x1).
+void mipmapDownsample(const unsigned char* src, int width, int height, unsigned char* dest);
+
+// Bilinear resize of an RGBA8 image, for when images have to match in size
+void mipmapResize(const unsigned char* src, int width, int height, unsigned char* dest, int destWidth, int destHeight);
+
+// Fills levels[1..numLevels) from levels[0], an RGBA8 image. The caller
+// allocates every level.
+void mipmapBuildChain(unsigned char** levels, size_t numLevels, int width, int height);
+
+#endif
@@ -3,10 +3,16 @@
 #include <assimp/cimport.h>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
+#include "arena.h"
+#include "bvh.h"
+#include "commands.h"
 #include "cglm/types-struct.h"
 #include "shader.h"
+#include "texture.h"
 
 typedef struct {
     vec3s Position;
@@ -15,9 +21,10 @@ typedef struct {
 } Vertex;
 
 typedef struct {
-    unsigned int id;
-    char* type;
-    char* path;
+    const char* type;
+    const char* path;
+    TextureHandle handle;
+    uint64_t bindlessHandle; // Resident handle once the model uses bindless textures
 } Texture;
 
 typedef struct {
@@ -30,32 +37,98 @@ typedef struct {
     Texture* textures;
     size_t numTextures;
 
+    // Layers in the model's texture array, -1 if the mesh has no such map
+    int diffuseLayer;
+    int specularLayer;
+
+    // Bounding sphere in model space
+    vec3s boundsCenter;
+    float boundsRadius;
+
+    // Average UV units per model space unit across the surface, which is
+    // what texture streaming needs to work out on screen texel density
+    float uvDensity;
+
+    // Index of the ModelNode the mesh hangs off
+    int node;
+
+    // Tree over the triangles for ray casts, built the first time one is
+    // cast at the mesh
+    Bvh* triangleBvh;
+
     unsigned int VAO, VBO, EBO;
 } Mesh;
 
-Mesh* newMesh(Vertex* vertices, size_t numVertices, unsigned int* indices, size_t numIndices, Texture* textures, size_t numTextures);
-void mesh_draw(Mesh* mesh, Shader* shader);
+void mesh_init(Mesh* mesh, Vertex* vertices, size_t numVertices, unsigned int* indices, size_t numIndices, Texture* textures, size_t numTextures);
 
 void mesh_setup(Mesh* mesh);
+void mesh_computeBounds(Mesh* mesh);
+float mesh_raycast(Mesh* mesh, vec3 origin, vec3 direction, float maxDistance, int* triangle);
+
+// A node of the model file's hierarchy, kept so multi-part models can be put
+// together the way they were authored (see scene.h)
+typedef struct {
+    char* name;
+    int parent; // -1 for the root, otherwise always a lower index
+    mat4 transform; // Relative to the parent
+} ModelNode;
 
+// A GL_TEXTURE_2D_ARRAY that one or more models draw from. It keeps a
+// reference to each texture in it, layer by layer, so it can be rebuilt,
+// and goes once the last model using it lets go.
 typedef struct {
+    unsigned int id;
+    int refs;
+    TextureHandle* layers;
+    size_t numLayers;
+} ModelTextureArray;
+
+typedef struct Model {
     Mesh* meshes;
     size_t numMeshes;
 
+    ModelNode* nodes;
+    size_t numNodes;
+
     char* directory;
 
-    Texture* texturesLoaded;
-    size_t numTexturesLoaded;
+    // Every material texture, maybe shared with other models, NULL if not built
+    ModelTextureArray* textureArray;
+
+    // Uniform buffer of bindless handles, one material per mesh, 0 if not built
+    unsigned int materialBuffer;
+
+    // Holds the nodes, meshes and everything in them, sized to fit when the
+    // file is loaded
+    Arena* memory;
 } Model;
 
-Model* newModel(char* path);
-void model_loadModel(Model* model, char* path);
+// Must match MAX_MATERIALS and the Materials block in shaders/lit/lit.frag
+#define MODEL_MAX_BINDLESS_MATERIALS 1024
+
+Model* newModel(const char* path);
+void model_init(Model* model);
+void model_free(Model* model);
+void model_loadModel(Model* model, const char* path);
+bool model_loadData(Model* model, const char* path);
+void model_uploadMesh(Model* model, size_t index, TexCacheImage* images);
+bool model_reload(Model* model, const char* path);
 void model_draw(Model* model, Shader* shader);
+void model_beginDraw(Model* model, Shader* shader);
+void model_drawMesh(Model* model, size_t index, Shader* shader);
+void model_recordBegin(Model* model, Shader* shader, CommandBuffer* commands);
+void model_recordMesh(Model* model, size_t index, Shader* shader, CommandBuffer* commands);
 void model_drawWithOutline(Model* model, Shader* shader, Shader* outlineShader);
 void model_scale(Model* model, float scale);
+bool model_buildTextureArray(Model** models, size_t numModels);
+void model_refreshTextureArray(Model* model);
+bool model_buildMaterialBuffer(Model* model);
+void model_useBoundTextures(Model* model);
+bool model_usesTexture(Model* model, TextureHandle texture);
+void model_requestTextureLevels(Model* model, mat4 transform, vec3 cameraPos, float fovY, float viewportHeight);
 
-void model_processNode(Model* model, struct aiNode* node, const struct aiScene* scene);
-Mesh* model_processMesh(Model* model, struct aiMesh* mesh, const struct aiScene* scene);
-Texture* model_loadMaterialTextures(Model* model, struct aiMaterial* mat, enum aiTextureType type, char* typeName);
+void model_processNode(Model* model, struct aiNode* node, const struct aiScene* scene, int parent);
+void model_processMesh(Model* model, struct aiMesh* mesh, const struct aiScene* scene, Mesh* dest);
+void model_loadMaterialTextures(Model* model, struct aiMaterial* mat, enum aiTextureType type, const char* typeName, Texture* dest);
 
 #endif
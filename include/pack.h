@@ -0,0 +1,83 @@
+#ifndef PACK_H
+#define PACK_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Shaders, models and textures packed into one file by the packer tool
+// (tools/packer.c), which the engine maps at startup. Loaders ask for files
+// by the same paths they'd open loose, get byte ranges straight out of the
+// mapping, and only touch the disk for pages they read. Anything that isn't
+// in the pack is opened loose, so a pack can be missing or out of date
+// without breaking anything. Files in the pack win over loose ones, until
+// packPreferLoose() says one changed on disk.
+//
+// The layout is a header, the entries, a hash table of entry indices keyed
+// on path, the paths themselves, then every entry's data starting on a
+// PACK_ALIGNMENT boundary.
+
+#define PACK_MAGIC "M182PAK"
+#define PACK_VERSION 1
+#define PACK_ALIGNMENT 64
+#define PACK_NO_ENTRY 0xffffffffu
+
+typedef enum {
+    PACK_STORED,
+    PACK_LZ4, // See lz4.h
+} PackCompression;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t numEntries;
+    uint32_t tableSize; // Slots in the hash table, a power of two
+    uint32_t reserved;
+    uint64_t entriesOffset;
+    uint64_t tableOffset;
+    uint64_t pathsOffset;
+    uint64_t pathsSize;
+} PackHeader;
+
+typedef struct {
+    uint64_t pathHash;
+    uint64_t contentHash; // Of the uncompressed data, same as texcacheHash() of the loose file
+    uint64_t offset;
+    uint64_t size; // As stored
+    uint64_t rawSize;
+    uint32_t compression;
+    uint32_t pathOffset; // Into the paths, which end in a NUL
+} PackEntry;
+
+// The bytes of a file, from the pack or a loose file. Only data and size
+// are for reading, the rest is whatever has to be let go of when it's
+// closed.
+typedef struct {
+    const unsigned char* data;
+    size_t size;
+
+    uint64_t hash;
+    bool hashed;
+
+    void* mapping; // A loose file's own mapping
+    size_t mappingSize;
+    void* buffer; // Decompressed data
+} PackFile;
+
+uint64_t packPathHash(const char* path);
+const char* packNormalizePath(const char* path);
+
+// Mount before anything is loaded and unmount once nothing that was is
+// around, since loaders keep pointers into the mapping. In between, files
+// can be opened from any thread.
+bool packMount(const char* path);
+void packUnmount();
+
+// From then on path is opened loose even though it's in the pack, for hot
+// reload to pick up edits. Safe to call while other threads open files.
+void packPreferLoose(const char* path);
+
+bool packOpenFile(const char* path, PackFile* file);
+void packCloseFile(PackFile* file);
+uint64_t packFileHash(PackFile* file);
+
+#endif
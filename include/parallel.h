@@ -0,0 +1,17 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+#include <stddef.h>
+
+// Called with a [begin, end) slice of the range handed to parallelFor()
+typedef void (*ParallelForFn)(size_t begin, size_t end, void* ctx);
+
+int parallelNumThreads();
+
+// Splits [0, count) into roughly equal slices and runs fn on each across the
+// machine's cores, returning once every slice is done. Goes through the job
+// system once jobs_init() has been called, and starts threads of its own
+// otherwise. Ranges smaller than
+// minPerThread per core aren't worth waking threads for and run inline.
+void parallelFor(size_t count, size_t minPerThread, ParallelForFn fn, void* ctx);
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef RESOURCES_H
+#define RESOURCES_H
+#include <stdbool.h>
+#include "handle.h"
+#include "model.h"
+#include "shader.h"
+
+// Anything that holds on to a resource past the current frame keeps one of
+// these rather than a pointer or a GL name, and looks it up each time it's
+// used. Once a resource is destroyed its handles resolve to NULL (or 0 for
+// buffers) instead of to freed memory or a recycled GL name.
+//
+// Textures already come with handles from their registry (see texture.h),
+// which never hands a texture's slot to a different file.
+typedef Handle ModelHandle;
+typedef Handle ShaderHandle;
+typedef Handle BufferHandle;
+
+// Meshes belong to their model, so a mesh is its model's handle and an
+// index, which stops resolving if a reload leaves the model with fewer
+// meshes
+typedef struct {
+    ModelHandle model;
+    unsigned int mesh;
+} MeshHandle;
+
+// Destroying a resource only invalidates its handles right away. Frames
+// already recorded may still draw with it, so the memory and GL objects go
+// once a fence placed at the end of the frame has signalled.
+//
+// Everything here is for the GL thread, between framePipeline_wait() and
+// framePipeline_submit() when it comes to adding and destroying, since the
+// update thread looks handles up while it builds a frame.
+void resources_init();
+void resources_shutdown();
+void resources_endFrame();
+
+ModelHandle resources_addModel(Model* model);
+Model* resources_getModel(ModelHandle handle);
+void resources_destroyModel(ModelHandle handle);
+
+MeshHandle resources_meshHandle(ModelHandle model, unsigned int mesh);
+Mesh* resources_getMesh(MeshHandle handle);
+
+ShaderHandle resources_addShader(Shader* shader);
+Shader* resources_getShader(ShaderHandle handle);
+void resources_destroyShader(ShaderHandle handle);
+
+BufferHandle resources_createBuffer();
+unsigned int resources_getBuffer(BufferHandle handle);
+void resources_destroyBuffer(BufferHandle handle);
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <glad/glad.h>
+
+// Frames the CPU may run ahead of the GPU. Each gets its own section of the
+// buffer, so writing one frame never waits on the GPU reading another.
+#define RING_BUFFER_FRAMES 3
+
+// A buffer for data that changes every frame (uniform blocks, per-draw
+// transforms, instance data), mapped once for its whole life. Each frame
+// sub-allocates linearly from its section, and a fence per section makes
+// sure the GPU is done with it before it's written again.
+//
+// Without GL_ARB_buffer_storage the buffer can't stay mapped while drawing,
+// so allocations go to a CPU copy instead and are sent with glBufferSubData
+// when they're bound.
+typedef struct {
+    unsigned int buffer;
+    unsigned char* data; // Persistent mapping, or the CPU copy
+    bool persistent;
+
+    size_t sectionSize;
+    size_t alignment; // Offsets have to suit any binding, uniform blocks are usually the strictest
+
+    unsigned int frame; // Section being written
+    size_t head; // Next free byte in the section
+    size_t flushed; // Bytes of the section already sent, without persistent mapping
+    GLsync fences[RING_BUFFER_FRAMES];
+    double stallSeconds; // Spent waiting on fences, for whoever wants to report it
+
+} RingBuffer;
+
+RingBuffer* newRingBuffer(size_t sectionSize);
+void ringBufferFree(RingBuffer* ring);
+bool ringBufferReserve(RingBuffer* ring, size_t sectionSize);
+void ringBufferBeginFrame(RingBuffer* ring);
+void* ringBufferAlloc(RingBuffer* ring, size_t size, size_t* offset);
+void ringBufferBindRange(RingBuffer* ring, GLenum target, unsigned int binding, size_t offset, size_t size);
+void ringBufferEndFrame(RingBuffer* ring);
+
+#endif
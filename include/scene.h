@@ -0,0 +1,70 @@
+#ifndef SCENE_H
+#define SCENE_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "cglm/types.h"
+#include "frame.h"
+#include "model.h"
+#include "resources.h"
+
+#define SCENE_NO_PARENT -1
+
+// A model placed in the scene. Its file's node hierarchy became scene nodes
+// rootNode onwards, in the same order, so mesh->node is an offset from it.
+// Once the model is destroyed it's skipped.
+typedef struct {
+    ModelHandle model;
+    int rootNode;
+    size_t numNodes;
+} SceneModel;
+
+// Node hierarchy stored as flat arrays indexed by node, with every parent
+// before its children. That lets scene_updateTransforms() walk the arrays
+// once, front to back, and always find a parent's world matrix already up
+// to date.
+//
+// Setting a node's transform marks it dirty, and only dirty nodes and
+// their descendants are recomputed on the next update, through the batch
+// kernels in transform.h.
+typedef struct {
+    size_t numNodes;
+    size_t capacity;
+
+    int* parents;
+    char** names;
+
+    // Local transform, relative to the parent
+    vec3* positions;
+    versor* rotations;
+    vec3* scales;
+
+    mat4* localMatrices;
+    mat4* worldMatrices;
+    bool* dirty;
+
+    // Scratch list of the nodes recomputed by an update
+    unsigned int* dirtyNodes;
+
+    SceneModel* models;
+    size_t numModels;
+} Scene;
+
+Scene* newScene();
+int scene_addNode(Scene* scene, int parent, const char* name);
+int scene_addModel(Scene* scene, int parent, ModelHandle handle);
+int scene_findNode(Scene* scene, const char* name);
+
+void scene_setPosition(Scene* scene, int node, vec3 position);
+void scene_setRotation(Scene* scene, int node, versor rotation);
+void scene_setScale(Scene* scene, int node, vec3 scale);
+void scene_setLocalMatrix(Scene* scene, int node, mat4 local);
+
+void scene_updateTransforms(Scene* scene);
+void scene_modelBounds(Scene* scene, int sceneModel, vec4 dest);
+float scene_raycastModel(Scene* scene, int sceneModel, vec3 origin, vec3 direction, float maxDistance,
+    int* mesh, int* triangle);
+
+void scene_collectModel(Scene* scene, int sceneModel, FrameDrawList* dest);
+void scene_collectModelTransformed(Scene* scene, int sceneModel, mat4 transform, FrameDrawList* dest);
+
+#endif
@@ -1,6 +1,9 @@
 #ifndef SHADER_H
 #define SHADER_H
+#include <stdbool.h>
+#include <stddef.h>
 #include "cglm/types.h"
+#include "arena.h"
 
 typedef struct {
     unsigned int ID;
@@ -8,10 +11,27 @@ typedef struct {
     char* fragmentPath;
 } Shader;
 
+// Feature bits used to pick a variant out of a ShaderPermutation. The point
+// and spot light counts are packed into the low byte, everything else is a
+// flag that turns into an #ifdef in the shader source.
+#define SHADER_FEATURE_POINT_LIGHTS(n) ((unsigned int)(n) & 0xFu)
+#define SHADER_FEATURE_SPOT_LIGHTS(n)  (((unsigned int)(n) & 0xFu) << 4)
+#define SHADER_FEATURE_DIR_LIGHT       (1u << 8)
+#define SHADER_FEATURE_SPECULAR_MAP    (1u << 9)
+#define SHADER_FEATURE_EMISSION_MAP    (1u << 10)
+#define SHADER_FEATURE_TEXTURE_ARRAY   (1u << 11)
+#define SHADER_FEATURE_BINDLESS        (1u << 12)
+
+#define SHADER_FEATURE_GET_POINT_LIGHTS(features) ((features) & 0xFu)
+#define SHADER_FEATURE_GET_SPOT_LIGHTS(features)  (((features) >> 4) & 0xFu)
+
 char* getShaderSourceFromFile(const char* filePath);
+char* shaderInjectDefines(const char* source, const char* defines);
 unsigned int compileShaderProgram(char* vertexPath, char* fragmentPath);
+unsigned int compileShaderProgramFromSource(const char* vertexSource, const char* fragmentSource);
 
 Shader* newShader(char* vertexPath, char* fragmentPath);
+bool shaderReload(Shader* shader);
 void shaderUse(Shader* shader);
 void shaderSetInt(Shader* shader, const char* name, int value);
 void shaderSetFloat(Shader* shader, const char* name, float value);
@@ -19,6 +39,57 @@ void shaderSetVec3(Shader* shader, const char* name, vec3 vec);
 void shaderSetVec3f(Shader* shader, const char* name, float x, float y, float z);
 void shaderSetVec4(Shader* shader, const char* name, vec4 vec);
 void shaderSetMat4v(Shader* shader, const char* name, mat4 mat);
+void shaderBindUniformBlock(Shader* shader, const char* name, unsigned int binding);
+void shaderBindStandardBlocks(Shader* shader);
+
+// "name[index].property", allocated in arena (usually the frame's) so
+// there's nothing to free
+char* shaderGetUniformName(Arena* arena, const char* name, unsigned int index, const char* property);
+
+typedef struct {
+    Shader* shader;
+    unsigned int vertexShader;
+    unsigned int fragmentShader;
+} PendingShader;
+
+// A set of programs compiled together. Every glCompileShader/glLinkProgram
+// call is issued up front and nothing is checked until shaderBatchFinish(),
+// so the driver can work on them in the background while we load assets.
+typedef struct {
+    PendingShader* pending;
+    size_t numPending;
+    bool submitted;
+} ShaderBatch;
+
+ShaderBatch* newShaderBatch();
+Shader* shaderBatchAdd(ShaderBatch* batch, char* vertexPath, char* fragmentPath);
+Shader* shaderBatchAddSource(ShaderBatch* batch, const char* vertexSource, const char* fragmentSource, char* vertexPath, char* fragmentPath);
+void shaderBatchSubmit(ShaderBatch* batch);
+bool shaderBatchPoll(ShaderBatch* batch);
+bool shaderBatchFinish(ShaderBatch* batch);
+
+typedef struct {
+    unsigned int features;
+    Shader* shader;
+} ShaderVariant;
+
+// One vertex/fragment source pair compiled into many variants, one per
+// feature bitmask. Variants are compiled the first time they're asked for.
+typedef struct {
+    char* vertexPath;
+    char* fragmentPath;
+
+    char* vertexSource;
+    char* fragmentSource;
+
+    ShaderVariant* variants;
+    size_t numVariants;
+} ShaderPermutation;
 
-char* shaderGetUniformName(char* name, unsigned int index, char* property);
+ShaderPermutation* newShaderPermutation(char* vertexPath, char* fragmentPath);
+void shaderPermutationFree(ShaderPermutation* permutation);
+Shader* shaderPermutationGet(ShaderPermutation* permutation, unsigned int features);
+Shader* shaderPermutationRequest(ShaderPermutation* permutation, unsigned int features, ShaderBatch* batch);
+bool shaderPermutationReload(ShaderPermutation* permutation);
+char* shaderFeaturesToDefines(unsigned int features);
 #endif
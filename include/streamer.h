@@ -0,0 +1,99 @@
+#ifndef STREAMER_H
+#define STREAMER_H
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "cglm/types.h"
+#include "handle.h"
+#include "model.h"
+#include "resources.h"
+#include "texcache.h"
+#include "texture.h"
+
+#define STREAMER_MAX_THREADS 8
+
+// Requests outside the view are loaded as if they were this much further
+// away, so anything on screen goes first
+#define STREAMER_HIDDEN_DISTANCE 1000.0f
+
+typedef Handle StreamRequest;
+
+typedef enum {
+    STREAM_MODEL,
+    STREAM_TEXTURE,
+} StreamKind;
+
+typedef enum {
+    STREAM_QUEUED,
+    STREAM_LOADING, // On an I/O thread
+    STREAM_LOADED, // Being uploaded on the GL thread
+    STREAM_FAILED,
+} StreamState;
+
+// Called from streamer_update() once a request is in. Models come with a
+// handle the resource manager now owns, textures with a reference of their
+// own. Both are 0 if the file didn't load.
+typedef void (*StreamDoneFn)(StreamRequest request, ModelHandle model, TextureHandle texture, void* ctx);
+
+typedef struct {
+    StreamKind kind;
+    char* path;
+    vec3 center; // Where it'll be in the world, with its radius, to rank it by
+    float radius;
+    StreamDoneFn done;
+    void* ctx;
+
+    StreamState state;
+    atomic_bool cancelled;
+
+    // Loaded off the GL thread: the model's data and every texture image of
+    // its meshes in order, or the one image of a texture
+    Model* model;
+    TexCacheImage* images;
+    size_t numImages;
+
+    // Upload progress, in meshes and images handed over
+    size_t uploadedMeshes;
+    size_t uploadedImages;
+} StreamItem;
+
+// Loads models and textures on I/O threads of its own, so blocking reads
+// never hold up the job system, closest and on screen requests first. At
+// most maxInFlight requests are loaded and waiting for upload at once,
+// which bounds the memory held by decoded data. The GL side happens in
+// streamer_update(), a mesh or texture at a time until its time budget is
+// spent.
+//
+// Requests, cancels and updates are for the GL thread, between
+// framePipeline_wait() and framePipeline_submit() so done callbacks can
+// change the scene.
+typedef struct {
+    HandlePool* items; // StreamItem*, which stay put while the pool grows
+
+    pthread_t threads[STREAMER_MAX_THREADS];
+    int numThreads;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    bool quit;
+
+    size_t maxInFlight;
+    size_t inFlight;
+
+    vec3 viewer;
+    vec4 planes[6];
+    bool hasView;
+} Streamer;
+
+Streamer* newStreamer(int numThreads, size_t maxInFlight);
+void streamer_free(Streamer* streamer);
+StreamRequest streamer_requestModel(Streamer* streamer, const char* path, vec3 center, float radius,
+    StreamDoneFn done, void* ctx);
+StreamRequest streamer_requestTexture(Streamer* streamer, const char* path, vec3 center, float radius,
+    StreamDoneFn done, void* ctx);
+void streamer_cancel(Streamer* streamer, StreamRequest request);
+void streamer_setViewer(Streamer* streamer, vec3 position, mat4 viewProjection);
+void streamer_update(Streamer* streamer, double budgetSeconds);
+size_t streamer_numPending(Streamer* streamer);
+
+#endif
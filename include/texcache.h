@@ -0,0 +1,44 @@
+#ifndef TEXCACHE_H
+#define TEXCACHE_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "bcn.h"
+#include "mipmap.h"
+
+// Where decoded textures get cached, relative to the working directory
+extern const char* TEXCACHE_DIR;
+
+typedef struct {
+    const unsigned char* data;
+    size_t size;
+    int width;
+    int height;
+} TexCacheLevel;
+
+// A texture with its whole mip chain, laid out so it can be mmap'd and
+// handed to GL level by level without any parsing or copying.
+typedef struct {
+    bool compressed;        // BCn blocks when true, RGBA8 pixels otherwise
+    enum BCnFormat format;  // Only meaningful when compressed
+    int width;
+    int height;
+    int channels;           // What the source image had, before expanding to RGBA
+
+    TexCacheLevel levels[MIPMAP_MAX_LEVELS];
+    size_t numLevels;
+
+    void* mapping;
+    size_t mappingSize;
+
+    void* buffer; // Level storage owned by the image when it isn't mapped
+} TexCacheImage;
+
+uint64_t texcacheHash(const void* data, size_t size, uint64_t seed);
+void texcacheEntryPath(uint64_t hash, bool compressed, char* dest, size_t lenDest);
+
+bool texcacheOpen(const char* entryPath, TexCacheImage* image);
+void texcacheClose(TexCacheImage* image);
+bool texcacheWrite(const char* entryPath, uint64_t hash, const TexCacheImage* image);
+
+#endif
@@ -1,6 +1,52 @@
 #ifndef TEXTURE_H
 #define TEXTURE_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "texcache.h"
+
+extern bool TEXTURE_COMPRESSION;
+extern bool TEXTURE_STREAMING;
+extern size_t TEXTURE_STREAMING_BUDGET;
+extern size_t TEXTURE_STREAMING_UPLOAD_LIMIT;
+extern int TEXTURE_STREAMING_MIN_SIZE;
 
 int loadTexture(char* path);
+bool textureLoadInto(unsigned int* texture, const char* path);
+bool textureLoadImage(const char* path, TexCacheImage* image);
+unsigned int textureArrayCreate(const char** paths, size_t numPaths);
+
+// Textures carry no filtering or wrapping state of their own. Draws bind
+// one of these shared sampler objects to each unit they sample from.
+enum TextureSamplerMode {
+    TEXTURE_SAMPLER_DEFAULT, // Repeat, trilinear minification, nearest magnification
+    TEXTURE_SAMPLER_LINEAR, // Repeat, trilinear both ways
+    TEXTURE_SAMPLER_NEAREST, // Repeat, no filtering at all
+    TEXTURE_SAMPLER_COUNT,
+};
+
+unsigned int textureGetSampler(enum TextureSamplerMode mode);
+void textureBindSampler(unsigned int unit, enum TextureSamplerMode mode);
+
+// Textures shared by everything in the engine. Each file is loaded once no
+// matter how many models use it, looked up by a hash of its canonical path
+// and kept alive by reference counting. 0 is never a valid handle.
+typedef unsigned int TextureHandle;
+
+TextureHandle textureAcquire(const char* path);
+TextureHandle textureAcquireImage(const char* path, TexCacheImage* image);
+TextureHandle textureFind(const char* path);
+void textureRetain(TextureHandle handle);
+void textureRelease(TextureHandle handle);
+unsigned int textureGetID(TextureHandle handle);
+const char* textureGetPath(TextureHandle handle);
+bool textureReload(TextureHandle handle);
+uint64_t textureGetBindlessHandle(TextureHandle handle);
+bool textureIsResident(TextureHandle handle);
+size_t textureNumLoaded();
+
+void textureRequestUVDensity(TextureHandle handle, float uvPerPixel);
+void textureStreamUpdate();
+size_t textureStreamResidentSize();
 
 #endif
@@ -0,0 +1,24 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+#include <stddef.h>
+#include "cglm/types.h"
+
+// Batch transform kernels over arrays with one entry per object. With AVX2
+// (checked at run time) composing does eight objects at a time, and
+// multiplying does two columns of a product at a time. Otherwise they fall
+// back to plain C and cglm. bench/transform.c times them against cglm.
+//
+// indices picks which objects to work on, in order. Passing NULL means all
+// of them from 0 to count - 1.
+
+// dest[i] = translate(positions[i]) * rotate(rotations[i]) * scale(scales[i])
+void transformBatchCompose(const vec3* positions, const versor* rotations, const vec3* scales,
+    const unsigned int* indices, size_t count, mat4* dest);
+
+// dest[i] = parentMatrices[parents[i]] * locals[i], or just locals[i] where
+// parents[i] is negative. dest may be parentMatrices, in which case no
+// object in the batch can be the parent of another one in it.
+void transformBatchMultiply(const mat4* parentMatrices, const int* parents, const mat4* locals,
+    const unsigned int* indices, size_t count, mat4* dest);
+
+#endif
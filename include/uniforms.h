@@ -0,0 +1,42 @@
+#ifndef UNIFORMS_H
+#define UNIFORMS_H
+#include <stdbool.h>
+#include "cglm/types.h"
+#include "ringbuffer.h"
+
+// Uniform blocks shared by the engine's shaders, laid out to match std140.
+// Shaders get these bindings as soon as they link, see shaderBatchFinish().
+#define UNIFORM_BINDING_MATERIALS 0
+#define UNIFORM_BINDING_FRAME 1
+#define UNIFORM_BINDING_DRAW 2
+#define UNIFORM_BINDING_LIGHTS 3
+
+// FrameData, written once per frame
+typedef struct {
+    mat4 view;
+    mat4 projection;
+} FrameUniforms;
+
+// DrawData, written for every draw that changes transform
+typedef struct {
+    mat4 model;
+    mat4 normalMatrix; // transpose(inverse(view * model)), only the 3x3 is used
+} DrawUniforms;
+
+// LightData in shaders/lit/lit.frag. vec3s take 16 bytes in std140.
+typedef struct {
+    vec4 direction;
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+} DirLightUniforms;
+
+typedef struct {
+    DirLightUniforms dirLight;
+} LightUniforms;
+
+void uniformsComputeDraw(DrawUniforms* dest, mat4 model, mat4 view);
+bool uniformsUploadDraw(RingBuffer* ring, const DrawUniforms* draw);
+bool uniformsBindDraw(RingBuffer* ring, mat4 model, mat4 view);
+
+#endif
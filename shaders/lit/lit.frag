@@ -0,0 +1,250 @@
+#version 330 core
+
+// This shader is compiled as a ShaderPermutation. The following are injected
+// by the engine right after the #version line, depending on the variant:
+//
+//   NR_POINT_LIGHTS    Number of point lights (0 disables the code path)
+//   NR_SPOT_LIGHTS     Number of spot lights (0 disables the code path)
+//   HAS_DIR_LIGHT      Evaluate the directional light
+//   HAS_SPECULAR_MAP   Sample texture_specular1, otherwise no specular term
+//   HAS_EMISSION_MAP   Add texture_emission1 on top of the lighting
+//   USE_TEXTURE_ARRAY  Sample materials from the model's texture array using
+//                      diffuseLayer/specularLayer instead of separate samplers
+//   USE_BINDLESS_TEXTURES  Sample materials through bindless handles stored in
+//                      the Materials block, indexed by materialIndex
+
+#ifdef USE_BINDLESS_TEXTURES
+#extension GL_ARB_bindless_texture : require
+#endif
+
+#ifndef NR_POINT_LIGHTS
+#define NR_POINT_LIGHTS 0
+#endif
+
+#ifndef NR_SPOT_LIGHTS
+#define NR_SPOT_LIGHTS 0
+#endif
+
+#define SHININESS (0.5 * 128.0) // TODO: pass this value through somehow
+
+struct DirLight {
+    vec3 direction;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct SpotLight {
+    vec3 position;
+    vec3 direction;
+    float cutOff; // Angle of the cone of the spotlight
+    float outerCutOff; // Angle of the cone of the spotlight
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+
+    float constant;
+    float linear;
+    float quadratic;
+};
+
+struct PointLight {
+    vec3 position;
+
+    float constant;
+    float linear;
+    float quadratic;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+in vec3 FragPos;
+in vec3 Normal;
+in vec2 TexCoords;
+
+#ifdef HAS_DIR_LIGHT
+layout(std140) uniform LightData {
+    DirLight dirLight;
+};
+#endif
+
+#if NR_POINT_LIGHTS > 0
+uniform PointLight pointLights[NR_POINT_LIGHTS];
+#endif
+
+#if NR_SPOT_LIGHTS > 0
+uniform SpotLight spotLights[NR_SPOT_LIGHTS];
+#endif
+
+#if defined(USE_BINDLESS_TEXTURES)
+// Must match MODEL_MAX_BINDLESS_MATERIALS and ModelMaterial in model.c
+#define MAX_MATERIALS 1024
+struct Material {
+    uvec2 diffuse; // 0 when the mesh has no such map
+    uvec2 specular;
+};
+layout(std140) uniform Materials {
+    Material materials[MAX_MATERIALS];
+};
+uniform int materialIndex;
+#elif defined(USE_TEXTURE_ARRAY)
+uniform sampler2DArray materialTextures;
+uniform int diffuseLayer;
+uniform int specularLayer; // -1 when the mesh has no specular map
+#else
+uniform sampler2D texture_diffuse1;
+#ifdef HAS_SPECULAR_MAP
+uniform sampler2D texture_specular1;
+#endif
+#endif
+#ifdef HAS_EMISSION_MAP
+uniform sampler2D texture_emission1;
+#endif
+
+out vec4 FragColor;
+
+// Material inputs are sampled once per fragment and shared by every light.
+vec3 albedo;
+vec3 specularColor;
+
+float CalcSpecular(vec3 lightDir, vec3 normal, vec3 viewDir)
+{
+#ifdef HAS_SPECULAR_MAP
+    vec3 reflectDir = reflect(-lightDir, normal);
+    return pow(max(dot(viewDir, reflectDir), 0.0), SHININESS);
+#else
+    return 0.0;
+#endif
+}
+
+#ifdef HAS_DIR_LIGHT
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
+{
+    vec3 lightDir = normalize(-light.direction);
+
+    float diff = max(dot(normal, lightDir), 0.0);
+    float spec = CalcSpecular(lightDir, normal, viewDir);
+
+    vec3 ambient = light.ambient * albedo;
+    vec3 diffuse = light.diffuse * diff * albedo;
+    vec3 specular = light.specular * spec * specularColor;
+
+    return (ambient + diffuse + specular);
+}
+#endif
+
+#if NR_POINT_LIGHTS > 0
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+{
+    vec3 lightDir = normalize(light.position - fragPos);
+
+    float diff = max(dot(normal, lightDir), 0.0);
+    float spec = CalcSpecular(lightDir, normal, viewDir);
+
+    float distance = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.constant + light.linear * distance
+                + light.quadratic * (distance * distance));
+
+    vec3 ambient = light.ambient * albedo;
+    vec3 diffuse = light.diffuse * diff * albedo;
+    vec3 specular = light.specular * spec * specularColor;
+
+    return (ambient + diffuse + specular) * attenuation;
+}
+#endif
+
+#if NR_SPOT_LIGHTS > 0
+vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+{
+    vec3 ambient = light.ambient * albedo;
+
+    vec3 lightDir = normalize(light.position - fragPos);
+    float theta = dot(lightDir, normalize(-light.direction));
+    if (theta <= light.outerCutOff)
+    {
+        // Use ambient light so scene isn't completely dark outside the spotlight.
+        return ambient;
+    }
+
+    float epsilon = light.cutOff - light.outerCutOff;
+    float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
+
+    float diff = max(dot(normal, lightDir), 0.0);
+    float spec = CalcSpecular(lightDir, normal, viewDir);
+
+    float distance = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.constant + light.linear * distance
+                + light.quadratic * (distance * distance));
+
+    vec3 diffuse = light.diffuse * diff * albedo;
+    vec3 specular = light.specular * spec * specularColor;
+
+    return ambient + (diffuse + specular) * intensity * attenuation;
+}
+#endif
+
+void main()
+{
+    vec3 viewPos = vec3(0.0);
+
+    // properties
+    vec3 norm = normalize(Normal);
+    vec3 viewDir = normalize(viewPos - FragPos);
+
+#if defined(USE_BINDLESS_TEXTURES)
+    Material material = materials[materialIndex];
+    albedo = material.diffuse == uvec2(0) ? vec3(0.0)
+        : vec3(texture(sampler2D(material.diffuse), TexCoords));
+#ifdef HAS_SPECULAR_MAP
+    specularColor = material.specular == uvec2(0) ? vec3(0.0)
+        : vec3(texture(sampler2D(material.specular), TexCoords));
+#else
+    specularColor = vec3(0.0);
+#endif
+#elif defined(USE_TEXTURE_ARRAY)
+    albedo = vec3(texture(materialTextures, vec3(TexCoords, diffuseLayer)));
+#ifdef HAS_SPECULAR_MAP
+    specularColor = specularLayer < 0 ? vec3(0.0)
+        : vec3(texture(materialTextures, vec3(TexCoords, specularLayer)));
+#else
+    specularColor = vec3(0.0);
+#endif
+#else
+    albedo = vec3(texture(texture_diffuse1, TexCoords));
+#ifdef HAS_SPECULAR_MAP
+    specularColor = vec3(texture(texture_specular1, TexCoords));
+#else
+    specularColor = vec3(0.0);
+#endif
+#endif
+
+    vec3 result = vec3(0.0);
+
+#ifdef HAS_DIR_LIGHT
+    result += CalcDirLight(dirLight, norm, viewDir);
+#endif
+
+#if NR_POINT_LIGHTS > 0
+    for (int i = 0; i < NR_POINT_LIGHTS; i++)
+    {
+        result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);
+    }
+#endif
+
+#if NR_SPOT_LIGHTS > 0
+    for (int i = 0; i < NR_SPOT_LIGHTS; i++)
+    {
+        result += CalcSpotLight(spotLights[i], norm, FragPos, viewDir);
+    }
+#endif
+
+#ifdef HAS_EMISSION_MAP
+    result += vec3(texture(texture_emission1, TexCoords));
+#endif
+
+    FragColor = vec4(result, 1.0);
+}
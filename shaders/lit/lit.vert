@@ -0,0 +1,31 @@
+#version 330 core
+layout(location = 0) in vec3 aPos;
+layout(location = 1) in vec3 aNormal;
+layout(location = 2) in vec2 aTexCoords;
+
+// Filled from the engine's ring buffer, see include/uniforms.h
+layout(std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+};
+
+layout(std140) uniform DrawData {
+    mat4 model;
+    mat4 normalMatrix;
+};
+
+out vec2 TexCoords;
+out vec3 FragPos;
+out vec3 Normal;
+
+void main()
+{
+    gl_Position = projection * view * model * vec4(aPos, 1.0);
+
+    // Send texture coords to fragment shader
+    TexCoords = aTexCoords;
+
+    // Do lighting calculations in view space
+    FragPos = vec3(view * model * vec4(aPos, 1.0));
+    Normal = mat3(normalMatrix) * aNormal;
+}
@@ -2,9 +2,17 @@
 layout(location = 0) in vec3 aPos;
 layout(location = 1) in vec3 aNormal;
 layout(location = 2) in vec2 aTexCoords;
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+// Filled from the engine's ring buffer, see include/uniforms.h
+layout(std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+};
+
+layout(std140) uniform DrawData {
+    mat4 model;
+    mat4 normalMatrix;
+};
 
 out vec2 TexCoords;
 out vec3 FragPos;
@@ -19,5 +27,5 @@ void main()
 
     // Do lighting calculations in view space
     FragPos = vec3(view * model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(view * model))) * aNormal;
+    Normal = mat3(normalMatrix) * aNormal;
 }
@@ -0,0 +1,174 @@
+#include "arena.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static atomic_size_t heapAllocationCount = 0;
+
+static _Thread_local Arena* scratchArena = NULL;
+
+void* heapAlloc(size_t size)
+{
+    atomic_fetch_add_explicit(&heapAllocationCount, 1, memory_order_relaxed);
+    return malloc(size);
+}
+
+void* heapCalloc(size_t count, size_t size)
+{
+    atomic_fetch_add_explicit(&heapAllocationCount, 1, memory_order_relaxed);
+    return calloc(count, size);
+}
+
+void* heapRealloc(void* ptr, size_t size)
+{
+    atomic_fetch_add_explicit(&heapAllocationCount, 1, memory_order_relaxed);
+    return realloc(ptr, size);
+}
+
+void* heapAlignedAlloc(size_t alignment, size_t size)
+{
+    atomic_fetch_add_explicit(&heapAllocationCount, 1, memory_order_relaxed);
+    return aligned_alloc(alignment, size);
+}
+
+size_t heapAllocations()
+{
+    return atomic_load_explicit(&heapAllocationCount, memory_order_relaxed);
+}
+
+static ArenaBlock* newArenaBlock(size_t size)
+{
+    ArenaBlock* block = heapAlloc(sizeof(ArenaBlock) + size);
+    if (block == NULL)
+    {
+        printf("Failed to allocate %zu bytes for an arena\n", size);
+        return NULL;
+    }
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+// The first block comes in the same allocation as the arena, so an arena
+// that never outgrows it costs one trip to the heap
+Arena* newArena(size_t blockSize)
+{
+    blockSize = blockSize > 0 ? blockSize : ARENA_DEFAULT_BLOCK_SIZE;
+    size_t blockOffset = (sizeof(Arena) + _Alignof(ArenaBlock) - 1) & ~(_Alignof(ArenaBlock) - 1);
+    Arena* arena = heapAlloc(blockOffset + sizeof(ArenaBlock) + blockSize);
+    if (arena == NULL)
+    {
+        printf("Failed to allocate %zu bytes for an arena\n", blockSize);
+        return NULL;
+    }
+
+    arena->blockSize = blockSize;
+    arena->first = (ArenaBlock*)((unsigned char*)arena + blockOffset);
+    arena->first->next = NULL;
+    arena->first->size = blockSize;
+    arena->first->used = 0;
+    arena->current = arena->first;
+    return arena;
+}
+
+void arenaFree(Arena* arena)
+{
+    if (arena == NULL)
+    {
+        return;
+    }
+    ArenaBlock* block = arena->first->next;
+    while (block)
+    {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    free(arena);
+}
+
+// Alignment is a power of two, up to the 16 the blocks themselves start at
+void* arenaAlloc(Arena* arena, size_t size, size_t alignment)
+{
+    ArenaBlock* block = arena->current;
+    size_t offset = (block->used + alignment - 1) & ~(alignment - 1);
+    while (offset + size > block->size)
+    {
+        // Blocks left from before a rewind get reused if they're big enough.
+        // One that's too small stays where it is for smaller frames.
+        if (block->next == NULL || block->next->size < size)
+        {
+            size_t blockSize = size > arena->blockSize ? size : arena->blockSize;
+            ArenaBlock* fresh = newArenaBlock(blockSize);
+            if (fresh == NULL)
+            {
+                return NULL;
+            }
+            fresh->next = block->next;
+            block->next = fresh;
+        }
+        block = block->next;
+        block->used = 0;
+        offset = 0;
+    }
+
+    block->used = offset + size;
+    arena->current = block;
+    return block->data + offset;
+}
+
+char* arenaPrintf(Arena* arena, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if (length < 0)
+    {
+        return NULL;
+    }
+
+    char* string = arenaAlloc(arena, length + 1, 1);
+    if (string)
+    {
+        va_start(args, format);
+        vsnprintf(string, length + 1, format, args);
+        va_end(args);
+    }
+    return string;
+}
+
+void arenaReset(Arena* arena)
+{
+    arena->current = arena->first;
+    arena->current->used = 0;
+}
+
+ArenaMark arenaMark(Arena* arena)
+{
+    ArenaMark mark = { arena->current, arena->current->used };
+    return mark;
+}
+
+void arenaRewind(Arena* arena, ArenaMark mark)
+{
+    arena->current = mark.block;
+    arena->current->used = mark.used;
+}
+
+Arena* arenaScratch()
+{
+    if (scratchArena == NULL)
+    {
+        scratchArena = newArena(ARENA_DEFAULT_BLOCK_SIZE);
+    }
+    return scratchArena;
+}
+
+// For threads that are about to exit
+void arenaScratchRelease()
+{
+    arenaFree(scratchArena);
+    scratchArena = NULL;
+}
@@ -0,0 +1,261 @@
+#include "bcn.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A small BC1/BC3/BC4/BC5 encoder. It fits color endpoints along the principal
+// axis of each block and picks the nearest palette entry for every pixel.
+// That's nowhere near as good as a real offline compressor, but it's cheap
+// enough to run on first load and looks fine on diffuse and specular maps.
+// https://learn.microsoft.com/en-us/windows/win32/direct3d10/d3d10-graphics-programming-guide-resources-block-compression
+
+size_t bcnBlockSize(enum BCnFormat format)
+{
+    switch (format) {
+        case BCN_BC1:
+        case BCN_BC4:
+            return 8;
+        default:
+            return 16;
+    }
+}
+
+size_t bcnImageSize(enum BCnFormat format, int width, int height)
+{
+    size_t blocksX = (width + 3) / 4;
+    size_t blocksY = (height + 3) / 4;
+    return blocksX * blocksY * bcnBlockSize(format);
+}
+
+static uint16_t bcnPack565(const float color[3])
+{
+    int r = (int)(color[0] * 31.0f / 255.0f + 0.5f);
+    int g = (int)(color[1] * 63.0f / 255.0f + 0.5f);
+    int b = (int)(color[2] * 31.0f / 255.0f + 0.5f);
+    r = r < 0 ? 0 : (r > 31 ? 31 : r);
+    g = g < 0 ? 0 : (g > 63 ? 63 : g);
+    b = b < 0 ? 0 : (b > 31 ? 31 : b);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static void bcnUnpack565(uint16_t packed, int color[3])
+{
+    int r = (packed >> 11) & 31;
+    int g = (packed >> 5) & 63;
+    int b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+static void bcnWrite16(unsigned char* dest, uint16_t value)
+{
+    dest[0] = value & 0xFF;
+    dest[1] = value >> 8;
+}
+
+// 16 RGBA pixels in, 8 bytes of BC1 out. Always uses the 4 color mode.
+static void bcnEncodeColorBlock(const unsigned char block[16][4], unsigned char* dest)
+{
+    float mean[3] = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; i++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            mean[c] += block[i][c] / 16.0f;
+        }
+    }
+
+    // Covariance of the block's colors, then a few rounds of power iteration
+    // to find the axis the colors are spread along.
+    float cov[6] = { 0 };
+    for (int i = 0; i < 16; i++)
+    {
+        float r = block[i][0] - mean[0];
+        float g = block[i][1] - mean[1];
+        float b = block[i][2] - mean[2];
+        cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+        cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+    }
+
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for (int iter = 0; iter < 4; iter++)
+    {
+        float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+        float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+        float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+        float len = sqrtf(x * x + y * y + z * z);
+        if (len < 1e-6f)
+        {
+            break;
+        }
+        axis[0] = x / len;
+        axis[1] = y / len;
+        axis[2] = z / len;
+    }
+
+    float minProj = INFINITY;
+    float maxProj = -INFINITY;
+    for (int i = 0; i < 16; i++)
+    {
+        float proj = (block[i][0] - mean[0]) * axis[0]
+                   + (block[i][1] - mean[1]) * axis[1]
+                   + (block[i][2] - mean[2]) * axis[2];
+        minProj = proj < minProj ? proj : minProj;
+        maxProj = proj > maxProj ? proj : maxProj;
+    }
+
+    // Pull the endpoints in a bit, the extremes are usually outliers
+    float inset = (maxProj - minProj) / 16.0f;
+    minProj += inset;
+    maxProj -= inset;
+
+    float maxColor[3], minColor[3];
+    for (int c = 0; c < 3; c++)
+    {
+        maxColor[c] = mean[c] + axis[c] * maxProj;
+        minColor[c] = mean[c] + axis[c] * minProj;
+    }
+
+    uint16_t color0 = bcnPack565(maxColor);
+    uint16_t color1 = bcnPack565(minColor);
+    if (color0 < color1)
+    {
+        uint16_t tmp = color0;
+        color0 = color1;
+        color1 = tmp;
+    }
+
+    uint32_t indices = 0;
+    if (color0 != color1)
+    {
+        int palette[4][3];
+        bcnUnpack565(color0, palette[0]);
+        bcnUnpack565(color1, palette[1]);
+        for (int c = 0; c < 3; c++)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0;
+            int bestDist = 0x7FFFFFFF;
+            for (int p = 0; p < 4; p++)
+            {
+                int dr = block[i][0] - palette[p][0];
+                int dg = block[i][1] - palette[p][1];
+                int db = block[i][2] - palette[p][2];
+                int dist = dr * dr + dg * dg + db * db;
+                if (dist < bestDist)
+                {
+                    bestDist = dist;
+                    best = p;
+                }
+            }
+            indices |= (uint32_t)best << (2 * i);
+        }
+    }
+
+    bcnWrite16(dest, color0);
+    bcnWrite16(dest + 2, color1);
+    dest[4] = indices & 0xFF;
+    dest[5] = (indices >> 8) & 0xFF;
+    dest[6] = (indices >> 16) & 0xFF;
+    dest[7] = (indices >> 24) & 0xFF;
+}
+
+// 16 pixels of one channel in, 8 bytes of BC4 out. Uses the 8 value mode.
+static void bcnEncodeChannelBlock(const unsigned char block[16][4], int channel, unsigned char* dest)
+{
+    int minValue = 255;
+    int maxValue = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        int v = block[i][channel];
+        minValue = v < minValue ? v : minValue;
+        maxValue = v > maxValue ? v : maxValue;
+    }
+
+    uint64_t indices = 0;
+    if (maxValue != minValue)
+    {
+        int palette[8];
+        palette[0] = maxValue;
+        palette[1] = minValue;
+        for (int p = 1; p < 7; p++)
+        {
+            palette[p + 1] = ((7 - p) * maxValue + p * minValue) / 7;
+        }
+
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0;
+            int bestDist = 256;
+            for (int p = 0; p < 8; p++)
+            {
+                int dist = abs(block[i][channel] - palette[p]);
+                if (dist < bestDist)
+                {
+                    bestDist = dist;
+                    best = p;
+                }
+            }
+            indices |= (uint64_t)best << (3 * i);
+        }
+    }
+
+    dest[0] = maxValue;
+    dest[1] = minValue;
+    for (int b = 0; b < 6; b++)
+    {
+        dest[2 + b] = (indices >> (8 * b)) & 0xFF;
+    }
+}
+
+void bcnEncode(enum BCnFormat format, const unsigned char* rgba, int width, int height, unsigned char* dest)
+{
+    size_t blockSize = bcnBlockSize(format);
+
+    for (int by = 0; by < height; by += 4)
+    {
+        for (int bx = 0; bx < width; bx += 4)
+        {
+            // Gather the block, clamping at the edges of images that aren't
+            // a multiple of 4 wide or tall.
+            unsigned char block[16][4];
+            for (int y = 0; y < 4; y++)
+            {
+                int sy = by + y < height ? by + y : height - 1;
+                for (int x = 0; x < 4; x++)
+                {
+                    int sx = bx + x < width ? bx + x : width - 1;
+                    memcpy(block[y * 4 + x], &rgba[((size_t)sy * width + sx) * 4], 4);
+                }
+            }
+
+            switch (format) {
+                case BCN_BC1:
+                    bcnEncodeColorBlock(block, dest);
+                    break;
+                case BCN_BC3:
+                    bcnEncodeChannelBlock(block, 3, dest);
+                    bcnEncodeColorBlock(block, dest + 8);
+                    break;
+                case BCN_BC4:
+                    bcnEncodeChannelBlock(block, 0, dest);
+                    break;
+                case BCN_BC5:
+                    bcnEncodeChannelBlock(block, 0, dest);
+                    bcnEncodeChannelBlock(block, 1, dest + 8);
+                    break;
+                default:
+                    memset(dest, 0, blockSize);
+                    break;
+            }
+            dest += blockSize;
+        }
+    }
+}
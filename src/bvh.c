@@ -0,0 +1,504 @@
+#include "bvh.h"
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cglm/cglm.h"
+#include "arena.h"
+
+// Buckets item centers are sorted into when looking for the best split
+#define BVH_BINS 16
+// Cost of visiting a node, relative to testing one item. Going by
+// bench/bvh.c, leaves of a few items beat leaves of one for every query.
+#define BVH_TRAVERSAL_COST 4.0f
+
+typedef struct {
+    vec3 min;
+    vec3 max;
+    unsigned int count;
+} BvhBin;
+
+Bvh* newBvh()
+{
+    return heapCalloc(1, sizeof(Bvh));
+}
+
+void bvh_free(Bvh* bvh)
+{
+    free(bvh->nodes);
+    free(bvh->items);
+    free(bvh->itemMins);
+    free(bvh->itemMaxs);
+    free(bvh);
+}
+
+static float bvh_area(vec3 min, vec3 max)
+{
+    vec3 size;
+    glm_vec3_sub(max, min, size);
+    if (size[0] < 0.0f || size[1] < 0.0f || size[2] < 0.0f)
+    {
+        return 0.0f;
+    }
+    return size[0] * size[1] + size[1] * size[2] + size[2] * size[0];
+}
+
+static void bvh_emptyBounds(vec3 min, vec3 max)
+{
+    glm_vec3_fill(min, FLT_MAX);
+    glm_vec3_fill(max, -FLT_MAX);
+}
+
+static void bvh_growBounds(vec3 min, vec3 max, vec3 otherMin, vec3 otherMax)
+{
+    glm_vec3_minv(min, otherMin, min);
+    glm_vec3_maxv(max, otherMax, max);
+}
+
+static void bvh_fitLeaf(Bvh* bvh, BvhNode* node)
+{
+    bvh_emptyBounds(node->min, node->max);
+    for (unsigned int i = node->first; i < node->first + node->count; i++)
+    {
+        unsigned int item = bvh->items[i];
+        bvh_growBounds(node->min, node->max, bvh->itemMins[item], bvh->itemMaxs[item]);
+    }
+}
+
+static void bvh_subdivide(Bvh* bvh, unsigned int nodeIndex, int depth)
+{
+    BvhNode* node = &bvh->nodes[nodeIndex];
+    if (node->count <= 1 || depth >= BVH_MAX_DEPTH)
+    {
+        return;
+    }
+
+    vec3 centerMin, centerMax;
+    bvh_emptyBounds(centerMin, centerMax);
+    for (unsigned int i = node->first; i < node->first + node->count; i++)
+    {
+        unsigned int item = bvh->items[i];
+        vec3 center;
+        glm_vec3_center(bvh->itemMins[item], bvh->itemMaxs[item], center);
+        bvh_growBounds(centerMin, centerMax, center, center);
+    }
+
+    // Bin the item centers along each axis and pick the split between bins
+    // with the lowest surface area cost
+    float bestCost = FLT_MAX;
+    int bestAxis = -1;
+    int bestSplit = 0;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float extent = centerMax[axis] - centerMin[axis];
+        if (extent <= 0.0f)
+        {
+            continue;
+        }
+
+        BvhBin bins[BVH_BINS];
+        for (int b = 0; b < BVH_BINS; b++)
+        {
+            bvh_emptyBounds(bins[b].min, bins[b].max);
+            bins[b].count = 0;
+        }
+
+        float scale = BVH_BINS / extent;
+        for (unsigned int i = node->first; i < node->first + node->count; i++)
+        {
+            unsigned int item = bvh->items[i];
+            float center = (bvh->itemMins[item][axis] + bvh->itemMaxs[item][axis]) * 0.5f;
+            int b = glm_min((int)((center - centerMin[axis]) * scale), BVH_BINS - 1);
+            bins[b].count++;
+            bvh_growBounds(bins[b].min, bins[b].max, bvh->itemMins[item], bvh->itemMaxs[item]);
+        }
+
+        // Sweep from both ends so each split's cost is one lookup
+        float leftArea[BVH_BINS - 1], rightArea[BVH_BINS - 1];
+        unsigned int leftCount[BVH_BINS - 1], rightCount[BVH_BINS - 1];
+        vec3 leftMin, leftMax, rightMin, rightMax;
+        bvh_emptyBounds(leftMin, leftMax);
+        bvh_emptyBounds(rightMin, rightMax);
+        unsigned int leftSum = 0, rightSum = 0;
+        for (int b = 0; b < BVH_BINS - 1; b++)
+        {
+            leftSum += bins[b].count;
+            bvh_growBounds(leftMin, leftMax, bins[b].min, bins[b].max);
+            leftCount[b] = leftSum;
+            leftArea[b] = bvh_area(leftMin, leftMax);
+
+            rightSum += bins[BVH_BINS - 1 - b].count;
+            bvh_growBounds(rightMin, rightMax, bins[BVH_BINS - 1 - b].min, bins[BVH_BINS - 1 - b].max);
+            rightCount[BVH_BINS - 2 - b] = rightSum;
+            rightArea[BVH_BINS - 2 - b] = bvh_area(rightMin, rightMax);
+        }
+
+        for (int split = 0; split < BVH_BINS - 1; split++)
+        {
+            float cost = leftCount[split] * leftArea[split] + rightCount[split] * rightArea[split];
+            if (leftCount[split] > 0 && rightCount[split] > 0 && cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = split;
+            }
+        }
+    }
+
+    // Every center in the same place, or splitting costs more than testing
+    // everything in one leaf. Boxes with no area (items along a line) give
+    // the heuristic nothing to go on, so those always split.
+    float area = bvh_area(node->min, node->max);
+    if (bestAxis < 0 || (area > 0.0f && bestCost + BVH_TRAVERSAL_COST * area >= node->count * area))
+    {
+        return;
+    }
+
+    float scale = BVH_BINS / (centerMax[bestAxis] - centerMin[bestAxis]);
+    unsigned int i = node->first;
+    unsigned int j = node->first + node->count;
+    while (i < j)
+    {
+        unsigned int item = bvh->items[i];
+        float center = (bvh->itemMins[item][bestAxis] + bvh->itemMaxs[item][bestAxis]) * 0.5f;
+        int b = glm_min((int)((center - centerMin[bestAxis]) * scale), BVH_BINS - 1);
+        if (b <= bestSplit)
+        {
+            i++;
+        }
+        else
+        {
+            bvh->items[i] = bvh->items[--j];
+            bvh->items[j] = item;
+        }
+    }
+
+    unsigned int leftCount = i - node->first;
+    if (leftCount == 0 || leftCount == node->count)
+    {
+        return;
+    }
+
+    unsigned int left = bvh->numNodes;
+    bvh->numNodes += 2;
+    bvh->nodes[left].first = node->first;
+    bvh->nodes[left].count = leftCount;
+    bvh->nodes[left + 1].first = i;
+    bvh->nodes[left + 1].count = node->count - leftCount;
+    node->first = left;
+    node->count = 0;
+
+    bvh_fitLeaf(bvh, &bvh->nodes[left]);
+    bvh_fitLeaf(bvh, &bvh->nodes[left + 1]);
+    bvh_subdivide(bvh, left, depth + 1);
+    bvh_subdivide(bvh, left + 1, depth + 1);
+}
+
+void bvh_build(Bvh* bvh, const vec3* mins, const vec3* maxs, size_t count)
+{
+    if (count > bvh->capacity)
+    {
+        bvh->capacity = count;
+        bvh->nodes = heapRealloc(bvh->nodes, sizeof(BvhNode) * (count * 2 - 1));
+        bvh->items = heapRealloc(bvh->items, sizeof(unsigned int) * count);
+        bvh->itemMins = heapRealloc(bvh->itemMins, sizeof(vec3) * count);
+        bvh->itemMaxs = heapRealloc(bvh->itemMaxs, sizeof(vec3) * count);
+    }
+
+    bvh->numItems = count;
+    bvh->numNodes = 0;
+    if (count == 0)
+    {
+        return;
+    }
+
+    memcpy(bvh->itemMins, mins, sizeof(vec3) * count);
+    memcpy(bvh->itemMaxs, maxs, sizeof(vec3) * count);
+    for (size_t i = 0; i < count; i++)
+    {
+        bvh->items[i] = i;
+    }
+
+    bvh->numNodes = 1;
+    bvh->nodes[0].first = 0;
+    bvh->nodes[0].count = count;
+    bvh_fitLeaf(bvh, &bvh->nodes[0]);
+    bvh_subdivide(bvh, 0, 0);
+}
+
+void bvh_refit(Bvh* bvh, const vec3* mins, const vec3* maxs)
+{
+    memcpy(bvh->itemMins, mins, sizeof(vec3) * bvh->numItems);
+    memcpy(bvh->itemMaxs, maxs, sizeof(vec3) * bvh->numItems);
+
+    for (size_t i = bvh->numNodes; i-- > 0;)
+    {
+        BvhNode* node = &bvh->nodes[i];
+        if (node->count > 0)
+        {
+            bvh_fitLeaf(bvh, node);
+            continue;
+        }
+
+        BvhNode* left = &bvh->nodes[node->first];
+        BvhNode* right = &bvh->nodes[node->first + 1];
+        glm_vec3_minv(left->min, right->min, node->min);
+        glm_vec3_maxv(left->max, right->max, node->max);
+    }
+}
+
+static size_t bvh_emitAll(Bvh* bvh, BvhNode* node, unsigned int* dest, size_t found)
+{
+    BvhNode* stack[BVH_MAX_DEPTH + 1];
+    int top = 0;
+    stack[top++] = node;
+    while (top > 0)
+    {
+        node = stack[--top];
+        if (node->count > 0)
+        {
+            memcpy(&dest[found], &bvh->items[node->first], sizeof(unsigned int) * node->count);
+            found += node->count;
+            continue;
+        }
+        stack[top++] = &bvh->nodes[node->first];
+        stack[top++] = &bvh->nodes[node->first + 1];
+    }
+    return found;
+}
+
+// Which planes the box is partly behind. Sets *outside if it's all the way
+// behind one of them. Planes not in mask are already known to be clear.
+static unsigned int bvh_boxPlanes(vec4 planes[6], unsigned int mask, vec3 min, vec3 max, bool* outside)
+{
+    unsigned int crossing = 0;
+    for (int p = 0; p < 6; p++)
+    {
+        if (!(mask & (1u << p)))
+        {
+            continue;
+        }
+
+        // Corners furthest along and furthest against the plane's normal
+        vec3 ahead, behind;
+        for (int k = 0; k < 3; k++)
+        {
+            ahead[k] = planes[p][k] >= 0.0f ? max[k] : min[k];
+            behind[k] = planes[p][k] >= 0.0f ? min[k] : max[k];
+        }
+        if (glm_vec3_dot(planes[p], ahead) + planes[p][3] < 0.0f)
+        {
+            *outside = true;
+            return 0;
+        }
+        if (glm_vec3_dot(planes[p], behind) + planes[p][3] < 0.0f)
+        {
+            crossing |= 1u << p;
+        }
+    }
+    *outside = false;
+    return crossing;
+}
+
+// Nodes entirely inside the frustum hand over everything below them
+// without further tests, and planes a node is clear of aren't tested again
+// for its children
+size_t bvh_queryFrustum(Bvh* bvh, vec4 planes[6], unsigned int* dest)
+{
+    if (bvh->numNodes == 0)
+    {
+        return 0;
+    }
+
+    BvhNode* stack[BVH_MAX_DEPTH + 1];
+    unsigned int masks[BVH_MAX_DEPTH + 1];
+    int top = 0;
+    size_t found = 0;
+    stack[top] = &bvh->nodes[0];
+    masks[top++] = 0x3F;
+    while (top > 0)
+    {
+        top--;
+        BvhNode* node = stack[top];
+        bool outside;
+        unsigned int mask = bvh_boxPlanes(planes, masks[top], node->min, node->max, &outside);
+        if (outside)
+        {
+            continue;
+        }
+        if (mask == 0)
+        {
+            found = bvh_emitAll(bvh, node, dest, found);
+            continue;
+        }
+
+        if (node->count > 0)
+        {
+            for (unsigned int i = node->first; i < node->first + node->count; i++)
+            {
+                unsigned int item = bvh->items[i];
+                bvh_boxPlanes(planes, mask, bvh->itemMins[item], bvh->itemMaxs[item], &outside);
+                if (!outside)
+                {
+                    dest[found++] = item;
+                }
+            }
+            continue;
+        }
+
+        stack[top] = &bvh->nodes[node->first];
+        masks[top++] = mask;
+        stack[top] = &bvh->nodes[node->first + 1];
+        masks[top++] = mask;
+    }
+    return found;
+}
+
+static bool bvh_boxTouchesSphere(vec3 min, vec3 max, vec3 center, float radius)
+{
+    vec3 closest;
+    glm_vec3_maxv(min, center, closest);
+    glm_vec3_minv(max, closest, closest);
+    return glm_vec3_distance2(closest, center) <= radius * radius;
+}
+
+size_t bvh_querySphere(Bvh* bvh, vec3 center, float radius, unsigned int* dest)
+{
+    if (bvh->numNodes == 0)
+    {
+        return 0;
+    }
+
+    BvhNode* stack[BVH_MAX_DEPTH + 1];
+    int top = 0;
+    size_t found = 0;
+    stack[top++] = &bvh->nodes[0];
+    while (top > 0)
+    {
+        BvhNode* node = stack[--top];
+        if (!bvh_boxTouchesSphere(node->min, node->max, center, radius))
+        {
+            continue;
+        }
+
+        if (node->count > 0)
+        {
+            for (unsigned int i = node->first; i < node->first + node->count; i++)
+            {
+                unsigned int item = bvh->items[i];
+                if (bvh_boxTouchesSphere(bvh->itemMins[item], bvh->itemMaxs[item], center, radius))
+                {
+                    dest[found++] = item;
+                }
+            }
+            continue;
+        }
+
+        stack[top++] = &bvh->nodes[node->first];
+        stack[top++] = &bvh->nodes[node->first + 1];
+    }
+    return found;
+}
+
+// Distance to where the ray enters the box, FLT_MAX if it misses it or
+// only gets there after maxDistance
+static float bvh_rayBox(vec3 origin, vec3 inverseDirection, vec3 min, vec3 max, float maxDistance)
+{
+    float enter = 0.0f;
+    float exit = maxDistance;
+    for (int k = 0; k < 3; k++)
+    {
+        float t0 = (min[k] - origin[k]) * inverseDirection[k];
+        float t1 = (max[k] - origin[k]) * inverseDirection[k];
+        enter = fmaxf(enter, fminf(t0, t1));
+        exit = fminf(exit, fmaxf(t0, t1));
+    }
+    return enter <= exit ? enter : FLT_MAX;
+}
+
+int bvh_raycast(Bvh* bvh, vec3 origin, vec3 direction, float maxDistance, BvhRayTest test, void* user,
+    float* distance)
+{
+    if (bvh->numNodes == 0)
+    {
+        return -1;
+    }
+
+    vec3 inverseDirection;
+    for (int k = 0; k < 3; k++)
+    {
+        inverseDirection[k] = 1.0f / direction[k];
+    }
+
+    int hit = -1;
+    float closest = maxDistance;
+    BvhNode* stack[BVH_MAX_DEPTH + 1];
+    float entries[BVH_MAX_DEPTH + 1];
+    int top = 0;
+    entries[top] = bvh_rayBox(origin, inverseDirection, bvh->nodes[0].min, bvh->nodes[0].max, closest);
+    stack[top++] = &bvh->nodes[0];
+    while (top > 0)
+    {
+        top--;
+        BvhNode* node = stack[top];
+        if (entries[top] > closest)
+        {
+            continue;
+        }
+
+        if (node->count > 0)
+        {
+            for (unsigned int i = node->first; i < node->first + node->count; i++)
+            {
+                unsigned int item = bvh->items[i];
+                float t = bvh_rayBox(origin, inverseDirection, bvh->itemMins[item], bvh->itemMaxs[item], closest);
+                if (t == FLT_MAX)
+                {
+                    continue;
+                }
+                if (test)
+                {
+                    t = test(item, origin, direction, user);
+                }
+                if (t >= 0.0f && t < closest)
+                {
+                    closest = t;
+                    hit = item;
+                }
+            }
+            continue;
+        }
+
+        // Push the nearer child last so it's visited first, which lets hits
+        // in it rule out the other one
+        BvhNode* left = &bvh->nodes[node->first];
+        BvhNode* right = &bvh->nodes[node->first + 1];
+        float leftEntry = bvh_rayBox(origin, inverseDirection, left->min, left->max, closest);
+        float rightEntry = bvh_rayBox(origin, inverseDirection, right->min, right->max, closest);
+        if (leftEntry < rightEntry)
+        {
+            BvhNode* swapNode = left;
+            left = right;
+            right = swapNode;
+            float swapEntry = leftEntry;
+            leftEntry = rightEntry;
+            rightEntry = swapEntry;
+        }
+        if (leftEntry != FLT_MAX)
+        {
+            stack[top] = left;
+            entries[top++] = leftEntry;
+        }
+        if (rightEntry != FLT_MAX)
+        {
+            stack[top] = right;
+            entries[top++] = rightEntry;
+        }
+    }
+
+    if (hit >= 0 && distance)
+    {
+        *distance = closest;
+    }
+    return hit;
+}
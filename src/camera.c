@@ -1,6 +1,7 @@
 #include "camera.h"
 #include "cglm/io.h"
 #include "cglm/vec3.h"
+#include "arena.h"
 
 float CAMERA_MAX_FOV = 90.0f;
 float CAMERA_SPEED = 1.0f;
@@ -30,7 +31,7 @@ Camera* newCameraWithDefaults()
 
 Camera* newCamera(vec3 pos, vec3 front, vec3 up, float yaw, float pitch)
 {
-    Camera* camera = malloc(sizeof(Camera));
+    Camera* camera = heapAlloc(sizeof(Camera));
     glm_vec3_copy(pos, camera->pos);
     glm_vec3_copy(front, camera->front);
     glm_vec3_copy(up, camera->up);
@@ -50,6 +51,18 @@ void cameraGetViewMatrix(Camera* camera, mat4 view)
     glm_lookat(camera->pos, center, camera->up, view);
 }
 
+// World space ray from the near plane through window position x, y, which
+// counts down from the top like GLFW's cursor does. direction is normalized.
+void cameraScreenRay(mat4 viewProjection, vec4 viewport, float x, float y, vec3 origin, vec3 direction)
+{
+    vec3 nearPoint = { x, viewport[3] - y, 0.0f };
+    vec3 farPoint = { x, viewport[3] - y, 1.0f };
+    glm_unproject(nearPoint, viewProjection, viewport, origin);
+    glm_unproject(farPoint, viewProjection, viewport, farPoint);
+    glm_vec3_sub(farPoint, origin, direction);
+    glm_vec3_normalize(direction);
+}
+
 void cameraProcessKeyboard(Camera* camera, enum CameraMovement direction, float deltaTime)
 {
     vec3 cameraSpeedXCameraFront;
@@ -0,0 +1,278 @@
+#include "commands.h"
+#include <glad/glad.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cglm/cglm.h"
+#include "arena.h"
+#include "model.h"
+
+// Every command starts on this boundary so mat4s in them stay aligned
+#define COMMAND_ALIGNMENT 16
+
+enum CommandType {
+    COMMAND_USE_SHADER,
+    COMMAND_BIND_UNIFORM_BUFFER,
+    COMMAND_BIND_TEXTURE,
+    COMMAND_BIND_TEXTURE_HANDLE,
+    COMMAND_SET_INT,
+    COMMAND_SET_DRAW_UNIFORMS,
+    COMMAND_DRAW_MESH,
+};
+
+typedef struct {
+    enum CommandType type;
+    unsigned int size; // Header included, up to the next command
+} CommandHeader;
+
+typedef struct {
+    CommandHeader header;
+    Shader* shader;
+} CommandUseShader;
+
+typedef struct {
+    CommandHeader header;
+    unsigned int binding;
+    const unsigned int* buffer;
+} CommandBindUniformBuffer;
+
+typedef struct {
+    CommandHeader header;
+    unsigned int unit;
+    unsigned int target;
+    const unsigned int* texture;
+} CommandBindTexture;
+
+typedef struct {
+    CommandHeader header;
+    unsigned int unit;
+    TextureHandle texture;
+} CommandBindTextureHandle;
+
+typedef struct {
+    CommandHeader header;
+    Shader* shader;
+    int value;
+    char name[]; // Null terminated
+} CommandSetInt;
+
+typedef struct {
+    CommandHeader header;
+    DrawUniforms uniforms;
+} CommandSetDrawUniforms;
+
+typedef struct {
+    CommandHeader header;
+    Model* model;
+    unsigned int mesh;
+} CommandDrawMesh;
+
+CommandBuffer* newCommandBuffer()
+{
+    return heapCalloc(1, sizeof(CommandBuffer));
+}
+
+void commandBufferFree(CommandBuffer* commands)
+{
+    free(commands->data);
+    free(commands);
+}
+
+void commandBufferReset(CommandBuffer* commands)
+{
+    commands->size = 0;
+}
+
+// Room for a command of size bytes, header filled in. Returns NULL if the
+// buffer couldn't grow, leaving it as it was.
+static void* commandBufferPush(CommandBuffer* commands, enum CommandType type, size_t size)
+{
+    size = (size + COMMAND_ALIGNMENT - 1) & ~(size_t)(COMMAND_ALIGNMENT - 1);
+    if (commands->size + size > commands->capacity)
+    {
+        size_t capacity = commands->capacity ? commands->capacity * 2 : 4096;
+        while (commands->size + size > capacity)
+        {
+            capacity *= 2;
+        }
+
+        // Plain realloc only promises alignment for the largest basic type
+        unsigned char* data = heapAlignedAlloc(COMMAND_ALIGNMENT, capacity);
+        if (data == NULL)
+        {
+            printf("Failed to allocate %zu bytes for commands\n", capacity);
+            return NULL;
+        }
+        if (commands->data)
+        {
+            memcpy(data, commands->data, commands->size);
+            free(commands->data);
+        }
+        commands->data = data;
+        commands->capacity = capacity;
+    }
+
+    CommandHeader* header = (CommandHeader*)&commands->data[commands->size];
+    header->type = type;
+    header->size = size;
+    commands->size += size;
+    return header;
+}
+
+void commandBufferUseShader(CommandBuffer* commands, Shader* shader)
+{
+    CommandUseShader* command = commandBufferPush(commands, COMMAND_USE_SHADER, sizeof(CommandUseShader));
+    if (command == NULL)
+    {
+        return;
+    }
+    command->shader = shader;
+}
+
+void commandBufferBindUniformBuffer(CommandBuffer* commands, unsigned int binding, const unsigned int* buffer)
+{
+    CommandBindUniformBuffer* command = commandBufferPush(commands, COMMAND_BIND_UNIFORM_BUFFER, sizeof(CommandBindUniformBuffer));
+    if (command == NULL)
+    {
+        return;
+    }
+    command->binding = binding;
+    command->buffer = buffer;
+}
+
+void commandBufferBindTexture(CommandBuffer* commands, unsigned int unit, unsigned int target, const unsigned int* texture)
+{
+    CommandBindTexture* command = commandBufferPush(commands, COMMAND_BIND_TEXTURE, sizeof(CommandBindTexture));
+    if (command == NULL)
+    {
+        return;
+    }
+    command->unit = unit;
+    command->target = target;
+    command->texture = texture;
+}
+
+void commandBufferBindTextureHandle(CommandBuffer* commands, unsigned int unit, TextureHandle texture)
+{
+    CommandBindTextureHandle* command = commandBufferPush(commands, COMMAND_BIND_TEXTURE_HANDLE, sizeof(CommandBindTextureHandle));
+    if (command == NULL)
+    {
+        return;
+    }
+    command->unit = unit;
+    command->texture = texture;
+}
+
+void commandBufferSetInt(CommandBuffer* commands, Shader* shader, const char* name, int value)
+{
+    size_t nameSize = strlen(name) + 1;
+    CommandSetInt* command = commandBufferPush(commands, COMMAND_SET_INT, sizeof(CommandSetInt) + nameSize);
+    if (command == NULL)
+    {
+        return;
+    }
+    command->shader = shader;
+    command->value = value;
+    memcpy(command->name, name, nameSize);
+}
+
+void commandBufferSetDrawUniforms(CommandBuffer* commands, mat4 model, mat4 view)
+{
+    CommandSetDrawUniforms* command = commandBufferPush(commands, COMMAND_SET_DRAW_UNIFORMS, sizeof(CommandSetDrawUniforms));
+    if (command == NULL)
+    {
+        return;
+    }
+    uniformsComputeDraw(&command->uniforms, model, view);
+}
+
+void commandBufferDrawMesh(CommandBuffer* commands, Model* model, unsigned int mesh)
+{
+    CommandDrawMesh* command = commandBufferPush(commands, COMMAND_DRAW_MESH, sizeof(CommandDrawMesh));
+    if (command == NULL)
+    {
+        return;
+    }
+    command->model = model;
+    command->mesh = mesh;
+}
+
+void commandBufferExecute(CommandBuffer* commands, RingBuffer* ring)
+{
+    // Set while the DrawData block doesn't hold the transform the next
+    // draws were recorded with
+    bool skipDraws = false;
+    size_t offset = 0;
+    while (offset < commands->size)
+    {
+        CommandHeader* header = (CommandHeader*)&commands->data[offset];
+        offset += header->size;
+
+        switch (header->type)
+        {
+        case COMMAND_USE_SHADER:
+        {
+            CommandUseShader* command = (CommandUseShader*)header;
+            shaderUse(command->shader);
+            break;
+        }
+        case COMMAND_BIND_UNIFORM_BUFFER:
+        {
+            CommandBindUniformBuffer* command = (CommandBindUniformBuffer*)header;
+            glBindBufferBase(GL_UNIFORM_BUFFER, command->binding, *command->buffer);
+            break;
+        }
+        case COMMAND_BIND_TEXTURE:
+        {
+            CommandBindTexture* command = (CommandBindTexture*)header;
+            glActiveTexture(GL_TEXTURE0 + command->unit);
+            glBindTexture(command->target, *command->texture);
+            textureBindSampler(command->unit, TEXTURE_SAMPLER_DEFAULT);
+            glActiveTexture(GL_TEXTURE0);
+            break;
+        }
+        case COMMAND_BIND_TEXTURE_HANDLE:
+        {
+            // The registry's ID is current even if a reload had to replace it
+            CommandBindTextureHandle* command = (CommandBindTextureHandle*)header;
+            glActiveTexture(GL_TEXTURE0 + command->unit);
+            glBindTexture(GL_TEXTURE_2D, textureGetID(command->texture));
+            textureBindSampler(command->unit, TEXTURE_SAMPLER_DEFAULT);
+            glActiveTexture(GL_TEXTURE0);
+            break;
+        }
+        case COMMAND_SET_INT:
+        {
+            CommandSetInt* command = (CommandSetInt*)header;
+            shaderSetInt(command->shader, command->name, command->value);
+            break;
+        }
+        case COMMAND_SET_DRAW_UNIFORMS:
+        {
+            CommandSetDrawUniforms* command = (CommandSetDrawUniforms*)header;
+            if (ring)
+            {
+                skipDraws = !uniformsUploadDraw(ring, &command->uniforms);
+            }
+            break;
+        }
+        case COMMAND_DRAW_MESH:
+        {
+            // A hot reload since recording can leave fewer meshes
+            CommandDrawMesh* command = (CommandDrawMesh*)header;
+            if (skipDraws || command->mesh >= command->model->numMeshes)
+            {
+                break;
+            }
+            Mesh* mesh = &command->model->meshes[command->mesh];
+            glBindVertexArray(mesh->VAO);
+            glDrawElements(GL_TRIANGLES, mesh->numIndices, GL_UNSIGNED_INT, 0);
+            glBindVertexArray(0);
+            break;
+        }
+        default:
+            printf("Unknown command %d in command buffer\n", header->type);
+            return;
+        }
+    }
+}
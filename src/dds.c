@@ -0,0 +1,262 @@
+#include "dds.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+// Just enough of the DDS format for block compressed 2D textures with mips.
+// https://learn.microsoft.com/en-us/windows/win32/direct3ddds/dds-header
+
+#define DDS_MAGIC 0x20534444 // "DDS "
+#define DDS_HEADER_SIZE 124
+#define DDS_PIXELFORMAT_SIZE 32
+
+#define DDSD_CAPS        0x1
+#define DDSD_HEIGHT      0x2
+#define DDSD_WIDTH       0x4
+#define DDSD_PIXELFORMAT 0x1000
+#define DDSD_MIPMAPCOUNT 0x20000
+#define DDSD_LINEARSIZE  0x80000
+
+#define DDPF_FOURCC 0x4
+
+#define DDSCAPS_COMPLEX 0x8
+#define DDSCAPS_TEXTURE 0x1000
+#define DDSCAPS_MIPMAP  0x400000
+
+#define DDS_FOURCC(a, b, c, d) ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+#define DXGI_FORMAT_BC1_UNORM      71
+#define DXGI_FORMAT_BC1_UNORM_SRGB 72
+#define DXGI_FORMAT_BC3_UNORM      77
+#define DXGI_FORMAT_BC3_UNORM_SRGB 78
+#define DXGI_FORMAT_BC4_UNORM      80
+#define DXGI_FORMAT_BC5_UNORM      83
+#define DXGI_FORMAT_BC7_UNORM      98
+#define DXGI_FORMAT_BC7_UNORM_SRGB 99
+
+// Word offsets into the header, counted after the magic
+enum {
+    DDS_SIZE = 0,
+    DDS_FLAGS = 1,
+    DDS_HEIGHT = 2,
+    DDS_WIDTH = 3,
+    DDS_LINEAR_SIZE = 4,
+    DDS_MIPMAP_COUNT = 6,
+    DDS_PF_SIZE = 18,
+    DDS_PF_FLAGS = 19,
+    DDS_PF_FOURCC = 20,
+    DDS_CAPS = 26,
+    DDS_HEADER_WORDS = 31,
+};
+
+static bool ddsFormatFromFourCC(uint32_t fourCC, enum BCnFormat* format)
+{
+    if (fourCC == DDS_FOURCC('D', 'X', 'T', '1'))
+        *format = BCN_BC1;
+    else if (fourCC == DDS_FOURCC('D', 'X', 'T', '5'))
+        *format = BCN_BC3;
+    else if (fourCC == DDS_FOURCC('A', 'T', 'I', '1') || fourCC == DDS_FOURCC('B', 'C', '4', 'U'))
+        *format = BCN_BC4;
+    else if (fourCC == DDS_FOURCC('A', 'T', 'I', '2') || fourCC == DDS_FOURCC('B', 'C', '5', 'U'))
+        *format = BCN_BC5;
+    else
+        return false;
+    return true;
+}
+
+static bool ddsFormatFromDXGI(uint32_t dxgiFormat, enum BCnFormat* format)
+{
+    switch (dxgiFormat) {
+        case DXGI_FORMAT_BC1_UNORM:
+        case DXGI_FORMAT_BC1_UNORM_SRGB:
+            *format = BCN_BC1;
+            return true;
+        case DXGI_FORMAT_BC3_UNORM:
+        case DXGI_FORMAT_BC3_UNORM_SRGB:
+            *format = BCN_BC3;
+            return true;
+        case DXGI_FORMAT_BC4_UNORM:
+            *format = BCN_BC4;
+            return true;
+        case DXGI_FORMAT_BC5_UNORM:
+            *format = BCN_BC5;
+            return true;
+        case DXGI_FORMAT_BC7_UNORM:
+        case DXGI_FORMAT_BC7_UNORM_SRGB:
+            *format = BCN_BC7;
+            return true;
+        default:
+            return false;
+    }
+}
+
+static uint32_t ddsFourCCFromFormat(enum BCnFormat format)
+{
+    switch (format) {
+        case BCN_BC1: return DDS_FOURCC('D', 'X', 'T', '1');
+        case BCN_BC3: return DDS_FOURCC('D', 'X', 'T', '5');
+        case BCN_BC4: return DDS_FOURCC('A', 'T', 'I', '1');
+        case BCN_BC5: return DDS_FOURCC('A', 'T', 'I', '2');
+        default:      return DDS_FOURCC('D', 'X', '1', '0');
+    }
+}
+
+// Reads the DDS file in data, which the levels point into and which has to
+// stay around as long as they do. path is only for messages.
+bool ddsParse(const char* path, const unsigned char* fileData, size_t size, DDSImage* image)
+{
+    uint32_t header[DDS_HEADER_WORDS];
+    if (size < 4 + DDS_HEADER_SIZE)
+    {
+        printf("DDS file %s is truncated\n", path);
+        return false;
+    }
+
+    uint32_t magic;
+    memcpy(&magic, fileData, 4);
+    memcpy(header, fileData + 4, DDS_HEADER_SIZE);
+    if (magic != DDS_MAGIC || header[DDS_SIZE] != DDS_HEADER_SIZE || !(header[DDS_PF_FLAGS] & DDPF_FOURCC))
+    {
+        printf("%s is not a block compressed DDS file\n", path);
+        return false;
+    }
+
+    size_t offset = 4 + DDS_HEADER_SIZE;
+    bool knownFormat;
+    if (header[DDS_PF_FOURCC] == DDS_FOURCC('D', 'X', '1', '0'))
+    {
+        uint32_t dxgiFormat;
+        memcpy(&dxgiFormat, fileData + offset, 4);
+        offset += 20;
+        knownFormat = ddsFormatFromDXGI(dxgiFormat, &image->format);
+    }
+    else
+    {
+        knownFormat = ddsFormatFromFourCC(header[DDS_PF_FOURCC], &image->format);
+    }
+
+    if (!knownFormat)
+    {
+        printf("DDS file %s uses a format we can't load\n", path);
+        return false;
+    }
+
+    image->width = header[DDS_WIDTH];
+    image->height = header[DDS_HEIGHT];
+    image->numLevels = (header[DDS_FLAGS] & DDSD_MIPMAPCOUNT) && header[DDS_MIPMAP_COUNT] > 0 ? header[DDS_MIPMAP_COUNT] : 1;
+    image->levels = heapAlloc(sizeof(DDSLevel) * image->numLevels);
+    image->fileData = NULL;
+
+    int width = image->width;
+    int height = image->height;
+    for (size_t i = 0; i < image->numLevels; i++)
+    {
+        size_t levelSize = bcnImageSize(image->format, width, height);
+        if (offset + levelSize > size)
+        {
+            // Keep whatever complete levels we got
+            printf("DDS file %s is missing mip levels past %zu\n", path, i);
+            image->numLevels = i;
+            break;
+        }
+
+        image->levels[i].data = fileData + offset;
+        image->levels[i].size = levelSize;
+        image->levels[i].width = width;
+        image->levels[i].height = height;
+
+        offset += levelSize;
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+
+    if (image->numLevels == 0)
+    {
+        ddsFree(image);
+        return false;
+    }
+
+    return true;
+}
+
+bool ddsRead(const char* path, DDSImage* image)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    fseek(file, 0L, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0L, SEEK_SET);
+
+    unsigned char* fileData = heapAlloc(size);
+    size_t read = fread(fileData, 1, size, file);
+    fclose(file);
+
+    if (read != (size_t)size || !ddsParse(path, fileData, size, image))
+    {
+        free(fileData);
+        return false;
+    }
+    image->fileData = fileData;
+    return true;
+}
+
+void ddsFree(DDSImage* image)
+{
+    free(image->levels);
+    free(image->fileData);
+    image->levels = NULL;
+    image->fileData = NULL;
+    image->numLevels = 0;
+}
+
+// Writes a mip chain that was encoded with bcnEncode(). levels[0] is the full
+// size image and every level after it is half the size of the one before.
+bool ddsWrite(const char* path, enum BCnFormat format, int width, int height, unsigned char** levels, size_t numLevels)
+{
+    if (format == BCN_BC7)
+    {
+        printf("Writing BC7 DDS files isn't supported\n");
+        return false;
+    }
+
+    FILE* file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        printf("Unable to write %s\n", path);
+        return false;
+    }
+
+    uint32_t magic = DDS_MAGIC;
+    uint32_t header[DDS_HEADER_WORDS];
+    memset(header, 0, sizeof(header));
+    header[DDS_SIZE] = DDS_HEADER_SIZE;
+    header[DDS_FLAGS] = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+    header[DDS_HEIGHT] = height;
+    header[DDS_WIDTH] = width;
+    header[DDS_LINEAR_SIZE] = bcnImageSize(format, width, height);
+    header[DDS_MIPMAP_COUNT] = numLevels;
+    header[DDS_PF_SIZE] = DDS_PIXELFORMAT_SIZE;
+    header[DDS_PF_FLAGS] = DDPF_FOURCC;
+    header[DDS_PF_FOURCC] = ddsFourCCFromFormat(format);
+    header[DDS_CAPS] = DDSCAPS_TEXTURE | (numLevels > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0);
+
+    fwrite(&magic, 4, 1, file);
+    fwrite(header, DDS_HEADER_SIZE, 1, file);
+
+    for (size_t i = 0; i < numLevels; i++)
+    {
+        fwrite(levels[i], 1, bcnImageSize(format, width, height), file);
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+
+    bool success = ferror(file) == 0;
+    fclose(file);
+    return success;
+}
@@ -0,0 +1,431 @@
+#include "ecs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cglm/cglm.h"
+#include "arena.h"
+
+EcsWorld* newEcsWorld(Scene* scene)
+{
+    EcsWorld* world = heapCalloc(1, sizeof(EcsWorld));
+    world->scene = scene;
+    world->nextEntity = 1;
+    world->boundsBvh = newBvh();
+    world->boundsGrid = newGrid(ECS_GRID_CELL_SIZE);
+    return world;
+}
+
+static bool ecs_has(EcsPool* pool, Entity entity)
+{
+    return entity < pool->numIndices && pool->indices[entity] != 0;
+}
+
+static size_t ecs_index(EcsPool* pool, Entity entity)
+{
+    return pool->indices[entity] - 1;
+}
+
+// Gives the entity a slot at the end of the pool. Returns true if the pool
+// grew, in which case its component arrays have to grow to capacity too.
+static bool ecs_poolAdd(EcsPool* pool, Entity entity, size_t* index)
+{
+    if (entity >= pool->numIndices)
+    {
+        size_t numIndices = pool->numIndices ? pool->numIndices : 64;
+        while (numIndices <= entity)
+        {
+            numIndices *= 2;
+        }
+        pool->indices = heapRealloc(pool->indices, sizeof(unsigned int) * numIndices);
+        memset(&pool->indices[pool->numIndices], 0, sizeof(unsigned int) * (numIndices - pool->numIndices));
+        pool->numIndices = numIndices;
+    }
+
+    bool grew = false;
+    if (pool->count == pool->capacity)
+    {
+        pool->capacity = pool->capacity ? pool->capacity * 2 : 64;
+        pool->entities = heapRealloc(pool->entities, sizeof(Entity) * pool->capacity);
+        grew = true;
+    }
+
+    *index = pool->count++;
+    pool->entities[*index] = entity;
+    pool->indices[entity] = *index + 1;
+    return grew;
+}
+
+// Takes the entity out by moving the last slot into its place. Returns
+// false if it wasn't there, otherwise the caller moves component data from
+// *last to *removed.
+static bool ecs_poolRemove(EcsPool* pool, Entity entity, size_t* removed, size_t* last)
+{
+    if (!ecs_has(pool, entity))
+    {
+        return false;
+    }
+
+    *removed = ecs_index(pool, entity);
+    *last = --pool->count;
+    Entity moved = pool->entities[*last];
+    pool->entities[*removed] = moved;
+    pool->indices[moved] = *removed + 1;
+    pool->indices[entity] = 0;
+    return true;
+}
+
+Entity ecs_createEntity(EcsWorld* world)
+{
+    if (world->numFreeEntities > 0)
+    {
+        return world->freeEntities[--world->numFreeEntities];
+    }
+    return world->nextEntity++;
+}
+
+void ecs_destroyEntity(EcsWorld* world, Entity entity)
+{
+    size_t removed, last;
+    if (ecs_poolRemove(&world->transforms, entity, &removed, &last))
+    {
+        world->transformNodes[removed] = world->transformNodes[last];
+    }
+    if (ecs_poolRemove(&world->renderables, entity, &removed, &last))
+    {
+        world->renderableModels[removed] = world->renderableModels[last];
+        world->renderableOutlined[removed] = world->renderableOutlined[last];
+    }
+    if (ecs_has(&world->bounds, entity) && world->boundsDynamic[ecs_index(&world->bounds, entity)])
+    {
+        grid_remove(world->boundsGrid, entity);
+    }
+    if (ecs_poolRemove(&world->bounds, entity, &removed, &last))
+    {
+        glm_vec4_copy(world->boundsSpheres[last], world->boundsSpheres[removed]);
+        glm_vec3_copy(world->boundsMins[last], world->boundsMins[removed]);
+        glm_vec3_copy(world->boundsMaxs[last], world->boundsMaxs[removed]);
+        world->boundsDynamic[removed] = world->boundsDynamic[last];
+        world->boundsVisible[removed] = world->boundsVisible[last];
+        world->boundsBvhStale = true;
+    }
+    if (ecs_poolRemove(&world->lights, entity, &removed, &last))
+    {
+        world->lightDirs[removed] = world->lightDirs[last];
+    }
+
+    world->freeEntities = heapRealloc(world->freeEntities, sizeof(Entity) * (world->numFreeEntities + 1));
+    world->freeEntities[world->numFreeEntities++] = entity;
+}
+
+void ecs_addTransform(EcsWorld* world, Entity entity, int node)
+{
+    size_t i;
+    if (ecs_has(&world->transforms, entity))
+    {
+        i = ecs_index(&world->transforms, entity);
+    }
+    else if (ecs_poolAdd(&world->transforms, entity, &i))
+    {
+        world->transformNodes = heapRealloc(world->transformNodes, sizeof(int) * world->transforms.capacity);
+    }
+    world->transformNodes[i] = node;
+}
+
+void ecs_addRenderable(EcsWorld* world, Entity entity, int sceneModel, bool outlined)
+{
+    size_t i;
+    if (ecs_has(&world->renderables, entity))
+    {
+        i = ecs_index(&world->renderables, entity);
+    }
+    else if (ecs_poolAdd(&world->renderables, entity, &i))
+    {
+        world->renderableModels = heapRealloc(world->renderableModels, sizeof(int) * world->renderables.capacity);
+        world->renderableOutlined = heapRealloc(world->renderableOutlined, sizeof(bool) * world->renderables.capacity);
+    }
+    world->renderableModels[i] = sceneModel;
+    world->renderableOutlined[i] = outlined;
+}
+
+// Bounds are worked out by ecs_updateBounds(), visible until the first
+// cull. Dynamic ones are for things expected to move most frames.
+void ecs_addBounds(EcsWorld* world, Entity entity, bool dynamic)
+{
+    size_t i;
+    if (ecs_has(&world->bounds, entity))
+    {
+        return;
+    }
+    if (ecs_poolAdd(&world->bounds, entity, &i))
+    {
+        world->boundsSpheres = heapRealloc(world->boundsSpheres, sizeof(vec4) * world->bounds.capacity);
+        world->boundsMins = heapRealloc(world->boundsMins, sizeof(vec3) * world->bounds.capacity);
+        world->boundsMaxs = heapRealloc(world->boundsMaxs, sizeof(vec3) * world->bounds.capacity);
+        world->boundsDynamic = heapRealloc(world->boundsDynamic, sizeof(bool) * world->bounds.capacity);
+        world->boundsVisible = heapRealloc(world->boundsVisible, sizeof(bool) * world->bounds.capacity);
+        world->boundsStatic = heapRealloc(world->boundsStatic, sizeof(unsigned int) * world->bounds.capacity);
+        world->boundsStaticMins = heapRealloc(world->boundsStaticMins, sizeof(vec3) * world->bounds.capacity);
+        world->boundsStaticMaxs = heapRealloc(world->boundsStaticMaxs, sizeof(vec3) * world->bounds.capacity);
+        world->boundsFound = heapRealloc(world->boundsFound, sizeof(unsigned int) * world->bounds.capacity);
+    }
+    glm_vec4_zero(world->boundsSpheres[i]);
+    glm_vec3_zero(world->boundsMins[i]);
+    glm_vec3_zero(world->boundsMaxs[i]);
+    world->boundsDynamic[i] = dynamic;
+    world->boundsVisible[i] = true;
+    world->boundsBvhStale = true;
+}
+
+void ecs_addLight(EcsWorld* world, Entity entity, DirLight* light)
+{
+    size_t i;
+    if (ecs_has(&world->lights, entity))
+    {
+        i = ecs_index(&world->lights, entity);
+    }
+    else if (ecs_poolAdd(&world->lights, entity, &i))
+    {
+        world->lightDirs = heapRealloc(world->lightDirs, sizeof(DirLight) * world->lights.capacity);
+    }
+    world->lightDirs[i] = *light;
+}
+
+// Scene node of the entity, -1 if it has no transform
+int ecs_getTransform(EcsWorld* world, Entity entity)
+{
+    if (!ecs_has(&world->transforms, entity))
+    {
+        return -1;
+    }
+    return world->transformNodes[ecs_index(&world->transforms, entity)];
+}
+
+void ecs_setOutlined(EcsWorld* world, Entity entity, bool outlined)
+{
+    if (ecs_has(&world->renderables, entity))
+    {
+        world->renderableOutlined[ecs_index(&world->renderables, entity)] = outlined;
+    }
+}
+
+static float ecs_rayEntity(EcsWorld* world, Entity entity, vec3 origin, vec3 direction, float maxDistance,
+    int* mesh, int* triangle)
+{
+    if (!ecs_has(&world->renderables, entity))
+    {
+        return -1.0f;
+    }
+    int sceneModel = world->renderableModels[ecs_index(&world->renderables, entity)];
+    return scene_raycastModel(world->scene, sceneModel, origin, direction, maxDistance, mesh, triangle);
+}
+
+typedef struct {
+    EcsWorld* world;
+    float maxDistance;
+} EcsRayContext;
+
+static float ecs_rayStatic(unsigned int item, vec3 origin, vec3 direction, void* user)
+{
+    EcsRayContext* context = user;
+    Entity entity = context->world->bounds.entities[context->world->boundsStatic[item]];
+    return ecs_rayEntity(context->world, entity, origin, direction, context->maxDistance, NULL, NULL);
+}
+
+static float ecs_rayDynamic(unsigned int item, vec3 origin, vec3 direction, void* user)
+{
+    EcsRayContext* context = user;
+    return ecs_rayEntity(context->world, item, origin, direction, context->maxDistance, NULL, NULL);
+}
+
+// Closest renderable with bounds whose triangles the ray hits, or
+// ENTITY_NONE. Goes through the tree and grid as of the last ecs_cull(), so
+// only the boxes the ray passes through have their meshes tested.
+Entity ecs_pick(EcsWorld* world, vec3 origin, vec3 direction, float maxDistance, EcsPickHit* hit)
+{
+    EcsRayContext context = { world, maxDistance };
+    Entity entity = ENTITY_NONE;
+    float distance = maxDistance;
+
+    float staticDistance;
+    int item = bvh_raycast(world->boundsBvh, origin, direction, distance, ecs_rayStatic, &context, &staticDistance);
+    if (item >= 0)
+    {
+        entity = world->bounds.entities[world->boundsStatic[item]];
+        distance = staticDistance;
+    }
+
+    float dynamicDistance;
+    item = grid_raycast(world->boundsGrid, origin, direction, distance, ecs_rayDynamic, &context, &dynamicDistance);
+    if (item >= 0)
+    {
+        entity = item;
+        distance = dynamicDistance;
+    }
+
+    if (entity == ENTITY_NONE || !hit)
+    {
+        return entity;
+    }
+
+    // The casts above only keep the closest distance, so find out what was
+    // hit on the winner again
+    hit->entity = entity;
+    hit->distance = ecs_rayEntity(world, entity, origin, direction, maxDistance, &hit->mesh, &hit->triangle);
+    glm_vec3_scale(direction, hit->distance, hit->point);
+    glm_vec3_add(origin, hit->point, hit->point);
+    return entity;
+}
+
+void ecs_updateTransforms(EcsWorld* world)
+{
+    scene_updateTransforms(world->scene);
+}
+
+void ecs_updateBounds(EcsWorld* world)
+{
+    for (size_t i = 0; i < world->bounds.count; i++)
+    {
+        Entity entity = world->bounds.entities[i];
+        if (!ecs_has(&world->renderables, entity))
+        {
+            continue;
+        }
+
+        int sceneModel = world->renderableModels[ecs_index(&world->renderables, entity)];
+        float* sphere = world->boundsSpheres[i];
+        scene_modelBounds(world->scene, sceneModel, sphere);
+
+        float radius = glm_max(sphere[3], 0.0f);
+        glm_vec3_subs(sphere, radius, world->boundsMins[i]);
+        glm_vec3_adds(sphere, radius, world->boundsMaxs[i]);
+        if (world->boundsDynamic[i])
+        {
+            grid_update(world->boundsGrid, entity, world->boundsMins[i], world->boundsMaxs[i]);
+        }
+    }
+}
+
+// Marks which bounds are at least partly inside the view frustum. Static
+// ones are found through the tree, so whole groups off screen are skipped
+// with one test, and dynamic ones through the grid.
+void ecs_cull(EcsWorld* world, mat4 viewProjection)
+{
+    if (world->boundsBvhStale)
+    {
+        world->numBoundsStatic = 0;
+        for (size_t i = 0; i < world->bounds.count; i++)
+        {
+            if (!world->boundsDynamic[i])
+            {
+                world->boundsStatic[world->numBoundsStatic++] = i;
+            }
+        }
+    }
+    for (size_t i = 0; i < world->numBoundsStatic; i++)
+    {
+        glm_vec3_copy(world->boundsMins[world->boundsStatic[i]], world->boundsStaticMins[i]);
+        glm_vec3_copy(world->boundsMaxs[world->boundsStatic[i]], world->boundsStaticMaxs[i]);
+    }
+
+    if (world->boundsBvhStale)
+    {
+        bvh_build(world->boundsBvh, world->boundsStaticMins, world->boundsStaticMaxs, world->numBoundsStatic);
+        world->boundsBvhStale = false;
+    }
+    else
+    {
+        bvh_refit(world->boundsBvh, world->boundsStaticMins, world->boundsStaticMaxs);
+    }
+
+    vec4 planes[6];
+    glm_frustum_planes(viewProjection, planes);
+    memset(world->boundsVisible, 0, sizeof(bool) * world->bounds.count);
+
+    size_t numFound = bvh_queryFrustum(world->boundsBvh, planes, world->boundsFound);
+    for (size_t i = 0; i < numFound; i++)
+    {
+        world->boundsVisible[world->boundsStatic[world->boundsFound[i]]] = true;
+    }
+
+    numFound = grid_queryFrustum(world->boundsGrid, planes, world->boundsFound);
+    for (size_t i = 0; i < numFound; i++)
+    {
+        world->boundsVisible[ecs_index(&world->bounds, world->boundsFound[i])] = true;
+    }
+}
+
+// The lit shader takes one directional light, so the first one wins
+void ecs_gatherLights(EcsWorld* world, mat4 view, LightUniforms* dest)
+{
+    memset(dest, 0, sizeof(LightUniforms));
+    if (world->lights.count == 0)
+    {
+        return;
+    }
+
+    DirLight* light = &world->lightDirs[0];
+    vec3 direction;
+    glm_mat4_mulv3(view, light->direction, 0.0f, direction);
+    glm_vec4(direction, 0.0f, dest->dirLight.direction);
+    glm_vec4(light->ambient, 0.0f, dest->dirLight.ambient);
+    glm_vec4(light->diffuse, 0.0f, dest->dirLight.diffuse);
+    glm_vec4(light->specular, 0.0f, dest->dirLight.specular);
+}
+
+static bool ecs_visible(EcsWorld* world, Entity entity)
+{
+    return !ecs_has(&world->bounds, entity) || world->boundsVisible[ecs_index(&world->bounds, entity)];
+}
+
+// Adds draws for every renderable that survived culling and is (or isn't)
+// outlined
+void ecs_collectDraws(EcsWorld* world, FrameDrawList* dest, bool outlined)
+{
+    for (size_t i = 0; i < world->renderables.count; i++)
+    {
+        if (world->renderableOutlined[i] == outlined && ecs_visible(world, world->renderables.entities[i]))
+        {
+            scene_collectModel(world->scene, world->renderableModels[i], dest);
+        }
+    }
+}
+
+// Adds draws for the entity's renderable as if its transform node were
+// scaled up by scale, which is how outlines are drawn around it. Everything
+// under the node is put through world * scale * inverse(world), so the
+// scene and its world matrices aren't touched.
+void ecs_collectOutline(EcsWorld* world, Entity entity, float scale, FrameDrawList* dest)
+{
+    int node = ecs_getTransform(world, entity);
+    if (node < 0 || !ecs_has(&world->renderables, entity) || !ecs_visible(world, entity))
+    {
+        return;
+    }
+
+    mat4 nodeWorld, inverse, transform;
+    glm_mat4_copy(world->scene->worldMatrices[node], nodeWorld);
+    glm_mat4_inv(nodeWorld, inverse);
+    glm_scale_uni(nodeWorld, scale);
+    glm_mat4_mul(nodeWorld, inverse, transform);
+
+    int sceneModel = world->renderableModels[ecs_index(&world->renderables, entity)];
+    scene_collectModelTransformed(world->scene, sceneModel, transform, dest);
+}
+
+// Lists the models of renderables that survived culling, placed by their
+// root node
+void ecs_collectModels(EcsWorld* world, FramePacket* packet)
+{
+    for (size_t i = 0; i < world->renderables.count; i++)
+    {
+        if (ecs_visible(world, world->renderables.entities[i]))
+        {
+            SceneModel* placed = &world->scene->models[world->renderableModels[i]];
+            Model* model = resources_getModel(placed->model);
+            if (model)
+            {
+                frame_addModel(packet, model, world->scene->worldMatrices[placed->rootNode]);
+            }
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#include "extensions.h"
+#include <stdio.h>
+#include <GLFW/glfw3.h>
+
+GLExtensions glExtensions = { 0 };
+
+PFNGLMAXSHADERCOMPILERTHREADSKHRPROC ext_glMaxShaderCompilerThreadsKHR = NULL;
+PFNGLTEXSTORAGE2DPROC ext_glTexStorage2D = NULL;
+PFNGLTEXSTORAGE3DPROC ext_glTexStorage3D = NULL;
+PFNGLBUFFERSTORAGEPROC ext_glBufferStorage = NULL;
+PFNGLGETTEXTUREHANDLEARBPROC ext_glGetTextureHandleARB = NULL;
+PFNGLGETTEXTURESAMPLERHANDLEARBPROC ext_glGetTextureSamplerHandleARB = NULL;
+PFNGLMAKETEXTUREHANDLERESIDENTARBPROC ext_glMakeTextureHandleResidentARB = NULL;
+PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC ext_glMakeTextureHandleNonResidentARB = NULL;
+
+void loadGLExtensions()
+{
+    // KHR and ARB flavours of parallel compile share the same enums and entry
+    // point signature, so take whichever one the driver gives us.
+    if (glfwExtensionSupported("GL_KHR_parallel_shader_compile"))
+    {
+        ext_glMaxShaderCompilerThreadsKHR = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+    }
+    else if (glfwExtensionSupported("GL_ARB_parallel_shader_compile"))
+    {
+        ext_glMaxShaderCompilerThreadsKHR = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+    }
+    glExtensions.parallelShaderCompile = ext_glMaxShaderCompilerThreadsKHR != NULL;
+
+    if (glExtensions.parallelShaderCompile)
+    {
+        // 0xFFFFFFFF lets the driver pick however many threads it wants
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+    }
+
+    // BC4 and BC5 (RGTC) are core since 3.0, BC1/BC3 and BC7 aren't
+    glExtensions.textureCompressionS3TC = glfwExtensionSupported("GL_EXT_texture_compression_s3tc");
+    glExtensions.textureCompressionBPTC = glfwExtensionSupported("GL_ARB_texture_compression_bptc");
+
+    // Core contexts from 4.2 up have it without advertising the extension
+    bool core42 = GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 2);
+    if (glfwExtensionSupported("GL_ARB_texture_storage") || core42)
+    {
+        ext_glTexStorage2D = (PFNGLTEXSTORAGE2DPROC)glfwGetProcAddress("glTexStorage2D");
+        ext_glTexStorage3D = (PFNGLTEXSTORAGE3DPROC)glfwGetProcAddress("glTexStorage3D");
+    }
+    glExtensions.textureStorage = ext_glTexStorage2D != NULL && ext_glTexStorage3D != NULL;
+
+    bool core44 = GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 4);
+    if (glfwExtensionSupported("GL_ARB_buffer_storage") || core44)
+    {
+        ext_glBufferStorage = (PFNGLBUFFERSTORAGEPROC)glfwGetProcAddress("glBufferStorage");
+    }
+    glExtensions.bufferStorage = ext_glBufferStorage != NULL;
+
+    if (glfwExtensionSupported("GL_ARB_bindless_texture"))
+    {
+        ext_glGetTextureHandleARB = (PFNGLGETTEXTUREHANDLEARBPROC)glfwGetProcAddress("glGetTextureHandleARB");
+        ext_glGetTextureSamplerHandleARB = (PFNGLGETTEXTURESAMPLERHANDLEARBPROC)glfwGetProcAddress("glGetTextureSamplerHandleARB");
+        ext_glMakeTextureHandleResidentARB = (PFNGLMAKETEXTUREHANDLERESIDENTARBPROC)glfwGetProcAddress("glMakeTextureHandleResidentARB");
+        ext_glMakeTextureHandleNonResidentARB = (PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC)glfwGetProcAddress("glMakeTextureHandleNonResidentARB");
+    }
+    glExtensions.bindlessTexture = ext_glGetTextureHandleARB != NULL
+        && ext_glGetTextureSamplerHandleARB != NULL
+        && ext_glMakeTextureHandleResidentARB != NULL
+        && ext_glMakeTextureHandleNonResidentARB != NULL;
+
+    printf("Parallel shader compile: %s\n", glExtensions.parallelShaderCompile ? "yes" : "no");
+    printf("S3TC texture compression: %s\n", glExtensions.textureCompressionS3TC ? "yes" : "no");
+    printf("BPTC texture compression: %s\n", glExtensions.textureCompressionBPTC ? "yes" : "no");
+    printf("Immutable texture storage: %s\n", glExtensions.textureStorage ? "yes" : "no");
+    printf("Persistent buffer mapping: %s\n", glExtensions.bufferStorage ? "yes" : "no");
+    printf("Bindless textures: %s\n", glExtensions.bindlessTexture ? "yes" : "no");
+}
@@ -0,0 +1,285 @@
+#include "frame.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cglm/cglm.h"
+#include "arena.h"
+#include "jobs.h"
+
+void frame_reset(FramePacket* packet)
+{
+    if (packet->arena == NULL)
+    {
+        packet->arena = newArena(FRAME_ARENA_BLOCK_SIZE);
+    }
+    arenaReset(packet->arena);
+
+    FrameDrawList empty = { NULL, 0, 0, packet->arena };
+    packet->opaque = empty;
+    packet->outlined = empty;
+    packet->outlines = empty;
+    packet->opaqueCommands.count = 0;
+    packet->outlinedCommands.count = 0;
+    packet->outlineCommands.count = 0;
+    packet->models = NULL;
+    packet->numModels = 0;
+    packet->modelCapacity = 0;
+}
+
+// Doubles an array in the arena. The old copy is only given back when the
+// arena is reset, which at most doubles what the array takes up.
+static void* frame_grow(Arena* arena, void* items, size_t count, size_t itemSize, size_t* capacity, size_t initial)
+{
+    *capacity = *capacity ? *capacity * 2 : initial;
+    void* grown = arenaAlloc(arena, itemSize * *capacity, 16);
+    if (grown && count > 0)
+    {
+        memcpy(grown, items, itemSize * count);
+    }
+    return grown;
+}
+
+void frame_addDraw(FrameDrawList* list, Model* model, unsigned int mesh, bool newTransform, mat4 world)
+{
+    if (list->count == list->capacity)
+    {
+        FrameDraw* draws = frame_grow(list->arena, list->draws, list->count, sizeof(FrameDraw), &list->capacity, 64);
+        if (draws == NULL)
+        {
+            list->capacity = list->count;
+            return;
+        }
+        list->draws = draws;
+    }
+
+    FrameDraw* draw = &list->draws[list->count++];
+    draw->model = model;
+    draw->mesh = mesh;
+    draw->newTransform = newTransform;
+    glm_mat4_copy(world, draw->world);
+}
+
+void frame_addModel(FramePacket* packet, Model* model, mat4 transform)
+{
+    if (packet->numModels == packet->modelCapacity)
+    {
+        FrameModel* models = frame_grow(packet->arena, packet->models, packet->numModels, sizeof(FrameModel), &packet->modelCapacity, 16);
+        if (models == NULL)
+        {
+            packet->modelCapacity = packet->numModels;
+            return;
+        }
+        packet->models = models;
+    }
+
+    packet->models[packet->numModels].model = model;
+    glm_mat4_copy(transform, packet->models[packet->numModels].transform);
+    packet->numModels++;
+}
+
+typedef struct {
+    FrameDrawList* list;
+    Shader* shader;
+    vec4* view;
+    CommandBuffer* commands;
+    size_t begin;
+    size_t end;
+} FrameRecordSlice;
+
+// Each slice binds its own model and transforms to start with, so slices
+// can be played back one after another without knowing about each other
+static void frame_recordSlice(void* data)
+{
+    FrameRecordSlice* slice = data;
+    commandBufferReset(slice->commands);
+
+    Model* boundModel = NULL;
+    bool transformSet = false;
+    for (size_t i = slice->begin; i < slice->end; i++)
+    {
+        FrameDraw* draw = &slice->list->draws[i];
+        if (draw->mesh >= draw->model->numMeshes)
+        {
+            continue;
+        }
+        if (draw->model != boundModel)
+        {
+            model_recordBegin(draw->model, slice->shader, slice->commands);
+            boundModel = draw->model;
+        }
+        if (draw->newTransform || !transformSet)
+        {
+            commandBufferSetDrawUniforms(slice->commands, draw->world, slice->view);
+            transformSet = true;
+        }
+        model_recordMesh(draw->model, draw->mesh, slice->shader, slice->commands);
+    }
+}
+
+// Records the list into slices across the job system's workers
+void frame_recordDraws(FrameDrawList* list, Shader* shader, mat4 view, FrameCommands* dest)
+{
+    if (shader == NULL)
+    {
+        dest->count = 0;
+        return;
+    }
+
+    size_t numSlices = jobs_numWorkers() + 1;
+    if (numSlices > FRAME_MAX_RECORDERS)
+    {
+        numSlices = FRAME_MAX_RECORDERS;
+    }
+    if (list->count / FRAME_MIN_DRAWS_PER_RECORDER < numSlices)
+    {
+        numSlices = list->count / FRAME_MIN_DRAWS_PER_RECORDER;
+    }
+    if (numSlices < 1)
+    {
+        numSlices = 1;
+    }
+
+    FrameRecordSlice* slices = arenaAlloc(list->arena, sizeof(FrameRecordSlice) * numSlices, 16);
+    Job* jobs = arenaAlloc(list->arena, sizeof(Job) * numSlices, 16);
+    if (slices == NULL || jobs == NULL)
+    {
+        dest->count = 0;
+        return;
+    }
+    JobCounter counter = { 0 };
+    size_t perSlice = list->count / numSlices;
+    for (size_t i = 0; i < numSlices; i++)
+    {
+        if (dest->buffers[i] == NULL)
+        {
+            dest->buffers[i] = newCommandBuffer();
+        }
+        slices[i].list = list;
+        slices[i].shader = shader;
+        slices[i].view = view;
+        slices[i].commands = dest->buffers[i];
+        slices[i].begin = i * perSlice;
+        slices[i].end = i + 1 == numSlices ? list->count : (i + 1) * perSlice;
+        jobs[i].fn = frame_recordSlice;
+        jobs[i].data = &slices[i];
+        jobs[i].counter = &counter;
+    }
+
+    jobs_run(jobs, numSlices - 1, &counter);
+    frame_recordSlice(&slices[numSlices - 1]);
+    jobs_wait(&counter);
+    dest->count = numSlices;
+}
+
+void frame_executeCommands(FrameCommands* commands, RingBuffer* ring)
+{
+    for (size_t i = 0; i < commands->count; i++)
+    {
+        commandBufferExecute(commands->buffers[i], ring);
+    }
+}
+
+static void* framePipeline_run(void* arg)
+{
+    FramePipeline* pipeline = arg;
+    pthread_mutex_lock(&pipeline->lock);
+    while (true)
+    {
+        while (!pipeline->requested && !pipeline->quit)
+        {
+            pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+        }
+        if (pipeline->quit)
+        {
+            break;
+        }
+        pipeline->requested = false;
+
+        // The back packet is ours until done is set
+        FramePacket* packet = &pipeline->packets[1 - pipeline->front];
+        FrameInput input = pipeline->input;
+        pthread_mutex_unlock(&pipeline->lock);
+
+        frame_reset(packet);
+        pipeline->update(&input, packet, pipeline->ctx);
+
+        pthread_mutex_lock(&pipeline->lock);
+        pipeline->done = true;
+        pthread_cond_broadcast(&pipeline->changed);
+    }
+    pthread_mutex_unlock(&pipeline->lock);
+    arenaScratchRelease();
+    return NULL;
+}
+
+FramePipeline* newFramePipeline(FrameUpdateFn update, void* ctx)
+{
+    FramePipeline* pipeline = heapCalloc(1, sizeof(FramePipeline));
+    pipeline->update = update;
+    pipeline->ctx = ctx;
+    pthread_mutex_init(&pipeline->lock, NULL);
+    pthread_cond_init(&pipeline->changed, NULL);
+    if (pthread_create(&pipeline->thread, NULL, framePipeline_run, pipeline) != 0)
+    {
+        printf("Couldn't start the update thread\n");
+        pthread_mutex_destroy(&pipeline->lock);
+        pthread_cond_destroy(&pipeline->changed);
+        free(pipeline);
+        return NULL;
+    }
+    return pipeline;
+}
+
+void framePipeline_free(FramePipeline* pipeline)
+{
+    pthread_mutex_lock(&pipeline->lock);
+    pipeline->quit = true;
+    pthread_cond_broadcast(&pipeline->changed);
+    pthread_mutex_unlock(&pipeline->lock);
+    pthread_join(pipeline->thread, NULL);
+
+    for (int i = 0; i < 2; i++)
+    {
+        arenaFree(pipeline->packets[i].arena);
+
+        FrameCommands* commands[] = {
+            &pipeline->packets[i].opaqueCommands,
+            &pipeline->packets[i].outlinedCommands,
+            &pipeline->packets[i].outlineCommands,
+        };
+        for (int c = 0; c < 3; c++)
+        {
+            for (int b = 0; b < FRAME_MAX_RECORDERS && commands[c]->buffers[b]; b++)
+            {
+                commandBufferFree(commands[c]->buffers[b]);
+            }
+        }
+    }
+    pthread_mutex_destroy(&pipeline->lock);
+    pthread_cond_destroy(&pipeline->changed);
+    free(pipeline);
+}
+
+void framePipeline_submit(FramePipeline* pipeline, const FrameInput* input)
+{
+    pthread_mutex_lock(&pipeline->lock);
+    pipeline->input = *input;
+    pipeline->requested = true;
+    pipeline->done = false;
+    pthread_cond_broadcast(&pipeline->changed);
+    pthread_mutex_unlock(&pipeline->lock);
+}
+
+FramePacket* framePipeline_wait(FramePipeline* pipeline)
+{
+    pthread_mutex_lock(&pipeline->lock);
+    while (!pipeline->done)
+    {
+        pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+    }
+    pipeline->done = false;
+    pipeline->front = 1 - pipeline->front;
+    FramePacket* packet = &pipeline->packets[pipeline->front];
+    pthread_mutex_unlock(&pipeline->lock);
+    return packet;
+}
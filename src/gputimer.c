@@ -0,0 +1,55 @@
+#include "gputimer.h"
+#include <stdlib.h>
+#include <glad/glad.h>
+#include "arena.h"
+
+GpuTimer* newGpuTimer()
+{
+    GpuTimer* timer = heapCalloc(1, sizeof(GpuTimer));
+    glGenQueries(GPU_TIMER_QUERIES, timer->queries);
+    return timer;
+}
+
+void gpuTimerFree(GpuTimer* timer)
+{
+    glDeleteQueries(GPU_TIMER_QUERIES, timer->queries);
+    free(timer);
+}
+
+// Collects the oldest query's result if it's in, then reuses it. A query
+// that's still not done after GPU_TIMER_QUERIES frames is dropped rather
+// than waited on.
+void gpuTimerBegin(GpuTimer* timer)
+{
+    unsigned int query = timer->queries[timer->next];
+    if (timer->pending[timer->next])
+    {
+        int available = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
+        {
+            GLuint64 elapsed;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+            timer->totalMs += elapsed / 1e6;
+            timer->samples++;
+        }
+        timer->pending[timer->next] = false;
+    }
+    glBeginQuery(GL_TIME_ELAPSED, query);
+}
+
+void gpuTimerEnd(GpuTimer* timer)
+{
+    glEndQuery(GL_TIME_ELAPSED);
+    timer->pending[timer->next] = true;
+    timer->next = (timer->next + 1) % GPU_TIMER_QUERIES;
+}
+
+// Average since the last call, which starts a new one. 0 with no samples.
+double gpuTimerAverageMs(GpuTimer* timer)
+{
+    double average = timer->samples ? timer->totalMs / timer->samples : 0.0;
+    timer->totalMs = 0.0;
+    timer->samples = 0;
+    return average;
+}
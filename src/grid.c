@@ -0,0 +1,406 @@
+#include "grid.h"
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cglm/cglm.h"
+#include "arena.h"
+
+Grid* newGrid(float cellSize)
+{
+    Grid* grid = heapCalloc(1, sizeof(Grid));
+    grid->cellSize = cellSize;
+    grid->tableSize = 64;
+    grid->table = heapCalloc(grid->tableSize, sizeof(unsigned int));
+    return grid;
+}
+
+void grid_free(Grid* grid)
+{
+    for (size_t i = 0; i < grid->numCells; i++)
+    {
+        free(grid->cells[i].items);
+    }
+    free(grid->cells);
+    free(grid->table);
+    free(grid->items);
+    free(grid);
+}
+
+static int64_t grid_coord(Grid* grid, float position)
+{
+    return (int64_t)floorf(position / grid->cellSize);
+}
+
+// 21 bits per axis, which is a million cells either way of the origin
+static int64_t grid_coordKey(const int64_t coords[3])
+{
+    int64_t key = 0;
+    for (int k = 0; k < 3; k++)
+    {
+        key = (key << 21) | (coords[k] & 0x1FFFFF);
+    }
+    return key;
+}
+
+static int64_t grid_key(Grid* grid, vec3 point)
+{
+    int64_t coords[3];
+    for (int k = 0; k < 3; k++)
+    {
+        coords[k] = grid_coord(grid, point[k]);
+    }
+    return grid_coordKey(coords);
+}
+
+static void grid_keyBounds(Grid* grid, int64_t key, vec3 min, vec3 max)
+{
+    for (int k = 2; k >= 0; k--)
+    {
+        // Sign extend the axis back out of its 21 bits
+        int64_t coord = ((key & 0x1FFFFF) ^ 0x100000) - 0x100000;
+        key >>= 21;
+        min[k] = coord * grid->cellSize - grid->looseness;
+        max[k] = (coord + 1) * grid->cellSize + grid->looseness;
+    }
+}
+
+static size_t grid_hash(int64_t key, size_t tableSize)
+{
+    uint64_t hash = (uint64_t)key * 0x9E3779B97F4A7C15ull;
+    return (hash >> 32) & (tableSize - 1);
+}
+
+static void grid_insertKey(Grid* grid, int64_t key, unsigned int cell)
+{
+    size_t i = grid_hash(key, grid->tableSize);
+    while (grid->table[i] != 0)
+    {
+        i = (i + 1) & (grid->tableSize - 1);
+    }
+    grid->table[i] = cell + 1;
+}
+
+// Index of the cell with the key, or -1 if there isn't one
+static int grid_findCell(Grid* grid, int64_t key)
+{
+    size_t i = grid_hash(key, grid->tableSize);
+    while (grid->table[i] != 0)
+    {
+        unsigned int cell = grid->table[i] - 1;
+        if (grid->cells[cell].key == key)
+        {
+            return cell;
+        }
+        i = (i + 1) & (grid->tableSize - 1);
+    }
+    return -1;
+}
+
+// Index of the cell with the key, made if there isn't one. Empty cells are
+// kept for when something moves back into them.
+static int grid_cell(Grid* grid, int64_t key)
+{
+    int found = grid_findCell(grid, key);
+    if (found >= 0)
+    {
+        return found;
+    }
+
+    if (grid->numCells == grid->cellCapacity)
+    {
+        grid->cellCapacity = grid->cellCapacity ? grid->cellCapacity * 2 : 64;
+        grid->cells = heapRealloc(grid->cells, sizeof(GridCell) * grid->cellCapacity);
+    }
+    unsigned int cell = grid->numCells++;
+    grid->cells[cell].key = key;
+    grid->cells[cell].items = NULL;
+    grid->cells[cell].count = 0;
+    grid->cells[cell].capacity = 0;
+
+    // Keep the table at most half full
+    if (grid->numCells * 2 > grid->tableSize)
+    {
+        grid->tableSize *= 2;
+        grid->table = heapRealloc(grid->table, sizeof(unsigned int) * grid->tableSize);
+        memset(grid->table, 0, sizeof(unsigned int) * grid->tableSize);
+        for (size_t c = 0; c < grid->numCells; c++)
+        {
+            grid_insertKey(grid, grid->cells[c].key, c);
+        }
+    }
+    else
+    {
+        grid_insertKey(grid, key, cell);
+    }
+    return cell;
+}
+
+static void grid_unlink(Grid* grid, GridItem* item)
+{
+    GridCell* cell = &grid->cells[item->cell];
+    unsigned int moved = cell->items[--cell->count];
+    cell->items[item->slot] = moved;
+    grid->items[moved].slot = item->slot;
+    item->cell = -1;
+}
+
+void grid_update(Grid* grid, unsigned int item, vec3 min, vec3 max)
+{
+    if (item >= grid->itemCapacity)
+    {
+        size_t capacity = grid->itemCapacity ? grid->itemCapacity : 64;
+        while (capacity <= item)
+        {
+            capacity *= 2;
+        }
+        grid->items = heapRealloc(grid->items, sizeof(GridItem) * capacity);
+        for (size_t i = grid->itemCapacity; i < capacity; i++)
+        {
+            grid->items[i].cell = -1;
+        }
+        grid->itemCapacity = capacity;
+    }
+    if (item >= grid->numItems)
+    {
+        grid->numItems = item + 1;
+    }
+
+    GridItem* entry = &grid->items[item];
+    glm_vec3_copy(min, entry->min);
+    glm_vec3_copy(max, entry->max);
+    for (int k = 0; k < 3; k++)
+    {
+        grid->looseness = fmaxf(grid->looseness, (max[k] - min[k]) * 0.5f);
+    }
+
+    // Most moves stay in the same cell, which needs no lookup
+    vec3 center;
+    glm_vec3_center(min, max, center);
+    int64_t key = grid_key(grid, center);
+    if (entry->cell >= 0 && grid->cells[entry->cell].key == key)
+    {
+        return;
+    }
+    int cellIndex = grid_cell(grid, key);
+    if (entry->cell >= 0)
+    {
+        grid_unlink(grid, entry);
+    }
+
+    GridCell* cell = &grid->cells[cellIndex];
+    if (cell->count == cell->capacity)
+    {
+        cell->capacity = cell->capacity ? cell->capacity * 2 : 8;
+        cell->items = heapRealloc(cell->items, sizeof(unsigned int) * cell->capacity);
+    }
+    entry->cell = cellIndex;
+    entry->slot = cell->count;
+    cell->items[cell->count++] = item;
+}
+
+void grid_remove(Grid* grid, unsigned int item)
+{
+    if (item < grid->numItems && grid->items[item].cell >= 0)
+    {
+        grid_unlink(grid, &grid->items[item]);
+    }
+}
+
+// Whether the box is entirely outside one of the planes. If it isn't and
+// inside is given, that says whether it's entirely inside all of them.
+static bool grid_boxOutside(vec4 planes[6], vec3 min, vec3 max, bool* inside)
+{
+    bool crossing = false;
+    for (int p = 0; p < 6; p++)
+    {
+        // Corners furthest along and furthest against the plane's normal
+        vec3 ahead, behind;
+        for (int k = 0; k < 3; k++)
+        {
+            ahead[k] = planes[p][k] >= 0.0f ? max[k] : min[k];
+            behind[k] = planes[p][k] >= 0.0f ? min[k] : max[k];
+        }
+        if (glm_vec3_dot(planes[p], ahead) + planes[p][3] < 0.0f)
+        {
+            return true;
+        }
+        crossing = crossing || glm_vec3_dot(planes[p], behind) + planes[p][3] < 0.0f;
+    }
+    if (inside)
+    {
+        *inside = !crossing;
+    }
+    return false;
+}
+
+// The frustum and rays go through every occupied cell rather than working
+// out which cell coordinates to look up. Cells wholly inside the frustum
+// hand over their items without testing each one.
+size_t grid_queryFrustum(Grid* grid, vec4 planes[6], unsigned int* dest)
+{
+    size_t found = 0;
+    for (size_t c = 0; c < grid->numCells; c++)
+    {
+        GridCell* cell = &grid->cells[c];
+        if (cell->count == 0)
+        {
+            continue;
+        }
+        vec3 min, max;
+        bool inside;
+        grid_keyBounds(grid, cell->key, min, max);
+        if (grid_boxOutside(planes, min, max, &inside))
+        {
+            continue;
+        }
+        if (inside)
+        {
+            memcpy(&dest[found], cell->items, sizeof(unsigned int) * cell->count);
+            found += cell->count;
+            continue;
+        }
+
+        for (size_t i = 0; i < cell->count; i++)
+        {
+            GridItem* item = &grid->items[cell->items[i]];
+            if (!grid_boxOutside(planes, item->min, item->max, NULL))
+            {
+                dest[found++] = cell->items[i];
+            }
+        }
+    }
+    return found;
+}
+
+static bool grid_boxTouchesSphere(vec3 min, vec3 max, vec3 center, float radius)
+{
+    vec3 closest;
+    glm_vec3_maxv(min, center, closest);
+    glm_vec3_minv(max, closest, closest);
+    return glm_vec3_distance2(closest, center) <= radius * radius;
+}
+
+static size_t grid_queryCellSphere(Grid* grid, GridCell* cell, vec3 center, float radius, unsigned int* dest,
+    size_t found)
+{
+    for (size_t i = 0; i < cell->count; i++)
+    {
+        GridItem* item = &grid->items[cell->items[i]];
+        if (grid_boxTouchesSphere(item->min, item->max, center, radius))
+        {
+            dest[found++] = cell->items[i];
+        }
+    }
+    return found;
+}
+
+// Looks up the cells whose items could reach the sphere, unless there are
+// more of those than there are cells to go through
+size_t grid_querySphere(Grid* grid, vec3 center, float radius, unsigned int* dest)
+{
+    int64_t first[3], last[3];
+    double numKeys = 1.0;
+    for (int k = 0; k < 3; k++)
+    {
+        first[k] = grid_coord(grid, center[k] - radius - grid->looseness);
+        last[k] = grid_coord(grid, center[k] + radius + grid->looseness);
+        numKeys *= (double)(last[k] - first[k] + 1);
+    }
+
+    size_t found = 0;
+    if (numKeys < grid->numCells)
+    {
+        int64_t coords[3];
+        for (coords[0] = first[0]; coords[0] <= last[0]; coords[0]++)
+        {
+            for (coords[1] = first[1]; coords[1] <= last[1]; coords[1]++)
+            {
+                for (coords[2] = first[2]; coords[2] <= last[2]; coords[2]++)
+                {
+                    int cell = grid_findCell(grid, grid_coordKey(coords));
+                    if (cell >= 0)
+                    {
+                        found = grid_queryCellSphere(grid, &grid->cells[cell], center, radius, dest, found);
+                    }
+                }
+            }
+        }
+        return found;
+    }
+
+    for (size_t c = 0; c < grid->numCells; c++)
+    {
+        GridCell* cell = &grid->cells[c];
+        vec3 min, max;
+        grid_keyBounds(grid, cell->key, min, max);
+        if (cell->count > 0 && grid_boxTouchesSphere(min, max, center, radius))
+        {
+            found = grid_queryCellSphere(grid, cell, center, radius, dest, found);
+        }
+    }
+    return found;
+}
+
+static float grid_rayBox(vec3 origin, vec3 inverseDirection, vec3 min, vec3 max, float maxDistance)
+{
+    float enter = 0.0f;
+    float exit = maxDistance;
+    for (int k = 0; k < 3; k++)
+    {
+        float t0 = (min[k] - origin[k]) * inverseDirection[k];
+        float t1 = (max[k] - origin[k]) * inverseDirection[k];
+        enter = fmaxf(enter, fminf(t0, t1));
+        exit = fminf(exit, fmaxf(t0, t1));
+    }
+    return enter <= exit ? enter : FLT_MAX;
+}
+
+int grid_raycast(Grid* grid, vec3 origin, vec3 direction, float maxDistance, BvhRayTest test, void* user,
+    float* distance)
+{
+    vec3 inverseDirection;
+    for (int k = 0; k < 3; k++)
+    {
+        inverseDirection[k] = 1.0f / direction[k];
+    }
+
+    int hit = -1;
+    float closest = maxDistance;
+    for (size_t c = 0; c < grid->numCells; c++)
+    {
+        GridCell* cell = &grid->cells[c];
+        vec3 min, max;
+        grid_keyBounds(grid, cell->key, min, max);
+        if (cell->count == 0 || grid_rayBox(origin, inverseDirection, min, max, closest) == FLT_MAX)
+        {
+            continue;
+        }
+
+        for (size_t i = 0; i < cell->count; i++)
+        {
+            unsigned int itemIndex = cell->items[i];
+            GridItem* item = &grid->items[itemIndex];
+            float t = grid_rayBox(origin, inverseDirection, item->min, item->max, closest);
+            if (t == FLT_MAX)
+            {
+                continue;
+            }
+            if (test)
+            {
+                t = test(itemIndex, origin, direction, user);
+            }
+            if (t >= 0.0f && t < closest)
+            {
+                closest = t;
+                hit = itemIndex;
+            }
+        }
+    }
+
+    if (hit >= 0 && distance)
+    {
+        *distance = closest;
+    }
+    return hit;
+}
@@ -0,0 +1,100 @@
+#include "handle.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+HandlePool* newHandlePool(size_t itemSize)
+{
+    HandlePool* pool = heapCalloc(1, sizeof(HandlePool));
+    pool->itemSize = itemSize;
+    return pool;
+}
+
+void handlePoolFree(HandlePool* pool)
+{
+    if (pool == NULL)
+    {
+        return;
+    }
+    free(pool->items);
+    free(pool->generations);
+    free(pool->alive);
+    free(pool->freeSlots);
+    free(pool);
+}
+
+Handle handlePoolAdd(HandlePool* pool, const void* item)
+{
+    uint32_t slot;
+    if (pool->numFree > 0)
+    {
+        slot = pool->freeSlots[--pool->numFree];
+    }
+    else
+    {
+        if (pool->count > HANDLE_INDEX_MASK)
+        {
+            printf("Handle pool is full at %zu items\n", pool->count);
+            return HANDLE_NONE;
+        }
+        if (pool->count == pool->capacity)
+        {
+            pool->capacity = pool->capacity ? pool->capacity * 2 : 64;
+            pool->items = heapRealloc(pool->items, pool->itemSize * pool->capacity);
+            pool->generations = heapRealloc(pool->generations, sizeof(uint32_t) * pool->capacity);
+            pool->alive = heapRealloc(pool->alive, sizeof(bool) * pool->capacity);
+            pool->freeSlots = heapRealloc(pool->freeSlots, sizeof(uint32_t) * pool->capacity);
+        }
+        slot = pool->count++;
+        pool->generations[slot] = 1;
+    }
+
+    memcpy(pool->items + pool->itemSize * slot, item, pool->itemSize);
+    pool->alive[slot] = true;
+    return (pool->generations[slot] << HANDLE_INDEX_BITS) | slot;
+}
+
+void* handlePoolGet(HandlePool* pool, Handle handle)
+{
+    uint32_t slot = handle & HANDLE_INDEX_MASK;
+    if (handle == HANDLE_NONE || slot >= pool->count || !pool->alive[slot]
+        || pool->generations[slot] != handle >> HANDLE_INDEX_BITS)
+    {
+        return NULL;
+    }
+    return pool->items + pool->itemSize * slot;
+}
+
+// Copies the item out to item, if that isn't NULL, and frees its slot.
+// Returns false if the handle was already stale.
+bool handlePoolRemove(HandlePool* pool, Handle handle, void* item)
+{
+    void* stored = handlePoolGet(pool, handle);
+    if (stored == NULL)
+    {
+        return false;
+    }
+    if (item)
+    {
+        memcpy(item, stored, pool->itemSize);
+    }
+
+    // Generation 0 is skipped when it wraps, so a handle is never 0
+    uint32_t slot = handle & HANDLE_INDEX_MASK;
+    pool->alive[slot] = false;
+    pool->generations[slot] = pool->generations[slot] == HANDLE_MAX_GENERATION ? 1 : pool->generations[slot] + 1;
+    pool->freeSlots[pool->numFree++] = slot;
+    return true;
+}
+
+// Handle of whatever is in a slot, HANDLE_NONE if it's empty. For walking
+// every item, slots 0 to count.
+Handle handlePoolAt(HandlePool* pool, size_t slot)
+{
+    if (slot >= pool->count || !pool->alive[slot])
+    {
+        return HANDLE_NONE;
+    }
+    return (pool->generations[slot] << HANDLE_INDEX_BITS) | (uint32_t)slot;
+}
@@ -0,0 +1,357 @@
+#include "hotreload.h"
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#include "arena.h"
+#include "pack.h"
+#include "texture.h"
+
+// Editors tend to save by writing a temp file and renaming it over the
+// original, so a rename into the directory counts as a change too.
+#define HOTRELOAD_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE)
+
+HotReload* newHotReload()
+{
+    HotReload* hotReload = heapAlloc(sizeof(HotReload));
+    hotReload->watchDescriptors = NULL;
+    hotReload->watchDirs = NULL;
+    hotReload->numWatches = 0;
+    hotReload->assets = NULL;
+    hotReload->numAssets = 0;
+
+#ifdef __linux__
+    hotReload->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (hotReload->fd < 0)
+    {
+        printf("Hot reload disabled, inotify_init1 failed: %s\n", strerror(errno));
+    }
+#else
+    hotReload->fd = -1;
+    printf("Hot reload is only supported on Linux\n");
+#endif
+
+    return hotReload;
+}
+
+// inotify isn't recursive, so every directory below dir gets its own watch.
+void hotReloadWatchDirectory(HotReload* hotReload, const char* dir)
+{
+#ifdef __linux__
+    if (hotReload->fd < 0)
+    {
+        return;
+    }
+
+    int wd = inotify_add_watch(hotReload->fd, dir, HOTRELOAD_EVENTS);
+    if (wd < 0)
+    {
+        printf("Unable to watch %s: %s\n", dir, strerror(errno));
+        return;
+    }
+
+    hotReload->watchDescriptors = heapRealloc(hotReload->watchDescriptors, sizeof(int) * (hotReload->numWatches + 1));
+    hotReload->watchDirs = heapRealloc(hotReload->watchDirs, sizeof(char*) * (hotReload->numWatches + 1));
+    hotReload->watchDescriptors[hotReload->numWatches] = wd;
+    hotReload->watchDirs[hotReload->numWatches] = strdup(dir);
+    hotReload->numWatches++;
+
+    DIR* d = opendir(dir);
+    if (d == NULL)
+    {
+        return;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL)
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+        {
+            continue;
+        }
+
+        char childPath[PATH_MAX];
+        snprintf(childPath, PATH_MAX, "%s/%s", dir, entry->d_name);
+
+        struct stat st;
+        if (stat(childPath, &st) == 0 && S_ISDIR(st.st_mode))
+        {
+            hotReloadWatchDirectory(hotReload, childPath);
+        }
+    }
+    closedir(d);
+#endif
+}
+
+static void hotReloadAdd(HotReload* hotReload, HotReloadKind kind, void* asset, const char* path)
+{
+    hotReload->assets = heapRealloc(hotReload->assets, sizeof(HotReloadAsset) * (hotReload->numAssets + 1));
+    hotReload->assets[hotReload->numAssets].kind = kind;
+    hotReload->assets[hotReload->numAssets].asset = asset;
+    hotReload->assets[hotReload->numAssets].shader = HANDLE_NONE;
+    hotReload->assets[hotReload->numAssets].model = HANDLE_NONE;
+    hotReload->assets[hotReload->numAssets].path = path ? strdup(path) : NULL;
+    hotReload->numAssets++;
+}
+
+void hotReloadAddShader(HotReload* hotReload, ShaderHandle shader)
+{
+    hotReloadAdd(hotReload, HOTRELOAD_SHADER, NULL, NULL);
+    hotReload->assets[hotReload->numAssets - 1].shader = shader;
+}
+
+void hotReloadAddPermutation(HotReload* hotReload, ShaderPermutation* permutation)
+{
+    hotReloadAdd(hotReload, HOTRELOAD_PERMUTATION, permutation, NULL);
+}
+
+// Watching a model covers its own file and the .mtl next to it. Textures
+// loaded through the registry are picked up without being added.
+void hotReloadAddModel(HotReload* hotReload, ModelHandle model, const char* path)
+{
+    hotReloadAdd(hotReload, HOTRELOAD_MODEL, NULL, path);
+    hotReload->assets[hotReload->numAssets - 1].model = model;
+}
+
+void hotReloadAddTexture(HotReload* hotReload, unsigned int* texture, const char* path)
+{
+    hotReloadAdd(hotReload, HOTRELOAD_TEXTURE, texture, path);
+}
+
+// Paths come from different places ("shaders/lit/lit.frag" from main(),
+// "models/backpack/diffuse.jpg" from the model loader), so fall back to
+// comparing canonical paths when the strings don't match outright.
+static bool hotReloadSamePath(const char* a, const char* b)
+{
+    if (a == NULL || b == NULL)
+    {
+        return false;
+    }
+    if (strcmp(a, b) == 0)
+    {
+        return true;
+    }
+
+    char realA[PATH_MAX];
+    char realB[PATH_MAX];
+    if (realpath(a, realA) == NULL || realpath(b, realB) == NULL)
+    {
+        return false;
+    }
+    return strcmp(realA, realB) == 0;
+}
+
+static bool hotReloadSameDirectory(const char* file, const char* otherFile)
+{
+    char fileDir[PATH_MAX];
+    char otherDir[PATH_MAX];
+    snprintf(fileDir, PATH_MAX, "%s", file);
+    snprintf(otherDir, PATH_MAX, "%s", otherFile);
+
+    char* slash = strrchr(fileDir, '/');
+    char* otherSlash = strrchr(otherDir, '/');
+    if (slash == NULL || otherSlash == NULL)
+    {
+        return false;
+    }
+    *slash = '\0';
+    *otherSlash = '\0';
+    return hotReloadSamePath(fileDir, otherDir);
+}
+
+// Reloads everything that depends on path. Assets already marked in reloaded
+// are skipped, so a save that touches both stages of a shader (or an .obj and
+// its .mtl) only rebuilds it once.
+static void hotReloadPath(HotReload* hotReload, const char* path, bool* reloaded)
+{
+    // Textures only need to be re-uploaded, everything that uses one already
+    // points at its ID.
+    TextureHandle texture = textureFind(path);
+    if (texture != 0 && textureIsResident(texture))
+    {
+        printf("Texture %s is resident for bindless use, restart to see changes\n", path);
+    }
+    else if (texture != 0 && textureGetID(texture) != 0)
+    {
+        printf("Reloading texture %s\n", path);
+        textureReload(texture);
+    }
+
+    for (size_t i = 0; i < hotReload->numAssets; i++)
+    {
+        HotReloadAsset* a = &hotReload->assets[i];
+        if (reloaded[i])
+        {
+            continue;
+        }
+
+        switch (a->kind) {
+            case HOTRELOAD_SHADER: {
+                Shader* shader = resources_getShader(a->shader);
+                if (shader == NULL)
+                {
+                    break;
+                }
+                if (hotReloadSamePath(path, shader->vertexPath) || hotReloadSamePath(path, shader->fragmentPath))
+                {
+                    shaderReload(shader);
+                    reloaded[i] = true;
+                }
+                break;
+            }
+
+            case HOTRELOAD_PERMUTATION: {
+                ShaderPermutation* permutation = a->asset;
+                if (hotReloadSamePath(path, permutation->vertexPath) || hotReloadSamePath(path, permutation->fragmentPath))
+                {
+                    shaderPermutationReload(permutation);
+                    reloaded[i] = true;
+                }
+                break;
+            }
+
+            case HOTRELOAD_MODEL: {
+                Model* model = resources_getModel(a->model);
+                if (model == NULL)
+                {
+                    break;
+                }
+
+                // The model file itself, or a material library next to it
+                const char* extension = strrchr(path, '.');
+                bool isMaterialLibrary = extension != NULL && strcmp(extension, ".mtl") == 0
+                    && hotReloadSameDirectory(path, a->path);
+                if (hotReloadSamePath(path, a->path) || isMaterialLibrary)
+                {
+                    model_reload(model, a->path);
+                    reloaded[i] = true;
+                }
+                else if (texture != 0 && model->textureArray != NULL && model_usesTexture(model, texture))
+                {
+                    // The texture array holds its own copy of the image
+                    model_refreshTextureArray(model);
+                }
+                break;
+            }
+
+            case HOTRELOAD_TEXTURE: {
+                unsigned int* texture = a->asset;
+                if (hotReloadSamePath(path, a->path))
+                {
+                    printf("Reloading texture %s\n", path);
+                    textureLoadInto(texture, path);
+                }
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
+}
+
+void hotReloadUpdate(HotReload* hotReload)
+{
+#ifdef __linux__
+    if (hotReload->fd < 0)
+    {
+        return;
+    }
+
+    // Gather every changed path first. Saving a file usually fires more than
+    // one event, and each asset should only be reloaded once per update.
+    char** changed = NULL;
+    size_t numChanged = 0;
+
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+    while ((len = read(hotReload->fd, buffer, sizeof(buffer))) > 0)
+    {
+        for (char* ptr = buffer; ptr < buffer + len; ptr += sizeof(struct inotify_event) + ((struct inotify_event*)ptr)->len)
+        {
+            struct inotify_event* event = (struct inotify_event*)ptr;
+            if (event->len == 0)
+            {
+                continue;
+            }
+
+            const char* dir = NULL;
+            for (size_t i = 0; i < hotReload->numWatches; i++)
+            {
+                if (hotReload->watchDescriptors[i] == event->wd)
+                {
+                    dir = hotReload->watchDirs[i];
+                    break;
+                }
+            }
+            if (dir == NULL)
+            {
+                continue;
+            }
+
+            char path[PATH_MAX];
+            snprintf(path, PATH_MAX, "%s/%s", dir, event->name);
+
+            // New subdirectories need watches of their own
+            if (event->mask & IN_ISDIR)
+            {
+                if (event->mask & IN_CREATE)
+                {
+                    hotReloadWatchDirectory(hotReload, path);
+                }
+                continue;
+            }
+
+            // A freshly created file is still empty, wait for it to be written
+            if (event->mask & IN_CREATE)
+            {
+                continue;
+            }
+
+            bool seen = false;
+            for (size_t i = 0; i < numChanged; i++)
+            {
+                if (strcmp(changed[i], path) == 0)
+                {
+                    seen = true;
+                    break;
+                }
+            }
+            if (!seen)
+            {
+                changed = heapRealloc(changed, sizeof(char*) * (numChanged + 1));
+                changed[numChanged++] = strdup(path);
+            }
+        }
+    }
+
+    if (numChanged == 0)
+    {
+        return;
+    }
+
+    Arena* scratch = arenaScratch();
+    ArenaMark mark = arenaMark(scratch);
+    bool* reloaded = arenaAlloc(scratch, sizeof(bool) * hotReload->numAssets, _Alignof(bool));
+    memset(reloaded, 0, sizeof(bool) * hotReload->numAssets);
+    for (size_t i = 0; i < numChanged; i++)
+    {
+        // A mounted pack still has the old file
+        packPreferLoose(changed[i]);
+        hotReloadPath(hotReload, changed[i], reloaded);
+        free(changed[i]);
+    }
+    arenaRewind(scratch, mark);
+    free(changed);
+#endif
+}
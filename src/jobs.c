@@ -0,0 +1,414 @@
+#include "jobs.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+// Chase-Lev deque. The owner pushes and takes at bottom, thieves steal at
+// top, and only the last job left needs a compare and swap to settle who
+// gets it.
+typedef struct {
+    atomic_long top;
+    atomic_long bottom;
+    _Atomic(Job*) jobs[JOBS_DEQUE_SIZE];
+} JobDeque;
+
+typedef struct {
+    pthread_t thread;
+    JobDeque deque;
+    int index;
+} JobWorker;
+
+static JobWorker* jobsWorkers = NULL;
+static int jobsNumWorkers = 0;
+static atomic_bool jobsRunning = false;
+
+// Jobs from threads that aren't workers
+static Job** jobsShared = NULL;
+static size_t jobsSharedCount = 0;
+static size_t jobsSharedCapacity = 0;
+static pthread_mutex_t jobsSharedLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Idle workers sleep until there's something queued
+static atomic_size_t jobsQueued = 0;
+static pthread_mutex_t jobsSleepLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobsWake = PTHREAD_COND_INITIALIZER;
+
+static _Thread_local JobWorker* jobsCurrentWorker = NULL;
+
+static bool jobs_dequePush(JobDeque* deque, Job* job)
+{
+    long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    if (bottom - top >= JOBS_DEQUE_SIZE)
+    {
+        return false;
+    }
+    atomic_store_explicit(&deque->jobs[bottom & (JOBS_DEQUE_SIZE - 1)], job, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    return true;
+}
+
+static Job* jobs_dequeTake(JobDeque* deque)
+{
+    long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+    if (top > bottom)
+    {
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    Job* job = atomic_load_explicit(&deque->jobs[bottom & (JOBS_DEQUE_SIZE - 1)], memory_order_relaxed);
+    if (top == bottom)
+    {
+        // Last one, a thief may be after it too
+        if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                memory_order_seq_cst, memory_order_relaxed))
+        {
+            job = NULL;
+        }
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    }
+    return job;
+}
+
+static Job* jobs_dequeSteal(JobDeque* deque)
+{
+    long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+    if (top >= bottom)
+    {
+        return NULL;
+    }
+
+    Job* job = atomic_load_explicit(&deque->jobs[top & (JOBS_DEQUE_SIZE - 1)], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+            memory_order_seq_cst, memory_order_relaxed))
+    {
+        return NULL;
+    }
+    return job;
+}
+
+static Job* jobs_takeShared()
+{
+    Job* job = NULL;
+    pthread_mutex_lock(&jobsSharedLock);
+    if (jobsSharedCount > 0)
+    {
+        job = jobsShared[--jobsSharedCount];
+    }
+    pthread_mutex_unlock(&jobsSharedLock);
+    return job;
+}
+
+// The next job in the shared queue that counts towards counter
+static Job* jobs_takeSharedFor(JobCounter* counter)
+{
+    Job* job = NULL;
+    pthread_mutex_lock(&jobsSharedLock);
+    for (size_t i = jobsSharedCount; i-- > 0;)
+    {
+        if (jobsShared[i]->counter == counter)
+        {
+            job = jobsShared[i];
+            memmove(&jobsShared[i], &jobsShared[i + 1], sizeof(Job*) * (jobsSharedCount - i - 1));
+            jobsSharedCount--;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&jobsSharedLock);
+    return job;
+}
+
+// Own deque first, then the shared queue, then everyone else's deques
+// starting from the next worker along
+static Job* jobs_find()
+{
+    JobWorker* self = jobsCurrentWorker;
+    Job* job = NULL;
+    if (self)
+    {
+        job = jobs_dequeTake(&self->deque);
+    }
+    if (!job && atomic_load_explicit(&jobsQueued, memory_order_relaxed) > 0)
+    {
+        job = jobs_takeShared();
+    }
+
+    int start = self ? self->index + 1 : 0;
+    for (int i = 0; !job && i < jobsNumWorkers; i++)
+    {
+        JobWorker* victim = &jobsWorkers[(start + i) % jobsNumWorkers];
+        if (victim != self)
+        {
+            job = jobs_dequeSteal(&victim->deque);
+        }
+    }
+
+    if (job)
+    {
+        atomic_fetch_sub(&jobsQueued, 1);
+    }
+    return job;
+}
+
+// What a thread that's waiting on counter may run: the newest job on its
+// own deque, which came from the job it's in the middle of, or one of
+// counter's own from the shared queue. Nothing is stolen, so a wait never
+// ends up stuck behind someone else's long job, like a texture encode the
+// streamer queued while the update thread waits on its draws.
+static Job* jobs_findFor(JobCounter* counter)
+{
+    JobWorker* self = jobsCurrentWorker;
+    Job* job = self ? jobs_dequeTake(&self->deque) : NULL;
+    if (!job && atomic_load_explicit(&jobsQueued, memory_order_relaxed) > 0)
+    {
+        job = jobs_takeSharedFor(counter);
+    }
+
+    if (job)
+    {
+        atomic_fetch_sub(&jobsQueued, 1);
+    }
+    return job;
+}
+
+// Whatever a job puts in its thread's scratch arena is gone once it's done,
+// without undoing anything the job that's waiting underneath it still has
+static void jobs_execute(Job* job)
+{
+    Arena* scratch = arenaScratch();
+    ArenaMark mark = arenaMark(scratch);
+    job->fn(job->data);
+    arenaRewind(scratch, mark);
+    if (job->counter)
+    {
+        atomic_fetch_sub_explicit(&job->counter->remaining, 1, memory_order_release);
+    }
+}
+
+static void* jobs_workerMain(void* arg)
+{
+    jobsCurrentWorker = arg;
+    while (atomic_load(&jobsRunning))
+    {
+        Job* job = jobs_find();
+        if (job)
+        {
+            jobs_execute(job);
+            continue;
+        }
+
+        pthread_mutex_lock(&jobsSleepLock);
+        while (atomic_load(&jobsRunning) && atomic_load(&jobsQueued) == 0)
+        {
+            pthread_cond_wait(&jobsWake, &jobsSleepLock);
+        }
+        pthread_mutex_unlock(&jobsSleepLock);
+    }
+    arenaScratchRelease();
+    return NULL;
+}
+
+void jobs_init(int numWorkers)
+{
+    if (atomic_load(&jobsRunning) || numWorkers < 1)
+    {
+        return;
+    }
+
+    jobsWorkers = heapCalloc(numWorkers, sizeof(JobWorker));
+    jobsNumWorkers = numWorkers;
+    atomic_store(&jobsRunning, true);
+    for (int i = 0; i < numWorkers; i++)
+    {
+        jobsWorkers[i].index = i;
+        if (pthread_create(&jobsWorkers[i].thread, NULL, jobs_workerMain, &jobsWorkers[i]) != 0)
+        {
+            // Workers that started steal from the rest's empty deques,
+            // which is harmless
+            printf("Could only start %d of %d job workers\n", i, numWorkers);
+            jobsNumWorkers = i;
+            break;
+        }
+    }
+}
+
+// Finish everything queued before calling this
+void jobs_shutdown()
+{
+    if (!atomic_load(&jobsRunning))
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&jobsSleepLock);
+    atomic_store(&jobsRunning, false);
+    pthread_cond_broadcast(&jobsWake);
+    pthread_mutex_unlock(&jobsSleepLock);
+
+    for (int i = 0; i < jobsNumWorkers; i++)
+    {
+        pthread_join(jobsWorkers[i].thread, NULL);
+    }
+    free(jobsWorkers);
+    jobsWorkers = NULL;
+    jobsNumWorkers = 0;
+}
+
+int jobs_numWorkers()
+{
+    return jobsNumWorkers;
+}
+
+void jobs_run(Job* jobs, size_t count, JobCounter* counter)
+{
+    if (counter)
+    {
+        atomic_fetch_add(&counter->remaining, count);
+    }
+
+    if (!atomic_load(&jobsRunning) || jobsNumWorkers == 0)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            jobs_execute(&jobs[i]);
+        }
+        return;
+    }
+
+    JobWorker* self = jobsCurrentWorker;
+    size_t queued = 0;
+    if (self)
+    {
+        // Counted before they go in so a quick thief never takes the count
+        // below zero
+        for (size_t i = 0; i < count; i++)
+        {
+            atomic_fetch_add(&jobsQueued, 1);
+            if (jobs_dequePush(&self->deque, &jobs[i]))
+            {
+                queued++;
+            }
+            else
+            {
+                atomic_fetch_sub(&jobsQueued, 1);
+                jobs_execute(&jobs[i]);
+            }
+        }
+    }
+    else
+    {
+        pthread_mutex_lock(&jobsSharedLock);
+        if (jobsSharedCount + count > jobsSharedCapacity)
+        {
+            while (jobsSharedCount + count > jobsSharedCapacity)
+            {
+                jobsSharedCapacity = jobsSharedCapacity ? jobsSharedCapacity * 2 : 256;
+            }
+            jobsShared = heapRealloc(jobsShared, sizeof(Job*) * jobsSharedCapacity);
+        }
+        // Reversed so they come off the end in the order given
+        for (size_t i = 0; i < count; i++)
+        {
+            jobsShared[jobsSharedCount + i] = &jobs[count - 1 - i];
+        }
+        jobsSharedCount += count;
+        atomic_fetch_add(&jobsQueued, count);
+        pthread_mutex_unlock(&jobsSharedLock);
+        queued = count;
+    }
+
+    if (queued > 0)
+    {
+        pthread_mutex_lock(&jobsSleepLock);
+        if (queued == 1)
+        {
+            pthread_cond_signal(&jobsWake);
+        }
+        else
+        {
+            pthread_cond_broadcast(&jobsWake);
+        }
+        pthread_mutex_unlock(&jobsSleepLock);
+    }
+}
+
+void jobs_wait(JobCounter* counter)
+{
+    while (atomic_load_explicit(&counter->remaining, memory_order_acquire) > 0)
+    {
+        Job* job = jobs_findFor(counter);
+        if (job)
+        {
+            jobs_execute(job);
+        }
+        else
+        {
+            // Whatever's left is running elsewhere
+            sched_yield();
+        }
+    }
+}
+
+typedef struct {
+    ParallelForFn fn;
+    void* ctx;
+    size_t begin;
+    size_t end;
+} JobSlice;
+
+static void jobs_runSlice(void* data)
+{
+    JobSlice* slice = data;
+    slice->fn(slice->begin, slice->end, slice->ctx);
+}
+
+void jobs_parallelFor(size_t count, size_t minPerJob, ParallelForFn fn, void* ctx)
+{
+    // Workers plus whoever's waiting
+    size_t numSlices = jobsNumWorkers + 1;
+    if (minPerJob < 1)
+    {
+        minPerJob = 1;
+    }
+    if (count / minPerJob < numSlices)
+    {
+        numSlices = count / minPerJob;
+    }
+
+    if (numSlices <= 1 || !atomic_load(&jobsRunning))
+    {
+        fn(0, count, ctx);
+        return;
+    }
+
+    JobCounter counter = { 0 };
+    JobSlice slices[numSlices];
+    Job jobs[numSlices];
+    size_t perSlice = count / numSlices;
+    for (size_t i = 0; i < numSlices; i++)
+    {
+        slices[i].fn = fn;
+        slices[i].ctx = ctx;
+        slices[i].begin = i * perSlice;
+        slices[i].end = i + 1 == numSlices ? count : (i + 1) * perSlice;
+        jobs[i].fn = jobs_runSlice;
+        jobs[i].data = &slices[i];
+        jobs[i].counter = &counter;
+    }
+
+    // The last slice runs here rather than waiting to be picked up
+    jobs_run(jobs, numSlices - 1, &counter);
+    jobs_runSlice(&slices[numSlices - 1]);
+    jobs_wait(&counter);
+}
@@ -0,0 +1,229 @@
+#include "lz4.h"
+#include <stdint.h>
+#include <string.h>
+
+// A greedy compressor with one hash table slot per 4 byte sequence. It
+// squeezes less out than the reference one, but it only runs in the packer,
+// and anything it writes decompresses at the same speed.
+
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5 // Every block ends on at least this many literals
+#define LZ4_MATCH_LIMIT 12 // and no match starts this close to its end
+#define LZ4_MAX_OFFSET 65535
+#define LZ4_HASH_BITS 12
+
+typedef struct {
+    unsigned char* op;
+    unsigned char* end;
+} Lz4Output;
+
+static uint32_t lz4_read32(const unsigned char* p)
+{
+    uint32_t value;
+    memcpy(&value, p, 4);
+    return value;
+}
+
+static uint32_t lz4_hash(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+size_t lz4CompressBound(size_t size)
+{
+    return size + size / 255 + 16;
+}
+
+// Lengths past what fits in the token carry on in bytes of 255 and a last
+// byte under it
+static bool lz4_writeLength(Lz4Output* out, size_t length)
+{
+    while (length >= 255)
+    {
+        if (out->op == out->end)
+        {
+            return false;
+        }
+        *out->op++ = 255;
+        length -= 255;
+    }
+    if (out->op == out->end)
+    {
+        return false;
+    }
+    *out->op++ = (unsigned char)length;
+    return true;
+}
+
+// A matchLength of 0 writes the last sequence, which is only literals
+static bool lz4_writeSequence(Lz4Output* out, const unsigned char* literals, size_t numLiterals, size_t offset, size_t matchLength)
+{
+    if (out->op == out->end)
+    {
+        return false;
+    }
+    unsigned char* token = out->op++;
+    *token = (numLiterals < 15 ? numLiterals : 15) << 4;
+    if (numLiterals >= 15 && !lz4_writeLength(out, numLiterals - 15))
+    {
+        return false;
+    }
+    if ((size_t)(out->end - out->op) < numLiterals)
+    {
+        return false;
+    }
+    memcpy(out->op, literals, numLiterals);
+    out->op += numLiterals;
+
+    if (matchLength == 0)
+    {
+        return true;
+    }
+    if (out->end - out->op < 2)
+    {
+        return false;
+    }
+    *out->op++ = offset & 0xff;
+    *out->op++ = offset >> 8;
+
+    size_t extra = matchLength - LZ4_MIN_MATCH;
+    *token |= extra < 15 ? extra : 15;
+    return extra < 15 || lz4_writeLength(out, extra - 15);
+}
+
+size_t lz4Compress(const unsigned char* src, size_t srcSize, unsigned char* dest, size_t destCapacity)
+{
+    if (srcSize > UINT32_MAX)
+    {
+        return 0;
+    }
+
+    // Where each sequence was last seen, plus one so 0 is nowhere
+    uint32_t table[1 << LZ4_HASH_BITS] = { 0 };
+    Lz4Output out = { dest, dest + destCapacity };
+    size_t anchor = 0;
+
+    if (srcSize > LZ4_MATCH_LIMIT)
+    {
+        size_t matchEnd = srcSize - LZ4_LAST_LITERALS;
+        size_t pos = 0;
+        while (pos < srcSize - LZ4_MATCH_LIMIT)
+        {
+            uint32_t sequence = lz4_read32(src + pos);
+            uint32_t* slot = &table[lz4_hash(sequence)];
+            size_t candidate = *slot;
+            *slot = pos + 1;
+            if (candidate == 0 || pos - (candidate - 1) > LZ4_MAX_OFFSET || lz4_read32(src + candidate - 1) != sequence)
+            {
+                pos++;
+                continue;
+            }
+
+            size_t match = candidate - 1;
+            size_t length = LZ4_MIN_MATCH;
+            while (pos + length < matchEnd && src[match + length] == src[pos + length])
+            {
+                length++;
+            }
+
+            if (!lz4_writeSequence(&out, src + anchor, pos - anchor, pos - match, length))
+            {
+                return 0;
+            }
+            pos += length;
+            anchor = pos;
+        }
+    }
+
+    if (!lz4_writeSequence(&out, src + anchor, srcSize - anchor, 0, 0))
+    {
+        return 0;
+    }
+    return out.op - dest;
+}
+
+static bool lz4_readLength(const unsigned char** ip, const unsigned char* end, size_t* length)
+{
+    unsigned char byte;
+    do
+    {
+        if (*ip == end)
+        {
+            return false;
+        }
+        byte = *(*ip)++;
+        *length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+// Every length and offset is checked against both buffers, so a corrupt
+// block fails instead of reading or writing past either of them
+bool lz4Decompress(const unsigned char* src, size_t srcSize, unsigned char* dest, size_t destSize)
+{
+    const unsigned char* ip = src;
+    const unsigned char* ipEnd = src + srcSize;
+    unsigned char* op = dest;
+    unsigned char* opEnd = dest + destSize;
+
+    while (ip < ipEnd)
+    {
+        unsigned int token = *ip++;
+        size_t numLiterals = token >> 4;
+        if (numLiterals == 15 && !lz4_readLength(&ip, ipEnd, &numLiterals))
+        {
+            return false;
+        }
+        if (numLiterals > (size_t)(ipEnd - ip) || numLiterals > (size_t)(opEnd - op))
+        {
+            return false;
+        }
+        memcpy(op, ip, numLiterals);
+        op += numLiterals;
+        ip += numLiterals;
+
+        // The last sequence has no match
+        if (ip == ipEnd)
+        {
+            break;
+        }
+
+        if (ipEnd - ip < 2)
+        {
+            return false;
+        }
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - dest))
+        {
+            return false;
+        }
+
+        size_t length = token & 15;
+        if (length == 15 && !lz4_readLength(&ip, ipEnd, &length))
+        {
+            return false;
+        }
+        length += LZ4_MIN_MATCH;
+        if (length > (size_t)(opEnd - op))
+        {
+            return false;
+        }
+
+        // Matches that overlap what they're writing repeat it, a byte at a time
+        const unsigned char* match = op - offset;
+        if (offset >= length)
+        {
+            memcpy(op, match, length);
+        }
+        else
+        {
+            for (size_t i = 0; i < length; i++)
+            {
+                op[i] = match[i];
+            }
+        }
+        op += length;
+    }
+    return op == opEnd;
+}
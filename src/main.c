@@ -2,17 +2,31 @@
 #include <GLFW/glfw3.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 #include "cglm/affine.h"
 #include "cglm/cglm.h"
 #include "cglm/mat3.h"
 #include "cglm/mat4.h"
 #include "cglm/util.h"
+#include "arena.h"
+#include "ecs.h"
+#include "extensions.h"
+#include "frame.h"
+#include "gputimer.h"
+#include "hotreload.h"
+#include "jobs.h"
 #include "light.h"
 #include "model.h"
+#include "pack.h"
+#include "resources.h"
+#include "ringbuffer.h"
+#include "scene.h"
 #include "shader.h"
+#include "streamer.h"
 #include "camera.h"
 #include "texture.h"
+#include "uniforms.h"
 #include "stb_image.h"
 
 // Epic face opacity
@@ -22,12 +36,25 @@ float visibility = 0.2f;
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
-// Camera Stuff
+// By this frame every arena and draw list has grown to fit, and a frame
+// that still goes to the heap gets reported
+#define STEADY_FRAME 120
+
+// How long a frame spends uploading what's been streamed in, in seconds
+#define STREAM_BUDGET 0.004
+
+// Frames between reports of how long drawing takes
+#define DRAW_REPORT_FRAMES 300
+
+// Camera Stuff. Only the update thread moves the camera, the callbacks
+// below just add up what happened for the next FrameInput.
 Camera* camera;
 
 // Mouse look stuff
 float lastX = 400, lastY = 300;
 bool firstMouse = true;
+float lookX = 0.0f, lookY = 0.0f;
+float scrollY = 0.0f;
 
 void mouse_callback(GLFWwindow* window, double xpos, double ypos)
 {
@@ -43,13 +70,25 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos)
     lastX = xpos;
     lastY = ypos;
 
-    cameraProcessMouse(camera, xoffset, yoffset, true);
+    lookX += xoffset;
+    lookY += yoffset;
+}
+
+// Picking: a left click selects whatever is under the crosshair
+bool pickRequested = false;
+
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
+{
+    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS)
+    {
+        pickRequested = true;
+    }
 }
 
 
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
-    cameraProcessScroll(camera, yoffset);
+    scrollY += yoffset;
 }
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
@@ -57,7 +96,8 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
     glViewport(0, 0, width, height);
 }
 
-void processInput(GLFWwindow *window)
+// Samples the keyboard and whatever the callbacks saw into input
+void processInput(GLFWwindow *window, FrameInput* input)
 {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
     {
@@ -74,42 +114,232 @@ void processInput(GLFWwindow *window)
         visibility -= 0.05f;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+    input->deltaTime = deltaTime;
+    input->moves[FORWARD] = glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS;
+    input->moves[BACKWARD] = glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS;
+    input->moves[LEFT] = glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS;
+    input->moves[RIGHT] = glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS;
+    input->moves[UP] = glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS;
+    input->moves[DOWN] = glfwGetKey(window, GLFW_KEY_LEFT_ALT) == GLFW_PRESS;
+    input->sprinting = glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS;
+
+    input->lookX = lookX;
+    input->lookY = lookY;
+    input->scroll = scrollY;
+    input->pick = pickRequested;
+    lookX = lookY = scrollY = 0.0f;
+    pickRequested = false;
+}
+
+// What the update thread works on
+typedef struct {
+    EcsWorld* world;
+    Scene* scene;
+    Shader* mainShader; // Belongs to its permutation
+    ShaderHandle outlineShader;
+    Entity selected; // Outlined, until something else gets clicked on
+    int windowWidth;
+    int windowHeight;
+} Game;
+
+// Runs on the update thread: moves the camera, runs the systems, and
+// records what the render thread should draw
+void updateFrame(const FrameInput* input, FramePacket* packet, void* ctx)
+{
+    Game* game = ctx;
+    EcsWorld* world = game->world;
+
+    if (input->lookX != 0.0f || input->lookY != 0.0f)
     {
-        cameraProcessKeyboard(camera, FORWARD, deltaTime);
+        cameraProcessMouse(camera, input->lookX, input->lookY, true);
     }
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+    if (input->scroll != 0.0f)
+    {
+        cameraProcessScroll(camera, input->scroll);
+    }
+    for (int i = 0; i < 6; i++)
+    {
+        if (input->moves[i])
+        {
+            cameraProcessKeyboard(camera, i, input->deltaTime);
+        }
+    }
+    camera->sprinting = input->sprinting;
+
+    cameraGetViewMatrix(camera, packet->view);
+    glm_perspective(glm_rad(camera->fov), (float)game->windowWidth/(float)game->windowHeight, 0.1f, 100.0f, packet->projection);
+    glm_vec3_copy(camera->pos, packet->cameraPos);
+    packet->fovY = glm_rad(camera->fov);
+
+    mat4 viewProjection;
+    glm_mat4_mul(packet->projection, packet->view, viewProjection);
+
+    ecs_updateTransforms(world);
+    ecs_updateBounds(world);
+    ecs_cull(world, viewProjection);
+
+    // The cursor is captured for mouse look, so picks go through the
+    // middle of the screen
+    if (input->pick)
+    {
+        vec4 viewport = { 0.0f, 0.0f, game->windowWidth, game->windowHeight };
+        vec3 rayOrigin, rayDirection;
+        cameraScreenRay(viewProjection, viewport, game->windowWidth * 0.5f, game->windowHeight * 0.5f, rayOrigin, rayDirection);
+
+        EcsPickHit hit;
+        ecs_setOutlined(world, game->selected, false);
+        game->selected = ecs_pick(world, rayOrigin, rayDirection, 100.0f, &hit);
+        ecs_setOutlined(world, game->selected, true);
+    }
+
+    ecs_gatherLights(world, packet->view, &packet->lights);
+    ecs_collectDraws(world, &packet->opaque, false);
+    ecs_collectDraws(world, &packet->outlined, true);
+    ecs_collectModels(world, packet);
+
+    // The outline is the selected entity scaled up a little
+    ecs_collectOutline(world, game->selected, 1.1f, &packet->outlines);
+
+    frame_recordDraws(&packet->opaque, game->mainShader, packet->view, &packet->opaqueCommands);
+    frame_recordDraws(&packet->outlined, game->mainShader, packet->view, &packet->outlinedCommands);
+    frame_recordDraws(&packet->outlines, resources_getShader(game->outlineShader), packet->view, &packet->outlineCommands);
+}
+
+struct Level;
+
+// A model of the level, which is in the scene as soon as it's streamed in
+typedef struct {
+    const char* path;
+    const char* name;
+    vec3 position;
+    float radius; // Rough size, so the closest models get loaded first
+    bool dynamic;
+    bool outlined;
+
+    struct Level* level;
+    int node;
+    Entity entity;
+    StreamRequest request;
+    ModelHandle model;
+} LevelModel;
+
+#define LEVEL_NUM_MODELS 2
+
+typedef struct Level {
+    LevelModel models[LEVEL_NUM_MODELS];
+    Game* game;
+    HotReload* hotReload;
+    ShaderPermutation* litShaders;
+    unsigned int mainFeatures;
+    unsigned int materialFeature;
+    bool materialsReady; // Until a model's materials can't be set up
+} Level;
+
+// Everything drawn with the main shader has to agree on where materials come
+// from, so once one model can't have a material buffer or texture array,
+// every model goes back to separate textures
+static void level_useBoundTextures(Level* level)
+{
+    Shader* fallback = shaderPermutationGet(level->litShaders, level->mainFeatures);
+    if (fallback == NULL)
     {
-        cameraProcessKeyboard(camera, BACKWARD, deltaTime);
+        printf("No shader to fall back to, materials will be wrong\n");
+        return;
     }
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+
+    level->materialsReady = false;
+    for (int i = 0; i < LEVEL_NUM_MODELS; i++)
     {
-        cameraProcessKeyboard(camera, LEFT, deltaTime);
+        Model* model = resources_getModel(level->models[i].model);
+        if (model)
+        {
+            model_useBoundTextures(model);
+        }
     }
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+    level->game->mainShader = fallback;
+}
+
+// Called by the streamer in the idle window, so the scene can be changed
+static void level_modelStreamed(StreamRequest request, ModelHandle handle, TextureHandle texture, void* ctx)
+{
+    // The entry already knows its request, and models don't come with a
+    // texture
+    (void)request;
+    (void)texture;
+    LevelModel* entry = ctx;
+    Level* level = entry->level;
+    Game* game = level->game;
+    entry->request = HANDLE_NONE;
+
+    Model* model = resources_getModel(handle);
+    if (model == NULL)
     {
-        cameraProcessKeyboard(camera, RIGHT, deltaTime);
+        printf("Leaving %s out of the level\n", entry->name);
+        return;
     }
+    entry->model = handle;
 
-    if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS)
+    if (level->materialsReady)
+    {
+        bool ready = true;
+        if (level->materialFeature == SHADER_FEATURE_BINDLESS)
+        {
+            ready = model_buildMaterialBuffer(model);
+        }
+        else if (level->materialFeature == SHADER_FEATURE_TEXTURE_ARRAY)
+        {
+            ready = model_buildTextureArray(&model, 1);
+        }
+        if (!ready)
+        {
+            level_useBoundTextures(level);
+        }
+    }
+    else
     {
-        cameraProcessKeyboard(camera, UP, deltaTime);
+        model_useBoundTextures(model);
     }
 
-    if (glfwGetKey(window, GLFW_KEY_LEFT_ALT) == GLFW_PRESS)
+    hotReloadAddModel(level->hotReload, handle, entry->path);
+    int inScene = scene_addModel(game->scene, entry->node, handle);
+    ecs_addRenderable(game->world, entry->entity, inScene, entry->outlined);
+    ecs_addBounds(game->world, entry->entity, entry->dynamic);
+}
+
+// The material path named by --materials, for comparing them on the same
+// scene. Returns false for one that's unknown or that the driver can't do.
+static bool parseMaterials(const char* name, unsigned int* materialFeature)
+{
+    if (strcmp(name, "bindless") == 0 && glExtensions.bindlessTexture)
     {
-        cameraProcessKeyboard(camera, DOWN, deltaTime);
+        *materialFeature = SHADER_FEATURE_BINDLESS;
     }
+    else if (strcmp(name, "array") == 0)
+    {
+        *materialFeature = SHADER_FEATURE_TEXTURE_ARRAY;
+    }
+    else if (strcmp(name, "bound") == 0)
+    {
+        *materialFeature = 0;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
 
-    if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS)
+static const char* materialsName(unsigned int materialFeature)
+{
+    switch (materialFeature)
     {
-        camera->sprinting = true;
-    } else {
-        camera->sprinting = false;
+        case SHADER_FEATURE_BINDLESS: return "bindless";
+        case SHADER_FEATURE_TEXTURE_ARRAY: return "array";
+        default: return "bound";
     }
 }
 
-int main()
+int main(int argc, char** argv)
 {
     printf("MATH-182: A custom game engine in C for learning and fun\nBy Willard Nilges\n");
 
@@ -137,6 +367,12 @@ int main()
         return -1;
     }
 
+    loadGLExtensions();
+
+    // Shaders, models and textures come out of the pack where there is one
+    // (see tools/packer.c), and are opened loose otherwise
+    packMount("assets.pack");
+
     int nrAttributes;
     glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &nrAttributes);
     printf("Maximum number of vertex attributes supported: %d\n", nrAttributes);
@@ -154,6 +390,7 @@ int main()
     // Mouse look
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
     glfwSetCursorPosCallback(window, mouse_callback);
+    glfwSetMouseButtonCallback(window, mouse_button_callback);
 
     // Scroll to zoom
     glfwSetScrollCallback(window, scroll_callback);
@@ -161,82 +398,255 @@ int main()
     // Initialize the camera
     camera = newCameraWithDefaults();
 
-    // Set up a shader for our backpack
-    Shader* mainShader = newShader(
-        "shaders/main/shader.vert",
-        "shaders/main/shader.frag"
+    // One worker per core besides this thread, which helps out whenever it
+    // waits on them
+    jobs_init(parallelNumThreads() - 1);
+    resources_init();
+
+    // All lit geometry comes out of one permutation. Each draw picks the
+    // variant that matches the lights and maps it actually uses.
+    ShaderPermutation* litShaders = newShaderPermutation(
+        "shaders/lit/lit.vert",
+        "shaders/lit/lit.frag"
     );
-    if (mainShader == NULL) {
+    if (litShaders == NULL) {
         printf("I'm outta here!\n");
         glfwTerminate();
         return -1;
     }
 
-    // Set up a shader for our backpack
-    Shader* outlineShader = newShader(
+    // Every program is compiled in one batch so the driver can chew on them
+    // while we set up the level and start loading models. Nothing is checked
+    // until shaderBatchFinish().
+    ShaderBatch* shaderBatch = newShaderBatch();
+
+    // Set up a shader for our backpack. Materials come from bindless handles
+    // where the driver has them, so meshes draw without texture binds.
+    // Bindless and texture arrays keep every level resident, so everywhere
+    // else textures are streamed under TEXTURE_STREAMING_BUDGET and bound
+    // the plain way.
+    unsigned int mainFeatures = SHADER_FEATURE_DIR_LIGHT | SHADER_FEATURE_SPECULAR_MAP;
+    unsigned int materialFeature = 0;
+    if (glExtensions.bindlessTexture)
+    {
+        materialFeature = SHADER_FEATURE_BINDLESS;
+        TEXTURE_STREAMING = false;
+    }
+
+    // --materials bindless|array|bound picks the path by hand
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (strcmp(argv[i], "--materials") != 0)
+        {
+            continue;
+        }
+        if (parseMaterials(argv[i + 1], &materialFeature))
+        {
+            TEXTURE_STREAMING = materialFeature == 0;
+        }
+        else
+        {
+            printf("Can't draw materials with %s here, using %s\n", argv[i + 1], materialsName(materialFeature));
+        }
+    }
+    printf("Drawing %s materials, %s textures\n", materialsName(materialFeature),
+        TEXTURE_STREAMING ? "streaming" : "not streaming");
+    Shader* mainShader = shaderPermutationRequest(litShaders,
+        mainFeatures | materialFeature, shaderBatch);
+
+    // ...and one for the outline around it
+    Shader* outlineShader = shaderBatchAdd(shaderBatch,
         "shaders/outlineHighlight/shader.vert",
         "shaders/outlineHighlight/shader.frag"
     );
+
     if (outlineShader == NULL) {
         printf("I'm outta here!\n");
         glfwTerminate();
         return -1;
     }
+    shaderBatchSubmit(shaderBatch);
+    double shadersSubmitted = glfwGetTime();
 
-    // XXX: Need to declare it like this so that dirname can edit it later :/
-    char backpackModelPath[] = "models/backpack/backpack.obj";
-    Model* backpack = newModel(backpackModelPath);
+    // Models are read and decoded on threads of their own, and show up a
+    // few frames in rather than holding up the first one
+    Streamer* streamer = newStreamer(2, 4);
+    if (streamer == NULL)
+    {
+        printf("I'm outta here!\n");
+        glfwTerminate();
+        return -1;
+    }
 
-    char floorModelPath[] = "models/plane/plane.obj";
-    Model* floor = newModel(floorModelPath);
+    // Pick up edits to shaders, models and textures without a restart
+    HotReload* hotReload = newHotReload();
+    hotReloadWatchDirectory(hotReload, "shaders");
+    hotReloadWatchDirectory(hotReload, "models");
+    hotReloadWatchDirectory(hotReload, "textures");
+    hotReloadAddPermutation(hotReload, litShaders);
+    ShaderHandle outlineHandle = resources_addShader(outlineShader);
+    hotReloadAddShader(hotReload, outlineHandle);
+
+    // Per-frame and per-draw uniform blocks are written straight into here.
+    // It grows to fit each frame's draws before the frame starts.
+    RingBuffer* uniformRing = newRingBuffer(64 * 1024);
+    if (uniformRing == NULL)
+    {
+        printf("I'm outta here!\n");
+        glfwTerminate();
+        return -1;
+    }
 
-    while(!glfwWindowShouldClose(window))
+    // Each model hangs off a node of its own that places it in the world
+    Scene* scene = newScene();
+
+    // Everything in the world is an entity, systems below do the rest
+    EcsWorld* world = newEcsWorld(scene);
+
+    // The backpack is the one thing that gets moved around, so its bounds
+    // live in the grid rather than the tree
+    Level level = {
+        .models = {
+            { .path = "models/plane/plane.obj", .name = "floor", .radius = 10.0f },
+            { .path = "models/backpack/backpack.obj", .name = "backpack", .radius = 2.0f, .dynamic = true, .outlined = true },
+        },
+        .hotReload = hotReload,
+        .litShaders = litShaders,
+        .mainFeatures = mainFeatures,
+        .materialFeature = materialFeature,
+        .materialsReady = true,
+    };
+
+    // Entities and nodes are there from the start, and get their model's
+    // renderable and bounds once it's in
+    for (int i = 0; i < LEVEL_NUM_MODELS; i++)
+    {
+        LevelModel* entry = &level.models[i];
+        entry->level = &level;
+        entry->node = scene_addNode(scene, SCENE_NO_PARENT, entry->name);
+        scene_setPosition(scene, entry->node, entry->position);
+        entry->entity = ecs_createEntity(world);
+        ecs_addTransform(world, entry->entity, entry->node);
+    }
+    Entity backpackEntity = level.models[1].entity;
+
+    DirLight sun = {
+        .direction = { -0.2f, -1.0f, -0.3f },
+        .ambient = { 0.1f, 0.1f, 0.1f },
+        .diffuse = { 0.5f, 0.5f, 0.5f },
+        .specular = { 1.0f, 1.0f, 1.0f },
+    };
+    Entity sunEntity = ecs_createEntity(world);
+    ecs_addLight(world, sunEntity, &sun);
+
+    // From here on the scene and the camera belong to the update thread,
+    // which always works on the frame after the one being drawn
+    Game game = { world, scene, mainShader, outlineHandle, backpackEntity, windowWidth, windowHeight };
+    level.game = &game;
+    for (int i = 0; i < LEVEL_NUM_MODELS; i++)
     {
-        processInput(window);
+        LevelModel* entry = &level.models[i];
+        entry->request = streamer_requestModel(streamer, entry->path, entry->position, entry->radius,
+            level_modelStreamed, entry);
+    }
 
-        float currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
+    // Whatever the streamer has read by now gets uploaded while the driver
+    // is still compiling. Without parallel compile the poll says done right
+    // away and shaderBatchFinish() does the waiting.
+    while (!shaderBatchPoll(shaderBatch))
+    {
+        streamer_update(streamer, STREAM_BUDGET);
+        glfwWaitEventsTimeout(0.001);
+    }
+    if (!shaderBatchFinish(shaderBatch)) {
+        printf("I'm outta here!\n");
+        glfwTerminate();
+        return -1;
+    }
+    printf("Shaders were ready %.1f ms after submitting them (parallel compile %s)\n",
+        (glfwGetTime() - shadersSubmitted) * 1000.0, glExtensions.parallelShaderCompile ? "on" : "off");
 
-        // Clear the screen with a color
-        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    FramePipeline* pipeline = newFramePipeline(updateFrame, &game);
+    if (pipeline == NULL)
+    {
+        printf("I'm outta here!\n");
+        glfwTerminate();
+        return -1;
+    }
 
-        mat4 view;
-        cameraGetViewMatrix(camera, view);
+    FrameInput input = { 0 };
+    framePipeline_submit(pipeline, &input);
 
-        mat4 projection;
-        glm_mat4_identity(projection);
-        glm_perspective(glm_rad(camera->fov), (float)windowWidth/(float)windowHeight, 0.1f, 100.0f, projection);
+    // How long the draw passes take, on the GPU and to submit
+    GpuTimer* drawTimer = newGpuTimer();
+    double drawCpuSeconds = 0.0;
+    size_t drawCount = 0;
 
-        vec3 zero = { 0.0f, 0.0f, 0.0f };
-        vec3 zeroOne = { 0.0f, 0.0f, -1.0f };
+    unsigned long frameNumber = 0;
+    bool levelStreamed = false;
+    while(!glfwWindowShouldClose(window))
+    {
+        size_t allocationsBefore = heapAllocations();
+        processInput(window, &input);
+
+        // The update thread sits idle between handing this packet over and
+        // the next submit, which is when models can be swapped for anything
+        // that changed on disk, and streamed in ones added to the level
+        FramePacket* packet = framePipeline_wait(pipeline);
+        hotReloadUpdate(hotReload);
 
-        // Set up the directional light
-        vec3 lightDir = { -0.2f, -1.0f, -0.3f };
-        vec3 viewspaceLightDir;
-        glm_mat4_mulv3(view, lightDir, 1.0, viewspaceLightDir);
+        mat4 viewProjection;
+        glm_mat4_mul(packet->projection, packet->view, viewProjection);
+        streamer_setViewer(streamer, packet->cameraPos, viewProjection);
+        streamer_update(streamer, STREAM_BUDGET);
+        framePipeline_submit(pipeline, &input);
 
-        // Lighting color information
-        vec3 ambientColor = { 0.1f, 0.1f, 0.1f };
-        vec3 diffuseColor = { 0.5f, 0.5f, 0.5f };
-        vec3 lightColor =   { 1.0f, 1.0f, 1.0f };
+        float currentFrame = glfwGetTime();
+        deltaTime = currentFrame - lastFrame;
+        lastFrame = currentFrame;
 
-        mat4 backpackModel;
-        glm_mat4_identity(backpackModel);
-        vec3 backpackPosition = { 0.0f, 0.0f, 0.0f };
-        glm_translate(backpackModel, backpackPosition);
+        // Every draw might change transform, and each allocation might be
+        // padded up to the ring's alignment
+        size_t numDraws = packet->opaque.count + packet->outlined.count + packet->outlines.count;
+        size_t ringBytes = sizeof(FrameUniforms) + sizeof(LightUniforms) + numDraws * sizeof(DrawUniforms)
+            + (numDraws + 2) * uniformRing->alignment;
+        ringBufferReserve(uniformRing, ringBytes);
+        ringBufferBeginFrame(uniformRing);
 
-        shaderUse(mainShader);
-        shaderSetMat4v(mainShader, "view", view);
-        shaderSetMat4v(mainShader, "projection", projection);
-        shaderSetVec3(mainShader, "dirLight.direction", viewspaceLightDir);
-        shaderSetVec3(mainShader, "dirLight.ambient", ambientColor);
-        shaderSetVec3(mainShader, "dirLight.diffuse", diffuseColor);
-        shaderSetVec3(mainShader, "dirLight.specular", lightColor);
-        shaderSetMat4v(mainShader, "model", backpackModel);
+        // Clear the screen with a color
+        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
-        model_draw(floor, mainShader);
+        size_t frameOffset;
+        FrameUniforms* frame = ringBufferAlloc(uniformRing, sizeof(FrameUniforms), &frameOffset);
+        size_t lightsOffset;
+        LightUniforms* lights = ringBufferAlloc(uniformRing, sizeof(LightUniforms), &lightsOffset);
+        if (frame == NULL || lights == NULL)
+        {
+            printf("No room in the uniform ring for the frame's uniforms\n");
+            break;
+        }
+        glm_mat4_copy(packet->view, frame->view);
+        glm_mat4_copy(packet->projection, frame->projection);
+        *lights = packet->lights;
+
+        ringBufferBindRange(uniformRing, GL_UNIFORM_BUFFER, UNIFORM_BINDING_FRAME, frameOffset, sizeof(FrameUniforms));
+        ringBufferBindRange(uniformRing, GL_UNIFORM_BUFFER, UNIFORM_BINDING_LIGHTS, lightsOffset, sizeof(LightUniforms));
+
+        shaderUse(game.mainShader);
+
+        if (TEXTURE_STREAMING)
+        {
+            for (size_t i = 0; i < packet->numModels; i++)
+            {
+                FrameModel* visible = &packet->models[i];
+                model_requestTextureLevels(visible->model, visible->transform, packet->cameraPos, packet->fovY, windowHeight);
+            }
+        }
+
+        double drawStart = glfwGetTime();
+        gpuTimerBegin(drawTimer);
+        frame_executeCommands(&packet->opaqueCommands, uniformRing);
 
         glEnable(GL_STENCIL_TEST);
         glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
@@ -244,31 +654,77 @@ int main()
         // 1st pass, draw the object, writing to stencil buffer
         glStencilFunc(GL_ALWAYS, 1, 0xFF); // Pass all fragments to stencil test
         glStencilMask(0xFF); // Enable writing to stencil buffer
-        model_draw(backpack, mainShader);
+        frame_executeCommands(&packet->outlinedCommands, uniformRing);
 
         // 2nd pass, draw outline.
         glStencilFunc(GL_NOTEQUAL, 1, 0xFF);
         glStencilMask(0x00);
         glDisable(GL_DEPTH_TEST);
-        shaderUse(outlineShader);
-        shaderSetMat4v(outlineShader, "view", view);
-        shaderSetMat4v(outlineShader, "projection", projection);
-        float scale = 1.1f;
-        vec3 sc = { scale, scale, scale };
-        glm_scale(backpackModel, sc);
-        shaderSetMat4v(outlineShader, "model", backpackModel);
-        model_draw(backpack, outlineShader);
+        shaderUse(resources_getShader(outlineHandle));
+        frame_executeCommands(&packet->outlineCommands, uniformRing);
         glBindVertexArray(0);
         glStencilMask(0xFF);
         glStencilFunc(GL_ALWAYS, 0, 0xFF);
         glEnable(GL_DEPTH_TEST);
+        gpuTimerEnd(drawTimer);
+        drawCpuSeconds += glfwGetTime() - drawStart;
+        drawCount += numDraws;
+
+        ringBufferEndFrame(uniformRing);
+        resources_endFrame();
+
+        // Stream texture levels for what this frame asked for
+        if (TEXTURE_STREAMING)
+        {
+            textureStreamUpdate();
+        }
 
         // Swap buffers!
         glfwSwapBuffers(window);
         // Read inputs!
         glfwPollEvents();
+
+        // Startup time, counted from glfwInit(), to the first frame and to
+        // the first one with the whole level in it
+        if (frameNumber == 0)
+        {
+            printf("First frame was up %.1f ms after startup\n", glfwGetTime() * 1000.0);
+        }
+        if (!levelStreamed && streamer_numPending(streamer) == 0)
+        {
+            levelStreamed = true;
+            printf("Level was streamed in %.1f ms after startup, by frame %lu\n", glfwGetTime() * 1000.0, frameNumber + 1);
+        }
+
+        if (frameNumber % DRAW_REPORT_FRAMES == DRAW_REPORT_FRAMES - 1)
+        {
+            printf("%zu draws a frame took %.3f ms on the GPU and %.3f ms to submit (%s materials)\n",
+                drawCount / DRAW_REPORT_FRAMES, gpuTimerAverageMs(drawTimer), drawCpuSeconds * 1000.0 / DRAW_REPORT_FRAMES,
+                level.materialsReady ? materialsName(materialFeature) : "bound");
+            printf("Waited %.3f ms a frame on the uniform ring (%s)\n",
+                uniformRing->stallSeconds * 1000.0 / DRAW_REPORT_FRAMES, uniformRing->persistent ? "persistent" : "copies");
+            uniformRing->stallSeconds = 0.0;
+            drawCpuSeconds = 0.0;
+            drawCount = 0;
+        }
+
+        size_t frameAllocations = heapAllocations() - allocationsBefore;
+        // Streaming allocates for what it loads, so only count the frames
+        // after it's done
+        if (++frameNumber > STEADY_FRAME && frameAllocations > 0 && streamer_numPending(streamer) == 0)
+        {
+            printf("Frame %lu made %zu heap allocations\n", frameNumber, frameAllocations);
+        }
     }
 
+    gpuTimerFree(drawTimer);
+    ringBufferFree(uniformRing);
+    framePipeline_free(pipeline);
+    streamer_free(streamer);
+    jobs_shutdown();
+    resources_shutdown();
+    shaderPermutationFree(litShaders);
     glfwTerminate();
+    packUnmount();
     return 0;
 }
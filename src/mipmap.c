@@ -0,0 +1,147 @@
+#include "mipmap.h"
+#include "parallel.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Rows of output per thread before it's worth splitting a level up
+#define MIPMAP_MIN_ROWS_PER_THREAD 64
+
+size_t mipmapNumLevels(int width, int height)
+{
+    // One level per halving, all the way down to 1x1
+    size_t numLevels = 1;
+    for (int size = width > height ? width : height; size > 1; size /= 2)
+    {
+        numLevels++;
+    }
+    return numLevels < MIPMAP_MAX_LEVELS ? numLevels : MIPMAP_MAX_LEVELS;
+}
+
+void mipmapLevelSize(int width, int height, size_t level, int* levelWidth, int* levelHeight)
+{
+    *levelWidth = width >> level;
+    *levelHeight = height >> level;
+    *levelWidth = *levelWidth > 0 ? *levelWidth : 1;
+    *levelHeight = *levelHeight > 0 ? *levelHeight : 1;
+}
+
+typedef struct {
+    const unsigned char* src;
+    int width;
+    int height;
+    unsigned char* dest;
+    int destWidth;
+} MipmapJob;
+
+static void mipmapDownsampleRows(size_t begin, size_t end, void* ctx)
+{
+    MipmapJob* job = ctx;
+    const unsigned char* src = job->src;
+    int width = job->width;
+    int height = job->height;
+    int w = job->destWidth;
+    size_t lastRow = (size_t)height - 1;
+
+    for (size_t y = begin; y < end; y++)
+    {
+        // Odd edges reuse the last row/column
+        size_t y0 = y * 2 < lastRow ? y * 2 : lastRow;
+        size_t y1 = y * 2 + 1 < lastRow ? y * 2 + 1 : lastRow;
+        const unsigned char* row0 = &src[y0 * width * 4];
+        const unsigned char* row1 = &src[y1 * width * 4];
+        unsigned char* out = &job->dest[y * w * 4];
+
+        int x = 0;
+#ifdef __SSE2__
+        // 8 source pixels from each row make 4 output pixels. Average the
+        // rows, then split even and odd pixels apart and average those.
+        if (width > 1)
+        {
+            for (; x + 4 <= w; x += 4)
+            {
+                __m128i a0 = _mm_loadu_si128((const __m128i*)&row0[x * 8]);
+                __m128i b0 = _mm_loadu_si128((const __m128i*)&row0[x * 8 + 16]);
+                __m128i a1 = _mm_loadu_si128((const __m128i*)&row1[x * 8]);
+                __m128i b1 = _mm_loadu_si128((const __m128i*)&row1[x * 8 + 16]);
+
+                __m128 a = _mm_castsi128_ps(_mm_avg_epu8(a0, a1));
+                __m128 b = _mm_castsi128_ps(_mm_avg_epu8(b0, b1));
+                __m128i even = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+                __m128i odd = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+
+                _mm_storeu_si128((__m128i*)&out[x * 4], _mm_avg_epu8(even, odd));
+            }
+        }
+#endif
+        for (; x < w; x++)
+        {
+            int x0 = x * 2 < width ? x * 2 : width - 1;
+            int x1 = x * 2 + 1 < width ? x * 2 + 1 : width - 1;
+            for (int c = 0; c < 4; c++)
+            {
+                int sum = row0[x0 * 4 + c] + row0[x1 * 4 + c]
+                        + row1[x0 * 4 + c] + row1[x1 * 4 + c];
+                out[x * 4 + c] = (sum + 2) / 4;
+            }
+        }
+    }
+}
+
+void mipmapDownsample(const unsigned char* src, int width, int height, unsigned char* dest)
+{
+    MipmapJob job;
+    job.src = src;
+    job.width = width;
+    job.height = height;
+    job.dest = dest;
+    job.destWidth = width > 1 ? width / 2 : 1;
+
+    int destHeight = height > 1 ? height / 2 : 1;
+    parallelFor(destHeight, MIPMAP_MIN_ROWS_PER_THREAD, mipmapDownsampleRows, &job);
+}
+
+void mipmapBuildChain(unsigned char** levels, size_t numLevels, int width, int height)
+{
+    for (size_t i = 1; i < numLevels; i++)
+    {
+        int w, h;
+        mipmapLevelSize(width, height, i - 1, &w, &h);
+        mipmapDownsample(levels[i - 1], w, h, levels[i]);
+    }
+}
+
+void mipmapResize(const unsigned char* src, int width, int height, unsigned char* dest, int destWidth, int destHeight)
+{
+    float scaleX = (float)width / destWidth;
+    float scaleY = (float)height / destHeight;
+
+    for (int y = 0; y < destHeight; y++)
+    {
+        // Sample at pixel centers
+        float sy = (y + 0.5f) * scaleY - 0.5f;
+        sy = sy < 0.0f ? 0.0f : sy;
+        int y0 = (int)sy;
+        int y1 = y0 + 1 < height ? y0 + 1 : height - 1;
+        float fy = sy - y0;
+
+        for (int x = 0; x < destWidth; x++)
+        {
+            float sx = (x + 0.5f) * scaleX - 0.5f;
+            sx = sx < 0.0f ? 0.0f : sx;
+            int x0 = (int)sx;
+            int x1 = x0 + 1 < width ? x0 + 1 : width - 1;
+            float fx = sx - x0;
+
+            for (int c = 0; c < 4; c++)
+            {
+                float top = src[((size_t)y0 * width + x0) * 4 + c] * (1.0f - fx)
+                          + src[((size_t)y0 * width + x1) * 4 + c] * fx;
+                float bottom = src[((size_t)y1 * width + x0) * 4 + c] * (1.0f - fx)
+                             + src[((size_t)y1 * width + x1) * 4 + c] * fx;
+                dest[((size_t)y * destWidth + x) * 4 + c] = (unsigned char)(top * (1.0f - fy) + bottom * fy + 0.5f);
+            }
+        }
+    }
+}
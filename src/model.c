@@ -1,6 +1,7 @@
 #include "model.h"
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include <assimp/cfileio.h>
 #include <assimp/cimport.h>
 #include <assimp/material.h>
 #include <assimp/postprocess.h>
@@ -10,37 +11,54 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 
 #include "assimp/types.h"
 #include "cglm/mat3.h"
+#include "cglm/ray.h"
+#include "cglm/mat4.h"
+#include "cglm/vec3.h"
 #include "cglm/types.h"
 //#include "libgen.h"
+#include "arena.h"
+#include "extensions.h"
 #include "libgen.h"
+#include "pack.h"
 #include "shader.h"
 #include "texture.h"
+#include "uniforms.h"
 
 const char MODEL_MATERIAL_DOT[] = "texture_%s%d";
 
 const char MODEL_TEXTURE_DIFFUSE[] = "diffuse";
 const char MODEL_TEXTURE_SPECULAR[] = "specular";
 
-Mesh* newMesh(Vertex* vertices, size_t numVertices, unsigned int* indices, size_t numIndices, Texture* textures, size_t numTextures)
+// Sets up a mesh in place around arrays the caller keeps alive, usually
+// carved from its model's memory. Nothing touches GL until mesh_setup().
+void mesh_init(Mesh* mesh, Vertex* vertices, size_t numVertices, unsigned int* indices, size_t numIndices, Texture* textures, size_t numTextures)
 {
-    Mesh* mesh = malloc(sizeof(Mesh));
     mesh->vertices = vertices;
     mesh->numVertices = numVertices;
     mesh->indices = indices;
     mesh->numIndices = numIndices;
     mesh->textures = textures;
     mesh->numTextures = numTextures;
+    mesh->diffuseLayer = -1;
+    mesh->specularLayer = -1;
+    mesh->node = 0;
+    mesh->triangleBvh = NULL;
+    mesh->VAO = 0;
+    mesh->VBO = 0;
+    mesh->EBO = 0;
 
-    mesh_setup(mesh);
-
-    return mesh;
+    mesh_computeBounds(mesh);
 }
 
-void mesh_draw(Mesh* mesh, Shader* shader)
+// Binds the mesh's own textures to consecutive units, points the material
+// samplers at them and draws it
+static void model_recordBoundTextures(Model* model, size_t index, Shader* shader, CommandBuffer* commands)
 {
+    Mesh* mesh = &model->meshes[index];
     unsigned int diffuseNr = 1;
     unsigned int specularNr = 1;
 
@@ -49,49 +67,33 @@ void mesh_draw(Mesh* mesh, Shader* shader)
     char texturesUsed[lenTexturesUsed][20];
     int texturesUsedIdx = 0;
 
-    //printf("Num textures: %zu\n", mesh->numTextures);
-    for (unsigned int i = 0; i < mesh->numTextures; i++)
+    for (unsigned int i = 0; i < mesh->numTextures && i < (unsigned int)lenTexturesUsed; i++)
     {
-        glActiveTexture(GL_TEXTURE0 + i); // Activate texture unit
         // retrieve texture number (N in diffuse_textureN)
-        char* number;
-        char* type = mesh->textures[i].type;
-        //printf("Texture: %s, Type: %s\n", mesh->textures[i].path, type);
+        const char* type = mesh->textures[i].type;
         if (strcmp(type, MODEL_TEXTURE_DIFFUSE) == 0)
         {
-            size_t lenType = strlen(type);
-            size_t lenNumber = snprintf(NULL, 0, "%u", diffuseNr);
-            // FIXME: This could segfault if I somehow load more than 16 textures
             snprintf(texturesUsed[texturesUsedIdx], 18, MODEL_MATERIAL_DOT, type, diffuseNr);
-            shaderSetInt(shader, texturesUsed[texturesUsedIdx], i);
+            commandBufferSetInt(commands, shader, texturesUsed[texturesUsedIdx], i);
             texturesUsedIdx++;
             diffuseNr++;
         }
         else if (strcmp(type, MODEL_TEXTURE_SPECULAR) == 0)
         {
-            size_t lenType = strlen(type);
-            size_t lenNumber = snprintf(NULL, 0, "%u", specularNr);
-            // FIXME: This could segfault if I somehow load more than 16 textures
             snprintf(texturesUsed[texturesUsedIdx], 18, MODEL_MATERIAL_DOT, type, specularNr);
-            shaderSetInt(shader, texturesUsed[texturesUsedIdx], i);
+            commandBufferSetInt(commands, shader, texturesUsed[texturesUsedIdx], i);
             texturesUsedIdx++;
             specularNr++;
         }
-        glBindTexture(GL_TEXTURE_2D, mesh->textures[i].id);
+        commandBufferBindTextureHandle(commands, i, mesh->textures[i].handle);
     }
-    glActiveTexture(GL_TEXTURE0);
-
-    //printf("Indices: %zu\n", mesh->numIndices);
 
-    // Draw mesh
-    glBindVertexArray(mesh->VAO);
-    glDrawElements(GL_TRIANGLES, mesh->numIndices, GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+    commandBufferDrawMesh(commands, model, index);
 
     // Clean up the uniforms
     for (int i = 0; i < texturesUsedIdx; i++)
     {
-        shaderSetInt(shader, texturesUsed[i], 0);
+        commandBufferSetInt(commands, shader, texturesUsed[i], 0);
     }
 }
 
@@ -134,43 +136,776 @@ void mesh_setup(Mesh* mesh)
     glBindVertexArray(0);
 }
 
-Model* newModel(char* path)
+void mesh_computeBounds(Mesh* mesh)
+{
+    vec3s min = { { INFINITY, INFINITY, INFINITY } };
+    vec3s max = { { -INFINITY, -INFINITY, -INFINITY } };
+    for (size_t i = 0; i < mesh->numVertices; i++)
+    {
+        vec3s p = mesh->vertices[i].Position;
+        min.x = fminf(min.x, p.x);
+        min.y = fminf(min.y, p.y);
+        min.z = fminf(min.z, p.z);
+        max.x = fmaxf(max.x, p.x);
+        max.y = fmaxf(max.y, p.y);
+        max.z = fmaxf(max.z, p.z);
+    }
+
+    if (mesh->numVertices == 0)
+    {
+        min = max = (vec3s){ { 0.0f, 0.0f, 0.0f } };
+    }
+    mesh->boundsCenter.x = (min.x + max.x) * 0.5f;
+    mesh->boundsCenter.y = (min.y + max.y) * 0.5f;
+    mesh->boundsCenter.z = (min.z + max.z) * 0.5f;
+    mesh->boundsRadius = 0.5f * sqrtf((max.x - min.x) * (max.x - min.x)
+        + (max.y - min.y) * (max.y - min.y)
+        + (max.z - min.z) * (max.z - min.z));
+
+    // Ratio of total UV area to total surface area, as a length
+    double uvArea = 0.0;
+    double area = 0.0;
+    for (size_t i = 0; i + 2 < mesh->numIndices; i += 3)
+    {
+        Vertex* a = &mesh->vertices[mesh->indices[i]];
+        Vertex* b = &mesh->vertices[mesh->indices[i + 1]];
+        Vertex* c = &mesh->vertices[mesh->indices[i + 2]];
+
+        vec3 ab, ac, cross;
+        glm_vec3_sub(b->Position.raw, a->Position.raw, ab);
+        glm_vec3_sub(c->Position.raw, a->Position.raw, ac);
+        glm_vec3_cross(ab, ac, cross);
+        area += 0.5 * glm_vec3_norm(cross);
+
+        float u1 = b->TexCoords.x - a->TexCoords.x;
+        float v1 = b->TexCoords.y - a->TexCoords.y;
+        float u2 = c->TexCoords.x - a->TexCoords.x;
+        float v2 = c->TexCoords.y - a->TexCoords.y;
+        uvArea += 0.5 * fabsf(u1 * v2 - u2 * v1);
+    }
+    mesh->uvDensity = area > 0.0 ? sqrt(uvArea / area) : 0.0f;
+}
+
+static float mesh_rayTriangle(unsigned int triangle, vec3 origin, vec3 direction, void* user)
+{
+    Mesh* mesh = user;
+    unsigned int* indices = &mesh->indices[triangle * 3];
+    float distance;
+    if (!glm_ray_triangle(origin, direction,
+            mesh->vertices[indices[0]].Position.raw,
+            mesh->vertices[indices[1]].Position.raw,
+            mesh->vertices[indices[2]].Position.raw, &distance))
+    {
+        return -1.0f;
+    }
+    return distance;
+}
+
+static void mesh_buildTriangleBvh(Mesh* mesh)
+{
+    size_t numTriangles = mesh->numIndices / 3;
+    vec3* mins = heapAlloc(sizeof(vec3) * numTriangles);
+    vec3* maxs = heapAlloc(sizeof(vec3) * numTriangles);
+    for (size_t i = 0; i < numTriangles; i++)
+    {
+        glm_vec3_copy(mesh->vertices[mesh->indices[i * 3]].Position.raw, mins[i]);
+        glm_vec3_copy(mins[i], maxs[i]);
+        for (int k = 1; k < 3; k++)
+        {
+            float* p = mesh->vertices[mesh->indices[i * 3 + k]].Position.raw;
+            glm_vec3_minv(mins[i], p, mins[i]);
+            glm_vec3_maxv(maxs[i], p, maxs[i]);
+        }
+    }
+
+    mesh->triangleBvh = newBvh();
+    bvh_build(mesh->triangleBvh, mins, maxs, numTriangles);
+    free(mins);
+    free(maxs);
+}
+
+// Distance along a model space ray to the closest triangle it hits, in
+// multiples of direction, or -1 if it misses. Writes the triangle's index
+// (its first index is indices[triangle * 3]) if triangle isn't NULL.
+float mesh_raycast(Mesh* mesh, vec3 origin, vec3 direction, float maxDistance, int* triangle)
 {
-    Model* model = malloc(sizeof(Model));
+    if (!mesh->triangleBvh)
+    {
+        mesh_buildTriangleBvh(mesh);
+    }
+
+    float distance;
+    int hit = bvh_raycast(mesh->triangleBvh, origin, direction, maxDistance, mesh_rayTriangle, mesh, &distance);
+    if (hit < 0)
+    {
+        return -1.0f;
+    }
+    if (triangle)
+    {
+        *triangle = hit;
+    }
+    return distance;
+}
 
+// Empties a model, without freeing anything it had
+void model_init(Model* model)
+{
     model->meshes = NULL;
     model->numMeshes = 0;
 
     model->directory = NULL;
 
-    model->texturesLoaded = NULL;
-    model->numTexturesLoaded = 0;
+    model->nodes = NULL;
+    model->numNodes = 0;
+    model->textureArray = NULL;
+    model->materialBuffer = 0;
+    model->memory = NULL;
+}
 
+Model* newModel(const char* path)
+{
+    Model* model = heapAlloc(sizeof(Model));
+    model_init(model);
     model_loadModel(model, path);
-
     return model;
 }
 
-void model_loadModel(Model* model, char* path)
+// Everything a model file needs, counted before anything is allocated
+typedef struct {
+    size_t numNodes;
+    size_t numMeshes;
+    size_t numVertices;
+    size_t numIndices;
+    size_t numTextures;
+    size_t nameBytes;
+    size_t textureNameBytes;
+} ModelSizes;
+
+static void model_countNode(const struct aiNode* node, const struct aiScene* scene, ModelSizes* sizes)
+{
+    sizes->numNodes++;
+    sizes->nameBytes += node->mName.length + 1;
+    for (unsigned int i = 0; i < node->mNumMeshes; i++)
+    {
+        const struct aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
+        sizes->numMeshes++;
+        sizes->numVertices += mesh->mNumVertices;
+        for (unsigned int f = 0; f < mesh->mNumFaces; f++)
+        {
+            sizes->numIndices += mesh->mFaces[f].mNumIndices;
+        }
+
+        const struct aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+        enum aiTextureType types[] = { aiTextureType_DIFFUSE, aiTextureType_SPECULAR };
+        for (int t = 0; t < 2; t++)
+        {
+            unsigned int count = aiGetMaterialTextureCount(material, types[t]);
+            for (unsigned int k = 0; k < count; k++)
+            {
+                struct aiString str;
+                aiGetMaterialTexture(material, types[t], k, &str, NULL, NULL, NULL, NULL, NULL, NULL);
+                sizes->textureNameBytes += str.length + 1;
+            }
+            sizes->numTextures += count;
+        }
+    }
+    for (unsigned int i = 0; i < node->mNumChildren; i++)
+    {
+        model_countNode(node->mChildren[i], scene, sizes);
+    }
+}
+
+// Bytes of model memory for everything counted, with room to align each
+// array that gets carved out of it
+static size_t model_memorySize(const ModelSizes* sizes, size_t pathBytes)
 {
-    const struct aiScene* scene = aiImportFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
+    size_t numArrays = 2 + sizes->numMeshes * 3 + sizes->numNodes + 1;
+    return sizeof(ModelNode) * sizes->numNodes
+        + sizeof(Mesh) * sizes->numMeshes
+        + sizeof(Vertex) * sizes->numVertices
+        + sizeof(unsigned int) * sizes->numIndices
+        + sizeof(Texture) * sizes->numTextures
+        + sizes->nameBytes
+        + pathBytes
+        + sizes->textureNameBytes + sizes->numTextures * pathBytes // Texture paths start with the directory
+        + numArrays * 16;
+}
+
+// Assimp reads models and the files they pull in, like .mtl files, through
+// these, so they come out of the mounted pack like everything else (see
+// pack.h)
+typedef struct {
+    struct aiFile file;
+    PackFile data;
+    size_t position;
+} ModelFile;
+
+static size_t model_fileRead(struct aiFile* file, char* buffer, size_t size, size_t count)
+{
+    ModelFile* modelFile = (ModelFile*)file;
+    if (size == 0)
+    {
+        return 0;
+    }
+    size_t available = (modelFile->data.size - modelFile->position) / size;
+    count = count < available ? count : available;
+    memcpy(buffer, modelFile->data.data + modelFile->position, size * count);
+    modelFile->position += size * count;
+    return count;
+}
+
+static size_t model_fileWrite(struct aiFile* file, const char* buffer, size_t size, size_t count)
+{
+    return 0;
+}
+
+static size_t model_fileTell(struct aiFile* file)
+{
+    return ((ModelFile*)file)->position;
+}
+
+static size_t model_fileSize(struct aiFile* file)
+{
+    return ((ModelFile*)file)->data.size;
+}
+
+static enum aiReturn model_fileSeek(struct aiFile* file, size_t offset, enum aiOrigin origin)
+{
+    ModelFile* modelFile = (ModelFile*)file;
+    size_t base = origin == aiOrigin_CUR ? modelFile->position : origin == aiOrigin_END ? modelFile->data.size : 0;
+    if (offset > modelFile->data.size - base)
+    {
+        return aiReturn_FAILURE;
+    }
+    modelFile->position = base + offset;
+    return aiReturn_SUCCESS;
+}
+
+static void model_fileFlush(struct aiFile* file)
+{
+}
+
+static struct aiFile* model_fileOpen(struct aiFileIO* io, const char* path, const char* mode)
+{
+    if (strchr(mode, 'w') || strchr(mode, 'a'))
+    {
+        return NULL;
+    }
+
+    ModelFile* modelFile = heapCalloc(1, sizeof(ModelFile));
+    if (!packOpenFile(path, &modelFile->data))
+    {
+        free(modelFile);
+        return NULL;
+    }
+    modelFile->file.ReadProc = model_fileRead;
+    modelFile->file.WriteProc = model_fileWrite;
+    modelFile->file.TellProc = model_fileTell;
+    modelFile->file.FileSizeProc = model_fileSize;
+    modelFile->file.SeekProc = model_fileSeek;
+    modelFile->file.FlushProc = model_fileFlush;
+    return &modelFile->file;
+}
+
+static void model_fileClose(struct aiFileIO* io, struct aiFile* file)
+{
+    ModelFile* modelFile = (ModelFile*)file;
+    packCloseFile(&modelFile->data);
+    free(modelFile);
+}
+
+// Loads the file into an empty model, everything but the GL side, so it
+// can run on any thread. The file is walked once to size everything, then
+// nodes, meshes, vertices, indices, textures and names are all carved from
+// a single block the model owns. Texture handles stay 0 and only the paths
+// are filled in until the meshes are uploaded.
+bool model_loadData(Model* model, const char* path)
+{
+    struct aiFileIO io = { model_fileOpen, model_fileClose, NULL };
+    const struct aiScene* scene = aiImportFileEx(path, aiProcess_Triangulate | aiProcess_FlipUVs, &io);
     if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE)
     {
         printf("ERROR::ASSIMP::%s\n", aiGetErrorString());
+        aiReleaseImport(scene);
+        return false;
+    }
+
+    ModelSizes sizes = { 0 };
+    model_countNode(scene->mRootNode, scene, &sizes);
+    model->memory = newArena(model_memorySize(&sizes, strlen(path) + 1));
+    if (model->memory == NULL)
+    {
+        aiReleaseImport(scene);
+        return false;
+    }
+
+    // dirname() edits the path in place, so it gets a copy of its own
+    model->directory = dirname(arenaPrintf(model->memory, "%s", path));
+    model->nodes = arenaAlloc(model->memory, sizeof(ModelNode) * sizes.numNodes, _Alignof(ModelNode));
+    model->meshes = arenaAlloc(model->memory, sizeof(Mesh) * sizes.numMeshes, _Alignof(Mesh));
+    model_processNode(model, scene->mRootNode, scene, -1);
+    aiReleaseImport(scene);
+    return true;
+}
+
+// Gives a mesh loaded by model_loadData() its GL objects and textures.
+// images can hold the mesh's textures in order, already loaded by
+// textureLoadImage(), and are taken over. Without them, or for any image
+// left without levels because it didn't load, the textures are loaded here.
+void model_uploadMesh(Model* model, size_t index, TexCacheImage* images)
+{
+    Mesh* mesh = &model->meshes[index];
+    mesh_setup(mesh);
+    for (size_t t = 0; t < mesh->numTextures; t++)
+    {
+        // The registry only loads the file if no model has it yet
+        Texture* texture = &mesh->textures[t];
+        if (images && images[t].numLevels > 0)
+        {
+            texture->handle = textureAcquireImage(texture->path, &images[t]);
+        }
+        else
+        {
+            texture->handle = textureAcquire(texture->path);
+        }
+        texture->path = textureGetPath(texture->handle);
+    }
+}
+
+void model_loadModel(Model* model, const char* path)
+{
+    if (!model_loadData(model, path))
+    {
         return;
     }
-    model->directory = dirname(path);
-    model_processNode(model, scene->mRootNode, scene);
+    for (size_t i = 0; i < model->numMeshes; i++)
+    {
+        model_uploadMesh(model, i, NULL);
+    }
 }
 
+// The layer texture is in, or -1
+static int model_findLayer(const ModelTextureArray* array, TextureHandle texture)
+{
+    for (size_t i = 0; i < array->numLayers; i++)
+    {
+        if (array->layers[i] == texture)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Points each mesh at the layers of its first diffuse and specular map.
+// Returns false if the array is missing any of the model's textures.
+static bool model_assignLayers(Model* model, const ModelTextureArray* array)
+{
+    bool complete = true;
+    for (size_t i = 0; i < model->numMeshes; i++)
+    {
+        Mesh* mesh = &model->meshes[i];
+        mesh->diffuseLayer = -1;
+        mesh->specularLayer = -1;
+        for (size_t t = 0; t < mesh->numTextures; t++)
+        {
+            TextureHandle texture = mesh->textures[t].handle;
+            int layer = model_findLayer(array, texture);
+            if (layer < 0)
+            {
+                complete = complete && texture == 0;
+                continue;
+            }
+
+            if (mesh->diffuseLayer < 0 && strcmp(mesh->textures[t].type, MODEL_TEXTURE_DIFFUSE) == 0)
+            {
+                mesh->diffuseLayer = layer;
+            }
+            else if (mesh->specularLayer < 0 && strcmp(mesh->textures[t].type, MODEL_TEXTURE_SPECULAR) == 0)
+            {
+                mesh->specularLayer = layer;
+            }
+        }
+    }
+    return complete;
+}
+
+// (Re)creates the GL texture from the array's layers, keeping the old one
+// if that fails
+static bool model_uploadTextureArray(ModelTextureArray* array)
+{
+    const char** paths = heapAlloc(sizeof(char*) * (array->numLayers ? array->numLayers : 1));
+    for (size_t i = 0; i < array->numLayers; i++)
+    {
+        paths[i] = textureGetPath(array->layers[i]);
+    }
+    unsigned int id = textureArrayCreate(paths, array->numLayers);
+    free(paths);
+    if (id == 0)
+    {
+        return false;
+    }
+
+    if (array->id != 0)
+    {
+        glDeleteTextures(1, &array->id);
+    }
+    array->id = id;
+    return true;
+}
+
+// Deletes the array and lets go of its textures
+static void model_freeTextureArray(ModelTextureArray* array)
+{
+    if (array->id != 0)
+    {
+        glDeleteTextures(1, &array->id);
+    }
+    for (size_t i = 0; i < array->numLayers; i++)
+    {
+        textureRelease(array->layers[i]);
+    }
+    free(array->layers);
+    free(array);
+}
+
+// Lets go of the model's texture array, deleting it if no other model uses it
+static void model_releaseTextureArray(Model* model)
+{
+    ModelTextureArray* array = model->textureArray;
+    model->textureArray = NULL;
+    if (array != NULL && --array->refs == 0)
+    {
+        model_freeTextureArray(array);
+    }
+}
+
+// Gives back what the model holds without freeing the Model itself. The
+// texture array and material buffer are left alone.
+static void model_release(Model* model)
+{
+    for (size_t i = 0; i < model->numMeshes; i++)
+    {
+        Mesh* mesh = &model->meshes[i];
+        glDeleteVertexArrays(1, &mesh->VAO);
+        glDeleteBuffers(1, &mesh->VBO);
+        glDeleteBuffers(1, &mesh->EBO);
+        if (mesh->triangleBvh)
+        {
+            bvh_free(mesh->triangleBvh);
+        }
+        for (size_t t = 0; t < mesh->numTextures; t++)
+        {
+            textureRelease(mesh->textures[t].handle);
+        }
+    }
+    arenaFree(model->memory);
+    model_init(model);
+}
+
+// Frees the model's memory, its meshes' GL objects and its material buffer,
+// and lets go of its textures and texture array.
+void model_free(Model* model)
+{
+    if (model == NULL)
+    {
+        return;
+    }
+    model_useBoundTextures(model);
+    model_release(model);
+    free(model);
+}
+
+// Loads the model at path from scratch and swaps it into model, so every
+// pointer to it sees the new meshes on the next draw. The old meshes are
+// freed, unless the new file doesn't load, in which case they're kept.
+// Only call it while nothing is recording or casting rays against the
+// model, since the meshes and their triangle trees go away.
+bool model_reload(Model* model, const char* path)
+{
+    Model fresh;
+    model_init(&fresh);
+    model_loadModel(&fresh, path);
+    if (fresh.numMeshes == 0)
+    {
+        printf("Keeping old model, reload of %s failed.\n", path);
+        model_release(&fresh);
+        return false;
+    }
+
+    // The new meshes may use different textures, so the layers and
+    // material handles are redone. Their textures were acquired before the
+    // old ones are released, so the ones both use stay loaded.
+    ModelTextureArray* oldTextureArray = model->textureArray;
+    unsigned int oldMaterialBuffer = model->materialBuffer;
+
+    model_release(model);
+    *model = fresh;
+
+    // An array shared with other models stays shared as long as it has
+    // every texture the new meshes use, otherwise the model gets its own
+    model->textureArray = oldTextureArray;
+    if (model->textureArray != NULL && !model_assignLayers(model, model->textureArray))
+    {
+        model_buildTextureArray(&model, 1);
+    }
+
+    model->materialBuffer = oldMaterialBuffer;
+    if (model->materialBuffer != 0)
+    {
+        model_buildMaterialBuffer(model);
+    }
+
+    printf("Reloaded model %s\n", path);
+    return true;
+}
+
+// Draws every mesh with whatever transform is already bound, ignoring the
+// node transforms. Use a Scene to draw multi-part models properly.
 void model_draw(Model* model, Shader* shader)
 {
+    model_beginDraw(model, shader);
     for (unsigned int i = 0; i < model->numMeshes; i++)
     {
-        mesh_draw(&model->meshes[i], shader);
+        model_drawMesh(model, i, shader);
+    }
+}
+
+// Binds what the model's meshes share before any of them are drawn
+void model_recordBegin(Model* model, Shader* shader, CommandBuffer* commands)
+{
+    // Bindless: the shader pulls each mesh's handles out of the material
+    // buffer, so there's nothing to bind per mesh at all
+    if (model->materialBuffer != 0)
+    {
+        commandBufferBindUniformBuffer(commands, UNIFORM_BINDING_MATERIALS, &model->materialBuffer);
+    }
+    else if (model->textureArray != NULL)
+    {
+        // One bind for the whole model, meshes only pick their layers
+        commandBufferBindTexture(commands, 0, GL_TEXTURE_2D_ARRAY, &model->textureArray->id);
+        commandBufferSetInt(commands, shader, "materialTextures", 0);
+    }
+}
+
+// Draws one mesh, after model_recordBegin()
+void model_recordMesh(Model* model, size_t index, Shader* shader, CommandBuffer* commands)
+{
+    Mesh* mesh = &model->meshes[index];
+    if (model->materialBuffer != 0)
+    {
+        commandBufferSetInt(commands, shader, "materialIndex", index);
+        commandBufferDrawMesh(commands, model, index);
+    }
+    else if (model->textureArray != NULL)
+    {
+        commandBufferSetInt(commands, shader, "diffuseLayer", mesh->diffuseLayer);
+        commandBufferSetInt(commands, shader, "specularLayer", mesh->specularLayer);
+        commandBufferDrawMesh(commands, model, index);
+    }
+    else
+    {
+        model_recordBoundTextures(model, index, shader, commands);
+    }
+}
+
+// Immediate versions of the above for the thread with the GL context, which
+// record into a buffer of their own and play it straight back
+static CommandBuffer* model_immediateCommands()
+{
+    static CommandBuffer* commands = NULL;
+    if (commands == NULL)
+    {
+        commands = newCommandBuffer();
+    }
+    commandBufferReset(commands);
+    return commands;
+}
+
+void model_beginDraw(Model* model, Shader* shader)
+{
+    CommandBuffer* commands = model_immediateCommands();
+    model_recordBegin(model, shader, commands);
+    commandBufferExecute(commands, NULL);
+}
+
+void model_drawMesh(Model* model, size_t index, Shader* shader)
+{
+    CommandBuffer* commands = model_immediateCommands();
+    model_recordMesh(model, index, shader, commands);
+    commandBufferExecute(commands, NULL);
+}
+
+// Packs every material texture of the given models into one texture array
+// they all share, and gives each mesh the layers of its first diffuse and
+// specular map. Passing several models lets them be drawn back to back
+// without any texture binds. Whatever array a model had before is let go
+// of. Returns false and leaves the models as they were if the array can't
+// be made.
+bool model_buildTextureArray(Model** models, size_t numModels)
+{
+    ModelTextureArray* array = heapCalloc(1, sizeof(ModelTextureArray));
+    for (size_t m = 0; m < numModels; m++)
+    {
+        for (size_t i = 0; i < models[m]->numMeshes; i++)
+        {
+            Mesh* mesh = &models[m]->meshes[i];
+            for (size_t t = 0; t < mesh->numTextures; t++)
+            {
+                TextureHandle texture = mesh->textures[t].handle;
+                if (texture != 0 && model_findLayer(array, texture) < 0)
+                {
+                    array->layers = heapRealloc(array->layers, sizeof(TextureHandle) * (array->numLayers + 1));
+                    array->layers[array->numLayers++] = texture;
+                    textureRetain(texture);
+                }
+            }
+        }
+    }
+
+    if (!model_uploadTextureArray(array))
+    {
+        printf("Unable to build texture array, using separate textures.\n");
+        model_freeTextureArray(array);
+        return false;
+    }
+
+    array->refs = numModels;
+    for (size_t m = 0; m < numModels; m++)
+    {
+        model_releaseTextureArray(models[m]);
+        models[m]->textureArray = array;
+        model_assignLayers(models[m], array);
+    }
+    return true;
+}
+
+// Rebuilds the model's texture array, if it has one, after one of its
+// textures changed. Every model sharing the array sees the new one.
+void model_refreshTextureArray(Model* model)
+{
+    if (model->textureArray != NULL && !model_uploadTextureArray(model->textureArray))
+    {
+        printf("Unable to rebuild texture array, keeping the old one.\n");
+    }
+}
+
+// Matches struct Material in shaders/lit/lit.frag under std140
+typedef struct {
+    uint64_t diffuse;
+    uint64_t specular;
+} ModelMaterial;
+
+static uint64_t model_findBindlessHandle(Mesh* mesh, const char* type)
+{
+    for (size_t t = 0; t < mesh->numTextures; t++)
+    {
+        if (strcmp(mesh->textures[t].type, type) == 0)
+        {
+            return mesh->textures[t].bindlessHandle;
+        }
+    }
+    return 0;
+}
+
+// Makes every texture of the model resident through GL_ARB_bindless_texture
+// and writes the handles of each mesh's first diffuse and specular map into
+// a uniform buffer, indexed by mesh. Missing maps are left as 0 and the
+// shader skips them. Returns false, leaving the model as it was, if bindless
+// textures aren't available or the model has too many meshes for one buffer.
+bool model_buildMaterialBuffer(Model* model)
+{
+    if (!glExtensions.bindlessTexture || model->numMeshes > MODEL_MAX_BINDLESS_MATERIALS)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < model->numMeshes; i++)
+    {
+        Mesh* mesh = &model->meshes[i];
+        for (size_t t = 0; t < mesh->numTextures; t++)
+        {
+            mesh->textures[t].bindlessHandle = textureGetBindlessHandle(mesh->textures[t].handle);
+        }
+    }
+
+    // The whole block has to be backed even if the model has fewer meshes
+    ModelMaterial* materials = heapCalloc(MODEL_MAX_BINDLESS_MATERIALS, sizeof(ModelMaterial));
+    for (size_t i = 0; i < model->numMeshes; i++)
+    {
+        materials[i].diffuse = model_findBindlessHandle(&model->meshes[i], MODEL_TEXTURE_DIFFUSE);
+        materials[i].specular = model_findBindlessHandle(&model->meshes[i], MODEL_TEXTURE_SPECULAR);
+    }
+
+    if (model->materialBuffer == 0)
+    {
+        glGenBuffers(1, &model->materialBuffer);
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, model->materialBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(ModelMaterial) * MODEL_MAX_BINDLESS_MATERIALS, materials, GL_STATIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    free(materials);
+    return true;
+}
+
+// Drops the texture array and material buffer so the model goes back to
+// binding each mesh's textures, for shaders built without either.
+void model_useBoundTextures(Model* model)
+{
+    model_releaseTextureArray(model);
+    if (model->materialBuffer != 0)
+    {
+        glDeleteBuffers(1, &model->materialBuffer);
+        model->materialBuffer = 0;
     }
 }
 
+// Tells texture streaming how much detail each mesh's textures need this
+// frame, from how many UV units one pixel covers at the mesh's nearest
+// point to the camera. fovY is in radians. Call it before drawing.
+void model_requestTextureLevels(Model* model, mat4 transform, vec3 cameraPos, float fovY, float viewportHeight)
+{
+    // The transform's largest axis scale is close enough for density
+    float scale = fmaxf(glm_vec3_norm(transform[0]), fmaxf(glm_vec3_norm(transform[1]), glm_vec3_norm(transform[2])));
+    float pixelsPerUnitAtOne = viewportHeight / (2.0f * tanf(fovY * 0.5f));
+
+    for (size_t i = 0; i < model->numMeshes; i++)
+    {
+        Mesh* mesh = &model->meshes[i];
+        if (mesh->numTextures == 0 || mesh->uvDensity <= 0.0f)
+        {
+            continue;
+        }
+
+        vec3 center;
+        glm_mat4_mulv3(transform, mesh->boundsCenter.raw, 1.0f, center);
+        float distance = glm_vec3_distance(center, cameraPos) - mesh->boundsRadius * scale;
+        distance = fmaxf(distance, 0.1f);
+
+        float uvPerPixel = mesh->uvDensity / scale * distance / pixelsPerUnitAtOne;
+        for (size_t t = 0; t < mesh->numTextures; t++)
+        {
+            textureRequestUVDensity(mesh->textures[t].handle, uvPerPixel);
+        }
+    }
+}
+
+bool model_usesTexture(Model* model, TextureHandle texture)
+{
+    for (size_t i = 0; i < model->numMeshes; i++)
+    {
+        for (size_t t = 0; t < model->meshes[i].numTextures; t++)
+        {
+            if (model->meshes[i].textures[t].handle == texture)
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
 void model_scale(Model *model, float scale)
 {
     // for each vertex, scale by the scale
@@ -182,6 +917,10 @@ void model_scale(Model *model, float scale)
             model->meshes[i].vertices[j].Position.y *= scale;
             model->meshes[i].vertices[j].Position.z *= scale;
         }
+
+        glm_vec3_scale(model->meshes[i].boundsCenter.raw, scale, model->meshes[i].boundsCenter.raw);
+        model->meshes[i].boundsRadius *= scale;
+        model->meshes[i].uvDensity /= scale;
     }
     //glm_mat3_scale(model->meshes->vertices->Position, scale);
 }
@@ -191,48 +930,44 @@ void model_drawWithOutline(Model* model, Shader* shader, Shader* outlineShader)
 
 }
 
-void model_processNode(Model* model, struct aiNode* node, const struct aiScene* scene)
+void model_processNode(Model* model, struct aiNode* node, const struct aiScene* scene, int parent)
 {
-    // Process node's meshes (if any exist)
-
-    // TODO: Allocate longer mesh array
-    // XXX: Does it matter what order we render meshes in? Let's find out!
-    // I might end up needing to somehow reverse this
+    // Keep the node, parents are always added before their children
+    int nodeIndex = model->numNodes;
+    ModelNode* modelNode = &model->nodes[nodeIndex];
+    modelNode->name = arenaPrintf(model->memory, "%s", node->mName.data);
+    modelNode->parent = parent;
 
-    // Make a new mesh array that can fit the new meshes
-    model->meshes = realloc(model->meshes, sizeof(Mesh) * (node->mNumMeshes + model->numMeshes));
+    // Assimp matrices are row major, cglm's are column major
+    struct aiMatrix4x4* t = &node->mTransformation;
+    mat4 transform = {
+        { t->a1, t->b1, t->c1, t->d1 },
+        { t->a2, t->b2, t->c2, t->d2 },
+        { t->a3, t->b3, t->c3, t->d3 },
+        { t->a4, t->b4, t->c4, t->d4 },
+    };
+    glm_mat4_copy(transform, modelNode->transform);
+    model->numNodes++;
 
-    // Create the new meshes ahead of the old meshes
+    // The mesh array was sized for the whole file up front
     for(unsigned int i = 0; i < node->mNumMeshes; i++)
     {
         struct aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-        model->meshes[model->numMeshes + i] = *model_processMesh(model, mesh, scene);
+        Mesh* dest = &model->meshes[model->numMeshes++];
+        model_processMesh(model, mesh, scene, dest);
+        dest->node = nodeIndex;
     }
 
-    // Update the number of meshes we have
-    model->numMeshes += node->mNumMeshes;
-
     // Then process meshes for any children
     for(unsigned int i = 0; i < node->mNumChildren; i++)
     {
-        //printf("Processing child %d\n", i);
-        model_processNode(model, node->mChildren[i], scene);
+        model_processNode(model, node->mChildren[i], scene, nodeIndex);
     }
 }
 
-Mesh* model_processMesh(Model * model, struct aiMesh* mesh, const struct aiScene* scene)
+void model_processMesh(Model* model, struct aiMesh* mesh, const struct aiScene* scene, Mesh* dest)
 {
-    Vertex* vertices;
-    //size_t numVertices;
-
-    unsigned int* indices;
-    size_t numIndices;
-
-    Texture* textures;
-    size_t numTextures;
-
-    // Allocate our vertex array
-    vertices = malloc(sizeof(Vertex) * mesh->mNumVertices);
+    Vertex* vertices = arenaAlloc(model->memory, sizeof(Vertex) * mesh->mNumVertices, _Alignof(Vertex));
     for (unsigned int i = 0; i < mesh->mNumVertices; i++)
     {
         vertices[i].Position.x = mesh->mVertices[i].x;
@@ -245,7 +980,6 @@ Mesh* model_processMesh(Model * model, struct aiMesh* mesh, const struct aiScene
 
         if (mesh->mTextureCoords[0])
         {
-            vec2s vec;
             vertices[i].TexCoords.x = mesh->mTextureCoords[0][i].x;
             vertices[i].TexCoords.y = mesh->mTextureCoords[0][i].y;
         }
@@ -257,92 +991,50 @@ Mesh* model_processMesh(Model * model, struct aiMesh* mesh, const struct aiScene
     }
 
     // Figure out how many indices we have
-    numIndices = 0;
-    size_t currentIndex = 0;
+    size_t numIndices = 0;
     for (unsigned int i = 0; i < mesh->mNumFaces; i++)
     {
         numIndices += mesh->mFaces[i].mNumIndices;
     }
-    indices = malloc(sizeof(unsigned int) * numIndices);
+    unsigned int* indices = arenaAlloc(model->memory, sizeof(unsigned int) * numIndices, _Alignof(unsigned int));
 
+    size_t currentIndex = 0;
     for (unsigned int i = 0; i < mesh->mNumFaces; i++)
     {
         struct aiFace face = mesh->mFaces[i];
         for (unsigned int j = 0; j < face.mNumIndices; j++)
         {
-            //indices.push_back(face.mIndices[j]);
             indices[currentIndex] = face.mIndices[j];
             currentIndex++;
         }
     }
 
-    if (mesh->mMaterialIndex >= 0)
-    {
-        struct aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-        Texture* diffuseMaps = model_loadMaterialTextures(model, material, aiTextureType_DIFFUSE, MODEL_TEXTURE_DIFFUSE);
-        size_t numDiffuseMaps = aiGetMaterialTextureCount(material, aiTextureType_DIFFUSE);
-
-        Texture* specularMaps = model_loadMaterialTextures(model, material, aiTextureType_SPECULAR, MODEL_TEXTURE_SPECULAR);
-        size_t numSpecularMaps = aiGetMaterialTextureCount(material, aiTextureType_SPECULAR);
-
-        textures = malloc(sizeof(Texture) * (numDiffuseMaps + numSpecularMaps));
-        memcpy(textures, diffuseMaps, sizeof(Texture) * numDiffuseMaps);
-        memcpy(&textures[numDiffuseMaps], specularMaps, sizeof(Texture) * numSpecularMaps); // XXX: Will this work?
-        numTextures = numDiffuseMaps + numSpecularMaps;
-    }
+    // Diffuse maps first, then specular
+    struct aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+    size_t numDiffuseMaps = aiGetMaterialTextureCount(material, aiTextureType_DIFFUSE);
+    size_t numSpecularMaps = aiGetMaterialTextureCount(material, aiTextureType_SPECULAR);
+    size_t numTextures = numDiffuseMaps + numSpecularMaps;
+    Texture* textures = arenaAlloc(model->memory, sizeof(Texture) * numTextures, _Alignof(Texture));
+    model_loadMaterialTextures(model, material, aiTextureType_DIFFUSE, MODEL_TEXTURE_DIFFUSE, textures);
+    model_loadMaterialTextures(model, material, aiTextureType_SPECULAR, MODEL_TEXTURE_SPECULAR, &textures[numDiffuseMaps]);
 
-    Mesh* m = newMesh(vertices, mesh->mNumVertices, indices, numIndices, textures, numTextures);
-    return m;
+    mesh_init(dest, vertices, mesh->mNumVertices, indices, numIndices, textures, numTextures);
 }
 
-Texture* model_loadMaterialTextures(Model* model, struct aiMaterial* mat, enum aiTextureType type, char* typeName)
+// Fills dest with the material's textures of the given type, which has to
+// have room for all of them
+void model_loadMaterialTextures(Model* model, struct aiMaterial* mat, enum aiTextureType type, const char* typeName, Texture* dest)
 {
     size_t textureCount = aiGetMaterialTextureCount(mat, type);
-    Texture* textures = malloc(sizeof(Texture) * textureCount);
     for (unsigned int i = 0; i < textureCount; i++)
     {
         struct aiString str;
         aiGetMaterialTexture(mat, type, i, &str, NULL, NULL, NULL, NULL, NULL, NULL);
 
-        // Get the texture path
-        size_t lenTexturePath = str.length + strlen(model->directory) + 2;
-        char texturePath[lenTexturePath];
-        snprintf(texturePath, lenTexturePath, "%s/%s", model->directory, str.data);
-
-        //printf("Checking if we need to load texture %s\n", str.data);
-
-        // Before doing the expensive step of loading the texture, check
-        // if we've already loaded it into memory and use that copy if we can.
-        bool skipLoading = false;
-        for (unsigned int j = 0; j < model->numTexturesLoaded; j++)
-        {
-            if (model->texturesLoaded[j].type == typeName && strcmp(model->texturesLoaded[j].path, str.data) == 0)
-            {
-                textures[i].id = model->texturesLoaded[j].id;
-                textures[i].type = model->texturesLoaded[j].type;
-                textures[i].path = model->texturesLoaded[j].path;
-                skipLoading = true;
-                //printf("Not loading. %s = %s\n", model->texturesLoaded[j].path, str.data);
-                break;
-            }
-        }
-
-        if (skipLoading)
-        {
-            continue;
-        }
-
-        printf("We should load %s\n", str.data);
-
-        // Set the texture
-        textures[i].id = loadTexture(texturePath);
-        textures[i].type = typeName;
-        textures[i].path = str.data;
-
-        // ...and update the known texture array
-        model->texturesLoaded = realloc(model->texturesLoaded, sizeof(Texture) * (++model->numTexturesLoaded));
-        model->texturesLoaded[model->numTexturesLoaded - 1] = textures[i];
+        // Acquired from the registry once the mesh is uploaded
+        dest[i].type = typeName;
+        dest[i].path = arenaPrintf(model->memory, "%s/%s", model->directory, str.data);
+        dest[i].handle = 0;
+        dest[i].bindlessHandle = 0;
     }
-
-    return textures;
 }
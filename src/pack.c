@@ -0,0 +1,319 @@
+#include "pack.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "arena.h"
+#include "lz4.h"
+#include "texcache.h"
+
+// The mounted pack, which never changes between packMount() and
+// packUnmount() so any thread can read it
+static void* packMapping = NULL;
+static size_t packMappingSize = 0;
+static const PackHeader* packHeader = NULL;
+static const PackEntry* packEntries = NULL;
+static const uint32_t* packTable = NULL;
+static const char* packPaths = NULL;
+
+// Hashes of paths that changed on disk since the pack was made, which can
+// grow while any thread is opening files
+static uint64_t* packLoose = NULL;
+static size_t packNumLoose = 0;
+static pthread_mutex_t packLooseLock = PTHREAD_MUTEX_INITIALIZER;
+
+uint64_t packPathHash(const char* path)
+{
+    return texcacheHash(path, strlen(path), 0);
+}
+
+// Paths are stored the way the packer was given them, so "./shaders/x" and
+// "shaders/x" have to come out the same
+const char* packNormalizePath(const char* path)
+{
+    while (path[0] == '.' && path[1] == '/')
+    {
+        path += 2;
+    }
+    return path;
+}
+
+// Starts reading a range in before it's touched, a page fault at a time
+// being the slowest way to read a file on a spinning or network disk
+static void pack_willNeed(const void* data, size_t size)
+{
+    if (size == 0)
+    {
+        return;
+    }
+    uintptr_t pageSize = sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)data & ~(pageSize - 1);
+    madvise((void*)start, (uintptr_t)data + size - start, MADV_WILLNEED);
+}
+
+static bool pack_inside(uint64_t offset, uint64_t size)
+{
+    return offset <= packMappingSize && size <= packMappingSize - offset;
+}
+
+// Everything the lookups trust is checked once here
+static bool pack_validate(const char* path)
+{
+    const PackHeader* header = packMapping;
+    if (packMappingSize < sizeof(PackHeader)
+        || memcmp(header->magic, PACK_MAGIC, sizeof(PACK_MAGIC)) != 0
+        || header->version != PACK_VERSION)
+    {
+        printf("%s isn't a pack this build can read\n", path);
+        return false;
+    }
+
+    if (header->tableSize <= header->numEntries || (header->tableSize & (header->tableSize - 1)) != 0
+        || header->entriesOffset % _Alignof(PackEntry) != 0 || header->tableOffset % _Alignof(uint32_t) != 0
+        || !pack_inside(header->entriesOffset, (uint64_t)sizeof(PackEntry) * header->numEntries)
+        || !pack_inside(header->tableOffset, (uint64_t)sizeof(uint32_t) * header->tableSize)
+        || !pack_inside(header->pathsOffset, header->pathsSize)
+        || header->pathsSize == 0 || ((const char*)packMapping)[header->pathsOffset + header->pathsSize - 1] != '\0')
+    {
+        printf("Pack %s has a bad table of contents\n", path);
+        return false;
+    }
+
+    const PackEntry* entries = (const PackEntry*)((const char*)packMapping + header->entriesOffset);
+    for (uint32_t i = 0; i < header->numEntries; i++)
+    {
+        const PackEntry* entry = &entries[i];
+        bool sized = entry->compression == PACK_LZ4 || (entry->compression == PACK_STORED && entry->size == entry->rawSize);
+        if (!sized || !pack_inside(entry->offset, entry->size) || entry->pathOffset >= header->pathsSize)
+        {
+            printf("Pack %s has a bad entry %u\n", path, i);
+            return false;
+        }
+    }
+
+    const uint32_t* table = (const uint32_t*)((const char*)packMapping + header->tableOffset);
+    for (uint32_t i = 0; i < header->tableSize; i++)
+    {
+        if (table[i] != PACK_NO_ENTRY && table[i] >= header->numEntries)
+        {
+            printf("Pack %s has a bad table slot %u\n", path, i);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool packMount(const char* path)
+{
+    packUnmount();
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    void* mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        return false;
+    }
+
+    packMapping = mapping;
+    packMappingSize = st.st_size;
+    if (!pack_validate(path))
+    {
+        packUnmount();
+        return false;
+    }
+
+    packHeader = packMapping;
+    packEntries = (const PackEntry*)((const char*)packMapping + packHeader->entriesOffset);
+    packTable = (const uint32_t*)((const char*)packMapping + packHeader->tableOffset);
+    packPaths = (const char*)packMapping + packHeader->pathsOffset;
+    printf("Mounted %s with %u files\n", path, packHeader->numEntries);
+    return true;
+}
+
+void packUnmount()
+{
+    if (packMapping != NULL)
+    {
+        munmap(packMapping, packMappingSize);
+    }
+    packMapping = NULL;
+    packMappingSize = 0;
+    packHeader = NULL;
+    packEntries = NULL;
+    packTable = NULL;
+    packPaths = NULL;
+
+    // A pack mounted next is built from whatever's on disk now
+    pthread_mutex_lock(&packLooseLock);
+    free(packLoose);
+    packLoose = NULL;
+    packNumLoose = 0;
+    pthread_mutex_unlock(&packLooseLock);
+}
+
+// Linear probing from the path's hash, which ends at the first empty slot
+static const PackEntry* pack_find(const char* path)
+{
+    uint64_t hash = packPathHash(path);
+    uint32_t mask = packHeader->tableSize - 1;
+    for (uint32_t probe = 0; probe < packHeader->tableSize; probe++)
+    {
+        uint32_t index = packTable[(hash + probe) & mask];
+        if (index == PACK_NO_ENTRY)
+        {
+            return NULL;
+        }
+
+        const PackEntry* entry = &packEntries[index];
+        if (entry->pathHash == hash && strcmp(packPaths + entry->pathOffset, path) == 0)
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static bool pack_isLoose(const char* path)
+{
+    uint64_t hash = packPathHash(path);
+    bool loose = false;
+    pthread_mutex_lock(&packLooseLock);
+    for (size_t i = 0; i < packNumLoose && !loose; i++)
+    {
+        loose = packLoose[i] == hash;
+    }
+    pthread_mutex_unlock(&packLooseLock);
+    return loose;
+}
+
+void packPreferLoose(const char* path)
+{
+    path = packNormalizePath(path);
+    if (pack_isLoose(path))
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&packLooseLock);
+    packLoose = heapRealloc(packLoose, sizeof(uint64_t) * (packNumLoose + 1));
+    packLoose[packNumLoose++] = packPathHash(path);
+    pthread_mutex_unlock(&packLooseLock);
+}
+
+static bool pack_openEntry(const char* path, const PackEntry* entry, PackFile* file)
+{
+    const unsigned char* data = (const unsigned char*)packMapping + entry->offset;
+    pack_willNeed(data, entry->size);
+    file->hash = entry->contentHash;
+    file->hashed = true;
+
+    if (entry->compression == PACK_STORED)
+    {
+        file->data = data;
+        file->size = entry->size;
+        return true;
+    }
+
+    file->buffer = heapAlloc(entry->rawSize ? entry->rawSize : 1);
+    if (!lz4Decompress(data, entry->size, file->buffer, entry->rawSize))
+    {
+        printf("%s is corrupt in the pack\n", path);
+        packCloseFile(file);
+        return false;
+    }
+    file->data = file->buffer;
+    file->size = entry->rawSize;
+    return true;
+}
+
+static bool pack_openLoose(const char* path, PackFile* file)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    // Empty files can't be mapped, and don't need to be
+    if (st.st_size == 0)
+    {
+        close(fd);
+        file->data = (const unsigned char*)"";
+        return true;
+    }
+
+    void* mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        return false;
+    }
+
+    madvise(mapping, st.st_size, MADV_WILLNEED);
+    file->data = mapping;
+    file->size = st.st_size;
+    file->mapping = mapping;
+    file->mappingSize = st.st_size;
+    return true;
+}
+
+// Opens path from the mounted pack if it's in there, otherwise from the
+// disk. Release it with packCloseFile().
+bool packOpenFile(const char* path, PackFile* file)
+{
+    memset(file, 0, sizeof(PackFile));
+    path = packNormalizePath(path);
+
+    const PackEntry* entry = packMapping != NULL && !pack_isLoose(path) ? pack_find(path) : NULL;
+    if (entry != NULL && pack_openEntry(path, entry, file))
+    {
+        return true;
+    }
+    return pack_openLoose(path, file);
+}
+
+void packCloseFile(PackFile* file)
+{
+    if (file->mapping != NULL)
+    {
+        munmap(file->mapping, file->mappingSize);
+    }
+    free(file->buffer);
+    memset(file, 0, sizeof(PackFile));
+}
+
+// Same as texcacheHash() over the file. The packer works it out ahead of
+// time, so for a file in the pack this doesn't read a byte of it.
+uint64_t packFileHash(PackFile* file)
+{
+    if (!file->hashed)
+    {
+        file->hash = texcacheHash(file->data, file->size, 0);
+        file->hashed = true;
+    }
+    return file->hash;
+}
@@ -0,0 +1,83 @@
+#include "parallel.h"
+#include "jobs.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef struct {
+    ParallelForFn fn;
+    void* ctx;
+    size_t begin;
+    size_t end;
+} ParallelSlice;
+
+int parallelNumThreads()
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (int)cores : 1;
+}
+
+static void* parallelRunSlice(void* arg)
+{
+    ParallelSlice* slice = arg;
+    slice->fn(slice->begin, slice->end, slice->ctx);
+    return NULL;
+}
+
+void parallelFor(size_t count, size_t minPerThread, ParallelForFn fn, void* ctx)
+{
+    // Reuse the job system's threads when it's running
+    if (jobs_numWorkers() > 0)
+    {
+        jobs_parallelFor(count, minPerThread, fn, ctx);
+        return;
+    }
+
+    size_t numThreads = parallelNumThreads();
+    if (minPerThread < 1)
+    {
+        minPerThread = 1;
+    }
+    if (count / minPerThread < numThreads)
+    {
+        numThreads = count / minPerThread;
+    }
+
+    if (numThreads <= 1)
+    {
+        fn(0, count, ctx);
+        return;
+    }
+
+    // The calling thread takes the last slice instead of sitting idle
+    pthread_t threads[numThreads - 1];
+    ParallelSlice slices[numThreads];
+    size_t perThread = count / numThreads;
+    for (size_t i = 0; i < numThreads; i++)
+    {
+        slices[i].fn = fn;
+        slices[i].ctx = ctx;
+        slices[i].begin = i * perThread;
+        slices[i].end = i + 1 == numThreads ? count : (i + 1) * perThread;
+    }
+
+    size_t numStarted = 0;
+    for (; numStarted < numThreads - 1; numStarted++)
+    {
+        if (pthread_create(&threads[numStarted], NULL, parallelRunSlice, &slices[numStarted]) != 0)
+        {
+            break;
+        }
+    }
+
+    // Anything we couldn't start a thread for runs here
+    for (size_t i = numStarted; i < numThreads; i++)
+    {
+        parallelRunSlice(&slices[i]);
+    }
+
+    for (size_t i = 0; i < numStarted; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+}
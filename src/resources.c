@@ -0,0 +1,256 @@
+#include "resources.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glad/glad.h>
+#include "arena.h"
+
+typedef enum {
+    RESOURCE_MODEL,
+    RESOURCE_SHADER,
+    RESOURCE_BUFFER,
+} ResourceKind;
+
+// A destroyed resource waiting for the GPU to be done with it
+typedef struct {
+    ResourceKind kind;
+    union {
+        Model* model;
+        Shader* shader;
+        unsigned int buffer;
+    };
+} ResourcePending;
+
+// Covers every pending resource before end, which only moves down as the
+// ones in front of it are destroyed
+typedef struct {
+    GLsync fence;
+    size_t end;
+} ResourceFence;
+
+static HandlePool* modelPool = NULL;
+static HandlePool* shaderPool = NULL;
+static HandlePool* bufferPool = NULL;
+
+static ResourcePending* pending = NULL;
+static size_t numPending = 0;
+static size_t pendingCapacity = 0;
+
+static ResourceFence* fences = NULL;
+static size_t numFences = 0;
+static size_t fenceCapacity = 0;
+
+void resources_init()
+{
+    modelPool = newHandlePool(sizeof(Model*));
+    shaderPool = newHandlePool(sizeof(Shader*));
+    bufferPool = newHandlePool(sizeof(unsigned int));
+}
+
+static void resources_destroyNow(ResourcePending* resource)
+{
+    switch (resource->kind)
+    {
+        case RESOURCE_MODEL:
+            model_free(resource->model);
+            break;
+        case RESOURCE_SHADER:
+            glDeleteProgram(resource->shader->ID);
+            free(resource->shader);
+            break;
+        case RESOURCE_BUFFER:
+            glDeleteBuffers(1, &resource->buffer);
+            break;
+    }
+}
+
+static void resources_defer(ResourcePending resource)
+{
+    if (numPending == pendingCapacity)
+    {
+        pendingCapacity = pendingCapacity ? pendingCapacity * 2 : 16;
+        pending = heapRealloc(pending, sizeof(ResourcePending) * pendingCapacity);
+    }
+    pending[numPending++] = resource;
+}
+
+// Call once a frame, after its draws are submitted. Fences off whatever was
+// destroyed since the last call, and destroys for real whatever an earlier
+// fence has cleared.
+void resources_endFrame()
+{
+    size_t fenced = numFences > 0 ? fences[numFences - 1].end : 0;
+    if (numPending > fenced)
+    {
+        if (numFences == fenceCapacity)
+        {
+            fenceCapacity = fenceCapacity ? fenceCapacity * 2 : 4;
+            fences = heapRealloc(fences, sizeof(ResourceFence) * fenceCapacity);
+        }
+        fences[numFences].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        fences[numFences].end = numPending;
+        numFences++;
+    }
+
+    // Fences signal in order, so stop at the first one that hasn't
+    size_t cleared = 0;
+    size_t destroyed = 0;
+    while (cleared < numFences)
+    {
+        GLenum status = glClientWaitSync(fences[cleared].fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        {
+            break;
+        }
+        glDeleteSync(fences[cleared].fence);
+        destroyed = fences[cleared].end;
+        cleared++;
+    }
+    if (cleared == 0)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < destroyed; i++)
+    {
+        resources_destroyNow(&pending[i]);
+    }
+    numPending -= destroyed;
+    memmove(pending, pending + destroyed, sizeof(ResourcePending) * numPending);
+    numFences -= cleared;
+    memmove(fences, fences + cleared, sizeof(ResourceFence) * numFences);
+    for (size_t i = 0; i < numFences; i++)
+    {
+        fences[i].end -= destroyed;
+    }
+}
+
+// Waits for the GPU and destroys everything, pending or not. The GL
+// context has to still be around.
+void resources_shutdown()
+{
+    glFinish();
+    for (size_t i = 0; i < numFences; i++)
+    {
+        glDeleteSync(fences[i].fence);
+    }
+    numFences = 0;
+
+    for (size_t i = 0; i < modelPool->count; i++)
+    {
+        resources_destroyModel(handlePoolAt(modelPool, i));
+    }
+    for (size_t i = 0; i < shaderPool->count; i++)
+    {
+        resources_destroyShader(handlePoolAt(shaderPool, i));
+    }
+    for (size_t i = 0; i < bufferPool->count; i++)
+    {
+        resources_destroyBuffer(handlePoolAt(bufferPool, i));
+    }
+    for (size_t i = 0; i < numPending; i++)
+    {
+        resources_destroyNow(&pending[i]);
+    }
+    numPending = 0;
+
+    free(pending);
+    free(fences);
+    pending = NULL;
+    fences = NULL;
+    pendingCapacity = 0;
+    fenceCapacity = 0;
+
+    handlePoolFree(modelPool);
+    handlePoolFree(shaderPool);
+    handlePoolFree(bufferPool);
+    modelPool = NULL;
+    shaderPool = NULL;
+    bufferPool = NULL;
+}
+
+// Takes ownership of the model, which is freed when it's destroyed
+ModelHandle resources_addModel(Model* model)
+{
+    return handlePoolAdd(modelPool, &model);
+}
+
+Model* resources_getModel(ModelHandle handle)
+{
+    Model** model = handlePoolGet(modelPool, handle);
+    return model ? *model : NULL;
+}
+
+void resources_destroyModel(ModelHandle handle)
+{
+    ResourcePending resource = { .kind = RESOURCE_MODEL };
+    if (handlePoolRemove(modelPool, handle, &resource.model))
+    {
+        resources_defer(resource);
+    }
+}
+
+MeshHandle resources_meshHandle(ModelHandle model, unsigned int mesh)
+{
+    MeshHandle handle = { model, mesh };
+    return handle;
+}
+
+Mesh* resources_getMesh(MeshHandle handle)
+{
+    Model* model = resources_getModel(handle.model);
+    if (model == NULL || handle.mesh >= model->numMeshes)
+    {
+        return NULL;
+    }
+    return &model->meshes[handle.mesh];
+}
+
+// Takes ownership of the shader, which is deleted when it's destroyed. Not
+// for variants of a ShaderPermutation, which belong to the permutation.
+ShaderHandle resources_addShader(Shader* shader)
+{
+    return handlePoolAdd(shaderPool, &shader);
+}
+
+Shader* resources_getShader(ShaderHandle handle)
+{
+    Shader** shader = handlePoolGet(shaderPool, handle);
+    return shader ? *shader : NULL;
+}
+
+void resources_destroyShader(ShaderHandle handle)
+{
+    ResourcePending resource = { .kind = RESOURCE_SHADER };
+    if (handlePoolRemove(shaderPool, handle, &resource.shader))
+    {
+        resources_defer(resource);
+    }
+}
+
+BufferHandle resources_createBuffer()
+{
+    unsigned int buffer;
+    glGenBuffers(1, &buffer);
+    BufferHandle handle = handlePoolAdd(bufferPool, &buffer);
+    if (handle == HANDLE_NONE)
+    {
+        glDeleteBuffers(1, &buffer);
+    }
+    return handle;
+}
+
+unsigned int resources_getBuffer(BufferHandle handle)
+{
+    unsigned int* buffer = handlePoolGet(bufferPool, handle);
+    return buffer ? *buffer : 0;
+}
+
+void resources_destroyBuffer(BufferHandle handle)
+{
+    ResourcePending resource = { .kind = RESOURCE_BUFFER };
+    if (handlePoolRemove(bufferPool, handle, &resource.buffer))
+    {
+        resources_defer(resource);
+    }
+}
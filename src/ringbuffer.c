@@ -0,0 +1,220 @@
+#include "ringbuffer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include "arena.h"
+#include "extensions.h"
+
+// GL_ARB_buffer_storage leaves it to us to say which target a buffer is for,
+// any will do for creating it
+#define RING_BUFFER_TARGET GL_COPY_WRITE_BUFFER
+
+// Makes the buffer and its mapping or CPU copy for ring->sectionSize
+static bool ringBufferCreate(RingBuffer* ring)
+{
+    size_t size = ring->sectionSize * RING_BUFFER_FRAMES;
+    glGenBuffers(1, &ring->buffer);
+    glBindBuffer(RING_BUFFER_TARGET, ring->buffer);
+
+    ring->persistent = glExtensions.bufferStorage;
+    if (ring->persistent)
+    {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(RING_BUFFER_TARGET, size, NULL, flags);
+        ring->data = glMapBufferRange(RING_BUFFER_TARGET, 0, size, flags);
+        if (ring->data == NULL)
+        {
+            printf("Unable to map ring buffer, falling back to copies\n");
+            glDeleteBuffers(1, &ring->buffer);
+            glGenBuffers(1, &ring->buffer);
+            glBindBuffer(RING_BUFFER_TARGET, ring->buffer);
+            ring->persistent = false;
+        }
+    }
+
+    if (!ring->persistent)
+    {
+        glBufferData(RING_BUFFER_TARGET, size, NULL, GL_STREAM_DRAW);
+        ring->data = heapAlloc(size);
+    }
+
+    glBindBuffer(RING_BUFFER_TARGET, 0);
+    if (ring->data == NULL)
+    {
+        printf("Failed to allocate %zu bytes for a ring buffer\n", size);
+        glDeleteBuffers(1, &ring->buffer);
+        return false;
+    }
+    return true;
+}
+
+// Deleting the buffer unmaps it
+static void ringBufferDestroy(RingBuffer* ring)
+{
+    glDeleteBuffers(1, &ring->buffer);
+    if (!ring->persistent)
+    {
+        free(ring->data);
+    }
+    ring->data = NULL;
+}
+
+// Waits until the GPU is done with a section, adding the time it took to
+// the ring's stall count
+static void ringBufferWait(RingBuffer* ring, unsigned int frame)
+{
+    GLsync fence = ring->fences[frame];
+    if (fence == NULL)
+    {
+        return;
+    }
+
+    GLenum result = glClientWaitSync(fence, 0, 0);
+    if (result == GL_TIMEOUT_EXPIRED)
+    {
+        double start = glfwGetTime();
+        while (result == GL_TIMEOUT_EXPIRED)
+        {
+            // One second at a time, flushing so the fence is sure to signal
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        }
+        ring->stallSeconds += glfwGetTime() - start;
+    }
+    if (result == GL_WAIT_FAILED)
+    {
+        printf("Waiting on ring buffer fence failed\n");
+    }
+
+    glDeleteSync(fence);
+    ring->fences[frame] = NULL;
+}
+
+RingBuffer* newRingBuffer(size_t sectionSize)
+{
+    RingBuffer* ring = heapAlloc(sizeof(RingBuffer));
+    if (ring == NULL)
+    {
+        printf("Failed to allocate a ring buffer\n");
+        return NULL;
+    }
+
+    GLint alignment;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    ring->alignment = alignment > 16 ? alignment : 16;
+    ring->sectionSize = (sectionSize + ring->alignment - 1) / ring->alignment * ring->alignment;
+    ring->frame = 0;
+    ring->head = 0;
+    ring->flushed = 0;
+    ring->stallSeconds = 0.0;
+    for (int i = 0; i < RING_BUFFER_FRAMES; i++)
+    {
+        ring->fences[i] = NULL;
+    }
+
+    if (!ringBufferCreate(ring))
+    {
+        free(ring);
+        return NULL;
+    }
+    return ring;
+}
+
+void ringBufferFree(RingBuffer* ring)
+{
+    for (int i = 0; i < RING_BUFFER_FRAMES; i++)
+    {
+        if (ring->fences[i] != NULL)
+        {
+            glDeleteSync(ring->fences[i]);
+        }
+    }
+    ringBufferDestroy(ring);
+    free(ring);
+}
+
+// Grows every section to hold at least sectionSize bytes, doubling so it
+// doesn't happen often. Call between frames, since it waits for the GPU to
+// finish with all of them and starts over with a new buffer. If that can't
+// be made, the old size is kept and this returns false.
+bool ringBufferReserve(RingBuffer* ring, size_t sectionSize)
+{
+    if (sectionSize <= ring->sectionSize)
+    {
+        return true;
+    }
+
+    for (unsigned int i = 0; i < RING_BUFFER_FRAMES; i++)
+    {
+        ringBufferWait(ring, i);
+    }
+    ringBufferDestroy(ring);
+
+    size_t oldSize = ring->sectionSize;
+    while (ring->sectionSize < sectionSize)
+    {
+        ring->sectionSize *= 2;
+    }
+    printf("Growing ring buffer sections from %zu to %zu bytes\n", oldSize, ring->sectionSize);
+    if (ringBufferCreate(ring))
+    {
+        return true;
+    }
+
+    ring->sectionSize = oldSize;
+    if (!ringBufferCreate(ring))
+    {
+        printf("Unable to remake the ring buffer\n");
+    }
+    return false;
+}
+
+// Moves on to the next section, waiting for the GPU if it's still reading
+// from that section (only if the CPU is RING_BUFFER_FRAMES frames ahead)
+void ringBufferBeginFrame(RingBuffer* ring)
+{
+    ring->frame = (ring->frame + 1) % RING_BUFFER_FRAMES;
+    ring->head = 0;
+    ring->flushed = 0;
+    ringBufferWait(ring, ring->frame);
+}
+
+// Returns size bytes to write this frame's data into and where they are in
+// the buffer. Returns NULL if the section is full.
+void* ringBufferAlloc(RingBuffer* ring, size_t size, size_t* offset)
+{
+    size_t start = (ring->head + ring->alignment - 1) / ring->alignment * ring->alignment;
+    if (start + size > ring->sectionSize)
+    {
+        printf("Ring buffer section of %zu bytes is full\n", ring->sectionSize);
+        return NULL;
+    }
+
+    ring->head = start + size;
+    *offset = ring->frame * ring->sectionSize + start;
+    return ring->data + *offset;
+}
+
+// Binds part of the buffer to an indexed target (GL_UNIFORM_BUFFER etc).
+// Everything allocated before this call has to be written by then.
+void ringBufferBindRange(RingBuffer* ring, GLenum target, unsigned int binding, size_t offset, size_t size)
+{
+    if (!ring->persistent && ring->flushed < ring->head)
+    {
+        size_t sectionStart = ring->frame * ring->sectionSize;
+        glBindBuffer(RING_BUFFER_TARGET, ring->buffer);
+        glBufferSubData(RING_BUFFER_TARGET, sectionStart + ring->flushed,
+            ring->head - ring->flushed, ring->data + sectionStart + ring->flushed);
+        glBindBuffer(RING_BUFFER_TARGET, 0);
+        ring->flushed = ring->head;
+    }
+
+    glBindBufferRange(target, binding, ring->buffer, offset, size);
+}
+
+// Call after the frame's last draw that reads from the ring
+void ringBufferEndFrame(RingBuffer* ring)
+{
+    ring->fences[ring->frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
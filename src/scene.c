@@ -0,0 +1,317 @@
+#include "scene.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cglm/cglm.h"
+#include "arena.h"
+#include "transform.h"
+
+Scene* newScene()
+{
+    Scene* scene = heapAlloc(sizeof(Scene));
+    scene->numNodes = 0;
+    scene->capacity = 0;
+    scene->parents = NULL;
+    scene->names = NULL;
+    scene->positions = NULL;
+    scene->rotations = NULL;
+    scene->scales = NULL;
+    scene->localMatrices = NULL;
+    scene->worldMatrices = NULL;
+    scene->dirty = NULL;
+    scene->dirtyNodes = NULL;
+    scene->models = NULL;
+    scene->numModels = 0;
+    return scene;
+}
+
+static void scene_grow(Scene* scene)
+{
+    scene->capacity = scene->capacity ? scene->capacity * 2 : 64;
+    scene->parents = heapRealloc(scene->parents, sizeof(int) * scene->capacity);
+    scene->names = heapRealloc(scene->names, sizeof(char*) * scene->capacity);
+    scene->positions = heapRealloc(scene->positions, sizeof(vec3) * scene->capacity);
+    scene->rotations = heapRealloc(scene->rotations, sizeof(versor) * scene->capacity);
+    scene->scales = heapRealloc(scene->scales, sizeof(vec3) * scene->capacity);
+    scene->localMatrices = heapRealloc(scene->localMatrices, sizeof(mat4) * scene->capacity);
+    scene->worldMatrices = heapRealloc(scene->worldMatrices, sizeof(mat4) * scene->capacity);
+    scene->dirty = heapRealloc(scene->dirty, sizeof(bool) * scene->capacity);
+    scene->dirtyNodes = heapRealloc(scene->dirtyNodes, sizeof(unsigned int) * scene->capacity);
+}
+
+// New nodes always go at the end, which is what keeps parents ahead of
+// their children
+int scene_addNode(Scene* scene, int parent, const char* name)
+{
+    if (parent >= (int)scene->numNodes)
+    {
+        printf("Scene node %d doesn't exist to be a parent\n", parent);
+        return -1;
+    }
+
+    if (scene->numNodes == scene->capacity)
+    {
+        scene_grow(scene);
+    }
+
+    int node = scene->numNodes++;
+    scene->parents[node] = parent;
+    scene->names[node] = strdup(name ? name : "");
+    glm_vec3_zero(scene->positions[node]);
+    glm_quat_identity(scene->rotations[node]);
+    glm_vec3_one(scene->scales[node]);
+    glm_mat4_identity(scene->worldMatrices[node]);
+    scene->dirty[node] = true;
+    return node;
+}
+
+// Adds the model's node hierarchy under parent, keeping the transforms it
+// was authored with. Returns the index of the SceneModel, or -1.
+int scene_addModel(Scene* scene, int parent, ModelHandle handle)
+{
+    Model* model = resources_getModel(handle);
+    if (model == NULL)
+    {
+        printf("No such model to add to the scene\n");
+        return -1;
+    }
+    if (model->numNodes == 0)
+    {
+        printf("Model has no nodes to add to the scene\n");
+        return -1;
+    }
+
+    int rootNode = scene->numNodes;
+    for (size_t i = 0; i < model->numNodes; i++)
+    {
+        ModelNode* modelNode = &model->nodes[i];
+        int nodeParent = modelNode->parent < 0 ? parent : rootNode + modelNode->parent;
+        int node = scene_addNode(scene, nodeParent, modelNode->name);
+        if (node < 0)
+        {
+            return -1;
+        }
+        scene_setLocalMatrix(scene, node, modelNode->transform);
+    }
+
+    scene->models = heapRealloc(scene->models, sizeof(SceneModel) * (scene->numModels + 1));
+    scene->models[scene->numModels].model = handle;
+    scene->models[scene->numModels].rootNode = rootNode;
+    scene->models[scene->numModels].numNodes = model->numNodes;
+    return scene->numModels++;
+}
+
+int scene_findNode(Scene* scene, const char* name)
+{
+    for (size_t i = 0; i < scene->numNodes; i++)
+    {
+        if (strcmp(scene->names[i], name) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void scene_setPosition(Scene* scene, int node, vec3 position)
+{
+    glm_vec3_copy(position, scene->positions[node]);
+    scene->dirty[node] = true;
+}
+
+void scene_setRotation(Scene* scene, int node, versor rotation)
+{
+    glm_quat_copy(rotation, scene->rotations[node]);
+    scene->dirty[node] = true;
+}
+
+void scene_setScale(Scene* scene, int node, vec3 scale)
+{
+    glm_vec3_copy(scale, scene->scales[node]);
+    scene->dirty[node] = true;
+}
+
+void scene_setLocalMatrix(Scene* scene, int node, mat4 local)
+{
+    vec4 translation;
+    mat4 rotation;
+    glm_decompose(local, translation, rotation, scene->scales[node]);
+    glm_vec3_copy(translation, scene->positions[node]);
+    glm_mat4_quat(rotation, scene->rotations[node]);
+    scene->dirty[node] = true;
+}
+
+// Recomputes world matrices of dirty nodes and everything below them.
+// Parents come first, so by the time a node is reached its parent has been
+// handled and its dirty flag says whether the node has to follow.
+void scene_updateTransforms(Scene* scene)
+{
+    size_t numDirty = 0;
+    for (size_t i = 0; i < scene->numNodes; i++)
+    {
+        int parent = scene->parents[i];
+        if (parent >= 0 && scene->dirty[parent])
+        {
+            scene->dirty[i] = true;
+        }
+        if (scene->dirty[i])
+        {
+            scene->dirtyNodes[numDirty++] = i;
+        }
+    }
+
+    transformBatchCompose(scene->positions, scene->rotations, scene->scales,
+        scene->dirtyNodes, numDirty, scene->localMatrices);
+
+    // A batch can't contain both a node and its parent, so the list is cut
+    // into runs where every parent comes before the start of the run. Flat
+    // scenes become a single run, deep chains fall back to short ones.
+    size_t start = 0;
+    while (start < numDirty)
+    {
+        int first = scene->dirtyNodes[start];
+        size_t end = start + 1;
+        while (end < numDirty && scene->parents[scene->dirtyNodes[end]] < first)
+        {
+            end++;
+        }
+
+        transformBatchMultiply(scene->worldMatrices, scene->parents, scene->localMatrices,
+            scene->dirtyNodes + start, end - start, scene->worldMatrices);
+        start = end;
+    }
+
+    memset(scene->dirty, 0, sizeof(bool) * scene->numNodes);
+}
+
+// World space bounding sphere (xyz center, w radius) around every mesh of a
+// placed model. Transforms have to be up to date.
+void scene_modelBounds(Scene* scene, int sceneModel, vec4 dest)
+{
+    SceneModel* placed = &scene->models[sceneModel];
+    Model* model = resources_getModel(placed->model);
+
+    glm_vec4_zero(dest);
+    dest[3] = -1.0f;
+    for (size_t i = 0; model && i < model->numMeshes; i++)
+    {
+        Mesh* mesh = &model->meshes[i];
+        int node = mesh->node >= 0 && (size_t)mesh->node < placed->numNodes ? mesh->node : 0;
+        mat4* world = &scene->worldMatrices[placed->rootNode + node];
+
+        vec4 sphere;
+        glm_mat4_mulv3(*world, mesh->boundsCenter.raw, 1.0f, sphere);
+        float scale = fmaxf(glm_vec3_norm((*world)[0]), fmaxf(glm_vec3_norm((*world)[1]), glm_vec3_norm((*world)[2])));
+        sphere[3] = mesh->boundsRadius * scale;
+
+        if (dest[3] < 0.0f)
+        {
+            glm_vec4_copy(sphere, dest);
+            continue;
+        }
+
+        // Grow dest just enough to take in sphere
+        float distance = glm_vec3_distance(dest, sphere);
+        if (distance + sphere[3] <= dest[3])
+        {
+            continue;
+        }
+        if (distance + dest[3] <= sphere[3])
+        {
+            glm_vec4_copy(sphere, dest);
+            continue;
+        }
+        float radius = (distance + dest[3] + sphere[3]) * 0.5f;
+        vec3 direction;
+        glm_vec3_sub(sphere, dest, direction);
+        glm_vec3_muladds(direction, (radius - dest[3]) / distance, dest);
+        dest[3] = radius;
+    }
+
+    if (dest[3] < 0.0f)
+    {
+        dest[3] = 0.0f;
+    }
+}
+
+// Closest triangle of a placed model a world space ray hits, as a distance
+// along direction, or -1. Each mesh takes the ray into its own space, where
+// its triangle tree is.
+float scene_raycastModel(Scene* scene, int sceneModel, vec3 origin, vec3 direction, float maxDistance,
+    int* mesh, int* triangle)
+{
+    SceneModel* placed = &scene->models[sceneModel];
+    Model* model = resources_getModel(placed->model);
+
+    float closest = -1.0f;
+    for (size_t i = 0; model && i < model->numMeshes; i++)
+    {
+        Mesh* candidate = &model->meshes[i];
+        int node = candidate->node >= 0 && (size_t)candidate->node < placed->numNodes ? candidate->node : 0;
+
+        // Leaving direction unnormalized keeps distances the same in both
+        // spaces
+        mat4 inverse;
+        vec3 localOrigin, localDirection;
+        glm_mat4_inv(scene->worldMatrices[placed->rootNode + node], inverse);
+        glm_mat4_mulv3(inverse, origin, 1.0f, localOrigin);
+        glm_mat4_mulv3(inverse, direction, 0.0f, localDirection);
+
+        int hitTriangle;
+        float limit = closest >= 0.0f ? closest : maxDistance;
+        float distance = mesh_raycast(candidate, localOrigin, localDirection, limit, &hitTriangle);
+        if (distance >= 0.0f && (closest < 0.0f || distance < closest))
+        {
+            closest = distance;
+            if (mesh)
+            {
+                *mesh = i;
+            }
+            if (triangle)
+            {
+                *triangle = hitTriangle;
+            }
+        }
+    }
+    return closest;
+}
+
+// Adds a draw for every mesh of a placed model, with its current world
+// matrix, so it can be drawn without the scene
+void scene_collectModel(Scene* scene, int sceneModel, FrameDrawList* dest)
+{
+    scene_collectModelTransformed(scene, sceneModel, NULL, dest);
+}
+
+// The same, with every world matrix put through transform first, if there is
+// one. The scene itself is left as it was.
+void scene_collectModelTransformed(Scene* scene, int sceneModel, mat4 transform, FrameDrawList* dest)
+{
+    SceneModel* placed = &scene->models[sceneModel];
+    Model* model = resources_getModel(placed->model);
+
+    int lastNode = -1;
+    for (size_t i = 0; model && i < model->numMeshes; i++)
+    {
+        // A hot reload can bring in a hierarchy that's a different shape
+        int node = model->meshes[i].node;
+        if (node < 0 || (size_t)node >= placed->numNodes)
+        {
+            node = 0;
+        }
+
+        // Meshes of the same node share their transforms
+        if (transform == NULL)
+        {
+            frame_addDraw(dest, model, i, node != lastNode, scene->worldMatrices[placed->rootNode + node]);
+        }
+        else
+        {
+            mat4 world;
+            glm_mat4_mul(transform, scene->worldMatrices[placed->rootNode + node], world);
+            frame_addDraw(dest, model, i, node != lastNode, world);
+        }
+        lastNode = node;
+    }
+}
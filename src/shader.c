@@ -1,22 +1,26 @@
 #include "shader.h"
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
 
 #include <glad/glad.h>
+#include "arena.h"
+#include "extensions.h"
+#include "pack.h"
+#include "uniforms.h"
 
 
 
 
 // Open and read the content of your shader files. Returns a char* containing
-// the data from the shader.
+// the data from the shader. Comes out of the mounted pack if it's in there
+// (see pack.h), and gets copied since GL wants it NUL terminated.
 // https://moderncprogramming.com/loading-a-glsl-shader-from-file-in-opengl-using-pure-c/
 char* getShaderSourceFromFile(const char* filePath) {
-    FILE* shaderFile = fopen (filePath, "rb");
-    long size = 0;
-    char* shaderContent;
-    if (NULL == shaderFile) {
+    PackFile shaderFile;
+    if (!packOpenFile(filePath, &shaderFile)) {
         fprintf(stderr, "Error: unable to open shader file '%s'\n", filePath);
         fflush (stderr);
         return(NULL);
@@ -24,19 +28,10 @@ char* getShaderSourceFromFile(const char* filePath) {
 
     printf("Reading shader source code from %s...\n", filePath); 
 
-    // Check the length of the file
-    fseek(shaderFile, 0L, SEEK_END);
-    size = ftell(shaderFile)+1;
-    fclose(shaderFile);
-
-    // FIXME: is it possible to blow up the program by giving it a file that's too
-    // big? Could we check the MIME types?
-
-    // Now read the content of the file
-    shaderFile = fopen(filePath, "r");
-    shaderContent = memset(malloc(size), '\0', size);
-    fread(shaderContent, 1, size-1, shaderFile);
-    fclose(shaderFile);
+    char* shaderContent = heapAlloc(shaderFile.size + 1);
+    memcpy(shaderContent, shaderFile.data, shaderFile.size);
+    shaderContent[shaderFile.size] = '\0';
+    packCloseFile(&shaderFile);
 
     return shaderContent; // DON'T FORGET TO FREE THIS LATER
 }
@@ -45,80 +40,244 @@ char* getShaderSourceFromFile(const char* filePath) {
 // and return its ID.
 // A return value of 0 is an error, as it means something happened while compiling
 // the shader.
-// https://registry.khronos.org/OpenGL-Refpages/gl4/html/glCreateProgram.xhtml
 unsigned int compileShaderProgram(char* vertexPath, char* fragmentPath) {
-    // Set up our vertex shader
-    unsigned int vertexShader;
-    vertexShader = glCreateShader(GL_VERTEX_SHADER);
     char* vertexShaderSource = getShaderSourceFromFile(vertexPath);
-    const GLchar* vertexShaderPtr = vertexShaderSource;
-    glShaderSource(vertexShader, 1, &vertexShaderPtr, NULL);
-    glCompileShader(vertexShader);
+    char* fragmentShaderSource = getShaderSourceFromFile(fragmentPath);
+    if (vertexShaderSource == NULL || fragmentShaderSource == NULL)
+    {
+        free(vertexShaderSource);
+        free(fragmentShaderSource);
+        return 0;
+    }
+
+    unsigned int shaderProgram = compileShaderProgramFromSource(vertexShaderSource, fragmentShaderSource);
+
+    free(vertexShaderSource);
+    free(fragmentShaderSource);
+
+    return shaderProgram;
+}
+
+// Same as compileShaderProgram(), but takes the GLSL source directly. This is
+// what permutations use once they've injected their #defines.
+// https://registry.khronos.org/OpenGL-Refpages/gl4/html/glCreateProgram.xhtml
+unsigned int compileShaderProgramFromSource(const char* vertexSource, const char* fragmentSource) {
+    // A batch of one is just a synchronous compile
+    ShaderBatch* batch = newShaderBatch();
+    Shader* s = shaderBatchAddSource(batch, vertexSource, fragmentSource, NULL, NULL);
+    shaderBatchSubmit(batch);
+    shaderBatchFinish(batch);
+
+    unsigned int shaderProgram = s->ID;
+    free(s);
+
+    return shaderProgram;
+}
 
-    // Check if compilation was successful
+// Checks a stage that was compiled through a batch. Querying
+// GL_COMPILE_STATUS blocks until the driver is done with it.
+static bool shaderCheckCompile(unsigned int shader, const char* stage)
+{
     int success;
     char infoLog[512];
-    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
     if (!success)
     {
-        glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
-        printf("ERROR:SHADER:VERTEX:COMPILATION_FAILED\n%s\n", infoLog);
-        glDeleteShader(vertexShader);
-        free(vertexShaderSource);
-        return 0;
+        glGetShaderInfoLog(shader, 512, NULL, infoLog);
+        printf("ERROR:SHADER:%s:COMPILATION_FAILED\n%s\n", stage, infoLog);
     }
+    return success;
+}
 
-    // Set up our fragment shader
-    unsigned int fragmentShader;
-    fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    char* fragmentShaderSource = getShaderSourceFromFile(fragmentPath);
-    const GLchar* fragmentShaderPtr = fragmentShaderSource;
-    glShaderSource(fragmentShader, 1, &fragmentShaderPtr, NULL);
-    glCompileShader(fragmentShader);
+ShaderBatch* newShaderBatch()
+{
+    ShaderBatch* batch = heapAlloc(sizeof(ShaderBatch));
+    batch->pending = NULL;
+    batch->numPending = 0;
+    batch->submitted = false;
+    return batch;
+}
 
-    // Make sure the fragment shader compiled successfully
-    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
-    if (!success)
+// Queues a program in the batch and kicks off compilation of both stages
+// without waiting on the result. The returned Shader's ID is only valid
+// after shaderBatchFinish(); it's set to 0 if the program failed.
+Shader* shaderBatchAddSource(ShaderBatch* batch, const char* vertexSource, const char* fragmentSource, char* vertexPath, char* fragmentPath)
+{
+    PendingShader p;
+
+    p.vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(p.vertexShader, 1, &vertexSource, NULL);
+    glCompileShader(p.vertexShader);
+
+    p.fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(p.fragmentShader, 1, &fragmentSource, NULL);
+    glCompileShader(p.fragmentShader);
+
+    p.shader = heapAlloc(sizeof(Shader));
+    p.shader->ID = glCreateProgram();
+    p.shader->vertexPath = vertexPath;
+    p.shader->fragmentPath = fragmentPath;
+
+    glAttachShader(p.shader->ID, p.vertexShader);
+    glAttachShader(p.shader->ID, p.fragmentShader);
+
+    batch->pending = heapRealloc(batch->pending, sizeof(PendingShader) * (batch->numPending + 1));
+    batch->pending[batch->numPending++] = p;
+
+    return p.shader;
+}
+
+Shader* shaderBatchAdd(ShaderBatch* batch, char* vertexPath, char* fragmentPath)
+{
+    char* vertexSource = getShaderSourceFromFile(vertexPath);
+    char* fragmentSource = getShaderSourceFromFile(fragmentPath);
+    if (vertexSource == NULL || fragmentSource == NULL)
     {
-        glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
-        printf("ERROR:SHADER:FRAGMENT:COMPILATION_FAILED\n%s\n", infoLog);
-        glDeleteShader(vertexShader);
-        glDeleteShader(fragmentShader);
-        free(vertexShaderSource);
-        free(fragmentShaderSource);
-        return 0;
+        free(vertexSource);
+        free(fragmentSource);
+        return NULL;
     }
 
-    // Time to create a shader program
-    unsigned int shaderProgram;
-    shaderProgram = glCreateProgram();
+    // GL copies the source in glShaderSource, so we can let go of it now
+    Shader* s = shaderBatchAddSource(batch, vertexSource, fragmentSource, vertexPath, fragmentPath);
+    free(vertexSource);
+    free(fragmentSource);
+    return s;
+}
 
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
+// Issues the link for every program in the batch. Linking right behind the
+// compiles (instead of after checking them) is what lets a driver with
+// parallel compile keep all of its threads busy.
+void shaderBatchSubmit(ShaderBatch* batch)
+{
+    for (size_t i = 0; i < batch->numPending; i++)
+    {
+        glLinkProgram(batch->pending[i].shader->ID);
+    }
+    batch->submitted = true;
+}
 
-    // Check if the linking was successful
-    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
-    if (!success) 
+// Non-blocking check on whether every program in the batch is done. Without
+// GL_KHR_parallel_shader_compile there's no way to ask, so we report done and
+// let shaderBatchFinish() block on the driver instead.
+bool shaderBatchPoll(ShaderBatch* batch)
+{
+    if (!batch->submitted)
     {
-        glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
-        printf("ERROR:SHADER:LINK_FAILED\n%s\n", infoLog);
-        glDeleteShader(vertexShader);
-        glDeleteShader(fragmentShader);
-        free(vertexShaderSource);
-        free(fragmentShaderSource);
-        return 0;
+        return false;
     }
 
-    // Always clean up after ourselves
+    if (!glExtensions.parallelShaderCompile)
+    {
+        return true;
+    }
 
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
+    for (size_t i = 0; i < batch->numPending; i++)
+    {
+        int complete;
+        glGetProgramiv(batch->pending[i].shader->ID, GL_COMPLETION_STATUS_KHR, &complete);
+        if (!complete)
+        {
+            return false;
+        }
+    }
+    return true;
+}
 
-    free(vertexShaderSource);
-    free(fragmentShaderSource);
+// Waits for the batch, reports any errors and frees it. Shaders that failed
+// are left with an ID of 0. Returns false if anything in the batch failed.
+bool shaderBatchFinish(ShaderBatch* batch)
+{
+    if (!batch->submitted)
+    {
+        shaderBatchSubmit(batch);
+    }
 
-    return shaderProgram;
+    bool allSucceeded = true;
+    for (size_t i = 0; i < batch->numPending; i++)
+    {
+        PendingShader* p = &batch->pending[i];
+
+        int success;
+        char infoLog[512];
+        glGetProgramiv(p->shader->ID, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            // Link errors are usually just fallout from a stage that didn't
+            // compile, so report those first.
+            if (shaderCheckCompile(p->vertexShader, "VERTEX") && shaderCheckCompile(p->fragmentShader, "FRAGMENT"))
+            {
+                glGetProgramInfoLog(p->shader->ID, 512, NULL, infoLog);
+                printf("ERROR:SHADER:LINK_FAILED\n%s\n", infoLog);
+            }
+            glDeleteProgram(p->shader->ID);
+            p->shader->ID = 0;
+            allSucceeded = false;
+        }
+        else
+        {
+            shaderBindStandardBlocks(p->shader);
+        }
+
+        // Always clean up after ourselves
+        glDeleteShader(p->vertexShader);
+        glDeleteShader(p->fragmentShader);
+    }
+
+    free(batch->pending);
+    free(batch);
+
+    return allSucceeded;
+}
+
+// Hooks up whichever of the engine's uniform blocks the program uses, so
+// every program (and every reload of one) agrees on where they live
+void shaderBindStandardBlocks(Shader* shader)
+{
+    shaderBindUniformBlock(shader, "Materials", UNIFORM_BINDING_MATERIALS);
+    shaderBindUniformBlock(shader, "FrameData", UNIFORM_BINDING_FRAME);
+    shaderBindUniformBlock(shader, "DrawData", UNIFORM_BINDING_DRAW);
+    shaderBindUniformBlock(shader, "LightData", UNIFORM_BINDING_LIGHTS);
+}
+
+// Returns a copy of source with defines spliced in right after the #version
+// line (GLSL requires #version to come first). A #line directive follows so
+// that compiler errors still point at the right line of the original file.
+char* shaderInjectDefines(const char* source, const char* defines)
+{
+    const char* insertAt = source;
+    int versionLine = 0;
+    const char* version = strstr(source, "#version");
+    if (version != NULL)
+    {
+        const char* newline = strchr(version, '\n');
+        insertAt = newline ? newline + 1 : version + strlen(version);
+        for (const char* c = source; c < insertAt; c++)
+        {
+            if (*c == '\n')
+            {
+                versionLine++;
+            }
+        }
+    }
+
+    size_t lenHead = insertAt - source;
+    size_t lenLine = snprintf(NULL, 0, "#line %d\n", versionLine + 1);
+    size_t lenResult = strlen(source) + strlen(defines) + lenLine + 2;
+
+    char* result = heapAlloc(lenResult);
+    memcpy(result, source, lenHead);
+    // A file whose #version line has no newline still needs one before the defines
+    size_t offset = lenHead;
+    if (lenHead > 0 && source[lenHead - 1] != '\n')
+    {
+        result[offset++] = '\n';
+    }
+    offset += sprintf(&result[offset], "%s", defines);
+    offset += sprintf(&result[offset], "#line %d\n", versionLine + 1);
+    strcpy(&result[offset], insertAt);
+
+    return result; // DON'T FORGET TO FREE THIS LATER
 }
 
 Shader* newShader(char* vertexPath, char* fragmentPath)
@@ -129,7 +288,7 @@ Shader* newShader(char* vertexPath, char* fragmentPath)
         return NULL;
     }
 
-    Shader* s = malloc(sizeof(Shader));
+    Shader* s = heapAlloc(sizeof(Shader));
     s->ID = shaderID;
     s->vertexPath = vertexPath;
     s->fragmentPath = fragmentPath;
@@ -138,6 +297,24 @@ Shader* newShader(char* vertexPath, char* fragmentPath)
     return s;
 }
 
+// Recompiles a shader from its paths and swaps the new program in. If the new
+// source doesn't compile the old program stays in use.
+bool shaderReload(Shader* shader)
+{
+    unsigned int shaderID = compileShaderProgram(shader->vertexPath, shader->fragmentPath);
+    if (shaderID == 0)
+    {
+        printf("Keeping old shader %d, reload of %s failed.\n", shader->ID, shader->fragmentPath);
+        return false;
+    }
+
+    glDeleteProgram(shader->ID);
+    shader->ID = shaderID;
+
+    printf("Reloaded shader %s with ID %d\n", shader->fragmentPath, shader->ID);
+    return true;
+}
+
 void shaderUse(Shader* shader) 
 {
     glUseProgram(shader->ID);
@@ -173,16 +350,214 @@ void shaderSetMat4v(Shader* shader, const char* name, mat4 mat)
     glad_glUniformMatrix4fv(glGetUniformLocation(shader->ID, name), 1, GL_FALSE, (float*) mat);
 }
 
-char* shaderGetUniformName(char* name, unsigned int index, char* property)
+// GLSL 3.30 can't give a block its binding in the source, so it's set here.
+// Blocks the program doesn't have are ignored.
+void shaderBindUniformBlock(Shader* shader, const char* name, unsigned int binding)
+{
+    unsigned int index = glGetUniformBlockIndex(shader->ID, name);
+    if (index != GL_INVALID_INDEX)
+    {
+        glUniformBlockBinding(shader->ID, index, binding);
+    }
+}
+
+char* shaderGetUniformName(Arena* arena, const char* name, unsigned int index, const char* property)
+{
+    return arenaPrintf(arena, "%s[%u].%s", name, index, property);
+}
+
+
+// Turns a feature bitmask into the block of #defines that gets injected into
+// both stages of a permutation.
+char* shaderFeaturesToDefines(unsigned int features)
+{
+    const char* flagDefines[] = {
+        (features & SHADER_FEATURE_DIR_LIGHT) ? "#define HAS_DIR_LIGHT\n" : "",
+        (features & SHADER_FEATURE_SPECULAR_MAP) ? "#define HAS_SPECULAR_MAP\n" : "",
+        (features & SHADER_FEATURE_EMISSION_MAP) ? "#define HAS_EMISSION_MAP\n" : "",
+        (features & SHADER_FEATURE_TEXTURE_ARRAY) ? "#define USE_TEXTURE_ARRAY\n" : "",
+        (features & SHADER_FEATURE_BINDLESS) ? "#define USE_BINDLESS_TEXTURES\n" : "",
+    };
+    const char format[] = "#define NR_POINT_LIGHTS %u\n#define NR_SPOT_LIGHTS %u\n%s%s%s%s%s";
+
+    unsigned int numPointLights = SHADER_FEATURE_GET_POINT_LIGHTS(features);
+    unsigned int numSpotLights = SHADER_FEATURE_GET_SPOT_LIGHTS(features);
+
+    size_t lenDefines = snprintf(NULL, 0, format, numPointLights, numSpotLights,
+        flagDefines[0], flagDefines[1], flagDefines[2], flagDefines[3], flagDefines[4]) + 1;
+    char* defines = heapAlloc(lenDefines);
+    snprintf(defines, lenDefines, format, numPointLights, numSpotLights,
+        flagDefines[0], flagDefines[1], flagDefines[2], flagDefines[3], flagDefines[4]);
+    return defines;
+}
+
+ShaderPermutation* newShaderPermutation(char* vertexPath, char* fragmentPath)
+{
+    char* vertexSource = getShaderSourceFromFile(vertexPath);
+    char* fragmentSource = getShaderSourceFromFile(fragmentPath);
+    if (vertexSource == NULL || fragmentSource == NULL)
+    {
+        printf("Shader permutation sources could not be read.\n");
+        free(vertexSource);
+        free(fragmentSource);
+        return NULL;
+    }
+
+    ShaderPermutation* p = heapAlloc(sizeof(ShaderPermutation));
+    p->vertexPath = vertexPath;
+    p->fragmentPath = fragmentPath;
+    p->vertexSource = vertexSource;
+    p->fragmentSource = fragmentSource;
+    p->variants = NULL;
+    p->numVariants = 0;
+
+    return p;
+}
+
+// Deletes every variant's program and frees the Shaders handed out for them,
+// so nothing can be drawn with any of them afterwards
+void shaderPermutationFree(ShaderPermutation* permutation)
 {
-    size_t lenName = strlen(name);
-    size_t lenProperty = strlen(property);
-    size_t lenIndex = snprintf(NULL, 0, "%u", index);
-    size_t lenExtra = 4; // Extra for '[].\0'
+    if (permutation == NULL)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < permutation->numVariants; i++)
+    {
+        glDeleteProgram(permutation->variants[i].shader->ID);
+        free(permutation->variants[i].shader);
+    }
+    free(permutation->variants);
+    free(permutation->vertexSource);
+    free(permutation->fragmentSource);
+    free(permutation);
+}
 
-    size_t lenUniformName = lenName + lenProperty + lenIndex + lenExtra;
+static ShaderVariant* shaderPermutationFind(ShaderPermutation* permutation, unsigned int features)
+{
+    // Only a handful of variants are ever live, so a linear scan is plenty.
+    for (size_t i = 0; i < permutation->numVariants; i++)
+    {
+        if (permutation->variants[i].features == features)
+        {
+            return &permutation->variants[i];
+        }
+    }
+    return NULL;
+}
+
+// Queues the variant for a feature set in a batch so it compiles alongside
+// everything else. The variant is cached right away, so a later
+// shaderPermutationGet() returns the same Shader once the batch is finished.
+Shader* shaderPermutationRequest(ShaderPermutation* permutation, unsigned int features, ShaderBatch* batch)
+{
+    ShaderVariant* existing = shaderPermutationFind(permutation, features);
+    if (existing != NULL)
+    {
+        return existing->shader;
+    }
+
+    char* defines = shaderFeaturesToDefines(features);
+    char* vertexSource = shaderInjectDefines(permutation->vertexSource, defines);
+    char* fragmentSource = shaderInjectDefines(permutation->fragmentSource, defines);
+
+    Shader* s = shaderBatchAddSource(batch, vertexSource, fragmentSource,
+        permutation->vertexPath, permutation->fragmentPath);
+
+    free(defines);
+    free(vertexSource);
+    free(fragmentSource);
+
+    permutation->variants = heapRealloc(permutation->variants, sizeof(ShaderVariant) * (permutation->numVariants + 1));
+    permutation->variants[permutation->numVariants].features = features;
+    permutation->variants[permutation->numVariants].shader = s;
+    permutation->numVariants++;
+
+    return s;
+}
+
+// Returns the variant for a feature set, compiling it the first time it's
+// requested. Returns NULL if the variant fails to compile.
+Shader* shaderPermutationGet(ShaderPermutation* permutation, unsigned int features)
+{
+    ShaderVariant* existing = shaderPermutationFind(permutation, features);
+    if (existing != NULL)
+    {
+        return existing->shader->ID != 0 ? existing->shader : NULL;
+    }
+
+    ShaderBatch* batch = newShaderBatch();
+    Shader* s = shaderPermutationRequest(permutation, features, batch);
+    shaderBatchFinish(batch);
+
+    if (s->ID == 0)
+    {
+        printf("Shader variant 0x%x of %s failed to compile.\n", features, permutation->fragmentPath);
+        return NULL;
+    }
+
+    printf("Compiled shader variant 0x%x with ID %d\n", features, s->ID);
+    return s;
+}
+
+// Re-reads a permutation's sources and recompiles every variant that has
+// been built so far. The swap is all or nothing: if any variant fails, all of
+// them keep their old programs. Shader pointers handed out earlier stay valid
+// and get the new programs, and the old ones are deleted.
+bool shaderPermutationReload(ShaderPermutation* permutation)
+{
+    char* vertexSource = getShaderSourceFromFile(permutation->vertexPath);
+    char* fragmentSource = getShaderSourceFromFile(permutation->fragmentPath);
+    if (vertexSource == NULL || fragmentSource == NULL)
+    {
+        free(vertexSource);
+        free(fragmentSource);
+        return false;
+    }
+
+    ShaderPermutation fresh = *permutation;
+    fresh.vertexSource = vertexSource;
+    fresh.fragmentSource = fragmentSource;
+    fresh.variants = NULL;
+    fresh.numVariants = 0;
+
+    ShaderBatch* batch = newShaderBatch();
+    for (size_t i = 0; i < permutation->numVariants; i++)
+    {
+        shaderPermutationRequest(&fresh, permutation->variants[i].features, batch);
+    }
+    bool success = shaderBatchFinish(batch);
+
+    if (success)
+    {
+        for (size_t i = 0; i < permutation->numVariants; i++)
+        {
+            glDeleteProgram(permutation->variants[i].shader->ID);
+            permutation->variants[i].shader->ID = fresh.variants[i].shader->ID;
+        }
+        free(permutation->vertexSource);
+        free(permutation->fragmentSource);
+        permutation->vertexSource = vertexSource;
+        permutation->fragmentSource = fragmentSource;
+        printf("Reloaded %zu variants of %s\n", permutation->numVariants, permutation->fragmentPath);
+    }
+    else
+    {
+        for (size_t i = 0; i < fresh.numVariants; i++)
+        {
+            glDeleteProgram(fresh.variants[i].shader->ID);
+        }
+        free(vertexSource);
+        free(fragmentSource);
+        printf("Keeping old variants, reload of %s failed.\n", permutation->fragmentPath);
+    }
+
+    for (size_t i = 0; i < fresh.numVariants; i++)
+    {
+        free(fresh.variants[i].shader);
+    }
+    free(fresh.variants);
 
-    char* uniformName = (char*)malloc(lenUniformName * sizeof(char));
-    snprintf(uniformName, lenUniformName, "%s[%u].%s", name, index, property);
-    return uniformName;
+    return success;
 }
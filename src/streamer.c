@@ -0,0 +1,380 @@
+#include "streamer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <GLFW/glfw3.h>
+#include "cglm/cglm.h"
+#include "arena.h"
+
+// Lower goes first: distance to the nearest point of the request's sphere,
+// pushed back by STREAMER_HIDDEN_DISTANCE when none of it is on screen
+static float streamer_score(Streamer* streamer, const StreamItem* item)
+{
+    if (!streamer->hasView)
+    {
+        return 0.0f;
+    }
+
+    // cglm doesn't take const vectors
+    vec3 center = { item->center[0], item->center[1], item->center[2] };
+    float distance = glm_max(glm_vec3_distance(streamer->viewer, center) - item->radius, 0.0f);
+    for (int i = 0; i < 6; i++)
+    {
+        if (glm_vec3_dot(streamer->planes[i], center) + streamer->planes[i][3] < -item->radius)
+        {
+            return distance + STREAMER_HIDDEN_DISTANCE;
+        }
+    }
+    return distance;
+}
+
+// Best request in the given state, with the lock held
+static StreamItem* streamer_best(Streamer* streamer, StreamState state, bool done, StreamRequest* request)
+{
+    StreamItem* best = NULL;
+    float bestScore = 0.0f;
+    for (size_t i = 0; i < streamer->items->count; i++)
+    {
+        StreamRequest handle = handlePoolAt(streamer->items, i);
+        StreamItem** slot = handlePoolGet(streamer->items, handle);
+        if (slot == NULL)
+        {
+            continue;
+        }
+
+        StreamItem* item = *slot;
+        bool matches = done ? item->state == STREAM_LOADED || item->state == STREAM_FAILED : item->state == state;
+        if (!matches)
+        {
+            continue;
+        }
+
+        // Cancelled ones only need their memory back, which is quick
+        float score = atomic_load(&item->cancelled) ? -1.0f : streamer_score(streamer, item);
+        if (best == NULL || score < bestScore)
+        {
+            best = item;
+            bestScore = score;
+            *request = handle;
+        }
+    }
+    return best;
+}
+
+// Everything that doesn't need GL. Runs on an I/O thread.
+static bool streamer_load(StreamItem* item)
+{
+    if (item->kind == STREAM_TEXTURE)
+    {
+        item->images = heapCalloc(1, sizeof(TexCacheImage));
+        item->numImages = 1;
+        if (!textureLoadImage(item->path, &item->images[0]))
+        {
+            memset(&item->images[0], 0, sizeof(TexCacheImage));
+            return false;
+        }
+        return true;
+    }
+
+    item->model = heapAlloc(sizeof(Model));
+    model_init(item->model);
+    if (!model_loadData(item->model, item->path))
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < item->model->numMeshes; i++)
+    {
+        item->numImages += item->model->meshes[i].numTextures;
+    }
+    item->images = heapCalloc(item->numImages ? item->numImages : 1, sizeof(TexCacheImage));
+
+    // Images that fail are left without levels, and get another go when
+    // their mesh is uploaded
+    size_t next = 0;
+    for (size_t i = 0; i < item->model->numMeshes && !atomic_load(&item->cancelled); i++)
+    {
+        Mesh* mesh = &item->model->meshes[i];
+        for (size_t t = 0; t < mesh->numTextures; t++, next++)
+        {
+            if (!textureLoadImage(mesh->textures[t].path, &item->images[next]))
+            {
+                memset(&item->images[next], 0, sizeof(TexCacheImage));
+            }
+        }
+    }
+    return true;
+}
+
+static void* streamer_run(void* arg)
+{
+    Streamer* streamer = arg;
+    pthread_mutex_lock(&streamer->lock);
+    while (!streamer->quit)
+    {
+        StreamRequest request;
+        StreamItem* item = NULL;
+        if (streamer->inFlight < streamer->maxInFlight)
+        {
+            item = streamer_best(streamer, STREAM_QUEUED, false, &request);
+        }
+        if (item == NULL)
+        {
+            pthread_cond_wait(&streamer->wake, &streamer->lock);
+            continue;
+        }
+
+        // Nothing else touches the item's data until it's marked loaded
+        item->state = STREAM_LOADING;
+        streamer->inFlight++;
+        pthread_mutex_unlock(&streamer->lock);
+
+        bool loaded = streamer_load(item);
+
+        pthread_mutex_lock(&streamer->lock);
+        item->state = loaded ? STREAM_LOADED : STREAM_FAILED;
+    }
+    pthread_mutex_unlock(&streamer->lock);
+    arenaScratchRelease();
+    return NULL;
+}
+
+Streamer* newStreamer(int numThreads, size_t maxInFlight)
+{
+    Streamer* streamer = heapCalloc(1, sizeof(Streamer));
+    streamer->items = newHandlePool(sizeof(StreamItem*));
+    streamer->maxInFlight = maxInFlight > 0 ? maxInFlight : 1;
+    pthread_mutex_init(&streamer->lock, NULL);
+    pthread_cond_init(&streamer->wake, NULL);
+
+    if (numThreads < 1)
+    {
+        numThreads = 1;
+    }
+    if (numThreads > STREAMER_MAX_THREADS)
+    {
+        numThreads = STREAMER_MAX_THREADS;
+    }
+    for (int i = 0; i < numThreads; i++)
+    {
+        if (pthread_create(&streamer->threads[streamer->numThreads], NULL, streamer_run, streamer) != 0)
+        {
+            printf("Couldn't start streaming thread %d\n", i);
+            break;
+        }
+        streamer->numThreads++;
+    }
+    if (streamer->numThreads == 0)
+    {
+        pthread_mutex_destroy(&streamer->lock);
+        pthread_cond_destroy(&streamer->wake);
+        handlePoolFree(streamer->items);
+        free(streamer);
+        return NULL;
+    }
+    return streamer;
+}
+
+// Frees whatever the item still owns, closing the images no texture took
+static void streamer_freeItem(StreamItem* item)
+{
+    for (size_t i = item->uploadedImages; i < item->numImages; i++)
+    {
+        texcacheClose(&item->images[i]);
+    }
+    free(item->images);
+    model_free(item->model);
+    free(item->path);
+    free(item);
+}
+
+// Drops a request that isn't loading and lets the I/O threads at the next
+static void streamer_retire(Streamer* streamer, StreamRequest request, StreamItem* item)
+{
+    pthread_mutex_lock(&streamer->lock);
+    if (item->state != STREAM_QUEUED)
+    {
+        streamer->inFlight--;
+    }
+    handlePoolRemove(streamer->items, request, NULL);
+    pthread_cond_broadcast(&streamer->wake);
+    pthread_mutex_unlock(&streamer->lock);
+    streamer_freeItem(item);
+}
+
+void streamer_free(Streamer* streamer)
+{
+    pthread_mutex_lock(&streamer->lock);
+    streamer->quit = true;
+    pthread_cond_broadcast(&streamer->wake);
+    pthread_mutex_unlock(&streamer->lock);
+    for (int i = 0; i < streamer->numThreads; i++)
+    {
+        pthread_join(streamer->threads[i], NULL);
+    }
+
+    for (size_t i = 0; i < streamer->items->count; i++)
+    {
+        StreamItem** slot = handlePoolGet(streamer->items, handlePoolAt(streamer->items, i));
+        if (slot)
+        {
+            streamer_freeItem(*slot);
+        }
+    }
+    handlePoolFree(streamer->items);
+    pthread_mutex_destroy(&streamer->lock);
+    pthread_cond_destroy(&streamer->wake);
+    free(streamer);
+}
+
+static StreamRequest streamer_request(Streamer* streamer, StreamKind kind, const char* path, vec3 center, float radius,
+    StreamDoneFn done, void* ctx)
+{
+    StreamItem* item = heapCalloc(1, sizeof(StreamItem));
+    item->kind = kind;
+    item->path = strdup(path);
+    glm_vec3_copy(center, item->center);
+    item->radius = radius;
+    item->done = done;
+    item->ctx = ctx;
+    item->state = STREAM_QUEUED;
+    atomic_init(&item->cancelled, false);
+
+    pthread_mutex_lock(&streamer->lock);
+    StreamRequest request = handlePoolAdd(streamer->items, &item);
+    pthread_cond_signal(&streamer->wake);
+    pthread_mutex_unlock(&streamer->lock);
+
+    if (request == HANDLE_NONE)
+    {
+        streamer_freeItem(item);
+    }
+    return request;
+}
+
+StreamRequest streamer_requestModel(Streamer* streamer, const char* path, vec3 center, float radius,
+    StreamDoneFn done, void* ctx)
+{
+    return streamer_request(streamer, STREAM_MODEL, path, center, radius, done, ctx);
+}
+
+StreamRequest streamer_requestTexture(Streamer* streamer, const char* path, vec3 center, float radius,
+    StreamDoneFn done, void* ctx)
+{
+    return streamer_request(streamer, STREAM_TEXTURE, path, center, radius, done, ctx);
+}
+
+// Its done callback won't be called. A request that's still queued goes
+// right away, one being loaded once its thread is done with it.
+void streamer_cancel(Streamer* streamer, StreamRequest request)
+{
+    pthread_mutex_lock(&streamer->lock);
+    StreamItem** slot = handlePoolGet(streamer->items, request);
+    if (slot == NULL)
+    {
+        pthread_mutex_unlock(&streamer->lock);
+        return;
+    }
+
+    StreamItem* item = *slot;
+    atomic_store(&item->cancelled, true);
+    if (item->state != STREAM_QUEUED)
+    {
+        pthread_mutex_unlock(&streamer->lock);
+        return;
+    }
+    handlePoolRemove(streamer->items, request, NULL);
+    pthread_mutex_unlock(&streamer->lock);
+    streamer_freeItem(item);
+}
+
+// Where requests are ranked from. Until it's called they go in order.
+void streamer_setViewer(Streamer* streamer, vec3 position, mat4 viewProjection)
+{
+    pthread_mutex_lock(&streamer->lock);
+    glm_vec3_copy(position, streamer->viewer);
+    glm_frustum_planes(viewProjection, streamer->planes);
+    streamer->hasView = true;
+    pthread_mutex_unlock(&streamer->lock);
+}
+
+// Uploads one mesh of a model, or a texture. Returns true once the whole
+// request is up.
+static bool streamer_uploadStep(StreamItem* item)
+{
+    if (item->kind == STREAM_TEXTURE)
+    {
+        return true;
+    }
+
+    Model* model = item->model;
+    if (item->uploadedMeshes < model->numMeshes)
+    {
+        Mesh* mesh = &model->meshes[item->uploadedMeshes];
+        model_uploadMesh(model, item->uploadedMeshes, &item->images[item->uploadedImages]);
+        item->uploadedImages += mesh->numTextures;
+        item->uploadedMeshes++;
+    }
+    return item->uploadedMeshes == model->numMeshes;
+}
+
+// Uploads what the I/O threads have loaded, best first, until budgetSeconds
+// is gone. At least one step is taken each call, so a tight budget still
+// gets there. Done callbacks are called from here.
+void streamer_update(Streamer* streamer, double budgetSeconds)
+{
+    double start = glfwGetTime();
+    do
+    {
+        StreamRequest request;
+        pthread_mutex_lock(&streamer->lock);
+        StreamItem* item = streamer_best(streamer, STREAM_LOADED, true, &request);
+        pthread_mutex_unlock(&streamer->lock);
+        if (item == NULL)
+        {
+            break;
+        }
+
+        if (atomic_load(&item->cancelled))
+        {
+            streamer_retire(streamer, request, item);
+            continue;
+        }
+
+        if (item->state == STREAM_FAILED)
+        {
+            printf("Couldn't stream in %s\n", item->path);
+            item->done(request, HANDLE_NONE, 0, item->ctx);
+            streamer_retire(streamer, request, item);
+            continue;
+        }
+
+        if (!streamer_uploadStep(item))
+        {
+            continue;
+        }
+
+        if (item->kind == STREAM_TEXTURE)
+        {
+            TextureHandle texture = textureAcquireImage(item->path, &item->images[0]);
+            item->uploadedImages = 1;
+            item->done(request, HANDLE_NONE, texture, item->ctx);
+        }
+        else
+        {
+            ModelHandle model = resources_addModel(item->model);
+            item->model = NULL;
+            item->done(request, model, 0, item->ctx);
+        }
+        streamer_retire(streamer, request, item);
+    } while (glfwGetTime() - start < budgetSeconds);
+}
+
+// Requests that haven't been handed over yet
+size_t streamer_numPending(Streamer* streamer)
+{
+    pthread_mutex_lock(&streamer->lock);
+    size_t pending = streamer->items->count - streamer->items->numFree;
+    pthread_mutex_unlock(&streamer->lock);
+    return pending;
+}
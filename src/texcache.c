@@ -0,0 +1,213 @@
+#include "texcache.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const char* TEXCACHE_DIR = ".texcache";
+
+#define TEXCACHE_MAGIC "M182TEX"
+#define TEXCACHE_VERSION 1
+
+// Level data starts on this boundary so every level is aligned in the mapping
+#define TEXCACHE_ALIGNMENT 64
+
+typedef struct {
+    uint64_t offset;
+    uint64_t size;
+    uint32_t width;
+    uint32_t height;
+} TexCacheLevelHeader;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t compressed;
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t channels;
+    uint32_t numLevels;
+    uint32_t reserved;
+    uint64_t sourceHash;
+    TexCacheLevelHeader levels[MIPMAP_MAX_LEVELS];
+} TexCacheHeader;
+
+// FNV-1a. Not cryptographic, but plenty to tell source images apart.
+// The cache is keyed on what's in the file rather than its name or mtime, so
+// copies of the same image share an entry and edited ones never go stale.
+uint64_t texcacheHash(const void* data, size_t size, uint64_t seed)
+{
+    const unsigned char* bytes = data;
+    uint64_t hash = seed ? seed : 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+void texcacheEntryPath(uint64_t hash, bool compressed, char* dest, size_t lenDest)
+{
+    snprintf(dest, lenDest, "%s/%016llx.%s.tex", TEXCACHE_DIR, (unsigned long long)hash, compressed ? "bcn" : "rgba");
+}
+
+bool texcacheOpen(const char* entryPath, TexCacheImage* image)
+{
+    int fd = open(entryPath, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(TexCacheHeader))
+    {
+        close(fd);
+        return false;
+    }
+
+    void* mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        return false;
+    }
+
+    const TexCacheHeader* header = mapping;
+    if (memcmp(header->magic, TEXCACHE_MAGIC, sizeof(TEXCACHE_MAGIC)) != 0
+        || header->version != TEXCACHE_VERSION
+        || header->numLevels == 0 || header->numLevels > MIPMAP_MAX_LEVELS)
+    {
+        printf("Ignoring bad texture cache entry %s\n", entryPath);
+        munmap(mapping, st.st_size);
+        return false;
+    }
+
+    image->compressed = header->compressed;
+    image->format = header->format;
+    image->width = header->width;
+    image->height = header->height;
+    image->channels = header->channels;
+    image->numLevels = header->numLevels;
+    image->mapping = mapping;
+    image->mappingSize = st.st_size;
+    image->buffer = NULL;
+
+    for (size_t i = 0; i < image->numLevels; i++)
+    {
+        const TexCacheLevelHeader* level = &header->levels[i];
+        if (level->offset + level->size > (uint64_t)st.st_size)
+        {
+            printf("Texture cache entry %s is truncated\n", entryPath);
+            texcacheClose(image);
+            return false;
+        }
+        image->levels[i].data = (const unsigned char*)mapping + level->offset;
+        image->levels[i].size = level->size;
+        image->levels[i].width = level->width;
+        image->levels[i].height = level->height;
+    }
+
+    // We're about to read every byte of it, so start paging it in now
+    madvise(mapping, st.st_size, MADV_WILLNEED);
+    return true;
+}
+
+// Releases the image's levels, whether they were mapped from the cache or
+// built in memory.
+void texcacheClose(TexCacheImage* image)
+{
+    if (image->mapping != NULL)
+    {
+        munmap(image->mapping, image->mappingSize);
+    }
+    free(image->buffer);
+    image->mapping = NULL;
+    image->mappingSize = 0;
+    image->buffer = NULL;
+}
+
+// Writes to a temporary file of its own and renames it into place, so a
+// crash, or another thread or process writing the same entry, never leaves
+// half of one or a mix of two behind.
+bool texcacheWrite(const char* entryPath, uint64_t hash, const TexCacheImage* image)
+{
+    if (mkdir(TEXCACHE_DIR, 0755) != 0 && errno != EEXIST)
+    {
+        printf("Unable to create texture cache directory %s\n", TEXCACHE_DIR);
+        return false;
+    }
+
+    TexCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TEXCACHE_MAGIC, sizeof(TEXCACHE_MAGIC));
+    header.version = TEXCACHE_VERSION;
+    header.compressed = image->compressed;
+    header.format = image->format;
+    header.width = image->width;
+    header.height = image->height;
+    header.channels = image->channels;
+    header.numLevels = image->numLevels;
+    header.sourceHash = hash;
+
+    uint64_t offset = (sizeof(header) + TEXCACHE_ALIGNMENT - 1) & ~(uint64_t)(TEXCACHE_ALIGNMENT - 1);
+    for (size_t i = 0; i < image->numLevels; i++)
+    {
+        header.levels[i].offset = offset;
+        header.levels[i].size = image->levels[i].size;
+        header.levels[i].width = image->levels[i].width;
+        header.levels[i].height = image->levels[i].height;
+        offset = (offset + image->levels[i].size + TEXCACHE_ALIGNMENT - 1) & ~(uint64_t)(TEXCACHE_ALIGNMENT - 1);
+    }
+
+    size_t lenTempPath = strlen(entryPath) + 32;
+    char tempPath[lenTempPath];
+    snprintf(tempPath, lenTempPath, "%s.XXXXXX", entryPath);
+
+    // mkstemp() makes it readable only by us, unlike the entries around it
+    int fd = mkstemp(tempPath);
+    FILE* file = NULL;
+    if (fd >= 0)
+    {
+        fchmod(fd, 0644);
+        file = fdopen(fd, "wb");
+    }
+    if (file == NULL)
+    {
+        printf("Unable to write texture cache entry %s\n", tempPath);
+        if (fd >= 0)
+        {
+            close(fd);
+            remove(tempPath);
+        }
+        return false;
+    }
+
+    static const unsigned char padding[TEXCACHE_ALIGNMENT] = { 0 };
+    fwrite(&header, sizeof(header), 1, file);
+    size_t written = sizeof(header);
+    for (size_t i = 0; i < image->numLevels; i++)
+    {
+        fwrite(padding, 1, header.levels[i].offset - written, file);
+        fwrite(image->levels[i].data, 1, image->levels[i].size, file);
+        written = header.levels[i].offset + image->levels[i].size;
+    }
+
+    bool success = ferror(file) == 0;
+    success = fclose(file) == 0 && success;
+    if (success)
+    {
+        success = rename(tempPath, entryPath) == 0;
+    }
+    if (!success)
+    {
+        remove(tempPath);
+    }
+    return success;
+}
@@ -1,8 +1,36 @@
 #include "texture.h"
+#include <limits.h>
+#include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include "arena.h"
+#include "bcn.h"
+#include "dds.h"
+#include "extensions.h"
+#include "mipmap.h"
+#include "pack.h"
+#include "parallel.h"
 #include "stb_image.h"
+#include "texcache.h"
+
+// Store textures block compressed on the GPU when the driver can sample them
+bool TEXTURE_COMPRESSION = true;
+
+// Stream mip levels in and out of shared textures as they're needed. On by
+// default, main() turns it off when it draws with bindless handles.
+bool TEXTURE_STREAMING = true;
+size_t TEXTURE_STREAMING_BUDGET = 256 * 1024 * 1024;
+size_t TEXTURE_STREAMING_UPLOAD_LIMIT = 16 * 1024 * 1024; // Per frame
+int TEXTURE_STREAMING_MIN_SIZE = 64; // Levels this small are always resident
+
+// Block rows per thread when compressing
+#define TEXTURE_MIN_BLOCK_ROWS_PER_THREAD 16
+
+static bool textureLoadDDS(const char* path, PackFile* file, TexCacheImage* image);
+static bool textureUpload(unsigned int* texture, const TexCacheImage* image);
 
 int loadTexture(char* path)
 {
@@ -10,34 +38,1154 @@ int loadTexture(char* path)
     // Generate texture
     unsigned int texture;
     glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
 
-    // set the texture wrapping/filtering options (on the currently bound texture object)
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    if (!textureLoadInto(&texture, path))
+    {
+        glDeleteTextures(1, &texture);
+        return -1;
+    }
+    return texture;
+}
+
+typedef struct {
+    enum BCnFormat format;
+    const unsigned char* rgba;
+    int width;
+    int height;
+    unsigned char* dest;
+} TextureEncodeJob;
+
+static void textureEncodeRows(size_t begin, size_t end, void* ctx)
+{
+    TextureEncodeJob* job = ctx;
+    size_t blocksX = (job->width + 3) / 4;
+    size_t y0 = begin * 4;
+    size_t y1 = end * 4 < (size_t)job->height ? end * 4 : (size_t)job->height;
+    bcnEncode(job->format,
+        &job->rgba[y0 * job->width * 4], job->width, (int)(y1 - y0),
+        &job->dest[begin * blocksX * bcnBlockSize(job->format)]);
+}
+
+// Picks the smallest format that keeps all of the image's channels. Gray
+// ones are swizzled back to gray when they're uploaded, see
+// textureSetSwizzle().
+static enum BCnFormat textureChooseFormat(const unsigned char* rgba, int width, int height, int nrChannels)
+{
+    if (nrChannels == 1)
+        return BCN_BC4;
+    if (nrChannels == 2)
+        return BCN_BC5;
+    if (nrChannels == 4)
+    {
+        // Plenty of PNGs carry an alpha channel they don't use
+        for (size_t i = 0; i < (size_t)width * height; i++)
+        {
+            if (rgba[i * 4 + 3] != 255)
+            {
+                return BCN_BC3;
+            }
+        }
+    }
+    return BCN_BC1;
+}
+
+// (Re)loads the image at path into an existing texture object. Used for the
+// initial load and for hot reloading, where everything that refers to the
+// texture's ID picks up the new image for free. Immutable storage can't
+// change size or format though, so an image that doesn't fit gets a new
+// texture object and *texture is updated. The old contents are left alone
+// if the image can't be decoded.
+bool textureLoadInto(unsigned int* texture, const char* path)
+{
+    TexCacheImage image;
+    if (!textureLoadImage(path, &image))
+    {
+        printf("Failed to load texture\n");
+        return false;
+    }
+
+    bool success = textureUpload(texture, &image);
+    texcacheClose(&image);
+    return success;
+}
+
+// Gets the full mip chain for the image at path, ready to upload, without
+// touching GL. Release it with texcacheClose().
+//
+// Images are decoded and mipmapped once, then kept in the texture cache
+// (see texcache.h) keyed on the hash of the source file. After that a load
+// is an mmap, with no decoding and no glGenerateMipmap. Source images come
+// out of the mounted pack where they're in it (see pack.h), which has their
+// hashes ready, so a cache hit doesn't read the source at all.
+bool textureLoadImage(const char* path, TexCacheImage* image)
+{
+    PackFile file;
+    if (!packOpenFile(path, &file))
+    {
+        return false;
+    }
+
+    const char* extension = strrchr(path, '.');
+    if (extension != NULL && strcmp(extension, ".dds") == 0)
+    {
+        return textureLoadDDS(path, &file, image);
+    }
+
+    bool compress = TEXTURE_COMPRESSION && glExtensions.textureCompressionS3TC;
+
+    uint64_t hash = packFileHash(&file);
+    char entryPath[PATH_MAX];
+    texcacheEntryPath(hash, compress, entryPath, PATH_MAX);
+    if (texcacheOpen(entryPath, image))
+    {
+        packCloseFile(&file);
+        return true;
+    }
+
     // load and generate the texture
     int width, height, nrChannels;
-    unsigned char *data = stbi_load(path, &width, &height, &nrChannels, 0);
-    if (data)
+    unsigned char* data = stbi_load_from_memory(file.data, file.size, &width, &height, &nrChannels, 4);
+    packCloseFile(&file);
+    if (!data)
     {
-        GLenum format;
-        if (nrChannels == 1)
-            format = GL_RED;
-        else if (nrChannels == 3)
-            format = GL_RGB;
-        else if (nrChannels == 4)
-            format = GL_RGBA;
+        return false;
+    }
 
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+    image->compressed = compress;
+    image->format = compress ? textureChooseFormat(data, width, height, nrChannels) : BCN_BC1;
+    image->width = width;
+    image->height = height;
+    image->channels = nrChannels;
+    image->numLevels = mipmapNumLevels(width, height);
+    image->mapping = NULL;
+    image->mappingSize = 0;
+
+    // Every level lives in one block that the image owns
+    size_t totalSize = 0;
+    for (size_t i = 0; i < image->numLevels; i++)
+    {
+        int w, h;
+        mipmapLevelSize(width, height, i, &w, &h);
+        image->levels[i].width = w;
+        image->levels[i].height = h;
+        image->levels[i].size = compress ? bcnImageSize(image->format, w, h) : (size_t)w * h * 4;
+        totalSize += image->levels[i].size;
     }
-    else
+    image->buffer = heapAlloc(totalSize);
+
+    unsigned char* pixels[MIPMAP_MAX_LEVELS];
+    unsigned char* dest = image->buffer;
+    for (size_t i = 0; i < image->numLevels; i++)
     {
-        printf("Failed to load texture\n");
-        return -1;
+        image->levels[i].data = dest;
+        dest += image->levels[i].size;
+
+        // Uncompressed mips are built right where they'll be uploaded from
+        if (!compress)
+        {
+            pixels[i] = (unsigned char*)image->levels[i].data;
+        }
+        else
+        {
+            pixels[i] = heapAlloc((size_t)image->levels[i].width * image->levels[i].height * 4);
+        }
     }
+
+    memcpy(pixels[0], data, (size_t)width * height * 4);
     stbi_image_free(data);
+    mipmapBuildChain(pixels, image->numLevels, width, height);
+
+    if (compress)
+    {
+        for (size_t i = 0; i < image->numLevels; i++)
+        {
+            TextureEncodeJob job;
+            job.format = image->format;
+            job.rgba = pixels[i];
+            job.width = image->levels[i].width;
+            job.height = image->levels[i].height;
+            job.dest = (unsigned char*)image->levels[i].data;
+            parallelFor((job.height + 3) / 4, TEXTURE_MIN_BLOCK_ROWS_PER_THREAD, textureEncodeRows, &job);
+            free(pixels[i]);
+        }
+    }
+
+    if (!texcacheWrite(entryPath, hash, image))
+    {
+        printf("Unable to cache texture %s\n", path);
+    }
+    else
+    {
+        // Swap the heap copy for the mapping so textures that are kept
+        // around for streaming are backed by the page cache
+        TexCacheImage mapped;
+        if (texcacheOpen(entryPath, &mapped))
+        {
+            texcacheClose(image);
+            *image = mapped;
+        }
+    }
+
+    return true;
+}
+
+static unsigned int textureSamplers[TEXTURE_SAMPLER_COUNT] = { 0 };
+
+// Samplers are made on first use, so this needs a current context
+unsigned int textureGetSampler(enum TextureSamplerMode mode)
+{
+    if (textureSamplers[mode] != 0)
+    {
+        return textureSamplers[mode];
+    }
+
+    GLint minFilter = GL_LINEAR_MIPMAP_LINEAR;
+    GLint magFilter = GL_NEAREST;
+    if (mode == TEXTURE_SAMPLER_LINEAR)
+    {
+        magFilter = GL_LINEAR;
+    }
+    else if (mode == TEXTURE_SAMPLER_NEAREST)
+    {
+        minFilter = GL_NEAREST_MIPMAP_NEAREST;
+    }
+
+    unsigned int sampler;
+    glGenSamplers(1, &sampler);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, minFilter);
+    glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, magFilter);
+
+    textureSamplers[mode] = sampler;
+    return sampler;
+}
+
+void textureBindSampler(unsigned int unit, enum TextureSamplerMode mode)
+{
+    glBindSampler(unit, textureGetSampler(mode));
+}
+
+static bool textureInternalFormat(enum BCnFormat format, GLenum* internalFormat)
+{
+    switch (format) {
+        case BCN_BC1:
+            *internalFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+            return glExtensions.textureCompressionS3TC;
+        case BCN_BC3:
+            *internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            return glExtensions.textureCompressionS3TC;
+        case BCN_BC4:
+            *internalFormat = GL_COMPRESSED_RED_RGTC1;
+            return true;
+        case BCN_BC5:
+            *internalFormat = GL_COMPRESSED_RG_RGTC2;
+            return true;
+        case BCN_BC7:
+            *internalFormat = GL_COMPRESSED_RGBA_BPTC_UNORM_ARB;
+            return glExtensions.textureCompressionBPTC;
+        default:
+            return false;
+    }
+}
+
+static bool textureImageInternalFormat(const TexCacheImage* image, GLenum* internalFormat)
+{
+    // Uncompressed images are always RGBA8 in memory, whatever the source had
+    *internalFormat = GL_RGBA8;
+    if (image->compressed && !textureInternalFormat(image->format, internalFormat))
+    {
+        printf("Texture compression format %d isn't supported by this driver\n", image->format);
+        return false;
+    }
+    return true;
+}
+
+// BC4 keeps only red and BC5 red and green. Encoded from a gray or gray and
+// alpha source that's gray and alpha, which gets spread back out so it
+// samples the same as the RGBA8 path. DDS files say they have 4 channels and
+// are left alone, BC4 and BC5 there being data like normal maps.
+static void textureSetSwizzle(GLenum target, const TexCacheImage* image)
+{
+    GLint swizzle[4] = { GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA };
+    if (image->compressed && image->format == BCN_BC4 && image->channels == 1)
+    {
+        GLint gray[4] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+        memcpy(swizzle, gray, sizeof(swizzle));
+    }
+    else if (image->compressed && image->format == BCN_BC5 && image->channels == 2)
+    {
+        GLint grayAlpha[4] = { GL_RED, GL_RED, GL_RED, GL_GREEN };
+        memcpy(swizzle, grayAlpha, sizeof(swizzle));
+    }
+    glTexParameteriv(target, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+}
+
+// Uploads one level of the image into the bound GL_TEXTURE_2D
+static void textureUploadLevel(const TexCacheImage* image, GLenum internalFormat, size_t i)
+{
+    const TexCacheLevel* level = &image->levels[i];
+    if (image->compressed)
+    {
+        glCompressedTexImage2D(GL_TEXTURE_2D, i, internalFormat, level->width, level->height, 0, level->size, level->data);
+    }
+    else
+    {
+        glTexImage2D(GL_TEXTURE_2D, i, internalFormat, level->width, level->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, level->data);
+    }
+}
+
+// Uploads one level of the image into storage that's already allocated
+static void textureUploadSubLevel(const TexCacheImage* image, GLenum internalFormat, size_t i)
+{
+    const TexCacheLevel* level = &image->levels[i];
+    if (image->compressed)
+    {
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, level->width, level->height, internalFormat, level->size, level->data);
+    }
+    else
+    {
+        glTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, level->width, level->height, GL_RGBA, GL_UNSIGNED_BYTE, level->data);
+    }
+}
+
+// Whether the bound texture's immutable storage can take the image as is
+static bool textureStorageMatches(const TexCacheImage* image, GLenum internalFormat)
+{
+    GLint levels, width, height, format;
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_IMMUTABLE_LEVELS, &levels);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &format);
+    return (size_t)levels == image->numLevels && width == image->width
+        && height == image->height && (GLenum)format == internalFormat;
+}
+
+// Uploads every level of the mip chain as is. The driver never has to
+// generate mips for these. Storage is immutable where the driver supports
+// it, with exactly the levels the image has, so the texture is complete by
+// construction and never has to be validated again.
+static bool textureUpload(unsigned int* texture, const TexCacheImage* image)
+{
+    GLenum internalFormat;
+    if (!textureImageInternalFormat(image, &internalFormat))
+    {
+        return false;
+    }
+
+    glBindTexture(GL_TEXTURE_2D, *texture);
+
+    if (!glExtensions.textureStorage)
+    {
+        textureSetSwizzle(GL_TEXTURE_2D, image);
+
+        // A chain that stops before 1x1 has to say so or the texture is incomplete
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image->numLevels - 1);
+
+        for (size_t i = 0; i < image->numLevels; i++)
+        {
+            textureUploadLevel(image, internalFormat, i);
+        }
+        return true;
+    }
+
+    GLint immutable;
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_IMMUTABLE_FORMAT, &immutable);
+    if (immutable && !textureStorageMatches(image, internalFormat))
+    {
+        glDeleteTextures(1, texture);
+        glGenTextures(1, texture);
+        glBindTexture(GL_TEXTURE_2D, *texture);
+        immutable = GL_FALSE;
+    }
+
+    if (!immutable)
+    {
+        glTexStorage2D(GL_TEXTURE_2D, image->numLevels, internalFormat, image->width, image->height);
+    }
+    textureSetSwizzle(GL_TEXTURE_2D, image);
+
+    for (size_t i = 0; i < image->numLevels; i++)
+    {
+        textureUploadSubLevel(image, internalFormat, i);
+    }
+
+    return true;
+}
+
+// Takes over file, which the levels point into
+static bool textureLoadDDS(const char* path, PackFile* file, TexCacheImage* image)
+{
+    DDSImage dds;
+    if (!ddsParse(path, file->data, file->size, &dds))
+    {
+        packCloseFile(file);
+        return false;
+    }
+
+    image->compressed = true;
+    image->format = dds.format;
+    image->width = dds.width;
+    image->height = dds.height;
+    image->channels = 4;
+    image->numLevels = dds.numLevels < MIPMAP_MAX_LEVELS ? dds.numLevels : MIPMAP_MAX_LEVELS;
+    for (size_t i = 0; i < image->numLevels; i++)
+    {
+        image->levels[i].data = dds.levels[i].data;
+        image->levels[i].size = dds.levels[i].size;
+        image->levels[i].width = dds.levels[i].width;
+        image->levels[i].height = dds.levels[i].height;
+    }
+
+    // The levels point into the file's data, so the image takes it over.
+    // Straight out of the pack it's neither, and the pack outlives it.
+    image->mapping = file->mapping;
+    image->mappingSize = file->mappingSize;
+    image->buffer = file->buffer;
+    free(dds.levels);
+    return true;
+}
+
+// Allocates every level of the bound GL_TEXTURE_2D_ARRAY, immutably where
+// the driver can. compressed gives the level sizes of block compressed
+// layers, NULL for RGBA8.
+static void textureArrayAllocate(GLenum internalFormat, const TexCacheImage* compressed, int width, int height, size_t layers, size_t numLevels)
+{
+    if (glExtensions.textureStorage)
+    {
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, numLevels, internalFormat, width, height, layers);
+        return;
+    }
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, numLevels - 1);
+    for (size_t level = 0; level < numLevels; level++)
+    {
+        int w, h;
+        mipmapLevelSize(width, height, level, &w, &h);
+        if (compressed != NULL)
+        {
+            glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, internalFormat, w, h, layers, 0, compressed->levels[level].size * layers, NULL);
+        }
+        else
+        {
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, level, internalFormat, w, h, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        }
+    }
+}
+
+// Layers can come straight from the texture cache if they're all compressed
+// the same way from as many channels and have the same size, otherwise
+// they're decoded again.
+static bool textureArrayCanCopyLevels(const TexCacheImage* images, size_t numImages)
+{
+    GLenum internalFormat;
+    for (size_t i = 0; i < numImages; i++)
+    {
+        if (images[i].compressed != images[0].compressed
+            || images[i].format != images[0].format
+            || images[i].channels != images[0].channels
+            || images[i].width != images[0].width
+            || images[i].height != images[0].height
+            || images[i].numLevels != images[0].numLevels)
+        {
+            return false;
+        }
+    }
+    return !images[0].compressed || textureInternalFormat(images[0].format, &internalFormat);
+}
+
+// Packs several images into one GL_TEXTURE_2D_ARRAY, one layer each, in the
+// order they're given, so a whole model (or scene) can be drawn with a
+// single texture bound. Images that don't match in size are resized to the
+// largest one. Returns 0 on failure.
+unsigned int textureArrayCreate(const char** paths, size_t numPaths)
+{
+    if (numPaths == 0)
+    {
+        return 0;
+    }
+
+    TexCacheImage* images = heapAlloc(sizeof(TexCacheImage) * numPaths);
+    for (size_t i = 0; i < numPaths; i++)
+    {
+        if (!textureLoadImage(paths[i], &images[i]))
+        {
+            printf("Failed to load texture array layer %s\n", paths[i]);
+            for (size_t j = 0; j < i; j++)
+            {
+                texcacheClose(&images[j]);
+            }
+            free(images);
+            return 0;
+        }
+    }
+
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+
+    if (textureArrayCanCopyLevels(images, numPaths))
+    {
+        GLenum internalFormat = GL_RGBA8;
+        bool compressed = images[0].compressed;
+        if (compressed)
+        {
+            textureInternalFormat(images[0].format, &internalFormat);
+        }
+
+        textureArrayAllocate(internalFormat, compressed ? &images[0] : NULL,
+            images[0].width, images[0].height, numPaths, images[0].numLevels);
+        textureSetSwizzle(GL_TEXTURE_2D_ARRAY, &images[0]);
+        for (size_t level = 0; level < images[0].numLevels; level++)
+        {
+            for (size_t layer = 0; layer < numPaths; layer++)
+            {
+                const TexCacheLevel* src = &images[layer].levels[level];
+                if (compressed)
+                {
+                    glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, src->width, src->height, 1, internalFormat, src->size, src->data);
+                }
+                else
+                {
+                    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, src->width, src->height, 1, GL_RGBA, GL_UNSIGNED_BYTE, src->data);
+                }
+            }
+        }
+    }
+    else
+    {
+        int width = 0;
+        int height = 0;
+        for (size_t i = 0; i < numPaths; i++)
+        {
+            width = images[i].width > width ? images[i].width : width;
+            height = images[i].height > height ? images[i].height : height;
+        }
+        printf("Texture array layers differ, resizing them all to %dx%d\n", width, height);
+
+        size_t numLevels = mipmapNumLevels(width, height);
+        textureArrayAllocate(GL_RGBA8, NULL, width, height, numPaths, numLevels);
+
+        unsigned char* pixels[MIPMAP_MAX_LEVELS];
+        for (size_t level = 0; level < numLevels; level++)
+        {
+            int w, h;
+            mipmapLevelSize(width, height, level, &w, &h);
+            pixels[level] = heapAlloc((size_t)w * h * 4);
+        }
+
+        for (size_t layer = 0; layer < numPaths; layer++)
+        {
+            int w, h, nrChannels;
+            unsigned char* data = NULL;
+            PackFile file;
+            if (packOpenFile(paths[layer], &file))
+            {
+                data = stbi_load_from_memory(file.data, file.size, &w, &h, &nrChannels, 4);
+                packCloseFile(&file);
+            }
+            if (data == NULL)
+            {
+                continue;
+            }
+            mipmapResize(data, w, h, pixels[0], width, height);
+            stbi_image_free(data);
+
+            mipmapBuildChain(pixels, numLevels, width, height);
+            for (size_t level = 0; level < numLevels; level++)
+            {
+                mipmapLevelSize(width, height, level, &w, &h);
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, w, h, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixels[level]);
+            }
+        }
+
+        for (size_t level = 0; level < numLevels; level++)
+        {
+            free(pixels[level]);
+        }
+    }
+
+    for (size_t i = 0; i < numPaths; i++)
+    {
+        texcacheClose(&images[i]);
+    }
+    free(images);
+
     return texture;
 }
+
+typedef struct {
+    char* path; // Canonical
+    uint64_t hash;
+    unsigned int id;
+    unsigned int refCount;
+    uint64_t bindlessHandle; // 0 until something asks for it
+
+    // Streaming state, only used while streamed is set
+    bool streamed;
+    TexCacheImage image; // Where the levels are streamed from
+    int baseLevel; // Coarsest level streaming is in charge of, always resident
+    int residentLevel; // Finest level uploaded
+    int requestedLevel; // Finest level asked for this frame, INT_MAX if none
+    int wantedLevel; // What the last update aimed for
+    unsigned int lastRequestFrame;
+} TextureEntry;
+
+// Entries are never removed, only unloaded, so a handle always points at the
+// same path and a texture that comes back later reuses its slot.
+static TextureEntry* textureEntries = NULL;
+static size_t numTextureEntries = 0;
+
+// Open addressing table from path hash to entry index + 1 (0 means empty).
+// Kept at most half full.
+static unsigned int* textureTable = NULL;
+static size_t textureTableSize = 0;
+
+static size_t numTexturesLoaded = 0;
+
+static void textureCanonicalPath(const char* path, char* dest)
+{
+    if (realpath(path, dest) == NULL)
+    {
+        snprintf(dest, PATH_MAX, "%s", path);
+    }
+}
+
+static void textureTableInsert(unsigned int entryIndex)
+{
+    size_t mask = textureTableSize - 1;
+    size_t slot = textureEntries[entryIndex].hash & mask;
+    while (textureTable[slot] != 0)
+    {
+        slot = (slot + 1) & mask;
+    }
+    textureTable[slot] = entryIndex + 1;
+}
+
+static void textureTableGrow()
+{
+    free(textureTable);
+    textureTableSize = textureTableSize ? textureTableSize * 2 : 64;
+    textureTable = heapCalloc(textureTableSize, sizeof(unsigned int));
+    for (size_t i = 0; i < numTextureEntries; i++)
+    {
+        textureTableInsert(i);
+    }
+}
+
+static TextureEntry* textureGetEntry(TextureHandle handle)
+{
+    if (handle == 0 || handle > numTextureEntries)
+    {
+        return NULL;
+    }
+    return &textureEntries[handle - 1];
+}
+
+// Texture streaming
+//
+// With TEXTURE_STREAMING on, a texture starts out with only the levels no
+// bigger than TEXTURE_STREAMING_MIN_SIZE uploaded. Its mip chain stays
+// mapped from the texture cache, and models report how much detail each
+// texture needs on screen (see model_requestTextureLevels()). Once a frame
+// textureStreamUpdate() uploads finer levels where they're needed most and
+// takes the finest levels away from textures nobody is looking at closely,
+// keeping the streamed levels within TEXTURE_STREAMING_BUDGET.
+//
+// Only GL_TEXTURE_BASE_LEVEL moves, so the texture ID never changes and
+// nothing that refers to it has to know.
+
+static unsigned int streamFrame = 0;
+static size_t streamResidentSize = 0;
+
+static size_t textureLevelsSize(const TexCacheImage* image, int firstLevel)
+{
+    size_t size = 0;
+    for (size_t i = firstLevel; i < image->numLevels; i++)
+    {
+        size += image->levels[i].size;
+    }
+    return size;
+}
+
+// The finest level that's always resident
+static int textureStreamBaseLevel(const TexCacheImage* image)
+{
+    for (size_t i = 0; i < image->numLevels; i++)
+    {
+        const TexCacheLevel* level = &image->levels[i];
+        if (level->width <= TEXTURE_STREAMING_MIN_SIZE && level->height <= TEXTURE_STREAMING_MIN_SIZE)
+        {
+            return i;
+        }
+    }
+    return image->numLevels - 1;
+}
+
+// Uploads the coarse end of the chain and frees anything finer that a
+// previous image left behind
+static bool textureStreamStart(TextureEntry* entry)
+{
+    const TexCacheImage* image = &entry->image;
+    GLenum internalFormat;
+    if (!textureImageInternalFormat(image, &internalFormat))
+    {
+        return false;
+    }
+
+    int base = textureStreamBaseLevel(image);
+
+    // Streamed textures stay mutable, levels come and go
+    glBindTexture(GL_TEXTURE_2D, entry->id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image->numLevels - 1);
+    textureSetSwizzle(GL_TEXTURE_2D, image);
+    for (int i = image->numLevels - 1; i >= base; i--)
+    {
+        textureUploadLevel(image, internalFormat, i);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, base);
+    for (int i = 0; i < base; i++)
+    {
+        glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    }
+
+    entry->baseLevel = base;
+    entry->residentLevel = base;
+    entry->requestedLevel = INT_MAX;
+    entry->wantedLevel = base;
+    entry->lastRequestFrame = streamFrame;
+    streamResidentSize += textureLevelsSize(image, base);
+    return true;
+}
+
+// Loads the image itself unless it's given one
+static bool textureStreamLoad(TextureEntry* entry, const TexCacheImage* image)
+{
+    if (image)
+    {
+        entry->image = *image;
+    }
+    else if (!textureLoadImage(entry->path, &entry->image))
+    {
+        printf("Failed to load texture\n");
+        return false;
+    }
+
+    glGenTextures(1, &entry->id);
+    if (!textureStreamStart(entry))
+    {
+        glDeleteTextures(1, &entry->id);
+        texcacheClose(&entry->image);
+        entry->id = 0;
+        return false;
+    }
+
+    entry->streamed = true;
+    return true;
+}
+
+// Uploads the next finer level
+static void textureStreamIn(TextureEntry* entry)
+{
+    GLenum internalFormat;
+    textureImageInternalFormat(&entry->image, &internalFormat);
+
+    int level = entry->residentLevel - 1;
+    glBindTexture(GL_TEXTURE_2D, entry->id);
+    textureUploadLevel(&entry->image, internalFormat, level);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+
+    entry->residentLevel = level;
+    streamResidentSize += entry->image.levels[level].size;
+}
+
+// Frees the finest resident level. A zero sized image is how GL is told a
+// level's storage isn't needed anymore.
+static void textureStreamOut(TextureEntry* entry)
+{
+    int level = entry->residentLevel;
+    glBindTexture(GL_TEXTURE_2D, entry->id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level + 1);
+    glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+    entry->residentLevel = level + 1;
+    streamResidentSize -= entry->image.levels[level].size;
+}
+
+// Uploads every level and stops streaming the texture, for uses that need
+// it to stay put, like bindless handles
+static void textureStreamFinish(TextureEntry* entry)
+{
+    while (entry->residentLevel > 0)
+    {
+        textureStreamIn(entry);
+    }
+    streamResidentSize -= textureLevelsSize(&entry->image, 0);
+    texcacheClose(&entry->image);
+    entry->streamed = false;
+}
+
+// The texture holding the most detail it doesn't need, preferring ones that
+// haven't been drawn lately. NULL if every texture needs all it has.
+static TextureEntry* textureStreamVictim(const TextureEntry* except)
+{
+    TextureEntry* victim = NULL;
+    for (size_t i = 0; i < numTextureEntries; i++)
+    {
+        TextureEntry* entry = &textureEntries[i];
+        if (!entry->streamed || entry == except || entry->residentLevel >= entry->wantedLevel)
+        {
+            continue;
+        }
+
+        if (victim == NULL
+            || entry->lastRequestFrame < victim->lastRequestFrame
+            || (entry->lastRequestFrame == victim->lastRequestFrame
+                && entry->wantedLevel - entry->residentLevel > victim->wantedLevel - victim->residentLevel))
+        {
+            victim = entry;
+        }
+    }
+    return victim;
+}
+
+static int textureStreamCompareDeficit(const void* a, const void* b)
+{
+    const TextureEntry* ea = *(TextureEntry* const*)a;
+    const TextureEntry* eb = *(TextureEntry* const*)b;
+    return (eb->residentLevel - eb->wantedLevel) - (ea->residentLevel - ea->wantedLevel);
+}
+
+void textureRequestUVDensity(TextureHandle handle, float uvPerPixel)
+{
+    TextureEntry* entry = textureGetEntry(handle);
+    if (entry == NULL || !entry->streamed || uvPerPixel <= 0.0f)
+    {
+        return;
+    }
+
+    const TexCacheImage* image = &entry->image;
+    float texelsPerPixel = uvPerPixel * (image->width > image->height ? image->width : image->height);
+    int level = texelsPerPixel > 1.0f ? (int)log2f(texelsPerPixel) : 0;
+    level = level < entry->baseLevel ? level : entry->baseLevel;
+
+    if (level < entry->requestedLevel)
+    {
+        entry->requestedLevel = level;
+    }
+    entry->lastRequestFrame = streamFrame;
+}
+
+// Call once per frame, after drawing has made its requests
+void textureStreamUpdate()
+{
+    Arena* scratch = arenaScratch();
+    ArenaMark mark = arenaMark(scratch);
+    TextureEntry** needy = arenaAlloc(scratch, sizeof(TextureEntry*) * (numTextureEntries + 1), _Alignof(TextureEntry*));
+    size_t numNeedy = 0;
+
+    for (size_t i = 0; i < numTextureEntries; i++)
+    {
+        TextureEntry* entry = &textureEntries[i];
+        if (!entry->streamed)
+        {
+            continue;
+        }
+
+        // Textures that weren't drawn this frame only keep what they have
+        // until something else needs the room
+        if (entry->lastRequestFrame == streamFrame && entry->requestedLevel != INT_MAX)
+        {
+            entry->wantedLevel = entry->requestedLevel;
+        }
+        else
+        {
+            entry->wantedLevel = entry->baseLevel;
+        }
+        entry->requestedLevel = INT_MAX;
+
+        if (entry->residentLevel > entry->wantedLevel)
+        {
+            needy[numNeedy++] = entry;
+        }
+    }
+
+    // Make room if the budget went down
+    while (streamResidentSize > TEXTURE_STREAMING_BUDGET)
+    {
+        TextureEntry* victim = textureStreamVictim(NULL);
+        if (victim == NULL)
+        {
+            break;
+        }
+        textureStreamOut(victim);
+    }
+
+    // Blurriest first, one level per pass so the budget is shared fairly
+    qsort(needy, numNeedy, sizeof(TextureEntry*), textureStreamCompareDeficit);
+
+    size_t uploaded = 0;
+    bool progress = true;
+    while (progress && uploaded < TEXTURE_STREAMING_UPLOAD_LIMIT)
+    {
+        progress = false;
+        for (size_t i = 0; i < numNeedy && uploaded < TEXTURE_STREAMING_UPLOAD_LIMIT; i++)
+        {
+            TextureEntry* entry = needy[i];
+            if (entry->residentLevel <= entry->wantedLevel)
+            {
+                continue;
+            }
+
+            size_t size = entry->image.levels[entry->residentLevel - 1].size;
+            while (streamResidentSize + size > TEXTURE_STREAMING_BUDGET)
+            {
+                TextureEntry* victim = textureStreamVictim(entry);
+                if (victim == NULL)
+                {
+                    break;
+                }
+                textureStreamOut(victim);
+            }
+            if (streamResidentSize + size > TEXTURE_STREAMING_BUDGET)
+            {
+                continue;
+            }
+
+            textureStreamIn(entry);
+            uploaded += size;
+            progress = true;
+        }
+    }
+
+    arenaRewind(scratch, mark);
+    streamFrame++;
+}
+
+size_t textureStreamResidentSize()
+{
+    return streamResidentSize;
+}
+
+TextureHandle textureFind(const char* path)
+{
+    if (textureTableSize == 0)
+    {
+        return 0;
+    }
+
+    char canonical[PATH_MAX];
+    textureCanonicalPath(path, canonical);
+    uint64_t hash = texcacheHash(canonical, strlen(canonical), 0);
+
+    size_t mask = textureTableSize - 1;
+    for (size_t slot = hash & mask; textureTable[slot] != 0; slot = (slot + 1) & mask)
+    {
+        TextureEntry* entry = &textureEntries[textureTable[slot] - 1];
+        if (entry->hash == hash && strcmp(entry->path, canonical) == 0)
+        {
+            return textureTable[slot];
+        }
+    }
+    return 0;
+}
+
+static TextureHandle textureAcquireFrom(const char* path, TexCacheImage* image)
+{
+    TextureHandle handle = textureFind(path);
+    if (handle == 0)
+    {
+        if ((numTextureEntries + 1) * 2 > textureTableSize)
+        {
+            textureTableGrow();
+        }
+
+        char canonical[PATH_MAX];
+        textureCanonicalPath(path, canonical);
+
+        textureEntries = heapRealloc(textureEntries, sizeof(TextureEntry) * (numTextureEntries + 1));
+        TextureEntry* entry = &textureEntries[numTextureEntries];
+        entry->path = strdup(canonical);
+        entry->hash = texcacheHash(canonical, strlen(canonical), 0);
+        entry->id = 0;
+        entry->refCount = 0;
+        entry->bindlessHandle = 0;
+        entry->streamed = false;
+        textureTableInsert(numTextureEntries);
+
+        handle = ++numTextureEntries;
+    }
+
+    TextureEntry* entry = textureGetEntry(handle);
+    if (entry->refCount == 0)
+    {
+        if (TEXTURE_STREAMING)
+        {
+            // A streamed texture keeps its image mapped
+            if (!textureStreamLoad(entry, image))
+            {
+                return 0;
+            }
+        }
+        else if (image)
+        {
+            glGenTextures(1, &entry->id);
+            bool uploaded = textureUpload(&entry->id, image);
+            texcacheClose(image);
+            if (!uploaded)
+            {
+                glDeleteTextures(1, &entry->id);
+                entry->id = 0;
+                return 0;
+            }
+        }
+        else
+        {
+            int id = loadTexture(entry->path);
+            if (id < 0)
+            {
+                return 0;
+            }
+            entry->id = id;
+        }
+        numTexturesLoaded++;
+    }
+    else if (image)
+    {
+        texcacheClose(image);
+    }
+
+    entry->refCount++;
+    return handle;
+}
+
+// Returns a reference to the texture at path, loading it if nothing else
+// holds one. Returns 0 if it can't be loaded.
+TextureHandle textureAcquire(const char* path)
+{
+    return textureAcquireFrom(path, NULL);
+}
+
+// textureAcquire() with the image already loaded by textureLoadImage(),
+// which doesn't need the GL thread. The texture takes the image either way,
+// closing it if the file was already loaded.
+TextureHandle textureAcquireImage(const char* path, TexCacheImage* image)
+{
+    return textureAcquireFrom(path, image);
+}
+
+void textureRetain(TextureHandle handle)
+{
+    TextureEntry* entry = textureGetEntry(handle);
+    if (entry != NULL && entry->refCount > 0)
+    {
+        entry->refCount++;
+    }
+}
+
+// Drops a reference, deleting the GL texture once nothing uses it
+void textureRelease(TextureHandle handle)
+{
+    TextureEntry* entry = textureGetEntry(handle);
+    if (entry == NULL || entry->refCount == 0)
+    {
+        return;
+    }
+
+    if (--entry->refCount == 0)
+    {
+        if (entry->bindlessHandle != 0)
+        {
+            glMakeTextureHandleNonResidentARB(entry->bindlessHandle);
+            entry->bindlessHandle = 0;
+        }
+        if (entry->streamed)
+        {
+            streamResidentSize -= textureLevelsSize(&entry->image, entry->residentLevel);
+            texcacheClose(&entry->image);
+            entry->streamed = false;
+        }
+        glDeleteTextures(1, &entry->id);
+        entry->id = 0;
+        numTexturesLoaded--;
+    }
+}
+
+// Reloads the texture from disk in place. Streamed textures drop back to
+// their coarse levels and stream the rest in again from the new image.
+bool textureReload(TextureHandle handle)
+{
+    TextureEntry* entry = textureGetEntry(handle);
+    if (entry == NULL || entry->id == 0)
+    {
+        return false;
+    }
+
+    if (!entry->streamed)
+    {
+        return textureLoadInto(&entry->id, entry->path);
+    }
+
+    TexCacheImage image;
+    if (!textureLoadImage(entry->path, &image))
+    {
+        printf("Failed to load texture\n");
+        return false;
+    }
+
+    streamResidentSize -= textureLevelsSize(&entry->image, entry->residentLevel);
+    texcacheClose(&entry->image);
+    entry->image = image;
+    return textureStreamStart(entry);
+}
+
+unsigned int textureGetID(TextureHandle handle)
+{
+    TextureEntry* entry = textureGetEntry(handle);
+    return entry ? entry->id : 0;
+}
+
+const char* textureGetPath(TextureHandle handle)
+{
+    TextureEntry* entry = textureGetEntry(handle);
+    return entry ? entry->path : NULL;
+}
+
+// Gets the GL_ARB_bindless_texture handle for the texture, making it resident
+// the first time. Once that happens GL won't let the texture's storage or
+// sampling state change, so it can't be hot reloaded anymore. Returns 0 if
+// bindless textures aren't supported or the texture isn't loaded.
+uint64_t textureGetBindlessHandle(TextureHandle handle)
+{
+    TextureEntry* entry = textureGetEntry(handle);
+    if (entry == NULL || entry->id == 0 || !glExtensions.bindlessTexture)
+    {
+        return 0;
+    }
+
+    if (entry->bindlessHandle == 0)
+    {
+        if (entry->streamed)
+        {
+            textureStreamFinish(entry);
+        }
+        entry->bindlessHandle = glGetTextureSamplerHandleARB(entry->id, textureGetSampler(TEXTURE_SAMPLER_DEFAULT));
+        if (entry->bindlessHandle != 0)
+        {
+            glMakeTextureHandleResidentARB(entry->bindlessHandle);
+        }
+    }
+    return entry->bindlessHandle;
+}
+
+bool textureIsResident(TextureHandle handle)
+{
+    TextureEntry* entry = textureGetEntry(handle);
+    return entry != NULL && entry->bindlessHandle != 0;
+}
+
+size_t textureNumLoaded()
+{
+    return numTexturesLoaded;
+}
@@ -0,0 +1,262 @@
+#include "transform.h"
+#include <stdbool.h>
+#include <string.h>
+#include "cglm/cglm.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define TRANSFORM_HAVE_AVX2
+// Compiled for AVX2 no matter what the rest of the build targets, and only
+// called after checking the CPU can run it
+#define TRANSFORM_AVX2 __attribute__((target("avx2,fma")))
+#endif
+
+// Objects per AVX2 batch
+#define TRANSFORM_LANES 8
+
+static unsigned int transformIndex(const unsigned int* indices, size_t i)
+{
+    return indices ? indices[i] : i;
+}
+
+static void transformCompose(const float* p, const float* q, const float* s, mat4 dest)
+{
+    // Same as glm_quat_mat4(), with the scale folded into the columns
+    float norm = q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3];
+    float k = norm > 0.0f ? 2.0f / norm : 0.0f;
+    float xx = k * q[0] * q[0], yy = k * q[1] * q[1], zz = k * q[2] * q[2];
+    float xy = k * q[0] * q[1], xz = k * q[0] * q[2], yz = k * q[1] * q[2];
+    float wx = k * q[3] * q[0], wy = k * q[3] * q[1], wz = k * q[3] * q[2];
+
+    dest[0][0] = (1.0f - yy - zz) * s[0];
+    dest[0][1] = (xy + wz) * s[0];
+    dest[0][2] = (xz - wy) * s[0];
+    dest[0][3] = 0.0f;
+
+    dest[1][0] = (xy - wz) * s[1];
+    dest[1][1] = (1.0f - xx - zz) * s[1];
+    dest[1][2] = (yz + wx) * s[1];
+    dest[1][3] = 0.0f;
+
+    dest[2][0] = (xz + wy) * s[2];
+    dest[2][1] = (yz - wx) * s[2];
+    dest[2][2] = (1.0f - xx - yy) * s[2];
+    dest[2][3] = 0.0f;
+
+    dest[3][0] = p[0];
+    dest[3][1] = p[1];
+    dest[3][2] = p[2];
+    dest[3][3] = 1.0f;
+}
+
+#ifdef TRANSFORM_HAVE_AVX2
+
+static bool transformUseAVX2()
+{
+    static int supported = -1;
+    if (supported < 0)
+    {
+        __builtin_cpu_init();
+        supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    }
+    return supported;
+}
+
+// Transposes 8 rows of 8 floats, in place
+TRANSFORM_AVX2 static inline void transformTranspose8(__m256* r)
+{
+    __m256 t0 = _mm256_unpacklo_ps(r[0], r[1]);
+    __m256 t1 = _mm256_unpackhi_ps(r[0], r[1]);
+    __m256 t2 = _mm256_unpacklo_ps(r[2], r[3]);
+    __m256 t3 = _mm256_unpackhi_ps(r[2], r[3]);
+    __m256 t4 = _mm256_unpacklo_ps(r[4], r[5]);
+    __m256 t5 = _mm256_unpackhi_ps(r[4], r[5]);
+    __m256 t6 = _mm256_unpacklo_ps(r[6], r[7]);
+    __m256 t7 = _mm256_unpackhi_ps(r[6], r[7]);
+
+    __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+
+    r[0] = _mm256_permute2f128_ps(s0, s4, 0x20);
+    r[1] = _mm256_permute2f128_ps(s1, s5, 0x20);
+    r[2] = _mm256_permute2f128_ps(s2, s6, 0x20);
+    r[3] = _mm256_permute2f128_ps(s3, s7, 0x20);
+    r[4] = _mm256_permute2f128_ps(s0, s4, 0x31);
+    r[5] = _mm256_permute2f128_ps(s1, s5, 0x31);
+    r[6] = _mm256_permute2f128_ps(s2, s6, 0x31);
+    r[7] = _mm256_permute2f128_ps(s3, s7, 0x31);
+}
+
+// Writes 8 matrices where m[e] holds element e (column * 4 + row) of each,
+// clobbering m
+TRANSFORM_AVX2 static inline void transformStore8(float* const* matrices, __m256* m)
+{
+    transformTranspose8(m);
+    transformTranspose8(m + 8);
+    for (int j = 0; j < 8; j++)
+    {
+        _mm256_storeu_ps(matrices[j], m[j]);
+        _mm256_storeu_ps(matrices[j] + 8, m[j + 8]);
+    }
+}
+
+TRANSFORM_AVX2 static void transformComposeAVX2(const vec3* positions, const versor* rotations, const vec3* scales,
+    const unsigned int* indices, size_t count, mat4* dest)
+{
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 two = _mm256_set1_ps(2.0f);
+    const __m256 zero = _mm256_setzero_ps();
+
+    for (size_t i = 0; i + TRANSFORM_LANES <= count; i += TRANSFORM_LANES)
+    {
+        __m256i index = indices
+            ? _mm256_loadu_si256((const __m256i*)&indices[i])
+            : _mm256_add_epi32(_mm256_set1_epi32(i), lanes);
+        __m256i index3 = _mm256_add_epi32(index, _mm256_add_epi32(index, index));
+        __m256i index4 = _mm256_slli_epi32(index, 2);
+
+        const float* p = (const float*)positions;
+        const float* q = (const float*)rotations;
+        const float* s = (const float*)scales;
+        __m256 px = _mm256_i32gather_ps(p, index3, 4);
+        __m256 py = _mm256_i32gather_ps(p + 1, index3, 4);
+        __m256 pz = _mm256_i32gather_ps(p + 2, index3, 4);
+        __m256 qx = _mm256_i32gather_ps(q, index4, 4);
+        __m256 qy = _mm256_i32gather_ps(q + 1, index4, 4);
+        __m256 qz = _mm256_i32gather_ps(q + 2, index4, 4);
+        __m256 qw = _mm256_i32gather_ps(q + 3, index4, 4);
+        __m256 sx = _mm256_i32gather_ps(s, index3, 4);
+        __m256 sy = _mm256_i32gather_ps(s + 1, index3, 4);
+        __m256 sz = _mm256_i32gather_ps(s + 2, index3, 4);
+
+        __m256 norm = _mm256_fmadd_ps(qx, qx, _mm256_fmadd_ps(qy, qy, _mm256_fmadd_ps(qz, qz, _mm256_mul_ps(qw, qw))));
+        __m256 k = _mm256_and_ps(_mm256_div_ps(two, norm), _mm256_cmp_ps(norm, zero, _CMP_GT_OQ));
+        __m256 kx = _mm256_mul_ps(k, qx), ky = _mm256_mul_ps(k, qy), kz = _mm256_mul_ps(k, qz);
+        __m256 xx = _mm256_mul_ps(kx, qx), yy = _mm256_mul_ps(ky, qy), zz = _mm256_mul_ps(kz, qz);
+        __m256 xy = _mm256_mul_ps(kx, qy), xz = _mm256_mul_ps(kx, qz), yz = _mm256_mul_ps(ky, qz);
+        __m256 wx = _mm256_mul_ps(kx, qw), wy = _mm256_mul_ps(ky, qw), wz = _mm256_mul_ps(kz, qw);
+
+        __m256 m[16];
+        m[0] = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(yy, zz)), sx);
+        m[1] = _mm256_mul_ps(_mm256_add_ps(xy, wz), sx);
+        m[2] = _mm256_mul_ps(_mm256_sub_ps(xz, wy), sx);
+        m[3] = zero;
+        m[4] = _mm256_mul_ps(_mm256_sub_ps(xy, wz), sy);
+        m[5] = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, zz)), sy);
+        m[6] = _mm256_mul_ps(_mm256_add_ps(yz, wx), sy);
+        m[7] = zero;
+        m[8] = _mm256_mul_ps(_mm256_add_ps(xz, wy), sz);
+        m[9] = _mm256_mul_ps(_mm256_sub_ps(yz, wx), sz);
+        m[10] = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, yy)), sz);
+        m[11] = zero;
+        m[12] = px;
+        m[13] = py;
+        m[14] = pz;
+        m[15] = one;
+
+        float* out[8];
+        for (int j = 0; j < 8; j++)
+        {
+            out[j] = (float*)dest[transformIndex(indices, i + j)];
+        }
+        transformStore8(out, m);
+    }
+}
+
+// One product at a time, two columns of it per instruction. The inputs are
+// whole matrices already, so transposing eight of them into lanes and back
+// costs more than multiplying them that way saves.
+TRANSFORM_AVX2 static void transformMultiplyAVX2(const mat4* parentMatrices, const int* parents, const mat4* locals,
+    const unsigned int* indices, size_t count, mat4* dest)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        unsigned int index = transformIndex(indices, i);
+        int parent = parents[index];
+        const float* b = (const float*)locals[index];
+        float* out = (float*)dest[index];
+        if (parent < 0)
+        {
+            _mm256_storeu_ps(out, _mm256_loadu_ps(b));
+            _mm256_storeu_ps(out + 8, _mm256_loadu_ps(b + 8));
+            continue;
+        }
+
+        // Column j of the product is the parent's columns weighted by
+        // column j of the local
+        const float* a = (const float*)parentMatrices[parent];
+        __m256 a0 = _mm256_broadcast_ps((const __m128*)a);
+        __m256 a1 = _mm256_broadcast_ps((const __m128*)(a + 4));
+        __m256 a2 = _mm256_broadcast_ps((const __m128*)(a + 8));
+        __m256 a3 = _mm256_broadcast_ps((const __m128*)(a + 12));
+        __m256 b01 = _mm256_loadu_ps(b);
+        __m256 b23 = _mm256_loadu_ps(b + 8);
+
+        __m256 c01 = _mm256_mul_ps(a0, _mm256_permute_ps(b01, 0x00));
+        c01 = _mm256_fmadd_ps(a1, _mm256_permute_ps(b01, 0x55), c01);
+        c01 = _mm256_fmadd_ps(a2, _mm256_permute_ps(b01, 0xaa), c01);
+        c01 = _mm256_fmadd_ps(a3, _mm256_permute_ps(b01, 0xff), c01);
+        __m256 c23 = _mm256_mul_ps(a0, _mm256_permute_ps(b23, 0x00));
+        c23 = _mm256_fmadd_ps(a1, _mm256_permute_ps(b23, 0x55), c23);
+        c23 = _mm256_fmadd_ps(a2, _mm256_permute_ps(b23, 0xaa), c23);
+        c23 = _mm256_fmadd_ps(a3, _mm256_permute_ps(b23, 0xff), c23);
+
+        _mm256_storeu_ps(out, c01);
+        _mm256_storeu_ps(out + 8, c23);
+    }
+}
+
+#endif
+
+void transformBatchCompose(const vec3* positions, const versor* rotations, const vec3* scales,
+    const unsigned int* indices, size_t count, mat4* dest)
+{
+    size_t i = 0;
+#ifdef TRANSFORM_HAVE_AVX2
+    if (transformUseAVX2())
+    {
+        transformComposeAVX2(positions, rotations, scales, indices, count, dest);
+        i = count / TRANSFORM_LANES * TRANSFORM_LANES;
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        unsigned int index = transformIndex(indices, i);
+        transformCompose(positions[index], rotations[index], scales[index], dest[index]);
+    }
+}
+
+void transformBatchMultiply(const mat4* parentMatrices, const int* parents, const mat4* locals,
+    const unsigned int* indices, size_t count, mat4* dest)
+{
+    size_t i = 0;
+#ifdef TRANSFORM_HAVE_AVX2
+    if (transformUseAVX2())
+    {
+        transformMultiplyAVX2(parentMatrices, parents, locals, indices, count, dest);
+        i = count;
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        unsigned int index = transformIndex(indices, i);
+        int parent = parents[index];
+        if (parent < 0)
+        {
+            glm_mat4_copy((vec4*)locals[index], dest[index]);
+        }
+        else
+        {
+            glm_mat4_mul((vec4*)parentMatrices[parent], (vec4*)locals[index], dest[index]);
+        }
+    }
+}
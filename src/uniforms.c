@@ -0,0 +1,47 @@
+#include "uniforms.h"
+#include <glad/glad.h>
+#include "cglm/cglm.h"
+
+// DrawData for a draw's transforms. Pure math, so any thread can do it.
+void uniformsComputeDraw(DrawUniforms* dest, mat4 model, mat4 view)
+{
+    glm_mat4_copy(model, dest->model);
+    mat4 modelView;
+    glm_mat4_mul(view, model, modelView);
+    glm_mat4_inv(modelView, dest->normalMatrix);
+    glm_mat4_transpose(dest->normalMatrix);
+}
+
+// Copies DrawData into this frame's part of the ring and points the block
+// at it. Returns false if the ring is full, which leaves the block pointing
+// at the last draw's data, so don't draw with it.
+bool uniformsUploadDraw(RingBuffer* ring, const DrawUniforms* draw)
+{
+    size_t offset;
+    DrawUniforms* dest = ringBufferAlloc(ring, sizeof(DrawUniforms), &offset);
+    if (dest == NULL)
+    {
+        return false;
+    }
+
+    *dest = *draw;
+    ringBufferBindRange(ring, GL_UNIFORM_BUFFER, UNIFORM_BINDING_DRAW, offset, sizeof(DrawUniforms));
+    return true;
+}
+
+// Writes a draw's transforms into this frame's part of the ring and points
+// the DrawData block at them. Returns false if the ring is full, same as
+// uniformsUploadDraw().
+bool uniformsBindDraw(RingBuffer* ring, mat4 model, mat4 view)
+{
+    size_t offset;
+    DrawUniforms* draw = ringBufferAlloc(ring, sizeof(DrawUniforms), &offset);
+    if (draw == NULL)
+    {
+        return false;
+    }
+
+    uniformsComputeDraw(draw, model, view);
+    ringBufferBindRange(ring, GL_UNIFORM_BUFFER, UNIFORM_BINDING_DRAW, offset, sizeof(DrawUniforms));
+    return true;
+}
@@ -0,0 +1,278 @@
+#include <dirent.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "arena.h"
+#include "lz4.h"
+#include "pack.h"
+#include "texcache.h"
+
+// Packs files and directories into one file the engine can mount (see
+// pack.h). Run it from where the engine runs, so the paths it stores are the
+// ones the engine asks for:
+//
+//     packer [-c] assets.pack shaders models textures
+//
+// -c compresses every file that comes out at least PACKER_MIN_SAVING
+// smaller with LZ4. Images are compressed already, so they're mostly stored.
+
+#define PACKER_MIN_SAVING 8 // As in 1/8th
+
+static char** paths = NULL;
+static size_t numPaths = 0;
+
+static void packer_addPath(const char* path)
+{
+    paths = heapRealloc(paths, sizeof(char*) * (numPaths + 1));
+    paths[numPaths++] = strdup(packNormalizePath(path));
+}
+
+static void packer_addDirectory(const char* dir)
+{
+    DIR* d = opendir(dir);
+    if (d == NULL)
+    {
+        printf("Unable to open directory %s\n", dir);
+        return;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL)
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+        {
+            continue;
+        }
+
+        char childPath[PATH_MAX];
+        snprintf(childPath, PATH_MAX, "%s/%s", dir, entry->d_name);
+
+        struct stat st;
+        if (stat(childPath, &st) != 0)
+        {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode))
+        {
+            packer_addDirectory(childPath);
+        }
+        else if (S_ISREG(st.st_mode))
+        {
+            packer_addPath(childPath);
+        }
+    }
+    closedir(d);
+}
+
+static int packer_comparePaths(const void* a, const void* b)
+{
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static uint64_t packer_align(uint64_t offset)
+{
+    return (offset + PACK_ALIGNMENT - 1) & ~(uint64_t)(PACK_ALIGNMENT - 1);
+}
+
+// Entries are written as they're read, then the table of contents goes in
+// front of them once every offset is known
+static bool packer_write(const char* outPath, bool compress)
+{
+    PackHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PACK_MAGIC, sizeof(PACK_MAGIC));
+    header.version = PACK_VERSION;
+    header.numEntries = numPaths;
+    header.tableSize = 16;
+    while (header.tableSize < numPaths * 2)
+    {
+        header.tableSize *= 2;
+    }
+
+    PackEntry* entries = heapCalloc(numPaths, sizeof(PackEntry));
+    uint32_t* table = heapAlloc(sizeof(uint32_t) * header.tableSize);
+    memset(table, 0xff, sizeof(uint32_t) * header.tableSize);
+    for (size_t i = 0; i < numPaths; i++)
+    {
+        entries[i].pathHash = packPathHash(paths[i]);
+        entries[i].pathOffset = header.pathsSize;
+        header.pathsSize += strlen(paths[i]) + 1;
+
+        uint32_t mask = header.tableSize - 1;
+        uint32_t slot = entries[i].pathHash & mask;
+        while (table[slot] != PACK_NO_ENTRY)
+        {
+            slot = (slot + 1) & mask;
+        }
+        table[slot] = i;
+    }
+
+    header.entriesOffset = sizeof(PackHeader);
+    header.tableOffset = header.entriesOffset + sizeof(PackEntry) * numPaths;
+    header.pathsOffset = header.tableOffset + sizeof(uint32_t) * header.tableSize;
+
+    size_t lenTempPath = strlen(outPath) + 32;
+    char tempPath[lenTempPath];
+    snprintf(tempPath, lenTempPath, "%s.%d.tmp", outPath, (int)getpid());
+
+    FILE* file = fopen(tempPath, "wb");
+    if (file == NULL)
+    {
+        printf("Unable to write %s\n", tempPath);
+        free(entries);
+        free(table);
+        return false;
+    }
+
+    static const unsigned char padding[PACK_ALIGNMENT] = { 0 };
+    uint64_t offset = packer_align(header.pathsOffset + header.pathsSize);
+    uint64_t totalRaw = 0;
+    bool success = fseek(file, offset, SEEK_SET) == 0;
+    for (size_t i = 0; i < numPaths && success; i++)
+    {
+        PackFile source;
+        if (!packOpenFile(paths[i], &source))
+        {
+            printf("Unable to read %s\n", paths[i]);
+            success = false;
+            break;
+        }
+
+        PackEntry* entry = &entries[i];
+        entry->contentHash = packFileHash(&source);
+        entry->offset = offset;
+        entry->rawSize = source.size;
+        entry->compression = PACK_STORED;
+        entry->size = source.size;
+
+        const unsigned char* data = source.data;
+        unsigned char* compressed = NULL;
+        if (compress && source.size > 0)
+        {
+            size_t bound = lz4CompressBound(source.size);
+            compressed = heapAlloc(bound);
+            size_t compressedSize = lz4Compress(source.data, source.size, compressed, bound);
+            if (compressedSize > 0 && compressedSize <= source.size - source.size / PACKER_MIN_SAVING)
+            {
+                entry->compression = PACK_LZ4;
+                entry->size = compressedSize;
+                data = compressed;
+            }
+        }
+
+        fwrite(data, 1, entry->size, file);
+        uint64_t next = packer_align(offset + entry->size);
+        fwrite(padding, 1, next - offset - entry->size, file);
+        offset = next;
+        totalRaw += entry->rawSize;
+
+        printf("%s %s\n", entry->compression == PACK_LZ4 ? "lz4   " : "stored", paths[i]);
+        free(compressed);
+        packCloseFile(&source);
+    }
+
+    if (success)
+    {
+        fseek(file, 0, SEEK_SET);
+        fwrite(&header, sizeof(header), 1, file);
+        fwrite(entries, sizeof(PackEntry), numPaths, file);
+        fwrite(table, sizeof(uint32_t), header.tableSize, file);
+        for (size_t i = 0; i < numPaths; i++)
+        {
+            fwrite(paths[i], 1, strlen(paths[i]) + 1, file);
+        }
+        success = ferror(file) == 0;
+    }
+
+    success = fclose(file) == 0 && success;
+    if (success)
+    {
+        success = rename(tempPath, outPath) == 0;
+    }
+    if (!success)
+    {
+        remove(tempPath);
+    }
+    else
+    {
+        printf("Packed %zu files, %llu bytes into %llu\n", numPaths,
+            (unsigned long long)totalRaw, (unsigned long long)offset);
+    }
+
+    free(entries);
+    free(table);
+    return success;
+}
+
+int main(int argc, char** argv)
+{
+    bool compress = false;
+    int first = 1;
+    if (first < argc && strcmp(argv[first], "-c") == 0)
+    {
+        compress = true;
+        first++;
+    }
+    if (argc - first < 2)
+    {
+        printf("Usage: %s [-c] output.pack file-or-directory...\n", argv[0]);
+        return 1;
+    }
+
+    const char* outPath = argv[first];
+    for (int i = first + 1; i < argc; i++)
+    {
+        struct stat st;
+        if (stat(argv[i], &st) != 0)
+        {
+            printf("Unable to find %s\n", argv[i]);
+            return 1;
+        }
+        if (S_ISDIR(st.st_mode))
+        {
+            packer_addDirectory(argv[i]);
+        }
+        else
+        {
+            packer_addPath(argv[i]);
+        }
+    }
+
+    // Sorted so the same files always make the same pack, and so the ones
+    // in a directory end up next to each other on disk
+    qsort(paths, numPaths, sizeof(char*), packer_comparePaths);
+    size_t unique = 0;
+    for (size_t i = 0; i < numPaths; i++)
+    {
+        if (unique > 0 && strcmp(paths[unique - 1], paths[i]) == 0)
+        {
+            free(paths[i]);
+            continue;
+        }
+        paths[unique++] = paths[i];
+    }
+    numPaths = unique;
+
+    if (numPaths == 0)
+    {
+        printf("Nothing to pack\n");
+        return 1;
+    }
+    if (numPaths >= PACK_NO_ENTRY / 2)
+    {
+        printf("Too many files to pack\n");
+        return 1;
+    }
+
+    bool success = packer_write(outPath, compress);
+    for (size_t i = 0; i < numPaths; i++)
+    {
+        free(paths[i]);
+    }
+    free(paths);
+    return success ? 0 : 1;
+}
@@ -0,0 +1,310 @@
+#include <dirent.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "arena.h"
+#include "lz4.h"
+#include "pack.h"
+#include "texcache.h"
+
+// Checks LZ4, and a pack made by the packer against the loose files it was
+// made from, including that packPreferLoose() sends opens back to them.
+// It's built with ASan and UBSan, so reading past a buffer fails it as well
+// as reading back the wrong bytes:
+//
+//     packer -c test.pack shaders models textures
+//     packtest test.pack shaders models textures
+//
+// `cmake --build build --target check_pack` does both.
+
+#define PACKTEST_SEED 182
+
+static int failures = 0;
+
+static void packtest_fail(const char* what, size_t size)
+{
+    printf("FAILED: %s (%zu bytes)\n", what, size);
+    failures++;
+}
+
+// Compressing into exactly the bound has to work, decompressing has to give
+// back the same bytes, and every way of getting the size wrong has to fail
+static void packtest_roundTrip(const char* what, const unsigned char* data, size_t size)
+{
+    size_t bound = lz4CompressBound(size);
+    unsigned char* compressed = heapAlloc(bound);
+    size_t compressedSize = lz4Compress(data, size, compressed, bound);
+    if (compressedSize == 0)
+    {
+        packtest_fail(what, size);
+        free(compressed);
+        return;
+    }
+
+    // Sized exactly, so ASan catches a write past the end
+    unsigned char* result = heapAlloc(size ? size : 1);
+    if (!lz4Decompress(compressed, compressedSize, result, size) || memcmp(result, data, size) != 0)
+    {
+        packtest_fail(what, size);
+    }
+    if (size > 0 && lz4Decompress(compressed, compressedSize, result, size - 1))
+    {
+        packtest_fail("decompressing into too little room", size);
+    }
+    if (compressedSize > 1 && lz4Decompress(compressed, compressedSize - 1, result, size))
+    {
+        packtest_fail("decompressing a truncated block", size);
+    }
+    if (size > 0 && lz4Compress(data, size, compressed, compressedSize - 1) != 0)
+    {
+        packtest_fail("compressing into too little room", size);
+    }
+
+    // Corrupt blocks only have to fail or come out the right size, without
+    // touching anything outside either buffer
+    for (int i = 0; i < 64 && compressedSize > 0; i++)
+    {
+        unsigned char* corrupt = heapAlloc(compressedSize);
+        memcpy(corrupt, compressed, compressedSize);
+        corrupt[rand() % compressedSize] ^= 1 << (rand() % 8);
+        lz4Decompress(corrupt, compressedSize, result, size);
+        free(corrupt);
+    }
+
+    free(compressed);
+    free(result);
+}
+
+static void packtest_lz4()
+{
+    static const size_t sizes[] = { 0, 1, 4, 5, 12, 13, 17, 255, 270, 4096, 65535, 65536, 65540, 300000 };
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        size_t size = sizes[s];
+        unsigned char* data = heapAlloc(size ? size : 1);
+
+        for (size_t i = 0; i < size; i++)
+        {
+            data[i] = rand();
+        }
+        packtest_roundTrip("random bytes", data, size);
+
+        memset(data, 'a', size);
+        packtest_roundTrip("one repeated byte", data, size);
+
+        // Short repeats, and long literal runs between matches
+        for (size_t i = 0; i < size; i++)
+        {
+            data[i] = (i / 300) % 2 ? rand() : "vertex normal "[i % 14];
+        }
+        packtest_roundTrip("text and noise", data, size);
+
+        // A repeat further back than a match can reach
+        for (size_t i = 0; i < size; i++)
+        {
+            data[i] = i < 70000 ? rand() : data[i - 70000];
+        }
+        packtest_roundTrip("far repeat", data, size);
+
+        free(data);
+    }
+}
+
+typedef struct {
+    char* path;
+    unsigned char* data;
+    size_t size;
+    uint64_t hash;
+} PackTestFile;
+
+static PackTestFile* files = NULL;
+static size_t numFiles = 0;
+
+static void packtest_addPath(const char* path)
+{
+    files = heapRealloc(files, sizeof(PackTestFile) * (numFiles + 1));
+    memset(&files[numFiles], 0, sizeof(PackTestFile));
+    files[numFiles++].path = strdup(packNormalizePath(path));
+}
+
+static void packtest_addDirectory(const char* dir)
+{
+    DIR* d = opendir(dir);
+    if (d == NULL)
+    {
+        printf("Unable to open directory %s\n", dir);
+        failures++;
+        return;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL)
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+        {
+            continue;
+        }
+
+        char childPath[PATH_MAX];
+        snprintf(childPath, PATH_MAX, "%s/%s", dir, entry->d_name);
+
+        struct stat st;
+        if (stat(childPath, &st) != 0)
+        {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode))
+        {
+            packtest_addDirectory(childPath);
+        }
+        else if (S_ISREG(st.st_mode))
+        {
+            packtest_addPath(childPath);
+        }
+    }
+    closedir(d);
+}
+
+// A copy of the start of the pack, which has to be turned away at mount
+static void packtest_mountTruncated(const char* packPath, size_t size)
+{
+    PackFile pack;
+    if (!packOpenFile(packPath, &pack))
+    {
+        packtest_fail("reading the pack", 0);
+        return;
+    }
+
+    size_t lenTempPath = strlen(packPath) + 32;
+    char tempPath[lenTempPath];
+    snprintf(tempPath, lenTempPath, "%s.%d.tmp", packPath, (int)getpid());
+    FILE* file = fopen(tempPath, "wb");
+    if (file == NULL)
+    {
+        printf("Unable to write %s\n", tempPath);
+        failures++;
+        packCloseFile(&pack);
+        return;
+    }
+    fwrite(pack.data, 1, size < pack.size ? size : pack.size, file);
+    fclose(file);
+    packCloseFile(&pack);
+
+    if (packMount(tempPath))
+    {
+        packtest_fail("mounting a truncated pack", size);
+        packUnmount();
+    }
+    remove(tempPath);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        printf("Usage: %s test.pack file-or-directory...\n", argv[0]);
+        return 1;
+    }
+    const char* packPath = argv[1];
+    srand(PACKTEST_SEED);
+
+    packtest_lz4();
+    printf("LZ4 round trips done, %d failures\n", failures);
+
+    for (int i = 2; i < argc; i++)
+    {
+        struct stat st;
+        if (stat(argv[i], &st) == 0 && S_ISDIR(st.st_mode))
+        {
+            packtest_addDirectory(argv[i]);
+        }
+        else
+        {
+            packtest_addPath(argv[i]);
+        }
+    }
+
+    // Nothing's mounted yet, so these are the loose files
+    size_t totalSize = 0;
+    for (size_t i = 0; i < numFiles; i++)
+    {
+        PackFile file;
+        if (!packOpenFile(files[i].path, &file))
+        {
+            packtest_fail(files[i].path, 0);
+            continue;
+        }
+        files[i].size = file.size;
+        files[i].data = heapAlloc(file.size ? file.size : 1);
+        memcpy(files[i].data, file.data, file.size);
+        files[i].hash = texcacheHash(file.data, file.size, 0);
+        totalSize += file.size;
+        packCloseFile(&file);
+    }
+
+    packtest_mountTruncated(packPath, sizeof(PackHeader) - 1);
+    packtest_mountTruncated(packPath, sizeof(PackHeader) + sizeof(PackEntry));
+
+    if (!packMount(packPath))
+    {
+        printf("Unable to mount %s\n", packPath);
+        return 1;
+    }
+
+    for (size_t i = 0; i < numFiles; i++)
+    {
+        PackFile file;
+        if (!packOpenFile(files[i].path, &file))
+        {
+            packtest_fail(files[i].path, files[i].size);
+            continue;
+        }
+
+        // Loose files come with a mapping of their own, ones from the pack don't
+        if (file.mapping != NULL)
+        {
+            printf("%s isn't in the pack\n", files[i].path);
+            failures++;
+        }
+        else if (file.size != files[i].size || memcmp(file.data, files[i].data, file.size) != 0
+            || packFileHash(&file) != files[i].hash)
+        {
+            packtest_fail(files[i].path, files[i].size);
+        }
+        packCloseFile(&file);
+    }
+
+    // Once hot reload says a file changed, it has to come from the disk
+    for (size_t i = 0; i < numFiles; i++)
+    {
+        PackFile file;
+        if (files[i].size == 0)
+        {
+            continue;
+        }
+        packPreferLoose(files[i].path);
+        if (!packOpenFile(files[i].path, &file) || file.mapping == NULL)
+        {
+            packtest_fail("opening a file loose once it's preferred", files[i].size);
+        }
+        packCloseFile(&file);
+        break;
+    }
+    packUnmount();
+
+    printf("Read back %zu files, %zu bytes\n", numFiles, totalSize);
+
+    for (size_t i = 0; i < numFiles; i++)
+    {
+        free(files[i].path);
+        free(files[i].data);
+    }
+    free(files);
+
+    printf("%s, %d failures\n", failures ? "FAILED" : "Passed", failures);
+    return failures ? 1 : 0;
+}